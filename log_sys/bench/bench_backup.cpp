@@ -0,0 +1,53 @@
+#include "../src/Manager.hpp"
+#include "../src/backup/ServerBackup.hpp"
+#include "bench_common.hpp"
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <cstdlib>
+// Round trip of start_log_backup() against a TCP_Server on localhost: from the call until the server
+// handed the message to its callback. The message goes through the spool and the sender thread.
+// Prints one JSON object per line, usage: bench_backup [messages] [port]
+asynlog::Util::JsonData* conf_data = asynlog::Util::JsonData::GetJsonData();
+ThreadPool *tp = new ThreadPool(1);
+
+static std::mutex mtx;
+static std::condition_variable cond;
+static size_t received = 0;
+
+int main(int argc, char *argv[]) {
+    size_t messages = argc > 1 ? strtoull(argv[1], nullptr, 10) : 2000;
+    uint16_t port = argc > 2 ? atoi(argv[2]) : 18080;
+    conf_data->backup_addr = "127.0.0.1";
+    conf_data->backup_port = port;
+    conf_data->backup_spool_dir = "./logfile/bench_backup_spool";
+    TCP_Server server(port, [](const std::string &) {}, [](const std::string &, const std::string &) {
+        std::lock_guard<std::mutex> lock(mtx);
+        received++;
+        cond.notify_all();
+    });
+    server.init_service();
+    std::thread([&server]() { server.start_service(); }).detach();
+
+    for (size_t size : {64, 512}) {
+        std::string msg(size, 'x');
+        std::vector<int64_t> samples;
+        int64_t start = bench::NowNs();
+        for (size_t i = 0; i < messages; i++) {
+            int64_t before = bench::NowNs();
+            start_log_backup(msg);
+            std::unique_lock<std::mutex> lock(mtx);
+            if (!cond.wait_for(lock, std::chrono::seconds(1), [&]() { return received > i; })) {
+                bench::Json("backup_round_trip").Str("error", "no reply").Print();
+                return 1;
+            }
+            samples.push_back(bench::NowNs() - before);
+        }
+        double seconds = (bench::NowNs() - start) / 1e9;
+        bench::Json("backup_round_trip").Num("messages", messages).Num("message_bytes", size)
+            .Num("seconds", seconds).Num("msgs_per_sec", messages / seconds).Lat(bench::Percentiles::Of(samples)).Print();
+        std::lock_guard<std::mutex> lock(mtx);
+        received = 0;
+    }
+    return 0;
+}
@@ -0,0 +1,36 @@
+#include "../src/AsynBuffer.hpp"
+#include "bench_common.hpp"
+#include <cstdlib>
+// Buffer::Push() cost while the buffer grows from a small initial size, against a buffer that is large enough
+// from the start. Growth triples below `threshold` and adds `linear_growth` above it.
+// Prints one JSON object per line, usage: bench_buffer [total_bytes]
+asynlog::Util::JsonData* conf_data = asynlog::Util::JsonData::GetJsonData();
+
+static void Run(const char *api, size_t initial, size_t total, size_t record) {
+    std::string data(record, 'x');
+    asynlog::Buffer buf(initial);
+    std::vector<int64_t> samples;
+    samples.reserve(total / record);
+    size_t growths = 0;
+    int64_t start = bench::NowNs();
+    for (size_t pushed = 0; pushed + record <= total; pushed += record) {
+        size_t capacity = buf.ReadableSize() + buf.WriteableSize();
+        int64_t before = bench::NowNs();
+        buf.Push(data.data(), data.size());
+        samples.push_back(bench::NowNs() - before);
+        growths += buf.ReadableSize() + buf.WriteableSize() != capacity;
+    }
+    double seconds = (bench::NowNs() - start) / 1e9;
+    bench::Json("buffer_push").Str("api", api).Num("initial_bytes", initial).Num("record_bytes", record)
+        .Num("total_bytes", buf.ReadableSize()).Num("growths", growths).Num("seconds", seconds)
+        .Num("mb_per_sec", buf.ReadableSize() / seconds / 1e6).Lat(bench::Percentiles::Of(samples)).Print();
+}
+
+int main(int argc, char *argv[]) {
+    size_t total = argc > 1 ? strtoull(argv[1], nullptr, 10) : 256 * 1024 * 1024;
+    for (size_t record : {64, 256, 4096}) {
+        Run("grow", 4096, total, record);
+        Run("presized", total + record, total, record);
+    }
+    return 0;
+}
@@ -0,0 +1,104 @@
+/**
+ * @file bench_common.hpp
+ * @brief Helpers shared by the benchmarks: clocks, percentiles and JSON line output.
+ * @author bhhxx
+ * @date 2025-06-10
+*/
+#pragma once
+#include <chrono> // for steady_clock
+#include <vector> // for vector
+#include <string> // for string
+#include <algorithm> // for sort
+#include <cstdio> // for printf
+#include <unistd.h> // for dup, dup2
+#include <fcntl.h> // for open
+
+namespace bench
+{
+/**
+ * @brief Get the steady clock time in nanoseconds
+*/
+inline int64_t NowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief Latency percentiles of a set of samples
+*/
+struct Percentiles {
+    int64_t p50 = 0, p99 = 0, p999 = 0, max = 0; // nanoseconds
+
+    /**
+     * @brief Compute the percentiles, sorts the samples
+     * @param samples latencies in nanoseconds
+    */
+    static Percentiles Of(std::vector<int64_t> &samples) {
+        Percentiles p;
+        if (samples.empty()) return p;
+        std::sort(samples.begin(), samples.end());
+        auto at = [&](double q) { return samples[static_cast<size_t>(q * (samples.size() - 1))]; };
+        p.p50 = at(0.50);
+        p.p99 = at(0.99);
+        p.p999 = at(0.999);
+        p.max = samples.back();
+        return p;
+    }
+};
+
+/**
+ * @brief One JSON object per line, e.g. `Json("logger_throughput").Str("type", "safe").Num("threads", 4).Print();`
+ * @note Keys and string values are printed as is, keep them free of quotes.
+*/
+class Json {
+public:
+    explicit Json(const char *bench) { line_ = std::string("{\"bench\":\"") + bench + "\""; }
+
+    Json &Str(const char *key, const std::string &value) {
+        line_ += std::string(",\"") + key + "\":\"" + value + "\"";
+        return *this;
+    }
+
+    Json &Num(const char *key, double value) {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%.*f", value == static_cast<int64_t>(value) ? 0 : 3, value);
+        line_ += std::string(",\"") + key + "\":" + buf;
+        return *this;
+    }
+
+    Json &Lat(const Percentiles &p) {
+        return Num("p50_ns", p.p50).Num("p99_ns", p.p99).Num("p999_ns", p.p999).Num("max_ns", p.max);
+    }
+
+    void Print() {
+        printf("%s}\n", line_.c_str());
+        fflush(stdout);
+    }
+
+private:
+    std::string line_;
+};
+
+/**
+ * @brief Send stdout to /dev/null while alive, so benchmarks of stdout sinks keep the results readable
+*/
+class MuteStdout {
+public:
+    MuteStdout() {
+        fflush(stdout);
+        saved_ = dup(STDOUT_FILENO);
+        int null = open("/dev/null", O_WRONLY);
+        dup2(null, STDOUT_FILENO);
+        close(null);
+    }
+
+    ~MuteStdout() {
+        fflush(stdout);
+        dup2(saved_, STDOUT_FILENO);
+        close(saved_);
+    }
+
+private:
+    int saved_;
+};
+} // namespace bench
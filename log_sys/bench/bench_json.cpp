@@ -0,0 +1,90 @@
+#include "../src/AsynLogger.hpp"
+#include "bench_common.hpp"
+#include <cstdlib>
+// Encoding one JSON log record (7 header members and 4 fields) with the JsonEncoder against jsoncpp,
+// as Util::JsonUtil::Serialize() does it and with a reused, compact writer. Then structured log calls
+// through a logger in the text and the JSON layout.
+// Prints one JSON object per line, usage: bench_json [records]
+asynlog::Util::JsonData* conf_data = asynlog::Util::JsonData::GetJsonData();
+ThreadPool *tp = new ThreadPool(1);
+
+using asynlog::kv;
+
+template <class Encode>
+static void Run(const char *api, size_t records, Encode encode) {
+    std::vector<int64_t> samples;
+    samples.reserve(records);
+    size_t bytes = 0;
+    int64_t start = bench::NowNs();
+    for (size_t i = 0; i < records; i++) {
+        int64_t before = bench::NowNs();
+        bytes += encode(i);
+        samples.push_back(bench::NowNs() - before);
+    }
+    double seconds = (bench::NowNs() - start) / 1e9;
+    bench::Json("json_encode").Str("api", api).Num("records", records).Num("bytes_per_record", bytes / records)
+        .Num("seconds", seconds).Num("records_per_sec", records / seconds).Lat(bench::Percentiles::Of(samples)).Print();
+}
+
+static Json::Value Record(size_t i, const std::string &user) {
+    Json::Value root;
+    root["ts"] = Json::Int64(asynlog::Util::Date::Now());
+    root["tid"] = Json::UInt64(pthread_self());
+    root["level"] = "INFO";
+    root["logger"] = "bench";
+    root["file"] = __FILE__;
+    root["line"] = __LINE__;
+    root["msg"] = "request done";
+    root["user"] = user;
+    root["latency_us"] = Json::UInt64(i);
+    root["ratio"] = 0.5;
+    root["ok"] = true;
+    return root;
+}
+
+int main(int argc, char *argv[]) {
+    size_t records = argc > 1 ? strtoull(argv[1], nullptr, 10) : 1000000;
+    std::string user = "user \"42\"";
+    std::string logger_name = "bench";
+    std::string file = __FILE__;
+
+    std::string out;
+    Run("encoder", records, [&](size_t i) {
+        out.clear();
+        asynlog::Field fields[] = {kv("user", user), kv("latency_us", i), kv("ratio", 0.5), kv("ok", true)};
+        asynlog::LogMessage::FormatJson(out, asynlog::LogLevel::value::INFO, asynlog::Util::Date::Now(), file.c_str(), __LINE__,
+                                        logger_name, "request done", 12, fields, 4);
+        return out.size();
+    });
+    Run("jsoncpp_serialize", records, [&](size_t i) {
+        asynlog::Util::JsonUtil::Serialize(Record(i, user), &out);
+        return out.size();
+    });
+    Json::StreamWriterBuilder swb;
+    swb["indentation"] = "";
+    std::unique_ptr<Json::StreamWriter> writer(swb.newStreamWriter());
+    std::ostringstream ss;
+    Run("jsoncpp_reused_writer", records, [&](size_t i) {
+        ss.str("");
+        writer->write(Record(i, user), &ss);
+        return static_cast<size_t>(ss.tellp());
+    });
+
+    // whole log calls, the consumer writes to a file
+    for (auto format : {asynlog::LogFormat::TEXT, asynlog::LogFormat::JSON}) {
+        const char *name = format == asynlog::LogFormat::JSON ? "logger_json" : "logger_text";
+        asynlog::LoggerBuilder builder;
+        builder.BuildLoggerName(name);
+        builder.BuildLoggerFormat(format);
+        builder.BuildLoggerFlush<asynlog::FileFlush>("./logfile/bench_json.log");
+        auto logger = builder.Build();
+        Run(name, records, [&](size_t i) {
+            logger->Info(__FILE__, __LINE__, "request done", kv("user", user), kv("latency_us", i), kv("ratio", 0.5), kv("ok", true));
+            return 0;
+        });
+        logger->Flush().wait();
+        logger.reset();
+        remove("./logfile/bench_json.log");
+    }
+    return 0;
+}
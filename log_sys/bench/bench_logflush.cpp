@@ -0,0 +1,56 @@
+#include "../src/LogFlush.hpp"
+#include "bench_common.hpp"
+#include <cstdlib>
+#include <memory>
+// Write cost of every LogFlush for the flush_log settings 0 (stdio buffered), 1 (fflush) and 2 (fsync).
+// Each Flush() call gets one batch, as a consumer would hand it over.
+// Prints one JSON object per line, usage: bench_logflush [batches] [batch_bytes]
+asynlog::Util::JsonData* conf_data = asynlog::Util::JsonData::GetJsonData();
+
+static void Run(const char *sink, asynlog::LogFlush &flush, size_t batches, const std::string &batch) {
+    std::vector<int64_t> samples;
+    samples.reserve(batches);
+    double seconds;
+    {
+        std::unique_ptr<bench::MuteStdout> mute; // the stdout sink writes to /dev/null
+        if (flush.Fd() == STDOUT_FILENO) mute.reset(new bench::MuteStdout());
+        int64_t start = bench::NowNs();
+        for (size_t i = 0; i < batches; i++) {
+            int64_t before = bench::NowNs();
+            flush.Flush(batch.data(), batch.size());
+            samples.push_back(bench::NowNs() - before);
+        }
+        flush.Sync();
+        seconds = (bench::NowNs() - start) / 1e9;
+    }
+    bench::Json("logflush_write").Str("sink", sink).Num("flush_log", conf_data->flush_log)
+        .Num("batches", batches).Num("batch_bytes", batch.size()).Num("seconds", seconds)
+        .Num("mb_per_sec", batches * batch.size() / seconds / 1e6).Lat(bench::Percentiles::Of(samples)).Print();
+}
+
+int main(int argc, char *argv[]) {
+    size_t batches = argc > 1 ? strtoull(argv[1], nullptr, 10) : 2000;
+    size_t batch_bytes = argc > 2 ? strtoull(argv[2], nullptr, 10) : 64 * 1024;
+    std::string line = "[12:00:00][140000000000000][INFO ][bench][bench_logflush.cpp:1]\tsome payload of a typical log line\n";
+    std::string batch;
+    while (batch.size() + line.size() <= batch_bytes) batch += line;
+    size_t configured = conf_data->flush_log;
+    for (size_t mode : {0, 1, 2}) {
+        conf_data->flush_log = mode;
+        {
+            asynlog::StdOutFlush flush;
+            Run("stdout", flush, batches, batch);
+        }
+        {
+            asynlog::FileFlush flush("./logfile/bench_file.log");
+            Run("file", flush, batches, batch);
+        }
+        {
+            asynlog::RollFileFlush flush("./logfile/bench_roll-", 16 * 1024 * 1024);
+            Run("roll_file", flush, batches, batch);
+        }
+        system("rm -f ./logfile/bench_file.log ./logfile/bench_roll-*");
+    }
+    conf_data->flush_log = configured;
+    return 0;
+}
@@ -0,0 +1,89 @@
+#include "../src/Manager.hpp"
+#include "bench_common.hpp"
+#include <atomic>
+#include <thread>
+#include <cstdlib>
+// AsynLogger producer throughput, per-call latency and end-to-end time to disk, ASYNC_SAFE vs ASYNC_UNSAFE.
+// Prints one JSON object per line, usage: bench_logger [records_per_run]
+asynlog::Util::JsonData* conf_data = asynlog::Util::JsonData::GetJsonData();
+ThreadPool *tp = new ThreadPool(1);
+
+/**
+ * @brief Flush that drops the data and counts the bytes, isolates the pipeline from the sink
+*/
+class NullFlush : public asynlog::LogFlush {
+public:
+    void Flush(const char *data, size_t len) override { bytes += len; }
+    std::atomic<size_t> bytes{0};
+};
+
+static const char *TypeName(asynlog::AsynType type) {
+    return type == asynlog::AsynType::ASYNC_SAFE ? "safe" : "unsafe";
+}
+
+static asynlog::AsynLogger::ptr MakeLogger(asynlog::AsynType type, const asynlog::LogFlush::ptr &flush) {
+    asynlog::LoggerBuilder builder;
+    builder.BuildLoggerName("bench");
+    builder.BuildLoggerType(type);
+    builder.BuildLoggerFlush(flush);
+    return builder.Build();
+}
+
+/**
+ * @brief Log from several threads, optionally timing every call
+ * @return wall time until the last record reached the sinks, in seconds
+*/
+static double Produce(asynlog::AsynLogger &logger, size_t threads, size_t records, std::vector<int64_t> *samples) {
+    std::vector<std::vector<int64_t>> per_thread(threads);
+    int64_t start = bench::NowNs();
+    std::vector<std::thread> producers;
+    for (size_t t = 0; t < threads; t++) {
+        producers.emplace_back([&, t]() {
+            size_t n = records / threads;
+            if (samples) per_thread[t].reserve(n);
+            for (size_t i = 0; i < n; i++) {
+                int64_t before = samples ? bench::NowNs() : 0;
+                logger.Info(__FILE__, __LINE__, "bench record %zu from thread %zu, some payload to reach a typical line length", i, t);
+                if (samples) per_thread[t].push_back(bench::NowNs() - before);
+            }
+        });
+    }
+    for (auto &p : producers) p.join();
+    logger.Sync().wait();
+    double seconds = (bench::NowNs() - start) / 1e9;
+    if (samples) {
+        for (auto &v : per_thread) samples->insert(samples->end(), v.begin(), v.end());
+    }
+    return seconds;
+}
+
+int main(int argc, char *argv[]) {
+    size_t records = argc > 1 ? strtoull(argv[1], nullptr, 10) : 400000;
+    for (auto type : {asynlog::AsynType::ASYNC_SAFE, asynlog::AsynType::ASYNC_UNSAFE}) {
+        for (size_t threads : {1, 2, 4, 8}) {
+            auto flush = std::make_shared<NullFlush>();
+            auto logger = MakeLogger(type, flush);
+            double seconds = Produce(*logger, threads, records, nullptr);
+            size_t n = records / threads * threads;
+            bench::Json("logger_throughput").Str("type", TypeName(type)).Num("threads", threads)
+                .Num("records", n).Num("seconds", seconds).Num("msgs_per_sec", n / seconds)
+                .Num("mb_per_sec", flush->bytes / seconds / 1e6).Print();
+        }
+        for (size_t threads : {1, 4}) {
+            auto logger = MakeLogger(type, std::make_shared<NullFlush>());
+            std::vector<int64_t> samples;
+            Produce(*logger, threads, records, &samples);
+            bench::Json("logger_latency").Str("type", TypeName(type)).Num("threads", threads)
+                .Num("records", samples.size()).Lat(bench::Percentiles::Of(samples)).Print();
+        }
+        // end to end: from the first call until the records are fsynced
+        const std::string path = "./logfile/bench_e2e.log";
+        auto logger = MakeLogger(type, std::make_shared<asynlog::FileFlush>(path));
+        double seconds = Produce(*logger, 4, records, nullptr);
+        logger.reset();
+        bench::Json("logger_end_to_end").Str("type", TypeName(type)).Str("sink", "file").Num("threads", 4)
+            .Num("records", records / 4 * 4).Num("seconds", seconds).Num("msgs_per_sec", records / 4 * 4 / seconds).Print();
+        remove(path.c_str());
+    }
+    return 0;
+}
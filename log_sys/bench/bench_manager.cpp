@@ -0,0 +1,61 @@
+#include "../src/Manager.hpp"
+#include <iostream>
+#include <chrono>
+#include <atomic>
+#include <vector>
+#include <thread>
+#include <cstdio>
+#include <cstdlib>
+// LoggerManager lookup cost as threads scale, compared with the old mutex guarded map.
+// Prints one JSON object per line, usage: bench_manager [lookups_per_thread]
+asynlog::Util::JsonData* conf_data = asynlog::Util::JsonData::GetJsonData();
+ThreadPool *tp = new ThreadPool(1);
+
+template <class Lookup>
+void Run(const char *api, size_t threads, size_t lookups, Lookup lookup) {
+    std::atomic<size_t> found(0);
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; t++) {
+        workers.emplace_back([&]() {
+            size_t n = 0;
+            for (size_t i = 0; i < lookups; i++) {
+                n += lookup() != nullptr;
+            }
+            found += n;
+        });
+    }
+    for (auto &w : workers) w.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("{\"bench\":\"manager_lookup\",\"api\":\"%s\",\"threads\":%zu,\"lookups\":%zu,"
+           "\"seconds\":%.6f,\"ns_per_lookup\":%.2f}\n",
+           api, threads, threads * lookups, seconds, seconds * 1e9 / lookups); // wall time per lookup of one thread
+}
+
+int main(int argc, char *argv[]) {
+    size_t lookups = argc > 1 ? strtoull(argv[1], nullptr, 10) : 1000000;
+    auto &manager = asynlog::LoggerManager::GetInstance();
+    std::unordered_map<std::string, asynlog::AsynLogger::ptr> baseline_map;
+    std::mutex baseline_mtx;
+    for (int i = 0; i < 16; i++) {
+        asynlog::LoggerBuilder builder;
+        builder.BuildLoggerName("logger" + std::to_string(i));
+        builder.BuildLoggerFlush<asynlog::StdOutFlush>();
+        auto logger = builder.Build();
+        baseline_map[logger->Name()] = logger;
+        manager.AddLogger(std::move(logger));
+    }
+    const std::string name = "logger7";
+    asynlog::LoggerHandle handle(name);
+    for (size_t threads : {1, 2, 4, 8, 16, 32}) {
+        Run("mutex_baseline", threads, lookups, [&]() {
+            std::lock_guard<std::mutex> lock(baseline_mtx);
+            auto it = baseline_map.find(name);
+            return it != baseline_map.end() ? it->second : nullptr;
+        });
+        Run("GetLogger", threads, lookups, [&]() { return manager.GetLogger(name); });
+        Run("FindLogger", threads, lookups, [&]() { return manager.FindLogger(name); });
+        Run("LoggerHandle", threads, lookups, [&]() { return handle.Get(); });
+    }
+    return 0;
+}
@@ -0,0 +1,69 @@
+#include "../src/AsynLogger.hpp"
+#include "bench_common.hpp"
+#include <cstdlib>
+// Formatting one text record: the stringstream path of LogMessage::format() against compiled PatternLayouts,
+// the default one and a custom one with milliseconds and the file basename; then a request id and a
+// tenant on every record, formatted into each message against the cached thread context of LogContext.
+// Prints one JSON object per line, usage: bench_pattern [records]
+asynlog::Util::JsonData* conf_data = asynlog::Util::JsonData::GetJsonData();
+ThreadPool *tp = new ThreadPool(1);
+
+template <class Format>
+static void Run(const char *api, size_t records, Format format) {
+    std::vector<int64_t> samples;
+    samples.reserve(records);
+    size_t bytes = 0;
+    int64_t start = bench::NowNs();
+    for (size_t i = 0; i < records; i++) {
+        int64_t before = bench::NowNs();
+        bytes += format();
+        samples.push_back(bench::NowNs() - before);
+    }
+    double seconds = (bench::NowNs() - start) / 1e9;
+    bench::Json("text_format").Str("api", api).Num("records", records).Num("bytes_per_record", bytes / records)
+        .Num("seconds", seconds).Num("records_per_sec", records / seconds).Lat(bench::Percentiles::Of(samples)).Print();
+}
+
+int main(int argc, char *argv[]) {
+    size_t records = argc > 1 ? strtoull(argv[1], nullptr, 10) : 1000000;
+    std::string name = "bench";
+    std::string file = __FILE__;
+    const char *payload = "bench record from the formatter benchmark, some payload to reach a typical line length";
+    size_t payload_len = strlen(payload);
+    Run("logmessage_stringstream", records, [&]() {
+        asynlog::LogMessage msg(asynlog::LogLevel::value::INFO, file, __LINE__, name, payload);
+        return msg.format().size();
+    });
+    std::string out;
+    for (const char *pattern : {"", "%d{%H:%M:%S.%e} [%t] %l %n %s:%# %v"}) {
+        asynlog::PatternLayout layout(pattern);
+        Run(*pattern ? "pattern_custom" : "pattern_default", records, [&]() {
+            out.clear();
+            layout.Format(out, asynlog::PatternLayout::Record{ASYNLOG_SITE(INFO, ""), asynlog::PatternLayout::Now(),
+                                                              &name, payload, payload_len});
+            return out.size();
+        });
+    }
+
+    asynlog::PatternLayout layout;
+    const uint64_t request_id = 8812736451;
+    const char *tenant = "acme";
+    Run("ids_in_message", records, [&]() {
+        char msg[256];
+        int n = snprintf(msg, sizeof(msg), "%s request_id=%llu tenant=%s", payload,
+                         static_cast<unsigned long long>(request_id), tenant);
+        out.clear();
+        layout.Format(out, asynlog::PatternLayout::Record{ASYNLOG_SITE(INFO, ""), asynlog::PatternLayout::Now(),
+                                                          &name, msg, static_cast<size_t>(n)});
+        return out.size();
+    });
+    asynlog::ScopedContext ctx(asynlog::kv("request_id", request_id), asynlog::kv("tenant", tenant));
+    asynlog::LogContext &current = asynlog::LogContext::Current();
+    Run("ids_in_context", records, [&]() {
+        out.clear();
+        layout.Format(out, asynlog::PatternLayout::Record{ASYNLOG_SITE(INFO, ""), asynlog::PatternLayout::Now(),
+                                                          &name, payload, payload_len, nullptr, 0, &current.Text()});
+        return out.size();
+    });
+    return 0;
+}
@@ -0,0 +1,100 @@
+#include "../src/query/Query.hpp"
+#include "bench_common.hpp"
+#include <cstdlib>
+#include <thread>
+// Search speed over a generated log file: the raw substring scan (Scan::Find against memmem and
+// std::string_view::find), whole queries through Query on 1 and all threads, in GB/s, and the index
+// sidecar: the cost of writing it and a time range query with and without it.
+// Prints one JSON object per line, usage: bench_query [megabytes]
+ThreadPool *tp = nullptr;
+
+static double Gbps(size_t bytes, int64_t ns) { return bytes / (ns / 1e9) / 1e9; }
+
+int main(int argc, char *argv[]) {
+    size_t mb = argc > 1 ? strtoull(argv[1], nullptr, 10) : 256;
+    std::string path = "./logfile/bench_query.log";
+    mkdir("./logfile", 0755);
+    {
+        FILE *fp = fopen(path.c_str(), "w");
+        char line[256];
+        for (size_t i = 0, bytes = 0; bytes < mb * 1024 * 1024; i++) {
+            int n = snprintf(line, sizeof(line), "[%02zu:%02zu:%02zu][140000000000][%s][svc%zu][handler.cpp:%zu]\trequest id=%zu user=u%zu done\n",
+                             i / 3600 % 24, i / 60 % 60, i % 60, i % 1000 ? "INFO " : "ERROR", i % 8, i % 300, i, i % 1000);
+            fwrite(line, 1, n, fp);
+            bytes += n;
+        }
+        fclose(fp);
+    }
+    asynlog::query::MappedFile file(path);
+    std::string_view all(file.data(), file.size());
+    const std::string needle = "user=u1000"; // never present
+    volatile size_t sink = 0;
+    for (int round = 0; round < 2; round++) { // the first round pages the file in
+        int64_t start = bench::NowNs();
+        sink += asynlog::query::Scan::Find(file.data(), file.size(), needle.data(), needle.size()) != nullptr;
+        int64_t simd = bench::NowNs() - start;
+        start = bench::NowNs();
+        sink += memmem(file.data(), file.size(), needle.data(), needle.size()) != nullptr;
+        int64_t mm = bench::NowNs() - start;
+        start = bench::NowNs();
+        sink += all.find(needle) != std::string_view::npos;
+        int64_t sv = bench::NowNs() - start;
+        if (round == 0) continue;
+        bench::Json("query_scan").Str("api", asynlog::query::Scan::HasAvx2() ? "simd_avx2" : "simd_sse2")
+            .Num("bytes", file.size()).Num("gb_per_sec", Gbps(file.size(), simd)).Print();
+        bench::Json("query_scan").Str("api", "memmem").Num("bytes", file.size()).Num("gb_per_sec", Gbps(file.size(), mm)).Print();
+        bench::Json("query_scan").Str("api", "string_view_find").Num("bytes", file.size()).Num("gb_per_sec", Gbps(file.size(), sv)).Print();
+    }
+
+    std::vector<size_t> thread_counts{1};
+    if (std::thread::hardware_concurrency() > 1) thread_counts.push_back(std::thread::hardware_concurrency());
+    for (size_t threads : thread_counts) {
+        ThreadPool pool(threads);
+        struct Case { const char *name; asynlog::query::Filter filter; };
+        std::vector<Case> cases(3);
+        cases[0].name = "substring";
+        cases[0].filter.contains = "user=u999 ";
+        cases[1].name = "level";
+        cases[1].filter.levels = {asynlog::LogLevel::value::ERROR};
+        cases[2].name = "time_range";
+        cases[2].filter.from = "12:00:00";
+        cases[2].filter.to = "12:10";
+        for (Case &c : cases) {
+            asynlog::query::Query query(c.filter, &pool);
+            int64_t start = bench::NowNs();
+            size_t n = query.Run({path}, nullptr);
+            int64_t ns = bench::NowNs() - start;
+            bench::Json("query_run").Str("filter", c.name).Num("threads", threads).Num("matches", n)
+                .Num("bytes", file.size()).Num("gb_per_sec", Gbps(file.size(), ns)).Print();
+        }
+    }
+
+    {
+        std::string idx = asynlog::query::IndexWriter::PathFor(path);
+        remove(idx.c_str());
+        const size_t interval = 64 * 1024, batch = 64 * 1024;
+        int64_t start = bench::NowNs();
+        {
+            asynlog::query::IndexWriter writer(path, interval, 0);
+            for (size_t pos = 0; pos < file.size(); pos += batch) writer.Add(file.data() + pos, std::min(batch, file.size() - pos));
+        }
+        int64_t ns = bench::NowNs() - start;
+        bench::Json("index_write").Num("bytes", file.size()).Num("interval_bytes", interval)
+            .Num("gb_per_sec", Gbps(file.size(), ns)).Print();
+        ThreadPool pool(1);
+        asynlog::query::Filter filter;
+        filter.from = "12:00:00";
+        filter.to = "12:10";
+        for (bool use_index : {false, true}) {
+            asynlog::query::Query query(filter, &pool, 16 * 1024 * 1024, use_index);
+            start = bench::NowNs();
+            size_t n = query.Run({path}, nullptr);
+            ns = bench::NowNs() - start;
+            bench::Json("query_indexed").Str("index", use_index ? "on" : "off").Num("matches", n)
+                .Num("skipped_bytes", query.SkippedBytes()).Num("seconds", ns / 1e9).Print();
+        }
+        remove(idx.c_str());
+    }
+    remove(path.c_str());
+    return 0;
+}
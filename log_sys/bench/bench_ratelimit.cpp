@@ -0,0 +1,37 @@
+#include "../src/AsynLog.hpp"
+#include "bench_common.hpp"
+#include <thread>
+#include <cstdlib>
+// Cost of a call site check of the rate limited and sampled macros when the record is dropped,
+// for 1 and 4 threads hitting the same call site.
+// Prints one JSON object per line, usage: bench_ratelimit [calls_per_thread]
+asynlog::Util::JsonData* conf_data = asynlog::Util::JsonData::GetJsonData();
+ThreadPool *tp = new ThreadPool(1);
+
+template <class Check>
+static void Run(const char *api, size_t threads, size_t calls, Check check) {
+    std::vector<std::thread> workers;
+    int64_t start = bench::NowNs();
+    for (size_t t = 0; t < threads; t++) {
+        workers.emplace_back([&]() { for (size_t i = 0; i < calls; i++) check(); });
+    }
+    for (auto &w : workers) w.join();
+    double seconds = (bench::NowNs() - start) / 1e9;
+    bench::Json("call_site_check").Str("api", api).Num("threads", threads).Num("calls", threads * calls)
+        .Num("seconds", seconds).Num("ns_per_call", seconds * 1e9 / calls).Print();
+}
+
+int main(int argc, char *argv[]) {
+    size_t calls = argc > 1 ? strtoull(argv[1], nullptr, 10) : 10000000;
+    asynlog::LoggerBuilder builder;
+    builder.BuildLoggerName("bench");
+    builder.BuildLoggerFlush<asynlog::FileFlush>("./logfile/bench_ratelimit.log");
+    auto logger = builder.Build();
+    for (size_t threads : {1, 4}) {
+        Run("limited", threads, calls, [&]() { WarnLimited(logger, 1, "hot warning %d", 42); });
+        Run("sampled", threads, calls, [&]() { DebugSampled(logger, 0.0, "hot debug %d", 42); });
+    }
+    logger.reset();
+    remove("./logfile/bench_ratelimit.log");
+    return 0;
+}
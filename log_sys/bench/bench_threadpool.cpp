@@ -0,0 +1,56 @@
+#include "../src/ThreadPool.hpp"
+#include <iostream>
+#include <chrono>
+#include <atomic>
+#include <vector>
+#include <thread>
+#include <cstdio>
+#include <cstdlib>
+// ThreadPool submission contention: 1/4/16/64 submitters push tiny tasks into a 4 thread pool.
+// Prints one JSON object per line, usage: bench_threadpool [tasks_per_run]
+
+struct Result {
+    const char *api;
+    size_t submitters;
+    size_t tasks;
+    double seconds;
+};
+
+template <class SubmitOne>
+Result Run(const char *api, size_t submitters, size_t tasks, SubmitOne submit_one) {
+    ThreadPool pool(4);
+    std::atomic<size_t> done(0);
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (size_t s = 0; s < submitters; s++) {
+        threads.emplace_back([&, s]() {
+            size_t n = tasks / submitters + (s < tasks % submitters ? 1 : 0);
+            for (size_t i = 0; i < n; i++) {
+                submit_one(pool, done);
+            }
+        });
+    }
+    for (auto &t : threads) t.join();
+    while (done.load(std::memory_order_acquire) < tasks) std::this_thread::yield();
+    auto end = std::chrono::steady_clock::now();
+    return {api, submitters, tasks, std::chrono::duration<double>(end - start).count()};
+}
+
+void Print(const Result &r) {
+    printf("{\"bench\":\"threadpool_submit\",\"api\":\"%s\",\"submitters\":%zu,\"tasks\":%zu,"
+           "\"seconds\":%.6f,\"tasks_per_sec\":%.0f}\n",
+           r.api, r.submitters, r.tasks, r.seconds, r.tasks / r.seconds);
+}
+
+int main(int argc, char *argv[]) {
+    size_t tasks = argc > 1 ? strtoull(argv[1], nullptr, 10) : 200000;
+    for (size_t submitters : {1, 4, 16, 64}) {
+        Print(Run("post", submitters, tasks, [](ThreadPool &pool, std::atomic<size_t> &done) {
+            pool.post([&done]() { done.fetch_add(1, std::memory_order_release); });
+        }));
+        Print(Run("enqueue", submitters, tasks, [](ThreadPool &pool, std::atomic<size_t> &done) {
+            pool.enqueue([&done]() { done.fetch_add(1, std::memory_order_release); });
+        }));
+    }
+    return 0;
+}
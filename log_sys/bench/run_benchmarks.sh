@@ -0,0 +1,19 @@
+#!/bin/bash
+# Run every benchmark and collect the JSON lines into one file, tagged with the commit and the host.
+# usage: run_benchmarks.sh <dir with the bench_* binaries> [output file]
+# Run it from log_sys/bench, the binaries read ../src/config.json.
+bin_dir=${1:?usage: run_benchmarks.sh <bin dir> [output]}
+out=${2:-bench-$(date +%Y%m%d-%H%M%S).jsonl}
+commit=$(git rev-parse --short HEAD 2>/dev/null || echo unknown)
+host=$(hostname)
+mkdir -p ./logfile
+: > "$out"
+for b in bench_logger bench_logflush bench_buffer bench_threadpool bench_manager bench_ratelimit bench_json bench_pattern bench_backup bench_query; do
+    if [ ! -x "$bin_dir/$b" ]; then
+        echo "skip $b: not built" >&2
+        continue
+    fi
+    echo "run $b" >&2
+    "$bin_dir/$b" | grep '^{' | sed "s/^{/{\"commit\":\"$commit\",\"host\":\"$host\",/" >> "$out"
+done
+echo "results in $out" >&2
@@ -35,6 +35,16 @@ public:
         read_pos_ = 0;
         buffer_.resize(conf_data->buffer_size);
     }
+
+    /**
+     * @brief Buffer constructor with an explicit initial size
+     * @param size The initial size of the buffer, 0 for the configured size
+     */
+    explicit Buffer(size_t size) {
+        write_pos_ = 0;
+        read_pos_ = 0;
+        buffer_.resize(size == 0 ? conf_data->buffer_size : size);
+    }
     
     /**
      * @brief Push data into the buffer
@@ -137,12 +147,13 @@ protected:
      */
     void ToBeEnough(size_t len) {
         size_t buffer_size = buffer_.size();
-        if (len >= WriteableSize()) {
+        while (len >= WriteableSize()) { // one step may not be enough for a large record
             if (buffer_.size() < conf_data->threshold) { // triple the size
                 buffer_.resize(2 * buffer_.size() + buffer_size);
             } else {
                 buffer_.resize(conf_data->linear_growth + buffer_size); // using linear growth
             }
+            buffer_size = buffer_.size();
         }
     }
 };
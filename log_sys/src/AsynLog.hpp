@@ -6,6 +6,8 @@
 */
 #pragma once
 #include "Manager.hpp"
+#include "RateLimit.hpp" // for RateLimiter, Sampler
+#include "CallSite.hpp" // for ASYNLOG_SITE
 namespace asynlog
 {
 /**
@@ -13,7 +15,7 @@ namespace asynlog
  * @param name Logger name
  * @return AsynLogger::ptr Pointer to the logger
 */
-AsynLogger::ptr GetLogger(const std::string &name)
+inline AsynLogger::ptr GetLogger(const std::string &name)
 {
     return LoggerManager::GetInstance().GetLogger(name);
 }
@@ -22,21 +24,23 @@ AsynLogger::ptr GetLogger(const std::string &name)
  * @brief Get default logger
  * @return AsynLogger::ptr Pointer to the default logger
 */
-AsynLogger::ptr GetDefaultLogger()
+inline AsynLogger::ptr GetDefaultLogger()
 {
     return LoggerManager::GetInstance().GetDefaultLogger();
 }
 
 /**
  * @brief define log macros
- * @param fmt Format string
+ * @param fmt Format string, a string literal
  * @param ... Arguments to format string
+ * @note Every call site passes a pointer to its static CallSite. A format built at run time needs the
+ * member named in parentheses, `(logger->Info)(__FILE__, __LINE__, format, ...)`.
 */
-#define Debug(fmt, ...) Debug(__FILE__, __LINE__, fmt, ##__VA_ARGS__)
-#define Info(fmt, ...) Info(__FILE__, __LINE__, fmt, ##__VA_ARGS__)
-#define Warn(fmt, ...) Warn(__FILE__, __LINE__, fmt, ##__VA_ARGS__)
-#define Error(fmt, ...) Error(__FILE__, __LINE__, fmt, ##__VA_ARGS__)
-#define Fatal(fmt, ...) Fatal(__FILE__, __LINE__, fmt, ##__VA_ARGS__)
+#define Debug(fmt, ...) Debug(ASYNLOG_SITE(DEBUG, fmt), ##__VA_ARGS__)
+#define Info(fmt, ...) Info(ASYNLOG_SITE(INFO, fmt), ##__VA_ARGS__)
+#define Warn(fmt, ...) Warn(ASYNLOG_SITE(WARN, fmt), ##__VA_ARGS__)
+#define Error(fmt, ...) Error(ASYNLOG_SITE(ERROR, fmt), ##__VA_ARGS__)
+#define Fatal(fmt, ...) Fatal(ASYNLOG_SITE(FATAL, fmt), ##__VA_ARGS__)
 
 /**
  * @brief define log macros for default logger
@@ -48,4 +52,43 @@ AsynLogger::ptr GetDefaultLogger()
 #define WarnDefault(fmt, ...) asynlog::GetDefaultLogger()->Warn(fmt, ##__VA_ARGS__)
 #define ErrorDefault(fmt, ...) asynlog::GetDefaultLogger()->Error(fmt, ##__VA_ARGS__)
 #define FatalDefault(fmt, ...) asynlog::GetDefaultLogger()->Fatal(fmt, ##__VA_ARGS__)
+
+/**
+ * @brief define rate limited log macros: at most per_second records of this call site per second
+ * @param logger Logger pointer
+ * @param per_second Records let through per second
+ * @param fmt Format string
+ * @param ... Arguments to format string
+ * @note Suppressed records are not formatted. The next record let through is preceded by
+ * "suppressed K messages". The member is named in parentheses so the macros above do not expand it.
+*/
+#define ASYNLOG_LIMITED(logger, level, lv, per_second, fmt, ...) do { \
+        static asynlog::RateLimiter asynlog_site_limiter(per_second); \
+        uint64_t asynlog_site_suppressed; \
+        if (asynlog_site_limiter.Allow(&asynlog_site_suppressed)) { \
+            if (asynlog_site_suppressed > 0) \
+                ((logger)->level)(ASYNLOG_SITE(lv, "suppressed %llu messages"), \
+                                  static_cast<unsigned long long>(asynlog_site_suppressed)); \
+            ((logger)->level)(ASYNLOG_SITE(lv, fmt), ##__VA_ARGS__); \
+        } \
+    } while (0)
+#define DebugLimited(logger, per_second, fmt, ...) ASYNLOG_LIMITED(logger, Debug, DEBUG, per_second, fmt, ##__VA_ARGS__)
+#define InfoLimited(logger, per_second, fmt, ...) ASYNLOG_LIMITED(logger, Info, INFO, per_second, fmt, ##__VA_ARGS__)
+#define WarnLimited(logger, per_second, fmt, ...) ASYNLOG_LIMITED(logger, Warn, WARN, per_second, fmt, ##__VA_ARGS__)
+#define ErrorLimited(logger, per_second, fmt, ...) ASYNLOG_LIMITED(logger, Error, ERROR, per_second, fmt, ##__VA_ARGS__)
+
+/**
+ * @brief define sampled log macros: log a record of this call site with the given probability
+ * @param logger Logger pointer
+ * @param probability Chance of a record to be logged, from 0 to 1
+ * @param fmt Format string
+ * @param ... Arguments to format string
+*/
+#define ASYNLOG_SAMPLED(logger, level, lv, probability, fmt, ...) do { \
+        static asynlog::Sampler asynlog_site_sampler(probability); \
+        if (asynlog_site_sampler.Sample()) \
+            ((logger)->level)(ASYNLOG_SITE(lv, fmt), ##__VA_ARGS__); \
+    } while (0)
+#define DebugSampled(logger, probability, fmt, ...) ASYNLOG_SAMPLED(logger, Debug, DEBUG, probability, fmt, ##__VA_ARGS__)
+#define InfoSampled(logger, probability, fmt, ...) ASYNLOG_SAMPLED(logger, Info, INFO, probability, fmt, ##__VA_ARGS__)
 } // namespace asynlog
\ No newline at end of file
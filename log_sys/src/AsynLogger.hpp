@@ -10,18 +10,32 @@
 #include <vector> // for vector
 #include <cstdarg> // for va_start
 #include <assert.h> // for assert
+#include <future> // for shared_future
+#include <cstring> // for strcmp
 
 #include "AsynWorker.hpp" // for AsynWorker
+#include "ShardMerger.hpp" // for ShardMerger, ShardMode
+#include "CrashHandler.hpp" // for CrashHandler
+#include "Coalescer.hpp" // for Coalescer
 #include "LogFlush.hpp" // for LogFlush, StdOutFlush, FileFlush, RollFileFlush
 #include "Level.hpp" // for LogLevel
 #include "Message.hpp" // for LogMessage
+#include "Pattern.hpp" // for PatternLayout
+#include "Context.hpp" // for LogContext
+#include "CallSite.hpp" // for CallSite
 #include "ThreadPool.hpp" // for ThreadPool
+#include "Metrics.hpp" // for Metrics
 #include "backup/ClientBackup.hpp"
 
 extern ThreadPool *tp;
 
 namespace asynlog
 {
+/**
+ * @brief Waitable handle returned by AsynLogger::Flush() and AsynLogger::Sync()
+*/
+using FlushHandle = std::shared_future<void>;
+
 /**
  * @brief AsynLogger class
  * @details This class is used to log messages asynchronously.
@@ -30,8 +44,27 @@ class AsynLogger {
 private:
     std::string logger_name_;              // logger's name
     AsynType asyntype_;                    // type of async
-    std::shared_ptr<AsynWorker> worker_;   // produer and consumer
-    std::vector<LogFlush::ptr> flushes_;   // vector for different Flush
+    ShardMode shard_mode_;                 // how shards share the flushes
+    size_t shard_count_;                   // number of workers
+    std::atomic<LogLevel::value> level_;   // records below this level are discarded
+    LogFormat format_;                     // text or JSON lines
+    PatternLayout layout_;                 // compiled text layout
+    struct FlushSet {
+        std::vector<LogFlush::ptr> all;                 // vector for different Flush
+        std::vector<std::vector<LogFlush::ptr>> shards; // flushes of each shard in PER_SHARD_FILE mode
+        std::vector<Histogram *> latency;               // flush latency of each entry of all, shared by its shard copies
+    };
+    std::mutex flush_mtx_;                 // guards swaps of flush_set_
+    std::shared_ptr<const FlushSet> flush_set_; // current flushes, a consumer keeps its copy for a whole batch
+    std::atomic<const FlushSet *> flush_set_raw_{nullptr}; // the same set for the crash handler, which cannot lock
+    std::atomic<bool> agent_backups_{false};  // a shm flush hands default layout records to the log agent, which backs them up
+    std::vector<AsynWorker::ptr> workers_; // produer and consumer, one per shard
+    ShardMerger::ptr merger_;              // merge stage in ORDERED_MERGE mode
+    std::vector<std::unique_ptr<Coalescer>> coalescers_; // one per output stream, empty if coalescing is off
+    std::unique_ptr<Coalescer> backup_coalescer_; // collapses repeated backups, null if coalescing is off
+    Counter *records_in_;                  // records pushed
+    Counter *bytes_in_;                    // bytes pushed
+    Counter *backups_dropped_;             // backups the thread pool refused
 public:
     using ptr = std::shared_ptr<AsynLogger>;
 
@@ -40,149 +73,755 @@ public:
      * @param logger_name name of the logger
      * @param asyntype type of async
      * @param flushes vector of flushes
+     * @param shard_count number of workers, each with its own buffers and consumer thread
+     * @param shard_mode how the shards write to the flushes when shard_count > 1
+     * @param thread_opts affinity, scheduling and name of the consumer threads, spread over the shards
+     * @param level minimum level of the records to log
+     * @param buffer_size initial size of the worker buffers, 0 for the configured buffer_size
+     * @param coalesce_window collapse runs of identical lines, holding a repeat count back at most this long, 0 for off
+     * @param format layout of the records, text or JSON lines
+     * @param pattern text layout, see PatternLayout, empty for the default layout
      * @details This constructor initializes the logger with the given name, async type and flushes.
+     * Producers are spread over the shards by thread, see Push().
     */
-    AsynLogger(const std::string logger_name, AsynType asyntype, std::vector<LogFlush::ptr> flushes) :
+    AsynLogger(const std::string logger_name, AsynType asyntype, std::vector<LogFlush::ptr> flushes,
+               size_t shard_count = 1, ShardMode shard_mode = ShardMode::ORDERED_MERGE,
+               const ThreadOptions &thread_opts = ThreadOptions(),
+               LogLevel::value level = LogLevel::value::DEBUG, size_t buffer_size = 0,
+               std::chrono::milliseconds coalesce_window = std::chrono::milliseconds(0),
+               LogFormat format = LogFormat::TEXT, const std::string &pattern = "") :
         logger_name_(logger_name),
         asyntype_(asyntype),
-        flushes_(flushes) {                                   // functor         who to call      the first param  
-            worker_ = std::make_shared<AsynWorker>(std::bind(&AsynLogger::RealFlush, this, std::placeholders::_1), asyntype);
+        shard_mode_(shard_mode),
+        shard_count_(shard_count < 1 ? 1 : shard_count),
+        level_(level),
+        format_(format),
+        layout_(pattern) {
+            WorkerMetrics wm = InitMetrics();
+            SetFlushes(flushes);
+            if (coalesce_window.count() > 0) { // one stream per shard in PER_SHARD_FILE mode, else one
+                size_t streams = shard_count_ > 1 && shard_mode_ == ShardMode::PER_SHARD_FILE ? shard_count_ : 1;
+                for (size_t i = 0; i < streams; i++) {
+                    coalescers_.push_back(std::make_unique<Coalescer>(coalesce_window, format_ == LogFormat::JSON));
+                }
+                backup_coalescer_ = std::make_unique<Coalescer>(coalesce_window, format_ == LogFormat::JSON, Metrics::Get().GetCounter(
+                    "asynlog_backups_coalesced_total", "Repeated backups collapsed into a count"));
+            }
+            CrashHandler::Register(this, &AsynLogger::CrashDump);
+            if (shard_count <= 1) {                                               // functor         who to call      the first param  
+                workers_.push_back(std::make_shared<AsynWorker>(std::bind(&AsynLogger::RealFlush, this, std::placeholders::_1), asyntype, thread_opts, buffer_size, wm,
+                                                                ExpireFunc(0), coalesce_window));
+                return;
+            }
+            if (shard_mode_ == ShardMode::ORDERED_MERGE) {
+                // merge as often as a shard consumer flushes
+                auto interval = std::chrono::milliseconds(conf_data->max_flush_delay_ms + 1);
+                merger_ = std::make_shared<ShardMerger>(std::bind(&AsynLogger::RealFlush, this, std::placeholders::_1), interval, thread_opts,
+                                                        ExpireFunc(0));
+                for (size_t i = 0; i < shard_count; i++) {
+                    workers_.push_back(std::make_shared<AsynWorker>(std::bind(&ShardMerger::Collect, merger_.get(), std::placeholders::_1),
+                                                                    asyntype, thread_opts.ForThread(i, shard_count), buffer_size, wm));
+                    merger_->AddShard(workers_.back().get());
+                }
+                return;
+            }
+            for (size_t i = 0; i < shard_count; i++) {
+                workers_.push_back(std::make_shared<AsynWorker>([this, i](Buffer &buffer) {
+                    auto set = CurrentFlushes();
+                    FlushTo(i, set->shards[i], set->latency, buffer);
+                }, asyntype, thread_opts.ForThread(i, shard_count), buffer_size, wm, ExpireFunc(i), coalesce_window));
+            }
         }
     /**
      * @brief AsynLogger destructor
+     * @details Stops the workers before the merge stage and the flushes they write to are destroyed.
+    */
+    ~AsynLogger() {
+        CrashHandler::Unregister(this);
+        for (auto &w : workers_) {
+            w->Stop();
+        }
+        if (merger_) {
+            merger_->Stop();
+        }
+        DrainCoalescers();
+    }
+
+    /**
+     * @brief Structured log: a fixed message and typed fields, e.g. `logger->Info("login", kv("user", id))`
+     * @param site the call site, its level is the level of the record
+     * @param msg the message, not a format string
+     * @param fields the fields made by kv()
+     * @note The text layout appends ` key=value` to the message, the JSON layout writes one member per field.
+     * The record is built in a thread_local string, so the JSON layout allocates nothing once it has grown.
+    */
+    template <class... Fields>
+    void Log(const CallSite &site, const char *msg, const Fields &...fields) {
+        if (level_.load(std::memory_order_relaxed) > site.level) return;
+        const Field arr[sizeof...(Fields) + 1] = {fields..., Field()}; // the extra element avoids a zero sized array
+        thread_local std::string data;
+        data.clear();
+        Render(site, msg, strlen(msg), arr, sizeof...(Fields), data);
+        Emit(site.level, data);
+    }
+
+    /**
+     * @brief Info Error Warn Fatal Debug log from a static call site, as expanded by the AsynLog.hpp macros
+     * @param site the call site, its format is the format string
+     * @param ... additional arguments
+    */
+    void Debug(const CallSite *site, ...) {
+        if (level_.load(std::memory_order_relaxed) > LogLevel::value::DEBUG) return;
+        va_list va;
+        va_start(va, site);
+        Logv(*site, site->format, va);
+        va_end(va);
+    }
+
+    void Info(const CallSite *site, ...) {
+        if (level_.load(std::memory_order_relaxed) > LogLevel::value::INFO) return;
+        va_list va;
+        va_start(va, site);
+        Logv(*site, site->format, va);
+        va_end(va);
+    }
+
+    void Warn(const CallSite *site, ...) {
+        if (level_.load(std::memory_order_relaxed) > LogLevel::value::WARN) return;
+        va_list va;
+        va_start(va, site);
+        Logv(*site, site->format, va);
+        va_end(va);
+    }
+
+    void Error(const CallSite *site, ...) {
+        if (level_.load(std::memory_order_relaxed) > LogLevel::value::ERROR) return;
+        va_list va;
+        va_start(va, site);
+        Logv(*site, site->format, va);
+        va_end(va);
+    }
+
+    void Fatal(const CallSite *site, ...) {
+        if (level_.load(std::memory_order_relaxed) > LogLevel::value::FATAL) return;
+        va_list va;
+        va_start(va, site);
+        Logv(*site, site->format, va);
+        va_end(va);
+    }
+
+    /**
+     * @brief Structured Info Error Warn Fatal Debug log from a static call site, as expanded by the AsynLog.hpp macros
+    */
+    template <class... Fields>
+    void Debug(const CallSite *site, const Field &field, const Fields &...fields) {
+        Log(*site, site->format, field, fields...);
+    }
+
+    template <class... Fields>
+    void Info(const CallSite *site, const Field &field, const Fields &...fields) {
+        Log(*site, site->format, field, fields...);
+    }
+
+    template <class... Fields>
+    void Warn(const CallSite *site, const Field &field, const Fields &...fields) {
+        Log(*site, site->format, field, fields...);
+    }
+
+    template <class... Fields>
+    void Error(const CallSite *site, const Field &field, const Fields &...fields) {
+        Log(*site, site->format, field, fields...);
+    }
+
+    template <class... Fields>
+    void Fatal(const CallSite *site, const Field &field, const Fields &...fields) {
+        Log(*site, site->format, field, fields...);
+    }
+
+    /**
+     * @brief Structured Info Error Warn Fatal Debug log without the call site, for code not using the macros
+    */
+    template <class... Fields>
+    void Debug(const char *msg, const Field &field, const Fields &...fields) {
+        Log(CallSite::Make("", 0, "", LogLevel::value::DEBUG, msg), msg, field, fields...);
+    }
+
+    template <class... Fields>
+    void Info(const char *msg, const Field &field, const Fields &...fields) {
+        Log(CallSite::Make("", 0, "", LogLevel::value::INFO, msg), msg, field, fields...);
+    }
+
+    template <class... Fields>
+    void Warn(const char *msg, const Field &field, const Fields &...fields) {
+        Log(CallSite::Make("", 0, "", LogLevel::value::WARN, msg), msg, field, fields...);
+    }
+
+    template <class... Fields>
+    void Error(const char *msg, const Field &field, const Fields &...fields) {
+        Log(CallSite::Make("", 0, "", LogLevel::value::ERROR, msg), msg, field, fields...);
+    }
+
+    template <class... Fields>
+    void Fatal(const char *msg, const Field &field, const Fields &...fields) {
+        Log(CallSite::Make("", 0, "", LogLevel::value::FATAL, msg), msg, field, fields...);
+    }
+
+    /**
+     * @brief Structured Info Error Warn Fatal Debug log with a call site given at run time
     */
-    ~AsynLogger() {}
+    template <class... Fields>
+    void Debug(const std::string &file, size_t line, const char *msg, const Field &field, const Fields &...fields) {
+        Log(CallSite::Make(file.c_str(), line, "", LogLevel::value::DEBUG, msg), msg, field, fields...);
+    }
+
+    template <class... Fields>
+    void Info(const std::string &file, size_t line, const char *msg, const Field &field, const Fields &...fields) {
+        Log(CallSite::Make(file.c_str(), line, "", LogLevel::value::INFO, msg), msg, field, fields...);
+    }
+
+    template <class... Fields>
+    void Warn(const std::string &file, size_t line, const char *msg, const Field &field, const Fields &...fields) {
+        Log(CallSite::Make(file.c_str(), line, "", LogLevel::value::WARN, msg), msg, field, fields...);
+    }
+
+    template <class... Fields>
+    void Error(const std::string &file, size_t line, const char *msg, const Field &field, const Fields &...fields) {
+        Log(CallSite::Make(file.c_str(), line, "", LogLevel::value::ERROR, msg), msg, field, fields...);
+    }
+
+    template <class... Fields>
+    void Fatal(const std::string &file, size_t line, const char *msg, const Field &field, const Fields &...fields) {
+        Log(CallSite::Make(file.c_str(), line, "", LogLevel::value::FATAL, msg), msg, field, fields...);
+    }
 
     /**
-     * @brief Info Error Warn Fatal Debug log
+     * @brief Info Error Warn Fatal Debug log with a call site given at run time
      * @param file filename where log generates
      * @param line line number where log generates
      * @param format the log content
      * @param ... additional arguments
     */
-    void Info(const std::string &file, size_t line, const std::string format, ...) {
+    void Debug(const std::string &file, size_t line, const std::string format, ...) {
+        if (level_.load(std::memory_order_relaxed) > LogLevel::value::DEBUG) return;
         va_list va;
         va_start(va, format);
-        char *ret;
-        int r = vasprintf(&ret, format.c_str(), va);
-        if (r == -1) {
-            perror("vasprintf failed!!!: ");
-        }
+        Logv(CallSite::Make(file.c_str(), line, "", LogLevel::value::DEBUG, nullptr), format.c_str(), va);
         va_end(va);
-        std::string single_log_data;
-        serialize(LogLevel::value::INFO, file, line, ret, single_log_data);
-        worker_->Push(single_log_data.c_str(), single_log_data.size()); // push formatted log to buffer
-        free(ret);
-        ret = nullptr;
     }
 
-    void Error(const std::string &file, size_t line, const std::string format, ...) {
+    void Info(const std::string &file, size_t line, const std::string format, ...) {
+        if (level_.load(std::memory_order_relaxed) > LogLevel::value::INFO) return;
         va_list va;
         va_start(va, format);
-        char *ret;
-        int r = vasprintf(&ret, format.c_str(), va);
-        if (r == -1) {
-            perror("vasprintf failed!!!: ");
-        }
+        Logv(CallSite::Make(file.c_str(), line, "", LogLevel::value::INFO, nullptr), format.c_str(), va);
         va_end(va);
-        std::string single_log_data;
-        serialize(LogLevel::value::ERROR, file, line, ret, single_log_data);
-        worker_->Push(single_log_data.c_str(), single_log_data.size()); // push formatted log to buffer
-        free(ret);
-        ret = nullptr;
     }
 
     void Warn(const std::string &file, size_t line, const std::string format, ...) {
+        if (level_.load(std::memory_order_relaxed) > LogLevel::value::WARN) return;
         va_list va;
         va_start(va, format);
-        char *ret;
-        int r = vasprintf(&ret, format.c_str(), va);
-        if (r == -1) {
-            perror("vasprintf failed!!!: ");
-        }
+        Logv(CallSite::Make(file.c_str(), line, "", LogLevel::value::WARN, nullptr), format.c_str(), va);
         va_end(va);
-        std::string single_log_data;
-        serialize(LogLevel::value::WARN, file, line, ret, single_log_data);
-        worker_->Push(single_log_data.c_str(), single_log_data.size()); // push formatted log to buffer
-        free(ret);
-        ret = nullptr;
     }
 
-    void Fatal(const std::string &file, size_t line, const std::string format, ...) {
+    void Error(const std::string &file, size_t line, const std::string format, ...) {
+        if (level_.load(std::memory_order_relaxed) > LogLevel::value::ERROR) return;
         va_list va;
         va_start(va, format);
-        char *ret;
-        int r = vasprintf(&ret, format.c_str(), va);
-        if (r == -1) {
-            perror("vasprintf failed!!!: ");
-        }
+        Logv(CallSite::Make(file.c_str(), line, "", LogLevel::value::ERROR, nullptr), format.c_str(), va);
         va_end(va);
-        std::string single_log_data;
-        serialize(LogLevel::value::FATAL, file, line, ret, single_log_data);
-        worker_->Push(single_log_data.c_str(), single_log_data.size()); // push formatted log to buffer
-        free(ret);
-        ret = nullptr;
     }
 
-    void Debug(const std::string &file, size_t line, const std::string format, ...) {
-        va_list va; // variable param
-        va_start(va, format); // using format to locate variable list
-        char *ret;
-        int r = vasprintf(&ret, format.c_str(), va); // using va to replace the symbol like %d, and ret store the final str
-        if (r == -1) {
-            perror("vasprintf failed!!!: ");
-        }
-        va_end(va); // pair with va_start for robustness
-        std::string single_log_data;
-        serialize(LogLevel::value::DEBUG, file, line, ret, single_log_data);
-        worker_->Push(single_log_data.c_str(), single_log_data.size()); // push formatted log to buffer
-        free(ret);
-        ret = nullptr;
+    void Fatal(const std::string &file, size_t line, const std::string format, ...) {
+        if (level_.load(std::memory_order_relaxed) > LogLevel::value::FATAL) return;
+        va_list va;
+        va_start(va, format);
+        Logv(CallSite::Make(file.c_str(), line, "", LogLevel::value::FATAL, nullptr), format.c_str(), va);
+        va_end(va);
     }
 
+    /**
+     * @brief Make every record logged so far visible in every flush
+     * @return handle that becomes ready when those records have been written to all flushes and their
+     * buffers written out, see LogFlush::Fflush()
+     * @details Built on the workers' sequence numbers, logging from other threads goes on meanwhile.
+    */
+    FlushHandle Flush() { return Barrier(false); }
+
+    /**
+     * @brief Make every record logged so far durable in every flush
+     * @return handle that becomes ready when those records have been written and the flushes synced
+    */
+    FlushHandle Sync() { return Barrier(true); }
+
     /**
      * @brief Get the logger name
      * @return logger name
     */
     std::string Name() { return logger_name_; }
 
+    /**
+     * @brief Set the minimum level of the records to log, takes effect immediately
+     * @param level the level
+    */
+    void SetLevel(LogLevel::value level) { level_.store(level, std::memory_order_relaxed); }
+
+    /**
+     * @brief Get the minimum level of the records to log
+    */
+    LogLevel::value Level() { return level_.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Replace the flushes of the logger
+     * @param flushes the new flushes, cloned per shard in PER_SHARD_FILE mode
+     * @details Consumers pick the flushes once per batch, so every record goes to either the old or the
+     * new set, never both or none. The old set is destroyed once the last batch using it is written.
+    */
+    void SetFlushes(const std::vector<LogFlush::ptr> &flushes) {
+        auto set = std::make_shared<FlushSet>();
+        set->all = flushes;
+        for (size_t i = 0; i < flushes.size(); i++) {
+            set->latency.push_back(Metrics::Get().GetHistogram("asynlog_flush_seconds", "Time to write one batch to a sink",
+                Metrics::Labels({{"logger", logger_name_}, {"sink", std::to_string(i)},
+                                 {"type", flushes[i] ? flushes[i]->Type() : "none"}})));
+        }
+        if (shard_count_ > 1 && shard_mode_ == ShardMode::PER_SHARD_FILE) {
+            for (size_t i = 0; i < shard_count_; i++) {
+                std::vector<LogFlush::ptr> own;
+                for (auto &e : flushes) {
+                    auto clone = e ? e->Clone(i) : nullptr;
+                    own.push_back(clone ? clone : e); // flushes without a file, e.g. stdout, are shared
+                }
+                set->shards.push_back(own);
+            }
+        }
+        // the agent finds ERROR/FATAL lines by the [LEVEL] of the default layout, other layouts back up here
+        bool agent = false;
+        if (format_ == LogFormat::TEXT && layout_.Pattern() == PatternLayout::DefaultPattern()) {
+            for (auto &e : flushes) agent = agent || (e && strcmp(e->Type(), "shm") == 0);
+        }
+        std::lock_guard<std::mutex> lock(flush_mtx_);
+        flush_set_ = set;
+        flush_set_raw_.store(set.get(), std::memory_order_release);
+        agent_backups_.store(agent, std::memory_order_relaxed);
+    }
+
 protected:
     
     /**
-     * @brief Serialize the log message and push it to the worker
+     * @brief Format a printf style record and push it to the worker
+     * @param site the call site
+     * @param format the format string
+     * @param va the arguments
+     * @note The message is formatted into a thread_local string, which only grows for longer messages.
+    */
+    void Logv(const CallSite &site, const char *format, va_list va) {
+        thread_local std::string msg;
+        msg.resize(msg.capacity());
+        va_list copy;
+        va_copy(copy, va);
+        int n = vsnprintf(&msg[0], msg.size() + 1, format, copy);
+        va_end(copy);
+        if (n < 0) {
+            perror("vsnprintf failed!!!: ");
+            return;
+        }
+        if (static_cast<size_t>(n) > msg.size()) {
+            msg.resize(n);
+            vsnprintf(&msg[0], n + 1, format, va);
+        }
+        msg.resize(n);
+        thread_local std::string data;
+        data.clear();
+        Render(site, msg.data(), msg.size(), nullptr, 0, data);
+        Emit(site.level, data);
+    }
+
+    /**
+     * @brief Back up and push a formatted record
      * @param level log level
-     * @param file name of the file which log
-     * @param line line number of the log
-     * @param ret the log message
-    */
-    void serialize(LogLevel::value level, const std::string &file, size_t line, char *ret, std::string &data) {
-        LogMessage msg(level, file, line, logger_name_, ret);
-        data = msg.format();
-        if (level == LogLevel::value::FATAL || level == LogLevel::value::ERROR) {
-            try {
-                auto ret = tp->enqueue(start_log_backup, data);
-                ret.get();
+     * @param data the formatted record
+     * @note A FATAL record waits until it is synced, except on a library thread, e.g. a flush or a pool task
+     * that logs, whose wait could need the thread itself.
+    */
+    void Emit(LogLevel::value level, const std::string &data) {
+        PostBackup(level, data);
+        Push(data); // push formatted log to buffer
+        if (level == LogLevel::value::FATAL && !ThreadOptions::LibraryThread()) {
+            Sync().wait(); // the process is likely to die next, so drain to disk before returning
+        }
+    }
+
+    /**
+     * @brief Append a record in the layout of the logger
+     * @param site the call site
+     * @param msg the message
+     * @param msg_len length of the message
+     * @param fields structured fields
+     * @param nfields number of fields
+     * @param data the string to append to
+     * @note The context fields of the thread come from the LogContext cache, not rendered per record.
+    */
+    void Render(const CallSite &site, const char *msg, size_t msg_len, const Field *fields, size_t nfields, std::string &data) {
+        LogContext &ctx = LogContext::Current();
+        if (format_ == LogFormat::JSON) {
+            LogMessage::FormatJson(data, site.level, Util::Date::Now(), site.basename, site.line, logger_name_,
+                                   msg, msg_len, fields, nfields, ctx.Empty() ? nullptr : &ctx);
+            return;
+        }
+        layout_.Format(data, PatternLayout::Record{&site, PatternLayout::Now(), &logger_name_, msg, msg_len, fields, nfields,
+                                                   ctx.Empty() ? nullptr : &ctx.Text()});
+    }
+
+    /**
+     * @brief Send ERROR and FATAL records to the backup server through the thread pool
+     * @param level log level
+     * @param data the formatted record
+     * @note Not with a shm flush and the default text layout: the log agent forwards the records it drains,
+     * see LogAgent. With JSON or a custom pattern the agent cannot tell the level, so they are backed up here. With coalescing
+     * on, the backups are collapsed like the log, a run is sent as its first record and a count.
+    */
+    void PostBackup(LogLevel::value level, const std::string &data) {
+        if (agent_backups_.load(std::memory_order_relaxed)) return; // the agent forwards them from the ring
+        if (level != LogLevel::value::FATAL && level != LogLevel::value::ERROR) return;
+        if (!backup_coalescer_) {
+            PostBackupTask(level, data);
+            return;
+        }
+        backup_coalescer_->Filter(data.data(), data.size(), [&](Buffer &out) {
+            PostBackupTask(level, std::string(out.Begin(), out.ReadableSize()));
+        });
+    }
+
+    /**
+     * @brief Post a backup task to the thread pool
+     * @param level level of the record, FATAL backups jump ahead of queued ERROR backups
+     * @param data the lines to back up
+    */
+    void PostBackupTask(LogLevel::value level, const std::string &data) {
+        try {
+            tp->post(level == LogLevel::value::FATAL ? TaskPriority::HIGH : TaskPriority::NORMAL,
+                     start_log_backup, data);
+        }
+        catch (const ThreadPoolFull &e) {
+            backups_dropped_->Add();
+            std::cout << __FILE__ << __LINE__ << "thread pool full, backup rejected" << std::endl;
+        }
+        catch (const std::runtime_error &e) {
+            std::cout << __FILE__ << __LINE__ << "thread pool closed" << std::endl;
+        }
+    }
+
+    /**
+     * @brief Place a barrier behind the records logged so far
+     * @param sync whether to sync every flush once the barrier is reached, else only write out their buffers
+     * @return handle that becomes ready when the barrier is reached
+     * @details Every worker runs the barrier callback on its consumer once its earlier records are
+     * flushed; the last one completes the handle, through the merge stage in ORDERED_MERGE mode.
+     * In PER_SHARD_FILE mode each consumer drains and syncs its own shard's files in its callback, only
+     * that consumer may touch them, e.g. a RollFileFlush may be switching files; the last one does the
+     * shared flushes.
+    */
+    FlushHandle Barrier(bool sync) {
+        struct State {
+            std::promise<void> done;
+            std::atomic<size_t> remaining;
+        };
+        auto state = std::make_shared<State>();
+        state->remaining = workers_.size();
+        FlushHandle handle = state->done.get_future().share();
+        auto finish = [this, state, sync]() {
+            auto set = CurrentFlushes();
+            if (set->shards.empty()) {
+                DrainCoalescer(0, *set); // repeats counted so far are part of what the barrier covers
             }
-            catch (const std::runtime_error &e) {
-                std::cout << __FILE__ << __LINE__ << "thread pool closed" << std::endl;
+            DrainBackupCoalescer();
+            SyncFlushes(set->all, nullptr, sync);
+            state->done.set_value();
+        };
+        for (size_t i = 0; i < workers_.size(); i++) {
+            workers_[i]->Barrier([this, state, finish, sync, i]() {
+                auto set = CurrentFlushes();
+                if (i < set->shards.size()) {
+                    DrainCoalescer(i, *set);
+                    SyncFlushes(set->shards[i], &set->all, sync);
+                }
+                if (state->remaining.fetch_sub(1) != 1) return;
+                if (merger_) {
+                    merger_->Barrier(finish);
+                } else {
+                    finish();
+                }
+            });
+        }
+        return handle;
+    }
+
+    /**
+     * @brief Write out the buffers of flushes, and make them durable if asked
+     * @param flushes the flushes
+     * @param shared skip the flushes that are also in it, the shared ones of a shard; null for none
+     * @param durable Sync() instead of Fflush()
+    */
+    void SyncFlushes(const std::vector<LogFlush::ptr> &flushes, const std::vector<LogFlush::ptr> *shared, bool durable) {
+        for (size_t i = 0; i < flushes.size(); i++) {
+            if (!flushes[i] || (shared && i < shared->size() && flushes[i] == (*shared)[i])) continue;
+            if (durable) {
+                flushes[i]->Sync();
+            } else {
+                flushes[i]->Fflush();
             }
         }
     }
 
+    /**
+     * @brief Get the current flushes
+    */
+    std::shared_ptr<const FlushSet> CurrentFlushes() {
+        std::lock_guard<std::mutex> lock(flush_mtx_);
+        return flush_set_;
+    }
+
+    /**
+     * @brief Write the pending data of a logger to its flushes, called by the crash handler
+     * @param self the logger
+     * @param sig the fatal signal
+     * @param frames the backtrace of the crashing thread
+     * @param nframes the number of frames
+     * @details Async-signal-safe: only write(2) on the flushes' file descriptors, no locks. Every shard writes
+     * its pending data, the backtrace goes once to every distinct descriptor, e.g. once to a shared stdout.
+    */
+    static void CrashDump(void *self, int sig, void *const *frames, int nframes) {
+        AsynLogger *logger = static_cast<AsynLogger *>(self);
+        const FlushSet *set = logger->flush_set_raw_.load(std::memory_order_acquire);
+        if (set == nullptr) return;
+        auto written_before = [&](size_t stream, int fd) { // by the flushes of an earlier shard
+            for (size_t i = 0; i < stream && i < set->shards.size(); i++) {
+                for (auto &e : set->shards[i]) {
+                    if (e && e->Fd() == fd) return true;
+                }
+            }
+            return false;
+        };
+        // workers are passed as a pointer range, building a vector here would allocate
+        auto dump_to = [&](size_t stream, const std::vector<LogFlush::ptr> &flushes, const AsynWorker::ptr *first, const AsynWorker::ptr *last) {
+            for (auto &e : flushes) {
+                int fd = e ? e->Fd() : -1;
+                if (fd < 0) continue;
+                logger->CrashSummary(fd, stream);
+                for (auto w = first; w != last; ++w) {
+                    const char *consumer, *producer;
+                    size_t consumer_len, producer_len;
+                    (*w)->PendingForCrash(&consumer, &consumer_len, &producer, &producer_len);
+                    logger->CrashWrite(fd, consumer, consumer_len);
+                    logger->CrashWrite(fd, producer, producer_len);
+                }
+                if (logger->merger_) {
+                    const char *staged;
+                    size_t staged_len;
+                    logger->merger_->StagedForCrash(&staged, &staged_len);
+                    CrashHandler::WriteAll(fd, staged, staged_len);
+                }
+                if (written_before(stream, fd)) continue;
+                const char *name = CrashHandler::SignalName(sig);
+                CrashHandler::WriteAll(fd, "*** fatal signal ", 17);
+                CrashHandler::WriteAll(fd, name, strlen(name));
+                CrashHandler::WriteAll(fd, ", backtrace:\n", 13);
+                backtrace_symbols_fd(frames, nframes, fd);
+            }
+        };
+        if (set->shards.empty()) {
+            dump_to(0, set->all, logger->workers_.data(), logger->workers_.data() + logger->workers_.size());
+            return;
+        }
+        for (size_t i = 0; i < logger->workers_.size() && i < set->shards.size(); i++) {
+            dump_to(i, set->shards[i], &logger->workers_[i], &logger->workers_[i] + 1);
+        }
+    }
+
+    /**
+     * @brief Write the repeat count the coalescer of a stream holds back to fd, as DrainCoalescers() would
+     * @param fd the file descriptor of a flush
+     * @param stream index of the output stream
+    */
+    void CrashSummary(int fd, size_t stream) {
+        if (stream >= coalescers_.size()) return;
+        coalescers_[stream]->SummaryForCrash([fd](const char *data, size_t len) { CrashHandler::WriteAll(fd, data, len); });
+    }
+
+    /**
+     * @brief Write pending worker data to fd, dropping the merge headers in ORDERED_MERGE mode
+    */
+    void CrashWrite(int fd, const char *data, size_t len) {
+        if (!merger_) {
+            CrashHandler::WriteAll(fd, data, len);
+            return;
+        }
+        while (len >= sizeof(ShardRecordHeader)) {
+            ShardRecordHeader head;
+            memcpy(&head, data, sizeof(head));
+            if (len < sizeof(head) + head.len) return;
+            CrashHandler::WriteAll(fd, data + sizeof(head), head.len);
+            data += sizeof(head) + head.len;
+            len -= sizeof(head) + head.len;
+        }
+    }
+
+    /**
+     * @brief Push a formatted log to the worker of the calling thread
+     * @param data the formatted log
+     * @details A thread always uses the same shard, so its own records never reorder.
+     * In ORDERED_MERGE mode the record is framed with a sequence number for the merge stage.
+    */
+    void Push(const std::string &data) {
+        records_in_->Add();
+        bytes_in_->Add(data.size());
+        if (workers_.size() == 1) {
+            workers_[0]->Push(data.c_str(), data.size());
+            return;
+        }
+        auto &worker = workers_[Util::Thread::Index() % workers_.size()];
+        if (merger_) {
+            ShardRecordHeader head{0, static_cast<uint32_t>(data.size())}; // seq is stamped under the worker lock
+            worker->Push(merger_->Sequence(), reinterpret_cast<const char *>(&head), sizeof(head), data.c_str(), data.size());
+        } else {
+            worker->Push(data.c_str(), data.size());
+        }
+    }
+
     /**
      * @brief the call back function for the worker to flush the log message
      * @param buffer buffer for the log message
     */
     void RealFlush (Buffer &buffer) {
-        if (flushes_.empty()) {
+        auto set = CurrentFlushes();
+        FlushTo(0, set->all, set->latency, buffer);
+    }
+
+    /**
+     * @brief write the log messages to the given flushes
+     * @param stream index of the output stream, the shard in PER_SHARD_FILE mode, else 0
+     * @param flushes flushes to write to
+     * @param latency where to record the time each flush takes
+     * @param buffer buffer for the log message
+    */
+    void FlushTo(size_t stream, const std::vector<LogFlush::ptr> &flushes, const std::vector<Histogram *> &latency, Buffer &buffer) {
+        if (flushes.empty()) {
+            return;
+        }
+        if (!coalescers_.empty()) {
+            coalescers_[stream]->Filter(buffer, [&](Buffer &out) { WriteFlushes(flushes, latency, out); });
+            return;
+        }
+        WriteFlushes(flushes, latency, buffer);
+    }
+
+    /**
+     * @brief Write the pending repeat counts of every stream to its flushes
+    */
+    void DrainCoalescers() {
+        if (coalescers_.empty()) {
+            return;
+        }
+        auto set = CurrentFlushes();
+        for (size_t i = 0; i < coalescers_.size(); i++) {
+            DrainCoalescer(i, *set);
+        }
+        DrainBackupCoalescer();
+    }
+
+    /**
+     * @brief Write the pending repeat count of a stream to its flushes
+     * @param stream index of the output stream
+     * @param set the current flushes
+    */
+    void DrainCoalescer(size_t stream, const FlushSet &set) {
+        if (stream >= coalescers_.size()) {
+            return;
+        }
+        const auto &flushes = set.shards.empty() ? set.all : set.shards[stream];
+        coalescers_[stream]->Drain([&](Buffer &out) { WriteFlushes(flushes, set.latency, out); });
+    }
+
+    /**
+     * @brief Back up the pending repeat count of the ERROR/FATAL backups
+    */
+    void DrainBackupCoalescer() {
+        if (!backup_coalescer_) {
             return;
         }
-        for (auto &e : flushes_) {
-            if (e) {
-                e->Flush(buffer.Begin(), buffer.ReadableSize());
+        backup_coalescer_->Drain([&](Buffer &out) {
+            PostBackupTask(LogLevel::value::ERROR, std::string(out.Begin(), out.ReadableSize()));
+        });
+    }
+
+    /**
+     * @brief Get the idle callback of a stream's consumer, it writes a repeat count older than the window
+     * and backs up a repeated backup count older than it
+     * @param stream index of the output stream
+     * @return empty if coalescing is off
+    */
+    idle_functor ExpireFunc(size_t stream) {
+        if (coalescers_.empty()) {
+            return nullptr;
+        }
+        return [this, stream]() {
+            auto set = CurrentFlushes();
+            const auto &flushes = set->shards.empty() ? set->all : set->shards[stream];
+            bool held = backup_coalescer_->Expire([&](Buffer &out) {
+                PostBackupTask(LogLevel::value::ERROR, std::string(out.Begin(), out.ReadableSize()));
+            });
+            return coalescers_[stream]->Expire([&](Buffer &out) { WriteFlushes(flushes, set->latency, out); }) || held;
+        };
+    }
+
+    /**
+     * @brief Write a batch to every flush and record how long each took
+    */
+    void WriteFlushes(const std::vector<LogFlush::ptr> &flushes, const std::vector<Histogram *> &latency, Buffer &buffer) {
+        for (size_t i = 0; i < flushes.size(); i++) {
+            if (flushes[i]) {
+                auto start = std::chrono::steady_clock::now();
+                flushes[i]->Flush(buffer.Begin(), buffer.ReadableSize());
+                latency[i]->Observe(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - start).count());
             }
         }
     }
+
+    /**
+     * @brief Get the metrics of the logger and its workers, and register the thread pool metrics once
+     * @return the metrics every worker of the logger records to
+    */
+    WorkerMetrics InitMetrics() {
+        static std::once_flag pool_once;
+        std::call_once(pool_once, []() {
+            auto &m = Metrics::Get();
+            m.AddCallback("asynlog_threadpool_queue_depth", "Backup tasks queued", "gauge", "",
+                          []() { return tp ? tp->stats().depth : 0.0; });
+            m.AddCallback("asynlog_threadpool_queue_high_water", "Most backup tasks ever queued", "gauge", "",
+                          []() { return tp ? tp->stats().high_water : 0.0; });
+            m.AddCallback("asynlog_threadpool_tasks_submitted_total", "Backup tasks accepted", "counter", "",
+                          []() { return tp ? tp->stats().submitted : 0.0; });
+            m.AddCallback("asynlog_threadpool_tasks_rejected_total", "Backup tasks refused by a full queue", "counter", "",
+                          []() { return tp ? tp->stats().rejected : 0.0; });
+            m.AddCallback("asynlog_threadpool_tasks_dropped_total", "Queued backup tasks dropped for higher priority ones", "counter", "",
+                          []() { return tp ? tp->stats().dropped : 0.0; });
+        });
+        auto &m = Metrics::Get();
+        std::string labels = Metrics::Labels({{"logger", logger_name_}});
+        records_in_ = m.GetCounter("asynlog_records_in_total", "Records logged", labels);
+        bytes_in_ = m.GetCounter("asynlog_bytes_in_total", "Bytes of the records logged", labels);
+        backups_dropped_ = m.GetCounter("asynlog_backups_dropped_total", "Backups the thread pool refused", labels);
+        WorkerMetrics wm;
+        wm.records_out = m.GetCounter("asynlog_records_out_total", "Records handed to the sinks", labels);
+        wm.bytes_out = m.GetCounter("asynlog_bytes_out_total", "Bytes handed to the sinks, with merge headers", labels);
+        wm.producer_wait = m.GetHistogram("asynlog_producer_wait_seconds", "Time producers blocked on a full buffer", labels);
+        wm.batch_high_water = m.GetMaxGauge("asynlog_batch_high_water_bytes", "Largest batch", labels);
+        wm.buffer_capacity = m.GetMaxGauge("asynlog_buffer_capacity_bytes", "Largest buffer allocation", labels);
+        return wm;
+    }
 };
 
 /**
@@ -205,6 +844,53 @@ public:
     */
     void BuildLoggerType(AsynType type) { asyn_type_ = type; }
 
+    /**
+     * @brief Build the logger shards
+     * @param count number of workers, each with its own buffers and consumer thread
+     * @param mode PER_SHARD_FILE gives every shard its own files, ORDERED_MERGE merges the shards by sequence
+    */
+    void BuildLoggerShards(size_t count, ShardMode mode = ShardMode::ORDERED_MERGE) {
+        shard_count_ = count;
+        shard_mode_ = mode;
+    }
+
+    /**
+     * @brief Build the logger level
+     * @param level minimum level of the records to log
+    */
+    void BuildLoggerLevel(LogLevel::value level) { level_ = level; }
+
+    /**
+     * @brief Build the logger buffer size
+     * @param size initial size of the worker buffers in bytes
+    */
+    void BuildLoggerBufferSize(size_t size) { buffer_size_ = size; }
+
+    /**
+     * @brief Build the logger duplicate coalescing
+     * @param window collapse runs of identical lines, holding a repeat count back at most this long, 0 for off
+    */
+    void BuildLoggerCoalesce(std::chrono::milliseconds window) { coalesce_window_ = window; }
+
+    /**
+     * @brief Build the logger record layout
+     * @param format LogFormat::TEXT or LogFormat::JSON lines
+    */
+    void BuildLoggerFormat(LogFormat format) { format_ = format; }
+
+    /**
+     * @brief Build the logger text layout
+     * @param pattern e.g. `%d{%H:%M:%S.%e} [%t] %l %n %s:%# %v`, see PatternLayout
+    */
+    void BuildLoggerPattern(const std::string &pattern) { pattern_ = pattern; }
+
+    /**
+     * @brief Build the logger consumer threads
+     * @param opts cores, scheduling policy, nice value and name of the consumer threads
+     * @note With several shards every consumer is pinned to one of the cores, see ThreadOptions::ForThread().
+    */
+    void BuildLoggerThread(const ThreadOptions &opts) { thread_opts_ = opts; }
+
     /**
      * @brief Build the logger flush
      * @param flush flush type
@@ -217,6 +903,12 @@ public:
         );
     }
 
+    /**
+     * @brief Build the logger flush from an existing flush object
+     * @param flush the flush, e.g. from LogFlushFactory::CreateFromConfig()
+    */
+    void BuildLoggerFlush(const LogFlush::ptr &flush) { flushes_.emplace_back(flush); }
+
     /**
      * @brief Build the logger
      * @return AsynLogger pointer
@@ -227,7 +919,8 @@ public:
             flushes_.emplace_back(std::make_shared<StdOutFlush>());
         }
         return std::make_shared<AsynLogger>(
-            logger_name_, asyn_type_, flushes_
+            logger_name_, asyn_type_, flushes_, shard_count_, shard_mode_, thread_opts_, level_, buffer_size_,
+            coalesce_window_, format_, pattern_
         );
     }
 protected:
@@ -235,5 +928,13 @@ protected:
     std::string logger_name_ = "async_logger";      // default logger name
     std::vector<asynlog::LogFlush::ptr> flushes_;   // vector for different Flush
     AsynType asyn_type_ = AsynType::ASYNC_SAFE;     // default async type
+    size_t shard_count_ = 1;                        // default one worker
+    ShardMode shard_mode_ = ShardMode::ORDERED_MERGE; // default merge shards into the same flushes
+    ThreadOptions thread_opts_;                     // default leave consumers to the scheduler
+    LogLevel::value level_ = LogLevel::value::DEBUG; // default log every level
+    size_t buffer_size_ = 0;                        // default buffer_size of the configuration
+    std::chrono::milliseconds coalesce_window_{0};  // default no duplicate coalescing
+    LogFormat format_ = LogFormat::TEXT;            // default text layout
+    std::string pattern_;                           // default PatternLayout::DefaultPattern()
 };
 } // namespace asynlog
\ No newline at end of file
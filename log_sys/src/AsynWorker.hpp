@@ -11,7 +11,15 @@
 #include <atomic> // for atomic
 #include <condition_variable> // for conditional_variable
 #include <thread> // for thread
+#include <chrono> // for milliseconds
+#include <vector> // for vector
+#include <limits> // for numeric_limits
+#include <cstring> // for memcpy
 #include "AsynBuffer.hpp" // for Buffer
+#include "ThreadAttr.hpp" // for ThreadOptions
+#include "Metrics.hpp" // for Counter, MaxGauge, Histogram
+#include "Util.hpp" // for JsonData
+extern asynlog::Util::JsonData* conf_data;
 
 namespace asynlog
 {
@@ -20,7 +28,26 @@ namespace asynlog
  * @param ASYNC_UNSAFE: Asynchronous unsafe
 */
 enum class AsynType { ASYNC_SAFE, ASYNC_UNSAFE };
+
+/**
+ * @param BUSY: consumer is swapping or flushing, producers need not notify
+ * @param WAIT_DATA: consumer sleeps on an empty buffer
+ * @param WAIT_BATCH: consumer sleeps until the wakeup threshold or the max flush delay
+*/
+enum class ConsumerState { BUSY, WAIT_DATA, WAIT_BATCH };
 using functor = std::function<void(Buffer&)>;
+using idle_functor = std::function<bool()>; // releases what the callback holds back, true while some is left
+
+/**
+ * @brief Metrics an AsynWorker records, every pointer may be null, workers of one logger share them
+*/
+struct WorkerMetrics {
+    Counter *records_out = nullptr;         // records handed to the callback
+    Counter *bytes_out = nullptr;           // bytes handed to the callback
+    Histogram *producer_wait = nullptr;     // time producers blocked on a full buffer
+    MaxGauge *batch_high_water = nullptr;   // largest batch in bytes
+    MaxGauge *buffer_capacity = nullptr;    // largest buffer allocation in bytes
+};
 
 /**
  * @brief Asynchronous worker class
@@ -39,17 +66,42 @@ public:
      * @brief AsynWorker constructor
      * @param cb The callback function to be called when the buffer is full
      * @param _type The type of asynchronous logging (safe or unsafe)
+     * @param opts The affinity, scheduling and name of the consumer thread
+     * @param buffer_size The initial size of both buffers, 0 for the configured buffer_size
+     * @param metrics Where to record the worker metrics
+     * @param idle Called when the consumer was idle for idle_interval after a batch, e.g. to write the
+     * repeat count a Coalescer holds back; the consumer keeps waking while it returns true
+     * @param idle_interval How long the consumer sleeps before it calls idle
      * @note 
      * 1. The constructor initializes the callback function and the type of asynchronous logging.
      * 
-     * 2. It also starts a new thread for the worker.
+     * 2. The wakeup threshold and the max flush delay are read from the configuration data.
+     * 
+     * 3. It also starts a new thread for the worker, after all members are initialized.
+     * 
+     * 4. If the consumer is pinned, the constructor waits until it has reallocated the buffers,
+     * so their pages are first touched on the consumer's NUMA node.
     */
-    AsynWorker(const functor& cb, AsynType _type = AsynType::ASYNC_SAFE):
-        callback_(cb),
+    AsynWorker(const functor& cb, AsynType _type = AsynType::ASYNC_SAFE, const ThreadOptions& opts = ThreadOptions(),
+               size_t buffer_size = 0, const WorkerMetrics& metrics = WorkerMetrics(),
+               const idle_functor& idle = nullptr, std::chrono::milliseconds idle_interval = std::chrono::milliseconds(0)):
         asyn_type_(_type),
         stop_(false),
-        thread_(std::thread(&AsynWorker::ThreadEntry, this))
-        {}
+        buffer_producer_(buffer_size),
+        buffer_consumer_(buffer_size),
+        wakeup_threshold_(conf_data->wakeup_threshold),
+        max_flush_delay_(conf_data->max_flush_delay_ms),
+        callback_(cb),
+        idle_(idle),
+        idle_interval_(idle_interval),
+        thread_opts_(opts),
+        metrics_(metrics) {
+            thread_ = std::thread(&AsynWorker::ThreadEntry, this);
+            if (thread_opts_.Pinned()) {
+                std::unique_lock<std::mutex> lock(mtx_);
+                cond_producer_.wait(lock, [&](){ return started_; });
+            }
+        }
     
     /**
      * @brief AsynWorker destructor
@@ -64,49 +116,250 @@ public:
      * @brief Push data into the producer buffer
      * @param data The data to be pushed into the buffer
      * @param len The length of the data to be pushed
+     * @note The consumer is only notified when it sleeps and either the buffer turns
+     * non-empty (to arm the max flush delay timer) or the wakeup threshold is crossed,
+     * so most pushes under load cost no futex call.
     */
     void Push(const char* data, size_t len) { // producer
-        std::unique_lock<std::mutex> lock(mtx_);
-        if (asyn_type_ == AsynType::ASYNC_SAFE) {
-            cond_producer_.wait(lock, [&](){ // using lambda function to pred
-                return len <= buffer_producer_.WriteableSize();
-            });
+        Push(nullptr, 0, data, len);
+    }
+
+    /**
+     * @brief Push a header and its data into the producer buffer as one record
+     * @param head The header to be pushed in front of the data
+     * @param head_len The length of the header
+     * @param data The data to be pushed into the buffer
+     * @param len The length of the data to be pushed
+     * @note Both parts land in the same batch, which the sharded logger relies on.
+    */
+    void Push(const char* head, size_t head_len, const char* data, size_t len) { // producer
+        PushRecord(nullptr, head, head_len, data, len);
+    }
+
+    /**
+     * @brief Push a header and its data as one record, numbered from a counter shared by several workers
+     * @param seq The shared counter, read under the lock so the records of a worker are numbered in push order
+     * @param head The header, its first 8 bytes are replaced by the number in the buffer
+     * @param head_len The length of the header, at most kMaxStampedHead
+     * @param data The data to be pushed into the buffer
+     * @param len The length of the data to be pushed
+    */
+    void Push(std::atomic<uint64_t> &seq, const char* head, size_t head_len, const char* data, size_t len) { // producer
+        PushRecord(&seq, head, head_len, data, len);
+    }
+
+    /**
+     * @brief Get the lowest number not handed to the callback yet, see Push(seq, ...)
+     * @return the number, or kNoStamp when every numbered record has been handed over
+    */
+    uint64_t FirstPendingStamp() {
+        std::lock_guard<std::mutex> lock(mtx_);
+        return consumer_first_stamp_ != kNoStamp ? consumer_first_stamp_ : producer_first_stamp_;
+    }
+
+    static constexpr size_t kMaxStampedHead = 64;
+    static constexpr uint64_t kNoStamp = std::numeric_limits<uint64_t>::max();
+
+    /**
+     * @brief Request a callback once every record pushed so far has been flushed
+     * @param on_reached The callback, run on the consumer thread after the callback functor
+     * returned for the last of those records, or right away if there is nothing pending
+     * @note The barrier wakes the consumer at once instead of waiting for the max flush delay.
+     * Producers are not stopped, records pushed after the call do not delay the barrier.
+    */
+    void Barrier(std::function<void()> on_reached) {
+        {
+            std::unique_lock<std::mutex> lock(mtx_);
+            if (flushed_seq_ < pushed_seq_) {
+                barriers_.emplace_back(pushed_seq_, std::move(on_reached));
+                if (consumer_state_ != ConsumerState::BUSY) {
+                    consumer_state_ = ConsumerState::BUSY;
+                    lock.unlock();
+                    cond_consumer_.notify_one();
+                }
+                return;
+            }
         }
-        buffer_producer_.Push(data, len);
-        cond_consumer_.notify_one();
+        on_reached();
+    }
+
+    /**
+     * @brief Get the data not flushed yet, for the crash handler
+     * @param consumer set to the batch the consumer holds, may be partly written already
+     * @param consumer_len set to the length of that batch
+     * @param producer set to the data not swapped to the consumer yet
+     * @param producer_len set to the length of that data
+     * @note Takes no lock on purpose: it runs in a signal handler while other threads are frozen
+     * at arbitrary points, so the result is a best effort.
+    */
+    void PendingForCrash(const char **consumer, size_t *consumer_len, const char **producer, size_t *producer_len) {
+        *consumer_len = buffer_consumer_.ReadableSize();
+        *consumer = buffer_consumer_.Begin();
+        *producer_len = buffer_producer_.ReadableSize();
+        *producer = buffer_producer_.Begin();
     }
 
     /**
      * @brief Stop the worker thread
     */
     void Stop() {
-        stop_ = true;
+        {
+            std::lock_guard<std::mutex> lock(mtx_); // so the consumer cannot miss the wakeup
+            stop_ = true;
+        }
         cond_consumer_.notify_all();
-        thread_.join();
+        if (thread_.joinable()) { // Stop() may be called again by the destructor
+            thread_.join();
+        }
     }
 
 private:
     /**
      * @brief Consumer: Thread entry point
+     * @note
+     * 1. When the producer buffer is empty, the consumer sleeps until the first push, or for the idle
+     * interval if the callback may hold data back since the last batch.
+     * 
+     * 2. Then it waits until the buffer reaches the wakeup threshold, a producer blocks,
+     * or the max flush delay expires, whichever comes first, and swaps the whole batch.
     */
     void ThreadEntry() { // consumer
+        thread_opts_.Apply();
+        if (thread_opts_.Pinned()) {
+            std::lock_guard<std::mutex> lock(mtx_);
+            size_t size = buffer_producer_.WriteableSize();
+            buffer_producer_ = Buffer(size); // first touch from the pinned thread places the pages on its node
+            buffer_consumer_ = Buffer(size);
+            started_ = true;
+            cond_producer_.notify_all();
+        }
+        std::vector<std::function<void()>> reached;
+        bool holding = false; // the callback may hold data back, see idle_
         while (1) {
+            uint64_t batch_seq, batch_records;
             { // use {} to limit the scope of the lock
                 std::unique_lock<std::mutex> lock(mtx_);
-                cond_consumer_.wait(lock, [&](){ // wait for producer produces data
-                    return stop_ || !buffer_producer_.IsEmpty();
-                });
+                if (buffer_producer_.IsEmpty() && !stop_) {
+                    consumer_state_ = ConsumerState::WAIT_DATA;
+                    auto has_data = [&](){ return stop_ || !buffer_producer_.IsEmpty(); };
+                    if (!holding) {
+                        cond_consumer_.wait(lock, has_data); // wait for producer produces data
+                    } else if (!cond_consumer_.wait_for(lock, idle_interval_, has_data)) {
+                        consumer_state_ = ConsumerState::BUSY;
+                        lock.unlock();
+                        holding = idle_();
+                        continue;
+                    }
+                }
+                if (!stop_ && producers_waiting_ == 0 && barriers_.empty() && buffer_producer_.ReadableSize() < wakeup_threshold_) {
+                    consumer_state_ = ConsumerState::WAIT_BATCH;
+                    cond_consumer_.wait_for(lock, max_flush_delay_, [&](){ // batch until threshold or delay
+                        return stop_ || producers_waiting_ > 0 || !barriers_.empty() ||
+                               buffer_producer_.ReadableSize() >= wakeup_threshold_;
+                    });
+                }
+                consumer_state_ = ConsumerState::BUSY;
                 buffer_producer_.Swap(buffer_consumer_); // swap buffer
-                if (asyn_type_ == AsynType::ASYNC_SAFE) {
-                    cond_producer_.notify_one();
+                consumer_first_stamp_ = producer_first_stamp_;
+                producer_first_stamp_ = kNoStamp;
+                batch_seq = pushed_seq_;
+                batch_records = batch_seq - flushed_seq_;
+                if (asyn_type_ == AsynType::ASYNC_SAFE && producers_waiting_ > 0) {
+                    cond_producer_.notify_all();
                 }
             }
-            if (buffer_consumer_.ReadableSize() > 0) {
+            size_t batch_bytes = buffer_consumer_.ReadableSize();
+            if (batch_bytes > 0) {
                 callback_(buffer_consumer_);
+                RecordBatch(batch_records, batch_bytes);
                 buffer_consumer_.Reset();
-            }            
-            if (stop_ && buffer_producer_.IsEmpty()) return; // when stop and there is no data in producer buffer, return
+                holding = idle_ != nullptr;
+            }
+            bool done;
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                flushed_seq_ = batch_seq;
+                consumer_first_stamp_ = kNoStamp; // the callback has taken the numbered records
+                TakeReached(reached);
+                done = stop_ && buffer_producer_.IsEmpty(); // when stop and there is no data in producer buffer, return
+            }
+            for (auto &cb : reached) {
+                cb();
+            }
+            reached.clear();
+            if (done) return;
+        }
+    }
+
+    /**
+     * @brief Push a record, numbering it from seq when that is set, see the public Push()
+    */
+    void PushRecord(std::atomic<uint64_t> *seq, const char* head, size_t head_len, const char* data, size_t len) { // producer
+        size_t total = head_len + len;
+        std::unique_lock<std::mutex> lock(mtx_);
+        if (asyn_type_ == AsynType::ASYNC_SAFE && total > buffer_producer_.WriteableSize()) {
+            ++producers_waiting_; // the consumer swaps at once when a producer is blocked
+            if (consumer_state_ != ConsumerState::BUSY) {
+                consumer_state_ = ConsumerState::BUSY;
+                cond_consumer_.notify_one();
+            }
+            auto wait_start = std::chrono::steady_clock::now();
+            cond_producer_.wait(lock, [&](){ // using lambda function to pred
+                return total <= buffer_producer_.WriteableSize();
+            });
+            --producers_waiting_;
+            if (metrics_.producer_wait) {
+                metrics_.producer_wait->Observe(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - wait_start).count());
+            }
+        }
+        if (seq != nullptr) {
+            assert(head_len >= sizeof(uint64_t) && head_len <= kMaxStampedHead);
+            char stamped[kMaxStampedHead];
+            memcpy(stamped, head, head_len);
+            uint64_t stamp = seq->fetch_add(1, std::memory_order_relaxed);
+            memcpy(stamped, &stamp, sizeof(stamp));
+            buffer_producer_.Push(stamped, head_len);
+            if (producer_first_stamp_ == kNoStamp) {
+                producer_first_stamp_ = stamp;
+            }
+        } else if (head_len > 0) {
+            buffer_producer_.Push(head, head_len);
+        }
+        buffer_producer_.Push(data, len);
+        ++pushed_seq_;
+        if (consumer_state_ == ConsumerState::WAIT_DATA ||
+           (consumer_state_ == ConsumerState::WAIT_BATCH && buffer_producer_.ReadableSize() >= wakeup_threshold_)) {
+            consumer_state_ = ConsumerState::BUSY; // avoid duplicate notify before the consumer runs
+            lock.unlock();
+            cond_consumer_.notify_one();
+        }
+    }
+
+    /**
+     * @brief Record the metrics of a flushed batch
+    */
+    void RecordBatch(uint64_t records, size_t bytes) {
+        if (metrics_.records_out) metrics_.records_out->Add(records);
+        if (metrics_.bytes_out) metrics_.bytes_out->Add(bytes);
+        if (metrics_.batch_high_water) metrics_.batch_high_water->Update(bytes);
+        if (metrics_.buffer_capacity) {
+            metrics_.buffer_capacity->Update(buffer_consumer_.ReadableSize() + buffer_consumer_.WriteableSize());
+        }
+    }
+
+    /**
+     * @brief Move the barriers whose records have all been flushed out of barriers_
+     * @param reached The callbacks of the reached barriers, in the order they were requested
+     * @note Must be called with mtx_ held.
+    */
+    void TakeReached(std::vector<std::function<void()>> &reached) {
+        size_t n = 0;
+        while (n < barriers_.size() && barriers_[n].first <= flushed_seq_) {
+            reached.push_back(std::move(barriers_[n].second));
+            n++;
         }
+        barriers_.erase(barriers_.begin(), barriers_.begin() + n);
     }
 
 private:
@@ -117,8 +370,22 @@ private:
     asynlog::Buffer buffer_consumer_;
     std::condition_variable cond_producer_; // two cv for producer and consumer
     std::condition_variable cond_consumer_;
-    std::thread thread_;                    // one thread for consumer
+    ConsumerState consumer_state_ = ConsumerState::BUSY; // guarded by mtx_
+    uint64_t pushed_seq_ = 0;               // records pushed, guarded by mtx_
+    uint64_t flushed_seq_ = 0;              // records handed to the callback and flushed, guarded by mtx_
+    std::vector<std::pair<uint64_t, std::function<void()>>> barriers_; // target seq and callback, guarded by mtx_
+    uint64_t producer_first_stamp_ = kNoStamp; // lowest number in buffer_producer_, guarded by mtx_
+    uint64_t consumer_first_stamp_ = kNoStamp; // lowest number in buffer_consumer_, guarded by mtx_
+    size_t producers_waiting_ = 0;          // producers blocked on a full buffer, guarded by mtx_
+    size_t wakeup_threshold_;               // bytes that wake the consumer before the delay expires
+    std::chrono::milliseconds max_flush_delay_; // worst-case time a record waits in the producer buffer
     functor callback_;                      // the functor to be excuited if there are something in consumer buffer
+    idle_functor idle_;                     // releases what callback_ holds back, may be empty
+    std::chrono::milliseconds idle_interval_; // idle time before idle_ is called
+    ThreadOptions thread_opts_;             // affinity, scheduling and name of the consumer
+    WorkerMetrics metrics_;                 // where to record the metrics
+    bool started_ = false;                  // pinned consumer has allocated its buffers, guarded by mtx_
+    std::thread thread_;                    // one thread for consumer, started last
 };
 
 } // namespace asynlog
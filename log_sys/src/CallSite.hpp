@@ -0,0 +1,63 @@
+/**
+ * @file CallSite.hpp
+ * @brief CallSite struct: the static, compile time part of a log call, made once per call site by ASYNLOG_SITE.
+ * @author bhhxx
+ * @date 2025-06-16
+*/
+#pragma once
+#include <cstdint> // for uint32_t
+#include "Level.hpp" // for LogLevel
+
+namespace asynlog
+{
+/**
+ * @brief Get the part of a path after the last '/'
+ * @param path the path
+ * @return a pointer into path
+ * @note constexpr, so for __FILE__ it is computed by the compiler.
+*/
+constexpr const char *Basename(const char *path) {
+    const char *base = path;
+    for (const char *p = path; *p; p++) {
+        if (*p == '/') base = p + 1;
+    }
+    return base;
+}
+
+/**
+ * @brief CallSite struct
+ * @note
+ * 1. The log macros of AsynLog.hpp put one `static constexpr` CallSite in the binary per call site and
+ * pass a pointer to it, so a call builds no file name string and the basename is never searched for.
+ *
+ * 2. Its address identifies the call site for as long as the process runs, e.g. as a key for sampling.
+*/
+struct CallSite {
+    const char *file;       // source file as given by __FILE__
+    const char *basename;   // source file without directories, points into file
+    uint32_t line;          // source line
+    const char *function;   // enclosing function
+    LogLevel::value level;  // level of the call
+    const char *format;     // format string, or the message of a structured call
+
+    /**
+     * @brief Make a call site, at compile time in ASYNLOG_SITE or at run time for calls without the macros
+    */
+    static constexpr CallSite Make(const char *file, uint32_t line, const char *function,
+                                   LogLevel::value level, const char *format) {
+        return CallSite{file, Basename(file), line, function, level, format};
+    }
+};
+} // namespace asynlog
+
+/**
+ * @brief Pointer to the static CallSite of the current source line
+ * @param lv DEBUG, INFO, WARN, ERROR or FATAL
+ * @param fmt the format string, a string literal
+ * @note A GNU statement expression, like the ##__VA_ARGS__ of the log macros it is understood by g++ and clang.
+*/
+#define ASYNLOG_SITE(lv, fmt) ({ \
+        static constexpr asynlog::CallSite asynlog_call_site = \
+            asynlog::CallSite::Make(__FILE__, __LINE__, __func__, asynlog::LogLevel::value::lv, fmt); \
+        &asynlog_call_site; \
+    })
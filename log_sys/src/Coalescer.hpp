@@ -0,0 +1,219 @@
+/**
+ * @file Coalescer.hpp
+ * @brief Coalescer class: collapse runs of identical log lines into one line and a repeat count.
+ * @author bhhxx
+ * @date 2025-06-13
+*/
+#pragma once
+#include <string> // for string
+#include <mutex> // for mutex
+#include <chrono> // for steady_clock
+#include <cstring> // for memchr, memcmp
+#include <algorithm> // for search
+#include "AsynBuffer.hpp" // for Buffer
+#include "Metrics.hpp" // for Counter
+
+namespace asynlog
+{
+/**
+ * @brief Coalescer class
+ * @note
+ * 1. Lines are compared by the text after the first '\t', the payload, and by the header before it without
+ * its leading [time][tid] fields of the default pattern, so the level, logger and call site file:line must
+ * match while the time and thread may differ.
+ * Only the previous line is kept, so a line costs a length compare and, if the lengths match, a memcmp.
+ * JSON lines are split before the "level" member instead, so ts and tid are the header.
+ *
+ * 2. The first line of a run is written, the repeats are counted. The run ends with a line
+ * `<header of the last repeat>\tlast message repeated N times` when a different line arrives, and at
+ * the end of a batch once the run is older than the window, so nothing is reordered and a count
+ * waits at most one window plus one batch. An idle consumer calls Expire() after a window, so a count
+ * is not held while nothing is logged. A JSON run ends with a record like its last repeat, with the msg
+ * "last message repeated N times" and a member "repeated": N instead of the message and its fields.
+ *
+ * 3. Fed by one consumer, the mutex orders it with Drain() from a barrier or the destructor. The backups of
+ * a logger are coalesced by producers, which take turns on the mutex.
+*/
+class Coalescer {
+public:
+    /**
+     * @brief Coalescer constructor
+     * @param window How long a repeat count may be held back
+     * @param json Whether the lines are JSON records, see LogFormat
+     * @param collapsed Where to count the collapsed repeats, null for asynlog_records_coalesced_total
+    */
+    explicit Coalescer(std::chrono::milliseconds window, bool json = false, Counter *collapsed = nullptr) :
+        window_(window),
+        json_(json),
+        out_(64 * 1024),
+        collapsed_(collapsed ? collapsed : Metrics::Get().GetCounter("asynlog_records_coalesced_total",
+                                                                     "Repeated lines collapsed into a count")) {}
+
+    /**
+     * @brief Filter a batch
+     * @param in The batch of formatted lines
+     * @param write Called with the lines to write, under the lock so a concurrent Drain() comes before or after
+    */
+    template <class Write>
+    void Filter(Buffer &in, Write write) {
+        Filter(in.Begin(), in.ReadableSize(), write);
+    }
+
+    /**
+     * @brief Filter formatted lines, e.g. a single record
+    */
+    template <class Write>
+    void Filter(const char *data, size_t len, Write write) {
+        std::lock_guard<std::mutex> lock(mtx_);
+        out_.Reset();
+        const char *p = data;
+        const char *end = p + len;
+        while (p < end) {
+            const char *nl = static_cast<const char *>(memchr(p, '\n', end - p));
+            const char *line_end = nl ? nl + 1 : end;
+            const char *key = KeyOf(p, line_end);
+            size_t key_len = line_end - key;
+            if (key_len == last_.size() && memcmp(key, last_.data(), key_len) == 0 && SameHeader(p, key - p)) {
+                if (repeats_ == 0) run_start_ = std::chrono::steady_clock::now();
+                repeats_++;
+            } else {
+                EmitSummary();
+                out_.Push(p, line_end - p);
+                last_.assign(key, key_len);
+            }
+            header_.assign(p, key - p);
+            p = line_end;
+        }
+        if (repeats_ > 0 && std::chrono::steady_clock::now() - run_start_ >= window_) {
+            EmitSummary();
+        }
+        if (out_.ReadableSize() > 0) write(out_);
+    }
+
+    /**
+     * @brief Emit the repeat count of the current run once it is older than the window
+     * @param write Called with the summary line if it was emitted
+     * @return true while a run is held back
+    */
+    template <class Write>
+    bool Expire(Write write) {
+        std::lock_guard<std::mutex> lock(mtx_);
+        if (repeats_ == 0 || std::chrono::steady_clock::now() - run_start_ < window_) return repeats_ > 0;
+        out_.Reset();
+        EmitSummary();
+        write(out_);
+        return false;
+    }
+
+    /**
+     * @brief Emit the repeat count of the current run, if any
+     * @param write Called with the summary line if there was a run
+    */
+    template <class Write>
+    void Drain(Write write) {
+        std::lock_guard<std::mutex> lock(mtx_);
+        out_.Reset();
+        EmitSummary();
+        if (out_.ReadableSize() > 0) write(out_);
+    }
+
+    /**
+     * @brief Write the summary of the run held back, for the crash handler
+     * @param put Called as `put(const char *data, size_t len)` with the pieces of the line, nothing without a run
+     * @note Takes no lock and allocates nothing, it runs in a signal handler; the result is a best effort.
+    */
+    template <class Put>
+    void SummaryForCrash(Put put) const {
+        if (repeats_ > 0) Summary(put);
+    }
+
+private:
+    /**
+     * @brief Get where the compared payload of a line starts, the header is before it
+    */
+    const char *KeyOf(const char *p, const char *line_end) const {
+        if (json_) { // {"ts":...,"tid":...,"level":...
+            static const char kLevel[] = "\"level\":";
+            const char *key = std::search(p, line_end, kLevel, kLevel + sizeof(kLevel) - 1);
+            return key != line_end ? key : p;
+        }
+        const char *tab = static_cast<const char *>(memchr(p, '\t', line_end - p));
+        return tab ? tab + 1 : p;
+    }
+
+    /**
+     * @brief Check if a header matches the previous line's header, time and thread aside
+     * @note A JSON header only holds ts and tid, the level and call site are part of the payload.
+    */
+    bool SameHeader(const char *h, size_t len) const {
+        if (json_) return true;
+        const char *a = SkipTimeAndThread(h, h + len), *a_end = h + len;
+        const char *b = SkipTimeAndThread(header_.data(), header_.data() + header_.size()), *b_end = header_.data() + header_.size();
+        return a_end - a == b_end - b && memcmp(a, b, a_end - a) == 0;
+    }
+
+    /**
+     * @brief Skip the leading [time][tid] fields of a header
+    */
+    static const char *SkipTimeAndThread(const char *p, const char *end) {
+        for (int field = 0; field < 2 && p < end && *p == '['; field++) {
+            const char *close = static_cast<const char *>(memchr(p, ']', end - p));
+            if (close == nullptr) break;
+            p = close + 1;
+        }
+        return p;
+    }
+
+    /**
+     * @brief Append the summary of the current run to out_, the next repeat starts a new count
+    */
+    void EmitSummary() {
+        if (repeats_ == 0) return;
+        Summary([this](const char *data, size_t len) { out_.Push(data, len); });
+        collapsed_->Add(repeats_);
+        repeats_ = 0;
+    }
+
+    /**
+     * @brief Put the summary line of the current run in pieces, without allocating
+    */
+    template <class Put>
+    void Summary(Put put) const {
+        char num[20];
+        size_t n = sizeof(num);
+        uint64_t r = repeats_;
+        do {
+            num[--n] = static_cast<char>('0' + r % 10);
+            r /= 10;
+        } while (r > 0 && n > 0);
+        auto text = [&](const char *s) { put(s, strlen(s)); };
+        put(header_.data(), header_.size());
+        if (!json_) {
+            text("last message repeated ");
+            put(num + n, sizeof(num) - n);
+            text(" times\n");
+            return;
+        }
+        size_t msg = last_.find(",\"msg\":"); // level, logger, file and line come before it
+        if (msg != std::string::npos) {
+            put(last_.data(), msg + 1);
+        }
+        text("\"msg\":\"last message repeated ");
+        put(num + n, sizeof(num) - n);
+        text(" times\",\"repeated\":");
+        put(num + n, sizeof(num) - n);
+        text("}\n");
+    }
+
+private:
+    std::mutex mtx_;
+    std::chrono::milliseconds window_;      // longest time a count is held back
+    bool json_;                             // the lines are JSON records
+    Buffer out_;                            // filtered lines of the last call
+    std::string last_;                      // payload of the previous line, with its '\n'
+    std::string header_;                    // time, thread, level and call site of the previous line, with the '\t'
+    uint64_t repeats_ = 0;                  // repeats of last_ not reported yet
+    std::chrono::steady_clock::time_point run_start_; // when the first unreported repeat arrived
+    Counter *collapsed_;                    // repeats collapsed so far
+};
+} // namespace asynlog
@@ -0,0 +1,113 @@
+/**
+ * @file ConfigWatcher.hpp
+ * @brief ConfigWatcher class: call back when a configuration file is rewritten, based on inotify.
+ * @author bhhxx
+ * @date 2025-06-09
+*/
+#pragma once
+#include <string> // for string
+#include <thread> // for thread
+#include <functional> // for function
+#include <iostream> // for cout
+#include <cstring> // for strerror
+#include <cerrno> // for errno
+#include <poll.h> // for poll
+#include <unistd.h> // for pipe, read, write, close
+#include <sys/inotify.h> // for inotify_init1, inotify_add_watch
+#include "Util.hpp" // for Util::File::Path
+
+namespace asynlog
+{
+/**
+ * @brief ConfigWatcher class
+ * @note
+ * 1. The directory of the file is watched, not the file itself: editors and deploy tools usually write
+ * a temporary file and rename it over the old one, which a watch on the old inode would miss.
+ *
+ * 2. The callback runs on the watcher thread once the file was closed after writing or moved in place.
+ *
+ * 3. Stop() wakes the thread through a pipe, the destructor calls it.
+*/
+class ConfigWatcher {
+public:
+    using callback = std::function<void(const std::string &path)>;
+
+    /**
+     * @brief ConfigWatcher constructor
+     * @param path The file to watch
+     * @param cb The callback, gets the path of the file
+    */
+    ConfigWatcher(const std::string &path, const callback &cb) : path_(path), callback_(cb) {
+        std::string dir = Util::File::Path(path_);
+        name_ = path_.substr(dir.size());
+        if (dir.empty()) dir = "./";
+        inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (inotify_fd_ < 0 || pipe(stop_pipe_) < 0) {
+            std::cout << __FILE__ << __LINE__ << "inotify init failed: " << strerror(errno) << std::endl;
+            return;
+        }
+        if (inotify_add_watch(inotify_fd_, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+            std::cout << __FILE__ << __LINE__ << "watch " << dir << " failed: " << strerror(errno) << std::endl;
+            return;
+        }
+        thread_ = std::thread(&ConfigWatcher::ThreadEntry, this);
+    }
+
+    ~ConfigWatcher() {
+        Stop();
+        if (inotify_fd_ >= 0) close(inotify_fd_);
+        if (stop_pipe_[0] >= 0) close(stop_pipe_[0]);
+        if (stop_pipe_[1] >= 0) close(stop_pipe_[1]);
+    }
+
+    /**
+     * @brief Stop watching, waits for a running callback to return
+    */
+    void Stop() {
+        if (!thread_.joinable()) return;
+        char c = 0;
+        while (write(stop_pipe_[1], &c, 1) < 0 && errno == EINTR) {}
+        thread_.join();
+    }
+
+    /**
+     * @brief Check if the file is being watched
+    */
+    bool Watching() { return thread_.joinable(); }
+
+private:
+    /**
+     * @brief Watcher thread: wait for inotify events and run the callback for the watched name
+    */
+    void ThreadEntry() {
+        alignas(struct inotify_event) char buf[4096];
+        struct pollfd fds[2] = {{inotify_fd_, POLLIN, 0}, {stop_pipe_[0], POLLIN, 0}};
+        while (1) {
+            int r = poll(fds, 2, -1);
+            if (r < 0) {
+                if (errno == EINTR) continue;
+                return;
+            }
+            if (fds[1].revents != 0) return;
+            bool changed = false;
+            ssize_t len;
+            while ((len = read(inotify_fd_, buf, sizeof(buf))) > 0) {
+                for (char *p = buf; p < buf + len; ) {
+                    auto *ev = reinterpret_cast<struct inotify_event *>(p);
+                    if (ev->len > 0 && name_ == ev->name) changed = true;
+                    p += sizeof(struct inotify_event) + ev->len;
+                }
+            }
+            if (changed) callback_(path_); // one callback for a burst of events
+        }
+    }
+
+private:
+    std::string path_;                  // watched file
+    std::string name_;                  // file name without the directory
+    callback callback_;                 // runs on the watcher thread
+    int inotify_fd_ = -1;
+    int stop_pipe_[2] = {-1, -1};       // written by Stop() to wake the thread
+    std::thread thread_;                // watcher thread, started last
+};
+} // namespace asynlog
@@ -0,0 +1,177 @@
+/**
+ * @file Context.hpp
+ * @brief LogContext class and ScopedContext: per-thread context fields (MDC) added to every record.
+ * @author bhhxx
+ * @date 2025-06-22
+*/
+#pragma once
+#include <string> // for string
+#include <vector> // for vector
+#include "Field.hpp" // for Field
+#include "JsonEncoder.hpp" // for JsonEncoder
+
+namespace asynlog
+{
+/**
+ * @brief LogContext class: the context fields of the calling thread
+ * @note
+ * 1. A stack of fields, e.g. a request id pushed when a request starts and popped when it ends. Every
+ * record the thread logs carries them after its own fields; a field pushed later hides an earlier one
+ * with the same key.
+ *
+ * 2. The fields are rendered once per change, in logfmt for the text layouts and as JSON members for
+ * the JSON layout, and the loggers append the cached bytes. Logging inside a context costs an append.
+*/
+class LogContext {
+public:
+    /**
+     * @brief Get the context of the calling thread
+    */
+    static LogContext &Current() {
+        thread_local LogContext ctx;
+        return ctx;
+    }
+
+    /**
+     * @brief Push a field, its key and string value are copied
+     * @param f the field, made by kv()
+    */
+    void Push(const Field &f) {
+        Entry e;
+        e.key = f.key;
+        e.value = f;
+        if (f.type == Field::Type::STRING) e.str.assign(f.str, f.len);
+        entries_.push_back(std::move(e));
+        Changed();
+    }
+
+    /**
+     * @brief Pop the fields pushed last
+     * @param n the number of fields
+    */
+    void Pop(size_t n = 1) {
+        entries_.resize(n < entries_.size() ? entries_.size() - n : 0);
+        Changed();
+    }
+
+    size_t Size() const { return entries_.size(); }
+    bool Empty() const { return entries_.empty(); }
+
+    /**
+     * @brief Get the fields as appended to a text record, ` key=value key2="a b"`, empty without fields
+    */
+    const std::string &Text() {
+        if (text_stale_) {
+            text_.clear();
+            for (size_t i = 0; i < entries_.size(); i++) {
+                if (Hidden(i)) continue;
+                Field f = FieldOf(entries_[i]);
+                Field::AppendText(text_, &f, 1);
+            }
+            text_stale_ = false;
+        }
+        return text_;
+    }
+
+    /**
+     * @brief Get the fields as members appended to a JSON record, `,"key":value,...`, empty without fields
+    */
+    const std::string &Json() {
+        if (json_stale_) {
+            json_.clear();
+            RenderJson(json_, nullptr, 0);
+            json_stale_ = false;
+        }
+        return json_;
+    }
+
+    /**
+     * @brief Append the fields as members of a JSON record, leaving out the keys the record has as fields
+     * @param out the record being written
+     * @param fields the fields of the record
+     * @param nfields the number of fields
+     * @note Appends the cached Json() unless a key is shared, then renders the members for this record.
+    */
+    void AppendJson(std::string &out, const Field *fields, size_t nfields) {
+        for (size_t i = 0; i < entries_.size(); i++) {
+            if (Field::Find(fields, nfields, entries_[i].key.c_str()) != nfields) {
+                RenderJson(out, fields, nfields);
+                return;
+            }
+        }
+        out += Json();
+    }
+
+private:
+    struct Entry {
+        std::string key;    // owned key
+        Field value;        // the value, its pointers are set by FieldOf()
+        std::string str;    // owned STRING value
+    };
+
+    LogContext() = default;
+
+    static Field FieldOf(const Entry &e) {
+        Field f = e.value;
+        f.key = e.key.c_str();
+        if (f.type == Field::Type::STRING) {
+            f.str = e.str.data();
+            f.len = e.str.size();
+        }
+        return f;
+    }
+
+    /**
+     * @brief Check if a later entry has the same key
+    */
+    bool Hidden(size_t i) const {
+        for (size_t j = i + 1; j < entries_.size(); j++) {
+            if (entries_[j].key == entries_[i].key) return true;
+        }
+        return false;
+    }
+
+    /**
+     * @brief Append the visible entries as JSON members, `,"key":value,...`, skipping the keys in fields
+    */
+    void RenderJson(std::string &out, const Field *fields, size_t nfields) const {
+        std::string obj;
+        JsonEncoder enc(obj);
+        enc.Begin();
+        for (size_t i = 0; i < entries_.size(); i++) {
+            if (Hidden(i) || Field::Find(fields, nfields, entries_[i].key.c_str()) != nfields) continue;
+            enc.Member(FieldOf(entries_[i]));
+        }
+        enc.End();
+        if (obj.size() > 2) out.append(",").append(obj, 1, obj.size() - 2);
+    }
+
+    void Changed() { text_stale_ = json_stale_ = true; }
+
+private:
+    std::vector<Entry> entries_;    // the stack, bottom first
+    std::string text_;              // cached Text()
+    std::string json_;              // cached Json()
+    bool text_stale_ = false;       // text_ needs rendering
+    bool json_stale_ = false;       // json_ needs rendering
+};
+
+/**
+ * @brief ScopedContext class: pushes fields on the thread's LogContext for the lifetime of the object
+ * @example `ScopedContext ctx(kv("request_id", id), kv("tenant", tenant)); logger->Info("start");`
+*/
+class ScopedContext {
+public:
+    template <class... Fields>
+    explicit ScopedContext(const Field &field, const Fields &...fields) : n_(1 + sizeof...(Fields)) {
+        LogContext &ctx = LogContext::Current();
+        for (const Field &f : {field, fields...}) ctx.Push(f);
+    }
+    ~ScopedContext() { LogContext::Current().Pop(n_); }
+    ScopedContext(const ScopedContext &) = delete;
+    ScopedContext &operator=(const ScopedContext &) = delete;
+
+private:
+    size_t n_;  // fields pushed
+};
+} // namespace asynlog
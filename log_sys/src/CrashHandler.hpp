@@ -0,0 +1,159 @@
+/**
+ * @file CrashHandler.hpp
+ * @brief CrashHandler class: write the logs still pending in the buffers to the flushes on fatal signals.
+ * @author bhhxx
+ * @date 2025-06-05
+*/
+#pragma once
+#include <atomic> // for atomic
+#include <vector> // for vector
+#include <csignal> // for sigaction, raise
+#include <cstring> // for strlen
+#include <cerrno> // for errno
+#include <unistd.h> // for write
+#include <execinfo.h> // for backtrace, backtrace_symbols_fd
+
+namespace asynlog
+{
+/**
+ * @brief CrashHandler class
+ * @note
+ * 1. Every AsynLogger registers itself, Install() opts in to the signal handlers.
+ *
+ * 2. On a fatal signal every registered logger writes its pending buffers and a backtrace straight
+ * to the file descriptors of its flushes with write(2), then the signal is raised again with the
+ * default action, so the process still dumps core.
+ *
+ * 3. Nothing in the handler takes a lock or allocates. Data in a stdio buffer that was never
+ * fflushed (`flush_log` 0) and a batch a consumer was writing when the crash happened can be
+ * lost or written twice.
+*/
+class CrashHandler {
+public:
+    using dump_func = void (*)(void *obj, int sig, void *const *frames, int nframes);
+    static const size_t kMaxLoggers = 64;   // loggers beyond this are not dumped
+
+    /**
+     * @brief Install the crash handler for the given signals
+     * @param sigs signals to handle, SIGSEGV SIGABRT SIGBUS SIGFPE SIGILL by default
+     * @note Also sets up an alternate signal stack for the calling thread, so a stack overflow
+     * in that thread can still be dumped.
+    */
+    static void Install(const std::vector<int> &sigs = {SIGSEGV, SIGABRT, SIGBUS, SIGFPE, SIGILL}) {
+        void *frames[1];
+        backtrace(frames, 1); // load libgcc now, the first call allocates
+        static char alt_stack[64 * 1024];
+        stack_t ss;
+        ss.ss_sp = alt_stack;
+        ss.ss_size = sizeof(alt_stack);
+        ss.ss_flags = 0;
+        sigaltstack(&ss, nullptr);
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = &CrashHandler::OnSignal;
+        sigemptyset(&sa.sa_mask);
+        sa.sa_flags = SA_ONSTACK | SA_RESETHAND; // a second fault goes to the default action
+        for (int sig : sigs) {
+            sigaction(sig, &sa, nullptr);
+        }
+    }
+
+    /**
+     * @brief Register an object to be dumped on a crash
+     * @param obj the object, usually an AsynLogger
+     * @param dump the function that writes the pending data of obj
+    */
+    static void Register(void *obj, dump_func dump) {
+        for (auto &slot : Slots()) {
+            void *expected = nullptr;
+            if (slot.obj.load(std::memory_order_relaxed) == nullptr &&
+                slot.obj.compare_exchange_strong(expected, obj)) {
+                slot.dump.store(dump, std::memory_order_release);
+                return;
+            }
+        }
+    }
+
+    /**
+     * @brief Unregister an object, must be called before it is destroyed
+     * @param obj the object passed to Register()
+    */
+    static void Unregister(void *obj) {
+        for (auto &slot : Slots()) {
+            if (slot.obj.load(std::memory_order_relaxed) == obj) {
+                slot.dump.store(nullptr, std::memory_order_release);
+                slot.obj.store(nullptr, std::memory_order_release);
+                return;
+            }
+        }
+    }
+
+    /**
+     * @brief Write all of data to fd, async-signal-safe
+     * @param fd file descriptor
+     * @param data data to write
+     * @param len length of data
+    */
+    static void WriteAll(int fd, const char *data, size_t len) {
+        while (len > 0) {
+            ssize_t n = write(fd, data, len);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return;
+            }
+            data += n;
+            len -= n;
+        }
+    }
+
+    /**
+     * @brief Get the name of a signal, async-signal-safe unlike strsignal()
+    */
+    static const char *SignalName(int sig) {
+        switch (sig) {
+            case SIGSEGV: return "SIGSEGV";
+            case SIGABRT: return "SIGABRT";
+            case SIGBUS: return "SIGBUS";
+            case SIGFPE: return "SIGFPE";
+            case SIGILL: return "SIGILL";
+            case SIGTERM: return "SIGTERM";
+            default: return "signal";
+        }
+    }
+
+    /**
+     * @brief Dump every registered object, then re-raise the signal
+     * @param sig the signal
+    */
+    static void OnSignal(int sig) {
+        static std::atomic<bool> dumping(false);
+        if (!dumping.exchange(true)) { // only the first crashing thread dumps
+            void *frames[64];
+            int nframes = backtrace(frames, 64);
+            const char head[] = "\n*** asynlog: fatal signal, pending logs and backtrace follow ***\n";
+            WriteAll(STDERR_FILENO, head, sizeof(head) - 1);
+            for (auto &slot : Slots()) {
+                void *obj = slot.obj.load(std::memory_order_acquire);
+                dump_func dump = slot.dump.load(std::memory_order_acquire);
+                if (obj != nullptr && dump != nullptr) {
+                    dump(obj, sig, frames, nframes);
+                }
+            }
+            backtrace_symbols_fd(frames, nframes, STDERR_FILENO);
+        }
+        signal(sig, SIG_DFL);
+        raise(sig);
+    }
+
+private:
+    struct Slot {
+        std::atomic<void *> obj{nullptr};
+        std::atomic<dump_func> dump{nullptr};
+    };
+
+    static Slot (&Slots())[kMaxLoggers] {
+        static Slot slots[kMaxLoggers];
+        return slots;
+    }
+};
+} // namespace asynlog
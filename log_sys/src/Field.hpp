@@ -0,0 +1,168 @@
+/**
+ * @file Field.hpp
+ * @brief Field struct: one typed key-value pair of a structured log record, made with kv().
+ * @author bhhxx
+ * @date 2025-06-14
+*/
+#pragma once
+#include <string> // for string
+#include <cstring> // for strlen, strcmp
+#include <charconv> // for to_chars
+#include <type_traits> // for enable_if
+
+namespace asynlog
+{
+/**
+ * @brief Field struct
+ * @note A field only points to its key and string value, it is encoded before the log call returns.
+*/
+struct Field {
+    enum class Type { INT, UINT, DOUBLE, BOOL, STRING };
+    const char *key = "";
+    Type type = Type::INT;
+    union {
+        int64_t i;
+        uint64_t u;
+        double d;
+        bool b;
+    };
+    const char *str = nullptr;  // STRING value, not null terminated
+    size_t len = 0;             // length of str
+
+    Field() : i(0) {}
+
+    /**
+     * @brief Append the value as text, strings as they are
+     * @param out the string to append to
+    */
+    void AppendValue(std::string &out) const {
+        char buf[32];
+        std::to_chars_result r;
+        switch (type) {
+            case Type::INT: r = std::to_chars(buf, buf + sizeof(buf), i); break;
+            case Type::UINT: r = std::to_chars(buf, buf + sizeof(buf), u); break;
+            case Type::DOUBLE: r = std::to_chars(buf, buf + sizeof(buf), d); break;
+            case Type::BOOL: out += b ? "true" : "false"; return;
+            case Type::STRING: out.append(str, len); return;
+        }
+        out.append(buf, r.ptr - buf);
+    }
+
+    /**
+     * @brief Append the fields in logfmt style, ` key=value key2="a b" key3="say \"hi\"\n"`
+     * @param out the string to append to
+     * @param fields the fields
+     * @param n the number of fields
+     * @note A string value is quoted if it is empty or has a space, '"', '=' or a control character;
+     * a quoted value escapes '\\', '"', newline, carriage return and tab, so a record stays one line.
+    */
+    static void AppendText(std::string &out, const Field *fields, size_t n) {
+        for (size_t k = 0; k < n; k++) {
+            const Field &f = fields[k];
+            out += ' ';
+            out += f.key;
+            out += '=';
+            if (f.type != Type::STRING || !NeedsQuote(f.str, f.len)) {
+                f.AppendValue(out);
+                continue;
+            }
+            out += '"';
+            for (size_t j = 0; j < f.len; j++) {
+                char c = f.str[j];
+                switch (c) {
+                    case '\\': out += "\\\\"; break;
+                    case '"': out += "\\\""; break;
+                    case '\n': out += "\\n"; break;
+                    case '\r': out += "\\r"; break;
+                    case '\t': out += "\\t"; break;
+                    default: out += c;
+                }
+            }
+            out += '"';
+        }
+    }
+
+    /**
+     * @brief Find a field in a list by key
+     * @param fields the fields
+     * @param n the number of fields
+     * @param key the key
+     * @return the index of the last field with the key, n if none has it
+    */
+    static size_t Find(const Field *fields, size_t n, const char *key) {
+        for (size_t k = n; k > 0; k--) {
+            if (strcmp(fields[k - 1].key, key) == 0) return k - 1;
+        }
+        return n;
+    }
+
+private:
+    static bool NeedsQuote(const char *s, size_t n) {
+        if (n == 0) return true;
+        for (size_t j = 0; j < n; j++) {
+            unsigned char c = static_cast<unsigned char>(s[j]);
+            if (c <= ' ' || c == '"' || c == '=' || c == 0x7f) return true;
+        }
+        return false;
+    }
+};
+
+/**
+ * @brief Make a field, e.g. `logger->Info("login", kv("user", id), kv("ok", true));`
+ * @param key the key, must outlive the log call
+ * @param value an integer, floating point, bool or string value
+*/
+template <class T, typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value, int>::type = 0>
+inline Field kv(const char *key, T value) {
+    Field f;
+    f.key = key;
+    f.type = Field::Type::INT;
+    f.i = value;
+    return f;
+}
+
+template <class T, typename std::enable_if<std::is_integral<T>::value && std::is_unsigned<T>::value &&
+                                           !std::is_same<T, bool>::value, int>::type = 0>
+inline Field kv(const char *key, T value) {
+    Field f;
+    f.key = key;
+    f.type = Field::Type::UINT;
+    f.u = value;
+    return f;
+}
+
+template <class T, typename std::enable_if<std::is_floating_point<T>::value, int>::type = 0>
+inline Field kv(const char *key, T value) {
+    Field f;
+    f.key = key;
+    f.type = Field::Type::DOUBLE;
+    f.d = value;
+    return f;
+}
+
+inline Field kv(const char *key, bool value) {
+    Field f;
+    f.key = key;
+    f.type = Field::Type::BOOL;
+    f.b = value;
+    return f;
+}
+
+inline Field kv(const char *key, const char *value) {
+    Field f;
+    f.key = key;
+    f.type = Field::Type::STRING;
+    f.str = value;
+    f.len = strlen(value);
+    return f;
+}
+
+inline Field kv(const char *key, const std::string &value) {
+    Field f;
+    f.key = key;
+    f.type = Field::Type::STRING;
+    f.str = value.data();
+    f.len = value.size();
+    return f;
+}
+} // namespace asynlog
@@ -0,0 +1,147 @@
+/**
+ * @file JsonEncoder.hpp
+ * @brief JsonEncoder class: append JSON objects to a string without building a document first.
+ * @author bhhxx
+ * @date 2025-06-14
+*/
+#pragma once
+#include <string> // for string
+#include <charconv> // for to_chars
+#include <cmath> // for isfinite
+#include <cstring> // for strcmp
+#include "Field.hpp" // for Field
+
+namespace asynlog
+{
+/**
+ * @brief JsonEncoder class
+ * @note
+ * 1. Writes straight into the caller's string, so with a reused string (e.g. a thread_local one that
+ * has grown to the record size) encoding allocates nothing. Numbers go through std::to_chars.
+ *
+ * 2. Only flat objects are needed for log records: Begin(), then Key() and a value per member, then End().
+ * Keys of Key() are written as they are; field keys of Member() and values are escaped.
+*/
+class JsonEncoder {
+public:
+    explicit JsonEncoder(std::string &out) : out_(out) {}
+
+    void Begin() {
+        out_ += '{';
+        first_ = true;
+    }
+
+    void End() { out_ += '}'; }
+
+    /**
+     * @brief Start a member
+     * @param key the key, plain ASCII without quotes or backslashes
+    */
+    void Key(const char *key) {
+        if (!first_) out_ += ',';
+        first_ = false;
+        out_ += '"';
+        out_ += key;
+        out_ += "\":";
+    }
+
+    void String(const char *s, size_t len) {
+        out_ += '"';
+        Escape(out_, s, len);
+        out_ += '"';
+    }
+
+    void String(const std::string &s) { String(s.data(), s.size()); }
+
+    void Int(int64_t v) { Number(v); }
+
+    void Uint(uint64_t v) { Number(v); }
+
+    /**
+     * @brief Write a double, NaN and infinities as null since JSON has no literal for them
+    */
+    void Double(double v) {
+        if (!std::isfinite(v)) {
+            out_ += "null";
+            return;
+        }
+        Number(v);
+    }
+
+    void Bool(bool v) { out_ += v ? "true" : "false"; }
+
+    /**
+     * @brief Append a field as a member
+     * @note A key the record uses itself, e.g. msg, gets the prefix "fields.", so a field cannot overwrite
+     * those members. Fields sharing a key are left out by the callers, see LogMessage::FormatJson().
+    */
+    void Member(const Field &f) {
+        if (!first_) out_ += ',';
+        first_ = false;
+        out_ += '"';
+        if (Reserved(f.key)) out_ += "fields.";
+        Escape(out_, f.key, strlen(f.key));
+        out_ += "\":";
+        switch (f.type) {
+            case Field::Type::INT: Int(f.i); break;
+            case Field::Type::UINT: Uint(f.u); break;
+            case Field::Type::DOUBLE: Double(f.d); break;
+            case Field::Type::BOOL: Bool(f.b); break;
+            case Field::Type::STRING: String(f.str, f.len); break;
+        }
+    }
+
+    /**
+     * @brief Check if a key is one of the members of a record, see LogMessage::FormatJson()
+    */
+    static bool Reserved(const char *key) {
+        static const char *const kReserved[] = {"ts", "tid", "level", "logger", "file", "line", "msg", "repeated"};
+        for (const char *r : kReserved) {
+            if (strcmp(key, r) == 0) return true;
+        }
+        return false;
+    }
+
+    /**
+     * @brief Append a string escaped for a JSON string literal
+     * @param out the string to append to
+     * @param s the text
+     * @param len the length of the text
+     * @note Runs of characters that need no escape are appended in one go.
+    */
+    static void Escape(std::string &out, const char *s, size_t len) {
+        static const char hex[] = "0123456789abcdef";
+        size_t run = 0;
+        for (size_t i = 0; i < len; i++) {
+            unsigned char c = static_cast<unsigned char>(s[i]);
+            if (c >= 0x20 && c != '"' && c != '\\') continue;
+            out.append(s + run, i - run);
+            run = i + 1;
+            switch (c) {
+                case '"': out += "\\\""; break;
+                case '\\': out += "\\\\"; break;
+                case '\n': out += "\\n"; break;
+                case '\r': out += "\\r"; break;
+                case '\t': out += "\\t"; break;
+                default:
+                    out += "\\u00";
+                    out += hex[c >> 4];
+                    out += hex[c & 0xf];
+            }
+        }
+        out.append(s + run, len - run);
+    }
+
+private:
+    template <class T>
+    void Number(T v) {
+        char buf[32];
+        auto r = std::to_chars(buf, buf + sizeof(buf), v);
+        out_.append(buf, r.ptr - buf);
+    }
+
+private:
+    std::string &out_;  // output, appended to
+    bool first_ = true; // no member written yet
+};
+} // namespace asynlog
@@ -22,5 +22,20 @@ namespace asynlog {
                 default: return "UNKNOWN";
             }
         }
+        /**
+         * @brief parse a level name, case sensitive, as written in config files
+         * @param name "DEBUG", "INFO", "WARN", "ERROR" or "FATAL"
+         * @param level set to the parsed level
+         * @return false if the name is unknown
+        */
+        static bool FromString(const std::string &name, value *level) {
+            if (name == "DEBUG") *level = value::DEBUG;
+            else if (name == "INFO") *level = value::INFO;
+            else if (name == "WARN") *level = value::WARN;
+            else if (name == "ERROR") *level = value::ERROR;
+            else if (name == "FATAL") *level = value::FATAL;
+            else return false;
+            return true;
+        }
     };
 }
@@ -9,7 +9,21 @@
 #include <memory> // for shared_ptr
 #include <string> // for string 
 #include <unistd.h> // for fsync
+#include <thread> // for this_thread
+#include <vector> // for vector
+#include <deque> // for deque
+#include <fcntl.h> // for O_NONBLOCK
+#include <sys/socket.h> // for sendmmsg
+#include <sys/un.h> // for sockaddr_un
+#include <sys/stat.h> // for fstat
+#include <netinet/in.h> // for sockaddr_in
+#include <arpa/inet.h> // for inet_pton
 #include "Util.hpp" // for Util::File, Util::Date
+#include "ShmRing.hpp" // for ShmRing
+#include "Metrics.hpp" // for Counter
+#include "backup/Protocol.hpp" // for backup::MakeFrame
+#include "backup/Spool.hpp" // for backup::Spool
+#include "query/Index.hpp" // for query::IndexWriter
 extern asynlog::Util::JsonData* conf_data; // singleton instance of JsonData
 namespace asynlog 
 {
@@ -23,6 +37,57 @@ public:
     using ptr = std::shared_ptr<LogFlush>;
     virtual ~LogFlush() {}
     virtual void Flush(const char*data, size_t len) = 0;
+
+    /**
+     * @brief Makes everything flushed so far durable, e.g. fsync for files.
+     */
+    virtual void Sync() {}
+
+    /**
+     * @brief Makes everything flushed so far visible to readers, e.g. writes out the stdio buffer of a file.
+     */
+    virtual void Fflush() {}
+
+    /**
+     * @brief Checks the flush could open what it writes to, see LogFlushFactory::CreateFromConfig().
+     */
+    virtual bool Ok() { return true; }
+
+    /**
+     * @brief Gets the file descriptor the crash handler writes to with write(2).
+     * @return The file descriptor, or -1 if the flush has none.
+     */
+    virtual int Fd() { return -1; }
+
+    /**
+     * @brief Gets the type of the flush, used as a metrics label.
+     * @return The type as in LogFlushFactory::CreateFromConfig(), "custom" for other flushes.
+     */
+    virtual const char *Type() { return "custom"; }
+
+    /**
+     * @brief Creates the copy of this flush used by one shard of a sharded logger.
+     * @param shard The index of the shard.
+     * @return A new flush for the shard, or nullptr if the shards can share this one.
+     */
+    virtual ptr Clone(size_t shard) { return nullptr; }
+
+protected:
+    /**
+     * @brief Inserts the shard index in front of the file extension.
+     * @param filename The name of the log file.
+     * @param shard The index of the shard.
+     * @return The file name of the shard, e.g. `logs/app.log` -> `logs/app.shard1.log`.
+     */
+    static std::string ShardFilename(const std::string &filename, size_t shard) {
+        std::string tag = ".shard" + std::to_string(shard);
+        auto dot = filename.find_last_of('.');
+        auto slash = filename.find_last_of("/\\");
+        if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+            return filename + tag;
+        }
+        return filename.substr(0, dot) + tag + filename.substr(dot);
+    }
 };
 
 /**
@@ -41,6 +106,24 @@ public:
     void Flush(const char*data, size_t len) override {
         std::cout.write(data, len);
     }
+
+    /**
+     * @brief Flushes the standard output stream.
+     */
+    void Sync() override {
+        std::cout.flush();
+    }
+
+    void Fflush() override {
+        std::cout.flush();
+    }
+
+    /**
+     * @brief Gets the file descriptor of standard output.
+     */
+    int Fd() override { return STDOUT_FILENO; }
+
+    const char *Type() override { return "stdout"; }
 };
 
 /**
@@ -51,21 +134,37 @@ class FileFlush : public LogFlush {
 private:
     std::string filename_;    // log file name
     FILE* fs_ = NULL;         // file pointer
+    size_t index_bytes_;      // bytes of log per index entry, 0 for no index
+    std::unique_ptr<query::IndexWriter> index_; // the index sidecar, nullptr if none
 public:
     using ptr = std::shared_ptr<FileFlush>;
 
     /**
      * @brief Constructs a new FileFlush object.
      * @param filename The name of the log file.
+     * @param index_bytes Write the index sidecar `<filename>.idx` with an entry per index_bytes of log, 0 for none.
      * @note This function creates the directory for the log file if it does not exist.
      */
-    FileFlush(const std::string &filename) : filename_(filename)
+    FileFlush(const std::string &filename, size_t index_bytes = 0) : filename_(filename), index_bytes_(index_bytes)
     {
         Util::File::CreateDirectory(Util::File::Path(filename));
         fs_ = fopen(filename.c_str(), "ab"); // "ab" mode for appending
         if(fs_ == NULL){
             std::cout <<__FILE__<<__LINE__<< "open log file failed" << std::endl;
             perror(NULL);
+        } else if (index_bytes_ > 0) {
+            struct stat st;
+            uint64_t size = fstat(fileno(fs_), &st) == 0 ? st.st_size : 0;
+            index_.reset(new query::IndexWriter(filename, index_bytes_, size));
+        }
+    }
+
+    /**
+     * @brief Closes the log file, writing out what is left in the stdio buffer.
+     */
+    ~FileFlush() override {
+        if (fs_ != NULL) {
+            fclose(fs_);
         }
     }
 
@@ -75,11 +174,13 @@ public:
      * @param len The length of the log message data.
      */
     void Flush(const char *data, size_t len) override{
+        if (fs_ == NULL) return; // the constructor reported it
         fwrite(data, 1, len, fs_);
         if(ferror(fs_)){
             std::cout <<__FILE__<<__LINE__<< "write log file failed" << std::endl;
             perror(NULL);
         }
+        if (index_) index_->Add(data, len);
         if(conf_data->flush_log == 1) {
             if(fflush(fs_) == EOF){
                 std::cout << __FILE__ << __LINE__ << "fflush file failed" << std::endl;
@@ -90,6 +191,50 @@ public:
             fsync(fileno(fs_));
         }
     }
+
+    /**
+     * @brief Flushes the stdio buffer and fsyncs the log file.
+     */
+    void Sync() override {
+        if (fs_ == NULL) return;
+        if (fflush(fs_) == EOF || fsync(fileno(fs_)) == -1) {
+            std::cout << __FILE__ << __LINE__ << "sync log file failed" << std::endl;
+            perror(NULL);
+        }
+        if (index_) index_->Flush();
+    }
+
+    /**
+     * @brief Flushes the stdio buffer and the index sidecar, without fsync.
+     */
+    void Fflush() override {
+        if (fs_ == NULL) return;
+        if (fflush(fs_) == EOF) {
+            std::cout << __FILE__ << __LINE__ << "fflush file failed" << std::endl;
+            perror(NULL);
+        }
+        if (index_) index_->Flush();
+    }
+
+    /**
+     * @brief Checks the log file is open.
+     */
+    bool Ok() override { return fs_ != NULL; }
+
+    /**
+     * @brief Gets the file descriptor of the log file.
+     */
+    int Fd() override { return fs_ == NULL ? -1 : fileno(fs_); }
+
+    const char *Type() override { return "file"; }
+
+    /**
+     * @brief Creates a FileFlush writing to the shard's own file.
+     * @param shard The index of the shard.
+     */
+    LogFlush::ptr Clone(size_t shard) override {
+        return std::make_shared<FileFlush>(ShardFilename(filename_, shard), index_bytes_);
+    }
 };
 
 
@@ -104,6 +249,8 @@ private:
     size_t max_size_;          // maximum file size
     std::string basename_;     // base name of the log file
     FILE* fs_ = NULL;          // file pointer
+    size_t index_bytes_;       // bytes of log per index entry, 0 for no index
+    std::unique_ptr<query::IndexWriter> index_; // the index sidecar of the current file, nullptr if none
 public:
     using ptr = std::shared_ptr<RollFileFlush>;
 
@@ -111,24 +258,37 @@ public:
      * @brief Constructs a new RollFileFlush object.
      * @param filename The base name of the log file.
      * @param max_size The maximum size of the log file.
+     * @param index_bytes Write an index sidecar `<file>.idx` for each file, an entry per index_bytes of log, 0 for none.
      * @note This function creates the directory for the log file if it does not exist.
      */
-    RollFileFlush(const std::string &filename, size_t max_size) : max_size_(max_size), basename_(filename) {
+    RollFileFlush(const std::string &filename, size_t max_size, size_t index_bytes = 0) :
+        max_size_(max_size), basename_(filename), index_bytes_(index_bytes) {
         Util::File::CreateDirectory(Util::File::Path(basename_));
     }
 
+    /**
+     * @brief Closes the current log file, writing out what is left in the stdio buffer.
+     */
+    ~RollFileFlush() override {
+        if (fs_ != NULL) {
+            fclose(fs_);
+        }
+    }
+
     /**
      * @brief Flushes the log message to the rolling log file.
      * @param data The log message data.
      * @param len The length of the log message data.
      */
-    void Flush(const char*data, size_t len) {
+    void Flush(const char*data, size_t len) override {
         InitLogFile();
+        if (fs_ == NULL) return; // InitLogFile() reported it
         fwrite(data, 1, len, fs_);
         if(ferror(fs_)){
             std::cout <<__FILE__<<__LINE__<< "write log file failed" << std::endl;
             perror(NULL);
         }
+        if (index_) index_->Add(data, len);
         cur_size_ += len;
         if(conf_data->flush_log == 1) {
             if(fflush(fs_) == EOF){
@@ -140,6 +300,53 @@ public:
             fsync(fileno(fs_));
         }
     }
+
+    /**
+     * @brief Flushes the stdio buffer and fsyncs the log file.
+     */
+    void Sync() override {
+        if (fs_ == NULL) return;
+        if (fflush(fs_) == EOF || fsync(fileno(fs_)) == -1) {
+            std::cout << __FILE__ << __LINE__ << "sync log file failed" << std::endl;
+            perror(NULL);
+        }
+        if (index_) index_->Flush();
+    }
+
+    /**
+     * @brief Flushes the stdio buffer and the index sidecar, without fsync.
+     */
+    void Fflush() override {
+        if (fs_ == NULL) return;
+        if (fflush(fs_) == EOF) {
+            std::cout << __FILE__ << __LINE__ << "fflush file failed" << std::endl;
+            perror(NULL);
+        }
+        if (index_) index_->Flush();
+    }
+
+    /**
+     * @brief Checks a log file can be created, the files are only opened by the first Flush().
+     */
+    bool Ok() override {
+        std::string dir = Util::File::Path(basename_);
+        return fs_ != NULL || access(dir.empty() ? "." : dir.c_str(), W_OK) == 0;
+    }
+
+    /**
+     * @brief Gets the file descriptor of the current log file.
+     */
+    int Fd() override { return fs_ == NULL ? -1 : fileno(fs_); }
+
+    const char *Type() override { return "roll_file"; }
+
+    /**
+     * @brief Creates a RollFileFlush rolling the shard's own files.
+     * @param shard The index of the shard.
+     */
+    LogFlush::ptr Clone(size_t shard) override {
+        return std::make_shared<RollFileFlush>(basename_ + "shard" + std::to_string(shard) + "-", max_size_, index_bytes_);
+    }
 private:
 
     /**
@@ -159,6 +366,7 @@ private:
                 perror(NULL);
             }
             cur_size_ = 0;
+            index_.reset(fs_ != NULL && index_bytes_ > 0 ? new query::IndexWriter(filename, index_bytes_, 0) : nullptr);
         }
     }
 
@@ -182,6 +390,574 @@ private:
     }
 };
 
+/**
+ * @class ShmFlush
+ * @brief Derived class for handing logs to the log agent through a ring in shared memory.
+ * @note The consumer thread only copies into the ring; the agent process does the file writes, compression
+ * and backups. A batch that does not fit waits at most max_wait for the agent, the lines still left are dropped
+ * and counted, so a stopped agent never blocks the logger for long. Only whole lines go into the ring, a line
+ * longer than the ring is dropped at once and the lines after it go on. What is in the ring survives a crash
+ * of the process.
+ */
+class ShmFlush : public LogFlush {
+private:
+    std::string name_;                      // stream name, the agent names its files after it
+    size_t capacity_;                       // ring size
+    std::chrono::milliseconds max_wait_;    // longest wait for room in the ring per batch
+    ShmRing::ptr ring_;                     // the ring, nullptr if it could not be created
+    Counter *dropped_;                      // bytes dropped on a full ring
+public:
+    using ptr = std::shared_ptr<ShmFlush>;
+
+    /**
+     * @brief Constructs a new ShmFlush object.
+     * @param name The stream name, the segment is /dev/shm/asynlog.<name>.<pid>, or .<pid>.<n> while that is in use.
+     * @param capacity The ring size in bytes.
+     * @param max_wait The longest wait for the agent to make room, per batch.
+     */
+    ShmFlush(const std::string &name, size_t capacity = 8 * 1024 * 1024,
+             std::chrono::milliseconds max_wait = std::chrono::milliseconds(100)) :
+        name_(name),
+        capacity_(capacity),
+        max_wait_(max_wait),
+        ring_(ShmRing::Create(ShmRing::MakeShmName(name), name, capacity)),
+        dropped_(Metrics::Get().GetCounter("asynlog_shm_dropped_bytes_total", "Bytes dropped on a full shared memory ring",
+                                           Metrics::Labels({{"stream", name}}))) {}
+
+    /**
+     * @brief Marks the ring closed, the agent drains and removes it.
+     */
+    ~ShmFlush() override {
+        if (ring_) ring_->Close();
+    }
+
+    /**
+     * @brief Copies the log data into the ring.
+     * @param data The log message data.
+     * @param len The length of the log message data.
+     */
+    void Flush(const char *data, size_t len) override {
+        if (!ring_) return;
+        size_t done = 0;
+        auto deadline = std::chrono::steady_clock::time_point::max();
+        while (done < len) {
+            const char *eol = static_cast<const char *>(memchr(data + done, '\n', len - done));
+            size_t line = eol ? eol - (data + done) + 1 : len - done;
+            if (line > ring_->Capacity()) { // never fits, waiting for room would only drop the lines after it
+                ring_->AddDropped(line);
+                dropped_->Add(line);
+                done += line;
+                continue;
+            }
+            size_t n = len - done, room = ring_->Free();
+            if (n > room) { // the whole lines that fit
+                const char *nl = room ? static_cast<const char *>(memrchr(data + done, '\n', room)) : nullptr;
+                n = nl ? nl - (data + done) + 1 : 0;
+            }
+            if (n > 0) {
+                done += ring_->Write(data + done, n);
+                continue;
+            }
+            auto now = std::chrono::steady_clock::now();
+            if (deadline == std::chrono::steady_clock::time_point::max()) deadline = now + max_wait_;
+            if (now >= deadline) break;
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+        if (done < len) {
+            ring_->AddDropped(len - done);
+            dropped_->Add(len - done);
+        }
+    }
+
+    const char *Type() override { return "shm"; }
+
+    /**
+     * @brief Gets the ring, e.g. to check that the agent caught up.
+     */
+    ShmRing::ptr Ring() { return ring_; }
+
+    /**
+     * @brief Creates a ShmFlush with the shard's own ring.
+     * @param shard The index of the shard.
+     */
+    LogFlush::ptr Clone(size_t shard) override {
+        return std::make_shared<ShmFlush>(name_ + ".shard" + std::to_string(shard), capacity_, max_wait_);
+    }
+};
+
+/**
+ * @class DatagramFlush
+ * @brief Derived class for sending logs as datagrams, over UDP or a Unix datagram socket.
+ * @note A batch is cut at record boundaries into datagrams of at most max_datagram bytes. A record longer
+ * than that is cut into pieces. The datagrams go out in one sendmmsg call per 64. The socket is
+ * non-blocking: what the kernel does not take, because the receiver is slow or absent, is dropped and
+ * counted, and the consumer thread never waits.
+ */
+class DatagramFlush : public LogFlush {
+public:
+    enum class Kind { UDP, UNIX };
+    using ptr = std::shared_ptr<DatagramFlush>;
+
+    /**
+     * @brief Constructs a new DatagramFlush object.
+     * @param kind UDP or UNIX.
+     * @param address "host:port" with an IPv4 host for UDP, the socket path for UNIX.
+     * @param max_datagram The largest datagram, 0 for 1472 bytes (no IP fragments on Ethernet) over UDP
+     * and 65536 over UNIX.
+     */
+    DatagramFlush(Kind kind, const std::string &address, size_t max_datagram = 0) :
+        kind_(kind),
+        address_(address),
+        max_datagram_(max_datagram ? max_datagram : kind == Kind::UDP ? 1472 : 65536),
+        sent_(Metrics::Get().GetCounter("asynlog_net_datagrams_sent_total", "Datagrams sent by datagram sinks",
+                                        Metrics::Labels({{"dest", address}}))),
+        dropped_(Metrics::Get().GetCounter("asynlog_net_datagrams_dropped_total", "Datagrams dropped by datagram sinks",
+                                           Metrics::Labels({{"dest", address}}))) {
+        Connect();
+    }
+
+    ~DatagramFlush() override {
+        if (fd_ >= 0) close(fd_);
+    }
+
+    /**
+     * @brief Sends the log data.
+     * @param data The log message data.
+     * @param len The length of the log message data.
+     */
+    void Flush(const char *data, size_t len) override {
+        Split(data, len);
+        if (fd_ < 0 && !Connect()) {
+            dropped_->Add(spans_.size());
+            return;
+        }
+        size_t done = 0;
+        while (done < spans_.size()) {
+            size_t n = std::min<size_t>(spans_.size() - done, 64);
+            for (size_t i = 0; i < n; i++) {
+                iov_[i].iov_base = const_cast<char *>(spans_[done + i].first);
+                iov_[i].iov_len = spans_[done + i].second;
+                memset(&msgs_[i], 0, sizeof(msgs_[i]));
+                msgs_[i].msg_hdr.msg_iov = &iov_[i];
+                msgs_[i].msg_hdr.msg_iovlen = 1;
+            }
+            int r = sendmmsg(fd_, msgs_, n, MSG_DONTWAIT | MSG_NOSIGNAL);
+            if (r < 0) {
+                if (errno == EINTR) continue;
+                if (errno != EAGAIN && errno != EWOULDBLOCK && errno != ENOBUFS) { // the receiver is gone
+                    close(fd_);
+                    fd_ = -1;
+                }
+                break;
+            }
+            sent_->Add(r);
+            done += r;
+        }
+        dropped_->Add(spans_.size() - done);
+    }
+
+    const char *Type() override { return kind_ == Kind::UDP ? "udp" : "unix_dgram"; }
+
+    /**
+     * @brief Gets the number of datagrams sent and dropped so far.
+     */
+    uint64_t Sent() { return sent_->Value(); }
+    uint64_t Dropped() { return dropped_->Value(); }
+
+private:
+    /**
+     * @brief Cut a batch into datagrams at record boundaries.
+     */
+    void Split(const char *data, size_t len) {
+        spans_.clear();
+        const char *p = data, *end = data + len;
+        while (p < end) {
+            size_t room = std::min<size_t>(max_datagram_, end - p);
+            const char *cut = p + room;
+            if (cut < end) { // end the datagram after the last record that fits, if one does
+                const void *nl = memrchr(p, '\n', room);
+                if (nl) cut = static_cast<const char *>(nl) + 1;
+            }
+            spans_.emplace_back(p, cut - p);
+            p = cut;
+        }
+    }
+
+    /**
+     * @brief Open the socket and connect it to the receiver, retried at most once a second.
+     */
+    bool Connect() {
+        time_t now = Util::Date::Now();
+        if (now == last_connect_) return false;
+        last_connect_ = now;
+        int fd = socket(kind_ == Kind::UDP ? AF_INET : AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) return false;
+        int r = -1;
+        if (kind_ == Kind::UDP) {
+            struct sockaddr_in addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sin_family = AF_INET;
+            size_t colon = address_.rfind(':');
+            if (colon != std::string::npos &&
+                inet_pton(AF_INET, address_.substr(0, colon).c_str(), &addr.sin_addr) == 1) {
+                addr.sin_port = htons(atoi(address_.c_str() + colon + 1));
+                r = connect(fd, (struct sockaddr *)&addr, sizeof(addr));
+            }
+        } else {
+            struct sockaddr_un addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sun_family = AF_UNIX;
+            strncpy(addr.sun_path, address_.c_str(), sizeof(addr.sun_path) - 1);
+            r = connect(fd, (struct sockaddr *)&addr, sizeof(addr));
+        }
+        if (r != 0) {
+            close(fd);
+            return false;
+        }
+        fd_ = fd;
+        return true;
+    }
+
+private:
+    Kind kind_;                                         // UDP or Unix datagrams
+    std::string address_;                               // host:port or socket path
+    size_t max_datagram_;                               // largest datagram
+    int fd_ = -1;                                       // connected socket, -1 until the receiver exists
+    time_t last_connect_ = 0;                           // second of the last connect attempt
+    std::vector<std::pair<const char *, size_t>> spans_; // datagrams of the current batch
+    struct iovec iov_[64];                              // one sendmmsg call
+    struct mmsghdr msgs_[64];
+    Counter *sent_;                                     // datagrams sent
+    Counter *dropped_;                                  // datagrams dropped
+};
+
+/**
+ * @class UnixStreamFlush
+ * @brief Derived class for sending logs over a Unix stream socket, e.g. to a local collector.
+ * @note Records are newline delimited. The socket is non-blocking: when the collector falls behind, the
+ * rest of a partly sent record is kept for the next batch and the records after it are dropped and counted.
+ * A closed connection is opened again at most once a second.
+ */
+class UnixStreamFlush : public LogFlush {
+public:
+    using ptr = std::shared_ptr<UnixStreamFlush>;
+
+    explicit UnixStreamFlush(const std::string &path) :
+        path_(path),
+        dropped_(Metrics::Get().GetCounter("asynlog_net_bytes_dropped_total", "Bytes dropped by stream sinks",
+                                           Metrics::Labels({{"dest", path}}))) {
+        Connect();
+    }
+
+    ~UnixStreamFlush() override {
+        if (fd_ >= 0) close(fd_);
+    }
+
+    /**
+     * @brief Sends the log data.
+     * @param data The log message data.
+     * @param len The length of the log message data.
+     */
+    void Flush(const char *data, size_t len) override {
+        if (fd_ < 0 && !Connect()) {
+            dropped_->Add(len);
+            return;
+        }
+        if (!pending_.empty()) { // finish the record cut by the last batch first, or the stream breaks
+            size_t n = Send(pending_.data(), pending_.size());
+            pending_.erase(0, n);
+            if (!pending_.empty()) {
+                dropped_->Add(len);
+                return;
+            }
+        }
+        size_t n = Send(data, len);
+        if (n == len) return;
+        const char *nl = static_cast<const char *>(memchr(data + n, '\n', len - n));
+        size_t record_end = nl ? nl - data + 1 : len;
+        if (fd_ >= 0 && n > 0 && data[n - 1] != '\n') pending_.assign(data + n, record_end - n);
+        else record_end = n;
+        dropped_->Add(len - record_end);
+    }
+
+    const char *Type() override { return "unix_stream"; }
+
+    uint64_t Dropped() { return dropped_->Value(); }
+
+private:
+    size_t Send(const char *data, size_t len) {
+        size_t done = 0;
+        while (done < len && fd_ >= 0) {
+            ssize_t n = send(fd_, data + done, len - done, MSG_DONTWAIT | MSG_NOSIGNAL);
+            if (n > 0) {
+                done += n;
+            } else if (n < 0 && errno == EINTR) {
+                continue;
+            } else {
+                if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) { // EPIPE, ECONNRESET
+                    close(fd_);
+                    fd_ = -1;
+                    pending_.clear();
+                }
+                break;
+            }
+        }
+        return done;
+    }
+
+    bool Connect() {
+        time_t now = Util::Date::Now();
+        if (now == last_connect_) return false;
+        last_connect_ = now;
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) return false;
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, path_.c_str(), sizeof(addr.sun_path) - 1);
+        if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+            close(fd);
+            return false;
+        }
+        fd_ = fd;
+        return true;
+    }
+
+private:
+    std::string path_;          // socket path
+    int fd_ = -1;               // connected socket
+    time_t last_connect_ = 0;   // second of the last connect attempt
+    std::string pending_;       // rest of a partly sent record
+    Counter *dropped_;          // bytes dropped
+};
+
+/**
+ * @class BackupFlush
+ * @brief Derived class for shipping whole batches to the backup server, see backup/Protocol.hpp.
+ * @note
+ * 1. One persistent TCP connection; every batch is one frame, zlib compressed if asked and built with zlib.
+ * Up to `window` frames are sent before the consumer thread waits for the server's acks, at most 1s.
+ *
+ * 2. Frames that cannot be sent or were not acked when the connection broke go to a backup::Spool. The next
+ * connection, tried at most once a second, replays the spool before new frames, about 1MB per Flush() so the
+ * consumer thread is not held up by a long outage; meanwhile new frames are spooled behind it. Acked frames
+ * are committed, so a replay cut short resumes after them. A full spool drops frames and counts their bytes.
+ *
+ * 3. Frames can arrive twice, e.g. when an ack was lost; the server stores a sequence number once per
+ * writer, identified by the spool, so other writers with the same name are not mistaken for duplicates.
+ */
+class BackupFlush : public LogFlush {
+public:
+    using ptr = std::shared_ptr<BackupFlush>;
+
+    /**
+     * @brief Constructs a new BackupFlush object.
+     * @param address "host:port" of the backup server with an IPv4 host, empty for backup_addr and backup_port of the config.
+     * @param name The stream name, the server stores it as backup/<name>.log.
+     * @param compress Whether to compress frames.
+     * @param spool The spool directory, empty for ./logfile/backup/<name>.spool.
+     * @param spool_max_bytes The largest spool.
+     * @param window The most frames sent and not acked.
+     */
+    BackupFlush(const std::string &address, const std::string &name, bool compress = true, const std::string &spool = "",
+                size_t spool_max_bytes = 256 * 1024 * 1024, size_t window = 32) :
+        address_(address.empty() ? conf_data->backup_addr + ":" + std::to_string(conf_data->backup_port) : address),
+        name_(name),
+        compress_(compress),
+        spool_path_(spool.empty() ? "./logfile/backup/" + name + ".spool" : spool),
+        spool_max_bytes_(spool_max_bytes),
+        window_(window ? window : 1),
+        spool_(spool_path_, spool_max_bytes),
+        sent_(Metrics::Get().GetCounter("asynlog_backup_frames_sent_total", "Frames sent to the backup server",
+                                        Metrics::Labels({{"stream", name}}))),
+        spooled_(Metrics::Get().GetCounter("asynlog_backup_spooled_bytes_total", "Bytes spooled while the backup server was unreachable",
+                                           Metrics::Labels({{"stream", name}}))),
+        dropped_(Metrics::Get().GetCounter("asynlog_backup_dropped_bytes_total", "Bytes dropped on a full backup spool",
+                                           Metrics::Labels({{"stream", name}}))) {
+        writer_ = backup::WriterId(spool_path_);
+        Connect();
+    }
+
+    /**
+     * @brief Waits for the last acks, spools what is not acked.
+     */
+    ~BackupFlush() override {
+        Sync();
+        if (fd_ >= 0) close(fd_);
+    }
+
+    /**
+     * @brief Sends the log data as one frame.
+     * @param data The log message data.
+     * @param len The length of the log message data.
+     */
+    void Flush(const char *data, size_t len) override {
+        seq_ = spool_.NextId();
+        backup::MakeFrame(seq_, data, len, compress_, &frame_);
+        // replay first, new frames after it: while behind, the frame takes its turn in the spool
+        if ((fd_ < 0 && !Connect()) || !Replay(std::max(kReplayBytes, 2 * frame_.size()))) {
+            Spool(seq_, frame_, len);
+            return;
+        }
+        if (!Send(seq_, frame_, false)) Spool(seq_, frame_, len);
+    }
+
+    /**
+     * @brief Waits for the acks of the frames sent, then makes the spool durable.
+     */
+    void Sync() override {
+        while (fd_ >= 0 && !inflight_.empty()) ReadAck(true);
+        spool_.Sync();
+    }
+
+    const char *Type() override { return "backup"; }
+
+    /**
+     * @brief Creates a BackupFlush with the shard's own stream and spool.
+     * @param shard The index of the shard.
+     */
+    LogFlush::ptr Clone(size_t shard) override {
+        return std::make_shared<BackupFlush>(address_, name_ + ".shard" + std::to_string(shard), compress_,
+                                             ShardFilename(spool_path_, shard), spool_max_bytes_, window_);
+    }
+
+    /**
+     * @brief Gets the state of the sink, e.g. for tests.
+     */
+    bool Connected() const { return fd_ >= 0; }
+    size_t InFlight() const { return inflight_.size(); }
+    size_t SpoolBytes() const { return spool_.Bytes(); }
+    uint64_t Sent() { return sent_->Value(); }
+    uint64_t Dropped() { return dropped_->Value(); }
+
+private:
+    static constexpr size_t kReplayBytes = 1024 * 1024; // spool replayed per Flush()
+
+    struct Frame {
+        uint64_t seq;
+        std::string data;
+        bool spooled;                           // already in the spool, replayed
+        backup::Spool::Position next;           // spooled: the spool position after the frame
+    };
+
+    /**
+     * @brief Send a frame and keep it until acked, waiting for acks while the window is full.
+     * @return false if the connection broke, the frames in flight are spooled then, this one is not
+     */
+    bool Send(uint64_t seq, const std::string &frame, bool spooled, const backup::Spool::Position &next = {}) {
+        if (!backup::WriteFull(fd_, frame.data(), frame.size())) {
+            Disconnect();
+            return false;
+        }
+        sent_->Add();
+        inflight_.push_back(Frame{seq, frame, spooled, next});
+        while (fd_ >= 0 && ReadAck(inflight_.size() >= window_)) {}
+        return true;
+    }
+
+    /**
+     * @brief Read one ack and release the frames it covers.
+     * @param block Whether to wait for the ack, at most the 1s receive timeout.
+     * @return true if an ack was read
+     */
+    bool ReadAck(bool block) {
+        while (ack_len_ < sizeof(ack_)) {
+            ssize_t n = recv(fd_, ack_ + ack_len_, sizeof(ack_) - ack_len_, block ? 0 : MSG_DONTWAIT);
+            if (n > 0) {
+                ack_len_ += n;
+            } else if (n < 0 && errno == EINTR) {
+                continue;
+            } else {
+                // a timeout while blocking means the server stopped reading, like a broken connection
+                if (n == 0 || block || (errno != EAGAIN && errno != EWOULDBLOCK)) Disconnect();
+                return false;
+            }
+        }
+        uint64_t seq;
+        memcpy(&seq, ack_, 8);
+        seq = be64toh(seq);
+        ack_len_ = 0;
+        while (!inflight_.empty() && inflight_.front().seq <= seq) {
+            if (inflight_.front().spooled) spool_.Commit(inflight_.front().next);
+            inflight_.pop_front();
+        }
+        return true;
+    }
+
+    /**
+     * @brief Connect to the server, at most once a second; the spool is replayed by the next Flush() calls.
+     */
+    bool Connect() {
+        time_t now = Util::Date::Now();
+        if (now == last_connect_) return false;
+        last_connect_ = now;
+        fd_ = backup::Connect(address_, backup::MakeHello(name_, compress_ ? backup::kFlagZlib : 0, writer_));
+        if (fd_ < 0) return false;
+        ack_len_ = 0;
+        replay_ = spool_.Checkpoint();
+        return true;
+    }
+
+    /**
+     * @brief Replay about max_bytes of the spool, oldest frames first.
+     * @return true once the whole spool is sent, new frames go out directly then
+     */
+    bool Replay(size_t max_bytes) {
+        size_t replayed = 0;
+        while (fd_ >= 0 && replay_ != spool_.End() && replayed < max_bytes) {
+            backup::Spool::Position next = spool_.Read(replay_, max_bytes - replayed,
+                [&](uint64_t seq, const char *data, size_t len, const backup::Spool::Position &next) {
+                    replayed += len;
+                    return Send(seq, std::string(data, len), true, next);
+                });
+            if (next == replay_) { // unreadable, the rest stays for the next connection
+                Disconnect();
+                break;
+            }
+            replay_ = next;
+        }
+        return fd_ >= 0 && replay_ == spool_.End();
+    }
+
+    /**
+     * @brief Close the connection and spool the frames it did not ack.
+     */
+    void Disconnect() {
+        if (fd_ >= 0) close(fd_);
+        fd_ = -1;
+        for (const Frame &f : inflight_) {
+            if (!f.spooled) Spool(f.seq, f.data, f.data.size());
+        }
+        inflight_.clear();
+    }
+
+    void Spool(uint64_t seq, const std::string &frame, size_t len) {
+        if (spool_.Append(seq, frame.data(), frame.size())) spooled_->Add(frame.size());
+        else dropped_->Add(len);
+    }
+
+private:
+    std::string address_;           // host:port of the server
+    std::string name_;              // stream name
+    bool compress_;                 // compress frames
+    std::string spool_path_;        // spool directory
+    size_t spool_max_bytes_;        // largest spool
+    size_t window_;                 // most frames in flight
+    backup::Spool spool_;           // frames not yet acked by the server, kept over restarts
+    uint64_t seq_ = 0;              // sequence number of the last frame, from spool_.NextId()
+    uint64_t writer_ = 0;           // writer id of the spool, the server dedups per stream and writer
+    backup::Spool::Position replay_; // next spooled frame to replay on this connection
+    int fd_ = -1;                   // connection, -1 while the server is unreachable
+    time_t last_connect_ = 0;       // second of the last connect attempt
+    std::deque<Frame> inflight_;    // frames sent and not acked, oldest first
+    std::string frame_;             // frame of the current batch
+    char ack_[8];                   // ack being read
+    size_t ack_len_ = 0;            // bytes of ack_ read
+    Counter *sent_;                 // frames sent
+    Counter *spooled_;              // bytes spooled
+    Counter *dropped_;              // bytes dropped
+};
+
 class LogFlushFactory {
 public:
     using ptr = std::shared_ptr<LogFlushFactory>;
@@ -197,5 +973,62 @@ public:
     {
         return std::make_shared<FlushType>(std::forward<Args>(args)...);
     }
+
+    /**
+     * @brief Creates a log flush object from its configuration.
+     * @param conf The flush configuration, e.g. `{"type": "file", "path": "./logfile/app.log", "index_kb": 64}`,
+     * `{"type": "roll_file", "path": "./logfile/app-", "max_size": 1048576, "index_kb": 64}`, `{"type": "stdout"}` or
+     * `{"type": "shm", "name": "app", "capacity": 8388608, "max_wait_ms": 100}`,
+     * `{"type": "udp", "address": "127.0.0.1:5140", "max_datagram": 1472}`,
+     * `{"type": "unix_dgram", "path": "/run/collector.sock"}`, `{"type": "unix_stream", "path": "/run/collector.sock"}` or
+     * `{"type": "backup", "address": "10.0.0.5:8080", "name": "app", "compress": true, "spool": "./logfile/backup/app.spool",
+     * "spool_max_bytes": 268435456}`.
+     * @return A shared pointer to the new log flush object, or nullptr if the type is unknown or the flush
+     * cannot open what it writes to, see LogFlush::Ok().
+     */
+    static std::shared_ptr<LogFlush> CreateFromConfig(const Json::Value &conf)
+    {
+        std::shared_ptr<LogFlush> flush = Create(conf);
+        if (flush && !flush->Ok()) {
+            std::cout << __FILE__ << __LINE__ << "cannot open flush: " << conf["type"].asString() << " "
+                      << conf.get("path", conf["name"]).asString() << std::endl;
+            return nullptr;
+        }
+        return flush;
+    }
+
+private:
+    /**
+     * @brief Creates a log flush object from its configuration, see CreateFromConfig().
+     */
+    static std::shared_ptr<LogFlush> Create(const Json::Value &conf)
+    {
+        std::string type = conf["type"].asString();
+        if (type == "stdout") {
+            return CreateLog<StdOutFlush>();
+        } else if (type == "file") {
+            return CreateLog<FileFlush>(conf["path"].asString(), static_cast<size_t>(conf.get("index_kb", 0).asUInt64() * 1024));
+        } else if (type == "roll_file") {
+            return CreateLog<RollFileFlush>(conf["path"].asString(), static_cast<size_t>(conf["max_size"].asUInt64()),
+                                            static_cast<size_t>(conf.get("index_kb", 0).asUInt64() * 1024));
+        } else if (type == "shm") {
+            return CreateLog<ShmFlush>(conf["name"].asString(), static_cast<size_t>(conf.get("capacity", 8 * 1024 * 1024).asUInt64()),
+                                       std::chrono::milliseconds(conf.get("max_wait_ms", 100).asUInt64()));
+        } else if (type == "udp") {
+            return CreateLog<DatagramFlush>(DatagramFlush::Kind::UDP, conf["address"].asString(),
+                                            static_cast<size_t>(conf["max_datagram"].asUInt64()));
+        } else if (type == "unix_dgram") {
+            return CreateLog<DatagramFlush>(DatagramFlush::Kind::UNIX, conf["path"].asString(),
+                                            static_cast<size_t>(conf["max_datagram"].asUInt64()));
+        } else if (type == "unix_stream") {
+            return CreateLog<UnixStreamFlush>(conf["path"].asString());
+        } else if (type == "backup") {
+            return CreateLog<BackupFlush>(conf["address"].asString(), conf["name"].asString(), conf.get("compress", true).asBool(),
+                                          conf["spool"].asString(),
+                                          static_cast<size_t>(conf.get("spool_max_bytes", 256 * 1024 * 1024).asUInt64()));
+        }
+        std::cout << __FILE__ << __LINE__ << "unknown flush type: " << type << std::endl;
+        return nullptr;
+    }
 };
 } // asynlog
\ No newline at end of file
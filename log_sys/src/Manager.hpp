@@ -6,7 +6,12 @@
 */
 #pragma once
 #include <unordered_map>
+#include <atomic> // for atomic
+#include <memory> // for unique_ptr
+#include <vector> // for vector
+#include <thread> // for this_thread
 #include "AsynLogger.hpp"
+#include "ConfigWatcher.hpp" // for ConfigWatcher
 namespace asynlog
 {
 /**
@@ -14,12 +19,32 @@ namespace asynlog
  * @note
  * The LoggerManager class is a singleton that manages all loggers.
  * It provides methods to add, get, and check the existence of loggers.
+ * 
+ * Lookups take no lock: the loggers live in an immutable map published through an atomic pointer.
+ * AddLogger() copies the map under mtx_, inserts and swaps the pointer. Old maps are retired: a lookup
+ * counts itself on the reader slot of its thread before loading the pointer, and the writer frees the
+ * retired maps only when it sees every slot at zero after the swap. A lookup counted later loads the new
+ * map, so no reader holds a freed one; when a lookup is in progress the maps wait for the next swap.
+ *
+ * Loggers can also be declared in a configuration file, see ApplyConfig(). WatchConfig() reapplies the
+ * file whenever it is rewritten: levels and sinks of existing loggers change in place, new loggers are added.
  */
 class LoggerManager {
 private:
-    std::mutex mtx_;                                            // mutex for thread safety
+    using LoggerMap = std::unordered_map<std::string, AsynLogger::ptr>;
+    std::mutex mtx_;                                            // mutex for writers
     AsynLogger::ptr default_logger_;                            // default logger
-    std::unordered_map<std::string, AsynLogger::ptr> loggers_;  // map of loggers
+    std::atomic<const LoggerMap *> loggers_;                    // current map of loggers, read without lock
+    std::vector<std::unique_ptr<const LoggerMap>> retired_;     // published maps not freed yet, current last, guarded by mtx_
+    static constexpr size_t kReaderSlots = 16;
+    struct alignas(64) ReaderSlot {
+        std::atomic<uint32_t> n{0};                             // lookups in progress
+    };
+    ReaderSlot readers_[kReaderSlots];                          // striped by thread, so lookups rarely share a line
+    std::mutex config_mtx_;                                     // serializes ApplyConfig()
+    std::unordered_map<std::string, std::string> sink_specs_;   // sinks each logger was configured with, guarded by config_mtx_
+    std::unordered_map<std::string, Json::Value> fixed_specs_;  // fields a configured logger was built with, guarded by config_mtx_
+    std::unique_ptr<ConfigWatcher> watcher_;                    // watches the configuration file, guarded by config_mtx_
 public:
 
     /**
@@ -37,20 +62,22 @@ public:
      * @return true if the logger exists, false otherwise
      */
     bool LoggerExists(const std::string &name) {
-        std::lock_guard<std::mutex> lock(mtx_);
-        return loggers_.find(name) != loggers_.end();
+        return FindLogger(name) != nullptr;
     }
 
     /**
      * @brief Add a logger to the manager
      * @param logger Logger to be added
-     * @note The logger is moved into the manager.
+     * @note The logger is moved into the manager. If a logger with the same name exists, nothing happens.
      */
     void AddLogger(const AsynLogger::ptr &&logger) {
-        if (LoggerExists(logger->Name()))
+        std::lock_guard<std::mutex> lock(mtx_); // check and insert under one lock
+        const LoggerMap *cur = loggers_.load(std::memory_order_relaxed);
+        if (cur->find(logger->Name()) != cur->end())
             return;
-        std::lock_guard<std::mutex> lock(mtx_);
-        loggers_[logger->Name()] = logger;
+        auto next = std::make_unique<LoggerMap>(*cur);
+        (*next)[logger->Name()] = logger;
+        Publish(std::move(next));
     }
 
     /**
@@ -59,12 +86,27 @@ public:
      * @return AsynLogger::ptr Pointer to the logger, or nullptr if not found
      */
     AsynLogger::ptr GetLogger(const std::string &name) {
-        std::lock_guard<std::mutex> lock(mtx_);
-        auto it = loggers_.find(name);
-        if (it != loggers_.end()) {
-            return it->second;
-        }
-        return nullptr;
+        return Read([&name](const LoggerMap &cur) -> AsynLogger::ptr {
+            auto it = cur.find(name);
+            if (it != cur.end()) {
+                return it->second;
+            }
+            return nullptr;
+        });
+    }
+
+    /**
+     * @brief Find a logger by name without touching its reference count
+     * @param name Name of the logger
+     * @return AsynLogger* Pointer to the logger, or nullptr if not found
+     * @note Loggers are never removed, so the pointer stays valid as long as the manager lives.
+     * Prefer it on hot paths: copying the shared_ptr makes all threads write the same reference count.
+     */
+    AsynLogger *FindLogger(const std::string &name) {
+        return Read([&name](const LoggerMap &cur) -> AsynLogger * {
+            auto it = cur.find(name);
+            return it != cur.end() ? it->second.get() : nullptr;
+        });
     }
 
     /**
@@ -72,8 +114,174 @@ public:
      * @return AsynLogger::ptr Pointer to the default logger
      */
     AsynLogger::ptr GetDefaultLogger() { return default_logger_; }
+
+    /**
+     * @brief Apply the `loggers` array of a configuration
+     * @param root The configuration, e.g.
+     * `{"loggers": [{"name": "net", "type": "safe", "level": "INFO", "buffer_size": 1048576, "shards": 2,
+     * "shard_mode": "ordered", "coalesce_ms": 1000, "format": "text", "pattern": "%d{%H:%M:%S.%e} [%t] %l %n %s:%# %v", "sinks": [{"type": "roll_file", "path": "./logfile/net-", "max_size": 1048576}]}]}`
+     * @return false if the configuration is malformed, nothing is applied then
+     * @note A logger that does not exist yet is built with all the fields. For an existing logger only
+     * the level and, if they differ from the last applied ones, the sinks change; type, buffer size,
+     * shards, coalescing, format and pattern are fixed once the logger runs, a change of them is reported and
+     * ignored. Swapping sinks loses and duplicates no record, see AsynLogger::SetFlushes(); unchanged sinks are
+     * not reopened. Every entry is checked and its new sinks are built before any is applied.
+     */
+    bool ApplyConfig(const Json::Value &root) {
+        if (!root.isObject() || !root["loggers"].isArray()) {
+            return false;
+        }
+        struct Entry {
+            const Json::Value *conf;
+            std::string name;
+            LogLevel::value level;
+            std::string spec;                       // the sinks, serialized
+            std::vector<LogFlush::ptr> flushes;
+        };
+        std::lock_guard<std::mutex> lock(config_mtx_);
+        std::vector<Entry> entries;
+        for (const Json::Value &conf : root["loggers"]) {
+            Entry e{&conf, conf["name"].asString(), LogLevel::value::DEBUG, "", {}};
+            if (e.name.empty() || (conf.isMember("level") && !LogLevel::FromString(conf["level"].asString(), &e.level)) ||
+                (conf.isMember("format") && conf["format"].asString() != "text" && conf["format"].asString() != "json")) {
+                std::cout << __FILE__ << __LINE__ << "bad logger config: " << e.name << std::endl;
+                return false;
+            }
+            Util::JsonUtil::Serialize(conf["sinks"], &e.spec);
+            auto applied = sink_specs_.find(e.name);
+            if (applied != sink_specs_.end() && applied->second == e.spec) {
+                entries.push_back(std::move(e)); // same sinks, kept open
+                continue;
+            }
+            for (const Json::Value &sink : conf["sinks"]) {
+                LogFlush::ptr flush = LogFlushFactory::CreateFromConfig(sink);
+                if (!flush) {
+                    std::cout << __FILE__ << __LINE__ << "bad sink config of logger " << e.name << std::endl;
+                    return false;
+                }
+                e.flushes.push_back(flush);
+            }
+            entries.push_back(std::move(e));
+        }
+        for (Entry &e : entries) {
+            const Json::Value &conf = *e.conf;
+            AsynLogger::ptr logger = GetLogger(e.name);
+            Json::Value fixed = FixedFields(conf);
+            if (logger) {
+                logger->SetLevel(e.level);
+                if (!e.flushes.empty()) {
+                    logger->SetFlushes(e.flushes);
+                }
+                ReportFixed(e.name, fixed);
+            } else {
+                LoggerBuilder builder;
+                builder.BuildLoggerName(e.name);
+                builder.BuildLoggerType(conf["type"].asString() == "unsafe" ? AsynType::ASYNC_UNSAFE : AsynType::ASYNC_SAFE);
+                builder.BuildLoggerLevel(e.level);
+                builder.BuildLoggerBufferSize(conf["buffer_size"].asUInt64());
+                builder.BuildLoggerCoalesce(std::chrono::milliseconds(conf["coalesce_ms"].asUInt64()));
+                builder.BuildLoggerFormat(conf["format"].asString() == "json" ? LogFormat::JSON : LogFormat::TEXT);
+                builder.BuildLoggerPattern(conf["pattern"].asString());
+                if (conf.isMember("shards")) {
+                    builder.BuildLoggerShards(conf["shards"].asUInt64(), conf["shard_mode"].asString() == "per_shard" ?
+                        ShardMode::PER_SHARD_FILE : ShardMode::ORDERED_MERGE);
+                }
+                for (auto &flush : e.flushes) {
+                    builder.BuildLoggerFlush(flush);
+                }
+                AddLogger(builder.Build());
+                fixed_specs_[e.name] = fixed;
+            }
+            sink_specs_[e.name] = e.spec;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Read a configuration file and apply it
+     * @param path The path of the file, JsonData::ConfigPath() by default
+     * @return false if the file cannot be read or is malformed
+     */
+    bool LoadConfig(const std::string &path = Util::JsonData::ConfigPath()) {
+        std::string content;
+        Json::Value root;
+        if (!Util::File().GetContent(&content, path) || !Util::JsonUtil::UnSerialize(content, &root)) {
+            return false;
+        }
+        return ApplyConfig(root);
+    }
+
+    /**
+     * @brief Load a configuration file and reload it whenever it is rewritten
+     * @param path The path of the file, JsonData::ConfigPath() by default
+     * @return false if the file cannot be watched, the first load failing is not an error
+     * @note A malformed rewrite is reported and ignored, the loggers keep the last good settings.
+     * Only the buffer sizes and thread count read by JsonData stay as they were at startup.
+     */
+    bool WatchConfig(const std::string &path = Util::JsonData::ConfigPath()) {
+        LoadConfig(path);
+        auto watcher = std::make_unique<ConfigWatcher>(path, [this](const std::string &p) {
+            if (!LoadConfig(p)) {
+                std::cout << __FILE__ << __LINE__ << "reload " << p << " failed" << std::endl;
+            }
+        });
+        if (!watcher->Watching()) {
+            return false;
+        }
+        std::unique_ptr<ConfigWatcher> old;
+        {
+            std::lock_guard<std::mutex> lock(config_mtx_);
+            old.swap(watcher_);
+            watcher_ = std::move(watcher);
+        }
+        return true; // old is stopped here, outside config_mtx_ its callback may be waiting for
+    }
+
+    /**
+     * @brief Stop reloading the configuration file
+     */
+    void StopWatching() {
+        std::unique_ptr<ConfigWatcher> old;
+        {
+            std::lock_guard<std::mutex> lock(config_mtx_);
+            old.swap(watcher_);
+        }
+    }
+
+    ~LoggerManager() { StopWatching(); }
 private:
 
+    /**
+     * @brief Get the fields of a logger entry that are fixed once the logger runs
+    */
+    static Json::Value FixedFields(const Json::Value &conf) {
+        static const char *kFixed[] = {"type", "buffer_size", "shards", "shard_mode", "coalesce_ms", "format", "pattern"};
+        Json::Value fixed(Json::objectValue);
+        for (const char *key : kFixed) {
+            if (conf.isMember(key)) fixed[key] = conf[key];
+        }
+        return fixed;
+    }
+
+    /**
+     * @brief Report the fixed fields a reload changes for a running logger, they are not applied
+     * @note Must be called with config_mtx_ held.
+    */
+    void ReportFixed(const std::string &name, const Json::Value &fixed) {
+        auto built = fixed_specs_.find(name);
+        Json::Value before = built != fixed_specs_.end() ? built->second : Json::Value(Json::objectValue);
+        std::string changed;
+        for (const std::string &key : before.getMemberNames()) {
+            if (!fixed.isMember(key) || fixed[key] != before[key]) changed += " " + key;
+        }
+        for (const std::string &key : fixed.getMemberNames()) {
+            if (!before.isMember(key)) changed += " " + key;
+        }
+        if (!changed.empty()) {
+            std::cout << __FILE__ << __LINE__ << "logger " << name << " is running, ignored changes of:" << changed << std::endl;
+        }
+    }
+
     /**
      * @brief Private constructor for singleton pattern
      * @note Initializes the default logger
@@ -82,7 +290,67 @@ private:
         std::unique_ptr<LoggerBuilder> builder = std::make_unique<LoggerBuilder>();
         builder->BuildLoggerName("default_logger");
         default_logger_ = builder->Build();
-        loggers_["default_logger"] = default_logger_;
+        auto first = std::make_unique<LoggerMap>();
+        (*first)["default_logger"] = default_logger_;
+        Publish(std::move(first));
+    }
+
+    /**
+     * @brief Look up in the current map, counted on the reader slot of the thread while it runs
+    */
+    template <class F>
+    auto Read(F &&f) -> decltype(f(std::declval<const LoggerMap &>())) {
+        std::atomic<uint32_t> &n = readers_[ReaderSlotOf()].n;
+        n.fetch_add(1, std::memory_order_seq_cst);
+        auto result = f(*loggers_.load(std::memory_order_seq_cst));
+        n.fetch_sub(1, std::memory_order_release);
+        return result;
+    }
+
+    /**
+     * @brief Swap in a new map and free the retired ones if no lookup is in progress, called under mtx_
+    */
+    void Publish(std::unique_ptr<const LoggerMap> next) {
+        loggers_.store(next.get(), std::memory_order_seq_cst);
+        retired_.push_back(std::move(next));
+        for (ReaderSlot &slot : readers_) {
+            if (slot.n.load(std::memory_order_seq_cst) != 0) return;
+        }
+        retired_.erase(retired_.begin(), retired_.end() - 1);
     }
+
+    static size_t ReaderSlotOf() {
+        thread_local size_t slot = std::hash<std::thread::id>()(std::this_thread::get_id()) % kReaderSlots;
+        return slot;
+    }
+};
+
+/**
+ * @brief LoggerHandle class
+ * @note
+ * An interned logger name: the first successful lookup is cached, later uses cost one atomic load.
+ * Keep it in a static at the call site, e.g. `static asynlog::LoggerHandle net("net"); net->Info(...);`
+ */
+class LoggerHandle {
+private:
+    std::string name_;                                          // name of the logger
+    std::atomic<AsynLogger *> logger_{nullptr};                 // cached logger
+public:
+    explicit LoggerHandle(const std::string &name) : name_(name) {}
+
+    /**
+     * @brief Get the logger
+     * @return AsynLogger* Pointer to the logger, or nullptr if it was not added yet
+     */
+    AsynLogger *Get() {
+        AsynLogger *logger = logger_.load(std::memory_order_acquire);
+        if (logger == nullptr) {
+            logger = LoggerManager::GetInstance().FindLogger(name_);
+            logger_.store(logger, std::memory_order_release);
+        }
+        return logger;
+    }
+
+    AsynLogger *operator->() { return Get(); }
 };
 } // namespace asynlog
\ No newline at end of file
@@ -10,8 +10,19 @@
 #include <thread> // for thread
 #include "Level.hpp" // for level
 #include "Util.hpp" // for Now()
+#include "Field.hpp" // for Field
+#include "JsonEncoder.hpp" // for JsonEncoder
+#include "Context.hpp" // for LogContext
 namespace asynlog
 {
+/**
+ * @brief Layout of the records of a logger
+*/
+enum class LogFormat {
+    TEXT, // [time][tid][LEVEL][logger][file:line]\tmessage key=value...
+    JSON  // one JSON object per line
+};
+
 /**
  * @brief LogMessage class
  */
@@ -24,6 +35,8 @@ public:
     std::string payload_;    // 
     std::thread::id tid_;    // thread id
     LogLevel::value level_;  // level of log
+    const Field *fields_ = nullptr; // structured fields, owned by the log call
+    size_t nfields_ = 0;     // number of fields
 public:
     LogMessage() = default;
     /**
@@ -35,13 +48,23 @@ public:
      * @param payload The payload of the log
     */
     LogMessage(LogLevel::value level, std::string filename, size_t line, std::string name, std::string payload) :
-        name_(name),
-        file_name_(filename),
         line_(line),
-        level_(level),
-        payload_(payload),
         ctime_(Util::Date::Now()),
-        tid_(std::this_thread::get_id()) {}
+        file_name_(filename),
+        name_(name),
+        payload_(payload),
+        tid_(std::this_thread::get_id()),
+        level_(level) {}
+
+    /**
+     * @brief Attach structured fields, they must outlive the formatting
+     * @param fields the fields
+     * @param n the number of fields
+    */
+    void SetFields(const Field *fields, size_t n) {
+        fields_ = fields;
+        nfields_ = n;
+    }
     /**
     * @brief formatter
     * @return The formatted log message
@@ -57,7 +80,58 @@ public:
         std::string tmp1 = '[' + std::string(buf) + "][";
         std::string tmp2 = "][" + std::string(LogLevel::ToString(level_)) + "][" + name_ + "][" + file_name_ + ":" + std::to_string(line_) + "]\t" + payload_ + "\n";
         ret << tmp1 << tid_ << tmp2;
-        return ret.str();
+        std::string out = ret.str();
+        if (nfields_ > 0) { // fields go after the payload, before the newline
+            out.pop_back();
+            Field::AppendText(out, fields_, nfields_);
+            out += '\n';
+        }
+        return out;
+    }
+
+    /**
+     * @brief JSON formatter
+     * @param out the string to append the record to
+     * @example {"ts":1749888000,"tid":140677926471488,"level":"INFO","logger":"log","file":"a.cpp","line":8,"msg":"login","user":42}
+    */
+    void FormatJson(std::string &out) const {
+        FormatJson(out, level_, ctime_, file_name_.c_str(), line_, name_, payload_.data(), payload_.size(), fields_, nfields_);
+    }
+
+    /**
+     * @brief JSON formatter without a LogMessage, used by the structured log calls
+     * @param context context of the thread, its members appended after the fields, may be nullptr
+     * @note Appends to out and allocates nothing once out has grown to the record size. A key appears once:
+     * of the fields sharing a key the last one is written, and a field hides a context member with its key.
+    */
+    static void FormatJson(std::string &out, LogLevel::value level, time_t ctime, const char *file, size_t line,
+                           const std::string &name, const char *msg, size_t msg_len, const Field *fields, size_t nfields,
+                           LogContext *context = nullptr) {
+        JsonEncoder enc(out);
+        enc.Begin();
+        enc.Key("ts");
+        enc.Int(ctime);
+        enc.Key("tid");
+        enc.Uint(static_cast<uint64_t>(pthread_self()));
+        enc.Key("level");
+        const char *lv = LogLevel::ToString(level);
+        size_t lv_len = strlen(lv);
+        while (lv_len > 0 && lv[lv_len - 1] == ' ') lv_len--; // text names are padded to one width
+        enc.String(lv, lv_len);
+        enc.Key("logger");
+        enc.String(name);
+        enc.Key("file");
+        enc.String(file, strlen(file));
+        enc.Key("line");
+        enc.Uint(line);
+        enc.Key("msg");
+        enc.String(msg, msg_len);
+        for (size_t i = 0; i < nfields; i++) {
+            if (Field::Find(fields, nfields, fields[i].key) == i) enc.Member(fields[i]);
+        }
+        if (context) context->AppendJson(out, fields, nfields);
+        enc.End();
+        out += '\n';
     }
 };
 } // namespace asynlog
\ No newline at end of file
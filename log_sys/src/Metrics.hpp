@@ -0,0 +1,384 @@
+/**
+ * @file Metrics.hpp
+ * @brief Metrics of the logger internals: striped counters, gauges and histograms, exported as Prometheus text.
+ * @author bhhxx
+ * @date 2025-06-11
+*/
+#pragma once
+#include <atomic> // for atomic
+#include <map> // for map
+#include <deque> // for deque
+#include <mutex> // for mutex
+#include <string> // for string
+#include <vector> // for vector
+#include <thread> // for thread
+#include <functional> // for function
+#include <chrono> // for steady_clock
+#include <iostream> // for cout
+#include <cstdio> // for snprintf, rename
+#include <cstring> // for strerror
+#include <cerrno> // for errno
+#include <poll.h> // for poll
+#include <unistd.h> // for pipe, write, close, unlink
+#include <sys/socket.h> // for socket, bind, listen, accept
+#include <sys/un.h> // for sockaddr_un
+#include "Util.hpp" // for Util::Thread
+
+namespace asynlog
+{
+/**
+ * @brief Number of stripes of a metric, threads with different Util::Thread::Index() below it never share one
+*/
+static constexpr size_t kMetricStripes = 16;
+
+/**
+ * @brief Counter class: monotonic count, each thread adds to its own stripe and Value() sums them
+*/
+class Counter {
+public:
+    void Add(uint64_t n = 1) {
+        stripes_[Util::Thread::Index() % kMetricStripes].v.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    uint64_t Value() const {
+        uint64_t sum = 0;
+        for (auto &s : stripes_) sum += s.v.load(std::memory_order_relaxed);
+        return sum;
+    }
+
+private:
+    struct alignas(64) Stripe {
+        std::atomic<uint64_t> v{0};
+    };
+    Stripe stripes_[kMetricStripes];
+};
+
+/**
+ * @brief MaxGauge class: the highest value ever reported, e.g. a high-water mark
+*/
+class MaxGauge {
+public:
+    void Update(uint64_t v) {
+        uint64_t cur = max_.load(std::memory_order_relaxed);
+        while (v > cur && !max_.compare_exchange_weak(cur, v, std::memory_order_relaxed)) {}
+    }
+
+    uint64_t Value() const { return max_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> max_{0};
+};
+
+/**
+ * @brief Histogram class: durations in power of two buckets from 1us to about 8.6s, striped like Counter
+*/
+class Histogram {
+public:
+    static constexpr size_t kBuckets = 24;      // bucket i holds durations <= 2^(10 + i) ns, one more for the rest
+    static constexpr int kFirstShift = 10;
+
+    void Observe(uint64_t ns) {
+        size_t i = ns <= (1ull << kFirstShift) ? 0 : 64 - __builtin_clzll(ns - 1) - kFirstShift;
+        if (i > kBuckets) i = kBuckets;
+        Stripe &s = stripes_[Util::Thread::Index() % kMetricStripes];
+        s.counts[i].fetch_add(1, std::memory_order_relaxed);
+        s.sum_ns.fetch_add(ns, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Sum the stripes
+     * @param counts set to the non-cumulative count of every bucket, the last one unbounded
+     * @param sum_ns set to the sum of the observed durations
+    */
+    void Snapshot(std::vector<uint64_t> *counts, uint64_t *sum_ns) const {
+        counts->assign(kBuckets + 1, 0);
+        *sum_ns = 0;
+        for (auto &s : stripes_) {
+            for (size_t i = 0; i <= kBuckets; i++) (*counts)[i] += s.counts[i].load(std::memory_order_relaxed);
+            *sum_ns += s.sum_ns.load(std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @brief Get the upper bound of bucket i in nanoseconds
+    */
+    static uint64_t BoundNs(size_t i) { return 1ull << (kFirstShift + i); }
+
+private:
+    struct alignas(64) Stripe {
+        std::atomic<uint64_t> counts[kBuckets + 1] = {};
+        std::atomic<uint64_t> sum_ns{0};
+    };
+    Stripe stripes_[kMetricStripes];
+};
+
+/**
+ * @brief Metrics class
+ * @note
+ * 1. A singleton registry of named metrics. Get*() returns the metric for a name and label set, creating it
+ * on first use; metrics are never freed, so the returned pointers stay valid and hot paths keep them.
+ *
+ * 2. Recording is a relaxed atomic add on the stripe of the calling thread; Render() sums the stripes.
+ *
+ * 3. Callback metrics read a value owned elsewhere at render time, e.g. the ThreadPool queue depth.
+*/
+class Metrics {
+public:
+    using callback = std::function<double()>;
+
+    static Metrics &Get() {
+        static Metrics *metrics = new Metrics(); // never destroyed, threads may still record at exit
+        return *metrics;
+    }
+
+    /**
+     * @brief Render a label set
+     * @param labels name and value pairs
+     * @return e.g. `logger="net",sink="0"`
+    */
+    static std::string Labels(std::initializer_list<std::pair<const char *, std::string>> labels) {
+        std::string out;
+        for (auto &l : labels) {
+            if (!out.empty()) out += ',';
+            out += l.first;
+            out += "=\"";
+            for (char c : l.second) {
+                if (c == '"' || c == '\\') out += '\\';
+                out += c == '\n' ? ' ' : c;
+            }
+            out += '"';
+        }
+        return out;
+    }
+
+    Counter *GetCounter(const std::string &name, const std::string &help, const std::string &labels = "") {
+        return &Find(name, help, "counter", labels).counter;
+    }
+
+    MaxGauge *GetMaxGauge(const std::string &name, const std::string &help, const std::string &labels = "") {
+        return &Find(name, help, "gauge", labels).gauge;
+    }
+
+    Histogram *GetHistogram(const std::string &name, const std::string &help, const std::string &labels = "") {
+        return &Find(name, help, "histogram", labels).histogram;
+    }
+
+    /**
+     * @brief Add a metric whose value is read from a callback when rendering
+     * @param type "counter" or "gauge"
+     * @note The callback must stay callable for the life of the process. A second add of the same series is ignored.
+    */
+    void AddCallback(const std::string &name, const std::string &help, const std::string &type,
+                     const std::string &labels, const callback &cb) {
+        Series &s = Find(name, help, type, labels);
+        std::lock_guard<std::mutex> lock(mtx_);
+        if (!s.cb) s.cb = cb;
+    }
+
+    /**
+     * @brief Render every metric in the Prometheus text exposition format
+    */
+    std::string Render() {
+        std::lock_guard<std::mutex> lock(mtx_);
+        std::string out;
+        char num[64];
+        std::vector<uint64_t> counts;
+        for (auto &f : families_) {
+            out += "# HELP " + f.first + " " + f.second.help + "\n";
+            out += "# TYPE " + f.first + " " + f.second.type + "\n";
+            for (Series *s : f.second.series) {
+                std::string labels = s->labels.empty() ? "" : "{" + s->labels + "}";
+                if (f.second.type != "histogram") {
+                    double v = s->cb ? s->cb() : f.second.type == "counter" ? s->counter.Value() : s->gauge.Value();
+                    snprintf(num, sizeof(num), " %.17g\n", v);
+                    out += f.first + labels + num;
+                    continue;
+                }
+                uint64_t sum_ns, total = 0;
+                s->histogram.Snapshot(&counts, &sum_ns);
+                std::string sep = s->labels.empty() ? "" : ",";
+                for (size_t i = 0; i <= Histogram::kBuckets; i++) {
+                    total += counts[i];
+                    if (i < Histogram::kBuckets) {
+                        snprintf(num, sizeof(num), "%.9g", Histogram::BoundNs(i) / 1e9);
+                    } else {
+                        snprintf(num, sizeof(num), "+Inf");
+                    }
+                    out += f.first + "_bucket{" + s->labels + sep + "le=\"" + num + "\"} " + std::to_string(total) + "\n";
+                }
+                snprintf(num, sizeof(num), " %.9f\n", sum_ns / 1e9);
+                out += f.first + "_sum" + labels + num;
+                out += f.first + "_count" + labels + " " + std::to_string(total) + "\n";
+            }
+        }
+        return out;
+    }
+
+    /**
+     * @brief Write a snapshot to a file, replaced atomically so a reader never sees half of it
+     * @param path the file, e.g. in the textfile directory of the node exporter
+     * @return false if the file cannot be written
+    */
+    bool WriteFile(const std::string &path) {
+        std::string text = Render();
+        std::string tmp = path + ".tmp";
+        FILE *fp = fopen(tmp.c_str(), "wb");
+        if (fp == NULL) {
+            return false;
+        }
+        bool ok = fwrite(text.data(), 1, text.size(), fp) == text.size();
+        ok = fclose(fp) == 0 && ok;
+        return ok && rename(tmp.c_str(), path.c_str()) == 0;
+    }
+
+private:
+    struct Series {
+        std::string labels;
+        Counter counter;
+        MaxGauge gauge;
+        Histogram histogram;
+        callback cb;
+    };
+
+    struct Family {
+        std::string help;
+        std::string type;
+        std::vector<Series *> series;
+    };
+
+    Metrics() = default;
+
+    Series &Find(const std::string &name, const std::string &help, const std::string &type, const std::string &labels) {
+        std::lock_guard<std::mutex> lock(mtx_);
+        Family &f = families_[name];
+        if (f.type.empty()) {
+            f.help = help;
+            f.type = type;
+        }
+        for (Series *s : f.series) {
+            if (s->labels == labels) return *s;
+        }
+        storage_.emplace_back();
+        storage_.back().labels = labels;
+        f.series.push_back(&storage_.back());
+        return storage_.back();
+    }
+
+private:
+    std::mutex mtx_;                            // guards the registry, not the values
+    std::map<std::string, Family> families_;    // by metric name, rendered in name order
+    std::deque<Series> storage_;                // every series, never moved
+};
+
+/**
+ * @brief MetricsExporter class
+ * @note
+ * 1. Serves a snapshot to every client connecting to a Unix domain socket, e.g. `socat - UNIX:/run/app.metrics`,
+ * and/or rewrites a snapshot file every interval.
+ *
+ * 2. Both run on one background thread; the destructor stops it and removes the socket.
+*/
+class MetricsExporter {
+public:
+    /**
+     * @brief MetricsExporter constructor
+     * @param socket_path the Unix socket to serve on, empty for none
+     * @param file_path the file to rewrite every interval, empty for none
+     * @param interval how often to rewrite the file
+    */
+    MetricsExporter(const std::string &socket_path, const std::string &file_path = "",
+                    std::chrono::milliseconds interval = std::chrono::milliseconds(10000)) :
+        socket_path_(socket_path), file_path_(file_path), interval_(interval) {
+        if (pipe(stop_pipe_) < 0) {
+            std::cout << __FILE__ << __LINE__ << "pipe failed: " << strerror(errno) << std::endl;
+            return;
+        }
+        if (!socket_path_.empty() && !Listen()) {
+            return;
+        }
+        thread_ = std::thread(&MetricsExporter::ThreadEntry, this);
+    }
+
+    ~MetricsExporter() {
+        if (thread_.joinable()) {
+            char c = 0;
+            while (write(stop_pipe_[1], &c, 1) < 0 && errno == EINTR) {}
+            thread_.join();
+        }
+        if (listen_fd_ >= 0) {
+            close(listen_fd_);
+            unlink(socket_path_.c_str());
+        }
+        if (stop_pipe_[0] >= 0) close(stop_pipe_[0]);
+        if (stop_pipe_[1] >= 0) close(stop_pipe_[1]);
+    }
+
+    /**
+     * @brief Check if the exporter thread runs
+    */
+    bool Running() { return thread_.joinable(); }
+
+private:
+    bool Listen() {
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (socket_path_.size() >= sizeof(addr.sun_path)) {
+            std::cout << __FILE__ << __LINE__ << "socket path too long: " << socket_path_ << std::endl;
+            return false;
+        }
+        memcpy(addr.sun_path, socket_path_.c_str(), socket_path_.size());
+        listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        unlink(socket_path_.c_str()); // left over by a previous run
+        if (listen_fd_ < 0 || bind(listen_fd_, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(listen_fd_, 8) < 0) {
+            std::cout << __FILE__ << __LINE__ << "metrics socket " << socket_path_ << " failed: " << strerror(errno) << std::endl;
+            if (listen_fd_ >= 0) close(listen_fd_);
+            listen_fd_ = -1;
+            return false;
+        }
+        return true;
+    }
+
+    void ThreadEntry() {
+        struct pollfd fds[2] = {{stop_pipe_[0], POLLIN, 0}, {listen_fd_, POLLIN, 0}};
+        auto next_write = std::chrono::steady_clock::now() + interval_;
+        while (1) {
+            int timeout = -1;
+            if (!file_path_.empty()) {
+                auto left = std::chrono::duration_cast<std::chrono::milliseconds>(next_write - std::chrono::steady_clock::now());
+                timeout = left.count() < 0 ? 0 : static_cast<int>(left.count());
+            }
+            int r = poll(fds, listen_fd_ >= 0 ? 2 : 1, timeout);
+            if (r < 0 && errno != EINTR) return;
+            if (fds[0].revents != 0) return;
+            if (!file_path_.empty() && std::chrono::steady_clock::now() >= next_write) {
+                Metrics::Get().WriteFile(file_path_);
+                next_write = std::chrono::steady_clock::now() + interval_;
+            }
+            if (r > 0 && listen_fd_ >= 0 && (fds[1].revents & POLLIN)) {
+                int conn = accept(listen_fd_, nullptr, nullptr);
+                if (conn < 0) continue;
+                std::string text = Metrics::Get().Render();
+                const char *p = text.data();
+                size_t left = text.size();
+                while (left > 0) {
+                    ssize_t n = send(conn, p, left, MSG_NOSIGNAL);
+                    if (n < 0 && errno == EINTR) continue;
+                    if (n <= 0) break;
+                    p += n;
+                    left -= n;
+                }
+                close(conn);
+            }
+        }
+    }
+
+private:
+    std::string socket_path_;
+    std::string file_path_;
+    std::chrono::milliseconds interval_;
+    int listen_fd_ = -1;
+    int stop_pipe_[2] = {-1, -1};       // written by the destructor to wake the thread
+    std::thread thread_;                // exporter thread, started last
+};
+} // namespace asynlog
@@ -0,0 +1,241 @@
+/**
+ * @file Pattern.hpp
+ * @brief PatternLayout class: a layout pattern such as `%d{%H:%M:%S.%e} [%t] %l %n %s:%# %v`, compiled once into steps.
+ * @author bhhxx
+ * @date 2025-06-15
+*/
+#pragma once
+#include <string> // for string
+#include <vector> // for vector
+#include <memory> // for shared_ptr
+#include <atomic> // for atomic
+#include <charconv> // for to_chars
+#include <time.h> // for clock_gettime, localtime_r, strftime
+#include <pthread.h> // for pthread_self
+#include "Level.hpp" // for LogLevel
+#include "Field.hpp" // for Field
+#include "CallSite.hpp" // for CallSite
+
+namespace asynlog
+{
+/**
+ * @brief PatternLayout class
+ * @note
+ * 1. Conversions:
+ *    %d{fmt} local time, fmt is strftime with %e for milliseconds and %f for microseconds, %d alone is %Y-%m-%d %H:%M:%S
+ *    %t thread id, %l level, %n logger name, %s source file basename, %g source file as given, %# line,
+ *    %! function,
+ *    %v message followed by the structured fields and the thread's context fields, %X the context fields
+ *    alone (then %v leaves them out), %% a percent sign. Any other text is copied as it is.
+ *
+ * 2. The pattern is parsed once into a vector of steps, Format() runs them in order and appends to the
+ * caller's string, no stream and no temporary strings. The strftime part of a date is rendered once per
+ * second and thread and then copied.
+ *
+ * 3. A newline is appended to every record. The Coalescer compares what follows the first '\t', so
+ * patterns without a tab are compared as whole lines.
+*/
+class PatternLayout {
+public:
+    using ptr = std::shared_ptr<const PatternLayout>;
+
+    /**
+     * @brief The parts of a record a layout can refer to, all owned by the log call
+    */
+    struct Record {
+        const CallSite *site;               // call site, with the level
+        struct timespec time;               // wall clock time of the log call
+        const std::string *logger;          // logger name
+        const char *msg;                    // message
+        size_t msg_len;                     // length of msg
+        const Field *fields = nullptr;      // structured fields
+        size_t nfields = 0;                 // number of fields
+        const std::string *context = nullptr; // context fields rendered by LogContext::Text(), may be nullptr
+    };
+
+    /**
+     * @brief The layout of LogMessage::format() with the file basename, `[%d{%H:%M:%S}][%t][%l][%n][%s:%#]\t%v`
+    */
+    static const char *DefaultPattern() { return "[%d{%H:%M:%S}][%t][%l][%n][%s:%#]\t%v"; }
+
+    /**
+     * @brief Compile a pattern
+     * @param pattern the pattern, an empty one is the default pattern
+    */
+    explicit PatternLayout(const std::string &pattern = "") : pattern_(pattern.empty() ? DefaultPattern() : pattern) {
+        Compile();
+    }
+
+    const std::string &Pattern() const { return pattern_; }
+
+    /**
+     * @brief Append a record and a newline
+     * @param out the string to append to
+     * @param r the record
+    */
+    void Format(std::string &out, const Record &r) const {
+        for (const Step &s : steps_) {
+            switch (s.kind) {
+                case Kind::LITERAL: out += s.text; break;
+                case Kind::DATE: AppendDate(out, s, r.time.tv_sec); break;
+                case Kind::MILLIS: AppendPadded(out, r.time.tv_nsec / 1000000, 3); break;
+                case Kind::MICROS: AppendPadded(out, r.time.tv_nsec / 1000, 6); break;
+                case Kind::THREAD: AppendThread(out); break;
+                case Kind::LEVEL: out += LogLevel::ToString(r.site->level); break;
+                case Kind::LOGGER: out += *r.logger; break;
+                case Kind::BASENAME: out += r.site->basename; break;
+                case Kind::FILE: out += r.site->file; break;
+                case Kind::LINE: AppendNumber(out, r.site->line); break;
+                case Kind::FUNCTION: out += r.site->function; break;
+                case Kind::MESSAGE:
+                    out.append(r.msg, r.msg_len);
+                    Field::AppendText(out, r.fields, r.nfields);
+                    if (r.context && !context_step_) out += *r.context;
+                    break;
+                case Kind::CONTEXT:
+                    if (r.context && !r.context->empty()) out.append(*r.context, 1, std::string::npos); // no leading space
+                    break;
+            }
+        }
+        out += '\n';
+    }
+
+    /**
+     * @brief Get the current wall clock time for Record::time
+    */
+    static struct timespec Now() {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        return ts;
+    }
+
+private:
+    enum class Kind { LITERAL, DATE, MILLIS, MICROS, THREAD, LEVEL, LOGGER, BASENAME, FILE, LINE, FUNCTION, MESSAGE, CONTEXT };
+
+    struct Step {
+        Kind kind;
+        std::string text;   // LITERAL text or DATE strftime format
+        uint64_t id = 0;    // DATE: identifies the step in the per-thread cache
+    };
+
+    void Compile() {
+        std::string literal;
+        auto flush_literal = [&]() {
+            if (literal.empty()) return;
+            steps_.push_back(Step{Kind::LITERAL, literal});
+            literal.clear();
+        };
+        auto push = [&](Kind kind) {
+            flush_literal();
+            steps_.push_back(Step{kind, ""});
+        };
+        const std::string &p = pattern_;
+        for (size_t i = 0; i < p.size(); i++) {
+            if (p[i] != '%' || i + 1 == p.size()) {
+                literal += p[i];
+                continue;
+            }
+            char c = p[++i];
+            switch (c) {
+                case 'd': {
+                    std::string spec = "%Y-%m-%d %H:%M:%S";
+                    size_t close;
+                    if (i + 1 < p.size() && p[i + 1] == '{' && (close = p.find('}', i + 2)) != std::string::npos) {
+                        spec = p.substr(i + 2, close - i - 2);
+                        i = close;
+                    }
+                    flush_literal();
+                    CompileDate(spec);
+                    break;
+                }
+                case 't': push(Kind::THREAD); break;
+                case 'l': push(Kind::LEVEL); break;
+                case 'n': push(Kind::LOGGER); break;
+                case 's': push(Kind::BASENAME); break;
+                case 'g': push(Kind::FILE); break;
+                case '#': push(Kind::LINE); break;
+                case '!': push(Kind::FUNCTION); break;
+                case 'v': push(Kind::MESSAGE); break;
+                case 'X': push(Kind::CONTEXT); context_step_ = true; break;
+                case '%': literal += '%'; break;
+                default: literal += '%'; literal += c; break; // unknown conversions are kept as text
+            }
+        }
+        flush_literal();
+    }
+
+    /**
+     * @brief Split a date spec at %e and %f into strftime steps and sub-second steps
+    */
+    void CompileDate(const std::string &spec) {
+        std::string part;
+        auto flush = [&]() {
+            if (part.empty()) return;
+            steps_.push_back(Step{Kind::DATE, part, NextId()});
+            part.clear();
+        };
+        for (size_t i = 0; i < spec.size(); i++) {
+            if (spec[i] == '%' && i + 1 < spec.size() && (spec[i + 1] == 'e' || spec[i + 1] == 'f')) {
+                flush();
+                steps_.push_back(Step{spec[i + 1] == 'e' ? Kind::MILLIS : Kind::MICROS, ""});
+                i++;
+            } else if (spec[i] == '%' && i + 1 < spec.size()) {
+                part += spec[i];
+                part += spec[++i];
+            } else {
+                part += spec[i];
+            }
+        }
+        flush();
+    }
+
+    static uint64_t NextId() {
+        static std::atomic<uint64_t> next{1};
+        return next.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Append the strftime part of a date, rendered again only when the second or the step changes
+    */
+    static void AppendDate(std::string &out, const Step &s, time_t sec) {
+        struct Cache {
+            uint64_t id = 0;
+            time_t sec = -1;
+            char buf[128];
+            size_t len = 0;
+        };
+        thread_local Cache caches[4]; // a few slots, so the date steps of a pattern or two do not evict each other
+        Cache &cache = caches[s.id % 4];
+        if (cache.id != s.id || cache.sec != sec) {
+            struct tm t;
+            localtime_r(&sec, &t);
+            cache.len = strftime(cache.buf, sizeof(cache.buf), s.text.c_str(), &t);
+            cache.id = s.id;
+            cache.sec = sec;
+        }
+        out.append(cache.buf, cache.len);
+    }
+
+    static void AppendThread(std::string &out) {
+        thread_local char buf[24];
+        thread_local size_t len = std::to_chars(buf, buf + sizeof(buf), static_cast<uint64_t>(pthread_self())).ptr - buf;
+        out.append(buf, len);
+    }
+
+    static void AppendNumber(std::string &out, uint64_t v) {
+        char buf[24];
+        out.append(buf, std::to_chars(buf, buf + sizeof(buf), v).ptr - buf);
+    }
+
+    static void AppendPadded(std::string &out, uint64_t v, int width) {
+        char buf[8];
+        for (int i = width - 1; i >= 0; i--, v /= 10) buf[i] = '0' + v % 10;
+        out.append(buf, width);
+    }
+
+private:
+    std::string pattern_;       // the pattern as given
+    std::vector<Step> steps_;   // the compiled steps, run in order
+    bool context_step_ = false; // the pattern places the context fields with %X
+};
+} // namespace asynlog
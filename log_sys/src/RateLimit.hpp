@@ -0,0 +1,117 @@
+/**
+ * @file RateLimit.hpp
+ * @brief RateLimiter and Sampler: per call site state of the rate limited and sampled log macros.
+ * @author bhhxx
+ * @date 2025-06-12
+*/
+#pragma once
+#include <atomic> // for atomic
+#include <cstdint> // for uint64_t
+#include <time.h> // for clock_gettime
+#include "Metrics.hpp" // for Metrics
+
+namespace asynlog
+{
+/**
+ * @brief RateLimiter class
+ * @note
+ * 1. Lets at most `per_second` records through in every second of the coarse monotonic clock and
+ * counts the rest, the first record let through in a later second reports how many were suppressed.
+ *
+ * 2. Lock-free and without formatting: a coarse clock read and one or two relaxed atomics per call.
+ * Threads racing on a new second may let a few records more through, never fewer.
+ *
+ * 3. Meant to live in a static at the call site, see the *Limited macros of AsynLog.hpp.
+*/
+class RateLimiter {
+public:
+    explicit RateLimiter(uint32_t per_second) : limit_(per_second) {}
+
+    /**
+     * @brief Check if a record may be logged
+     * @param suppressed set to the number of records suppressed since the last one let through
+     * @return true if the record may be logged
+    */
+    bool Allow(uint64_t *suppressed) {
+        int64_t now = CoarseSeconds();
+        int64_t window = window_.load(std::memory_order_relaxed);
+        if (now != window && window_.compare_exchange_strong(window, now, std::memory_order_relaxed)) {
+            count_.store(0, std::memory_order_relaxed);
+        }
+        // once over the limit only read the count, so a flood does not bounce its cache line
+        if (count_.load(std::memory_order_relaxed) < limit_ && count_.fetch_add(1, std::memory_order_relaxed) < limit_) {
+            *suppressed = suppressed_.load(std::memory_order_relaxed) == 0 ? 0 :
+                          suppressed_.exchange(0, std::memory_order_relaxed);
+            return true;
+        }
+        suppressed_.fetch_add(1, std::memory_order_relaxed);
+        SuppressedCounter()->Add();
+        return false;
+    }
+
+    /**
+     * @brief Get the seconds of the coarse monotonic clock, read from the vDSO in a few nanoseconds
+    */
+    static int64_t CoarseSeconds() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+        return ts.tv_sec;
+    }
+
+private:
+    static Counter *SuppressedCounter() {
+        static Counter *counter = Metrics::Get().GetCounter("asynlog_records_suppressed_total",
+                                                            "Records dropped by call site rate limits");
+        return counter;
+    }
+
+private:
+    uint32_t limit_;                        // records let through per second
+    std::atomic<int64_t> window_{-1};       // second the count belongs to
+    std::atomic<uint32_t> count_{0};        // records let through in that second, may run a little past limit_
+    std::atomic<uint64_t> suppressed_{0};   // records suppressed and not reported yet
+};
+
+/**
+ * @brief Sampler class
+ * @note Lets a record through with a fixed probability, decided by a per-thread xorshift generator,
+ * so the call sites share no state that threads write.
+*/
+class Sampler {
+public:
+    /**
+     * @brief Sampler constructor
+     * @param probability chance of a record to be logged, from 0 to 1
+    */
+    explicit Sampler(double probability) :
+        threshold_(probability >= 1.0 ? UINT32_MAX : probability <= 0.0 ? 0 : static_cast<uint32_t>(probability * UINT32_MAX)) {}
+
+    /**
+     * @brief Check if a record may be logged
+    */
+    bool Sample() {
+        if (threshold_ == UINT32_MAX) return true;
+        if (static_cast<uint32_t>(Next() >> 32) < threshold_) return true;
+        UnsampledCounter()->Add();
+        return false;
+    }
+
+private:
+    static uint64_t Next() {
+        thread_local uint64_t state = reinterpret_cast<uintptr_t>(&state) * 0x9E3779B97F4A7C15ull | 1;
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+
+    static Counter *UnsampledCounter() {
+        static Counter *counter = Metrics::Get().GetCounter("asynlog_records_unsampled_total",
+                                                            "Records dropped by call site sampling");
+        return counter;
+    }
+
+private:
+    uint32_t threshold_;                    // a record is logged if the next random number is below it
+};
+} // namespace asynlog
@@ -0,0 +1,252 @@
+/**
+ * @file ShardMerger.hpp
+ * @brief ShardMerger class: merge the batches of several AsynWorker shards back into one ordered stream.
+ * @author bhhxx
+ * @date 2025-06-02
+*/
+#pragma once
+#include <vector> // for vector
+#include <mutex> // for mutex
+#include <condition_variable> // for condition_variable
+#include <thread> // for thread
+#include <chrono> // for milliseconds
+#include <atomic> // for atomic
+#include <algorithm> // for sort
+#include <cstring> // for memcpy
+#include "AsynBuffer.hpp" // for Buffer
+#include "AsynWorker.hpp" // for functor
+#include "ThreadAttr.hpp" // for ThreadOptions
+
+namespace asynlog
+{
+/**
+ * @param PER_SHARD_FILE: every shard writes to its own copy of the file sinks
+ * @param ORDERED_MERGE: shards share the sinks and a merge stage restores the global order
+*/
+enum class ShardMode { PER_SHARD_FILE, ORDERED_MERGE };
+
+/**
+ * @brief Header put in front of every record pushed into a shard in ORDERED_MERGE mode
+*/
+struct ShardRecordHeader {
+    uint64_t seq;     // global sequence number of the record, stamped by AsynWorker::Push(seq, ...)
+    uint32_t len;     // length of the formatted record that follows
+};
+
+/**
+ * @brief ShardMerger class
+ * @note
+ * 1. Shard consumers hand their batches to Collect(), which only copies the records into a staging area.
+ *
+ * 2. Every shard numbers its records from Sequence() under its own lock, so a shard hands them over in
+ * increasing order. A merge thread periodically sorts the staged records and emits the ones below the
+ * lowest number some shard still holds, see Watermark(). A slow or stalled shard holds the others back
+ * instead of letting its records come out of order.
+ *
+ * 3. Stop() emits everything that is left, so call it after all shards are stopped.
+*/
+class ShardMerger {
+public:
+    using ptr = std::shared_ptr<ShardMerger>;
+
+    /**
+     * @brief ShardMerger constructor
+     * @param cb The callback that receives merged batches
+     * @param interval How often the merge thread emits the records every shard has handed over
+     * @param opts The affinity, scheduling and name of the merge thread
+     * @param idle Called every round, e.g. to write the repeat count a Coalescer holds back, may be empty
+    */
+    ShardMerger(const functor &cb, std::chrono::milliseconds interval, const ThreadOptions &opts = ThreadOptions(),
+                const idle_functor &idle = nullptr) :
+        interval_(interval),
+        callback_(cb),
+        idle_(idle),
+        thread_opts_(opts) {
+            thread_ = std::thread(&ShardMerger::ThreadEntry, this);
+        }
+
+    ~ShardMerger() { Stop(); }
+
+    /**
+     * @brief Get the counter the shards number their records from
+    */
+    std::atomic<uint64_t> &Sequence() { return seq_; }
+
+    /**
+     * @brief Add a shard whose pending records hold the merge back, see Watermark()
+     * @param shard The worker, it must outlive the merger or be stopped after Stop()
+    */
+    void AddShard(AsynWorker *shard) {
+        std::lock_guard<std::mutex> lock(mtx_);
+        shards_.push_back(shard);
+    }
+
+    /**
+     * @brief Copy the framed records of one shard batch into the staging area
+     * @param batch The batch of a shard consumer, made of ShardRecordHeader + record pairs
+    */
+    void Collect(Buffer &batch) {
+        std::lock_guard<std::mutex> lock(mtx_);
+        const char *p = batch.Begin();
+        size_t left = batch.ReadableSize();
+        while (left >= sizeof(ShardRecordHeader)) {
+            ShardRecordHeader head;
+            memcpy(&head, p, sizeof(head));
+            assert(left >= sizeof(head) + head.len);
+            staged_.push_back({head.seq, arena_.size(), head.len});
+            arena_.insert(arena_.end(), p + sizeof(head), p + sizeof(head) + head.len);
+            p += sizeof(head) + head.len;
+            left -= sizeof(head) + head.len;
+        }
+    }
+
+    /**
+     * @brief Request a callback once every record collected so far has been emitted
+     * @param on_reached The callback, run on the merge thread after the merged batch was flushed
+     * @note Request it once every shard has handed over the records in question, as AsynLogger::Barrier()
+     * does. The merge thread then runs a round at once, and whatever a shard still holds was numbered later.
+    */
+    void Barrier(std::function<void()> on_reached) {
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            barriers_.push_back(std::move(on_reached));
+        }
+        cond_.notify_all();
+    }
+
+    /**
+     * @brief Get the bytes of the staged records, for the crash handler
+     * @param data set to the records, back to back but not in sequence order
+     * @param len set to their total length
+     * @note Takes no lock on purpose, see AsynWorker::PendingForCrash().
+    */
+    void StagedForCrash(const char **data, size_t *len) {
+        *len = arena_.size();
+        *data = arena_.data();
+    }
+
+    /**
+     * @brief Emit every staged record and stop the merge thread
+    */
+    void Stop() {
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            if (stop_) return;
+            stop_ = true;
+        }
+        cond_.notify_all();
+        thread_.join();
+    }
+
+private:
+    struct Entry {
+        uint64_t seq;
+        size_t offset;    // offset in arena_
+        uint32_t len;
+    };
+
+    /**
+     * @brief Merge thread: every interval emit the records below the watermark
+    */
+    void ThreadEntry() {
+        thread_opts_.Apply();
+        Buffer out;
+        std::vector<Entry> ready;
+        std::vector<char> ready_arena;
+        std::vector<std::function<void()>> reached;
+        while (1) {
+            bool stop;
+            {
+                std::unique_lock<std::mutex> lock(mtx_);
+                cond_.wait_for(lock, interval_, [&](){ return stop_ || !barriers_.empty(); });
+                stop = stop_;
+                reached.swap(barriers_);
+            }
+            uint64_t watermark = stop ? AsynWorker::kNoStamp : Watermark();
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                TakeReady(watermark, ready, ready_arena);
+            }
+            for (auto &e : ready) {
+                out.Push(&ready_arena[e.offset], e.len);
+            }
+            if (out.ReadableSize() > 0) {
+                callback_(out);
+                out.Reset();
+            }
+            if (idle_) {
+                idle_();
+            }
+            for (auto &cb : reached) {
+                cb();
+            }
+            reached.clear();
+            if (stop) {
+                std::lock_guard<std::mutex> lock(mtx_);
+                if (barriers_.empty()) return; // barriers requested while stopping are served by one more round
+            }
+        }
+    }
+
+    /**
+     * @brief Get the number below which every record has been handed over by its shard
+     * @details The counter is read first: a shard that holds nothing at its check numbers its later
+     * records from at least that value, and a shard that holds something numbers in increasing order,
+     * so nothing below the lowest of these can still arrive.
+    */
+    uint64_t Watermark() {
+        uint64_t watermark = seq_.load();
+        std::vector<AsynWorker *> shards;
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            shards = shards_;
+        }
+        for (auto shard : shards) {
+            watermark = std::min(watermark, shard->FirstPendingStamp());
+        }
+        return watermark;
+    }
+
+    /**
+     * @brief Move the records below the watermark out of the staging area
+     * @param watermark The first sequence number that stays staged
+     * @param ready The taken records in sequence order
+     * @param ready_arena The bytes of the taken records
+    */
+    void TakeReady(uint64_t watermark, std::vector<Entry> &ready, std::vector<char> &ready_arena) {
+        ready.clear();
+        ready_arena.clear();
+        if (staged_.empty()) return;
+        std::sort(staged_.begin(), staged_.end(), [](const Entry &a, const Entry &b) { return a.seq < b.seq; });
+        size_t n = 0;
+        while (n < staged_.size() && staged_[n].seq < watermark) n++;
+        if (n == 0) return;
+        ready.assign(staged_.begin(), staged_.begin() + n);
+        ready_arena.swap(arena_);
+        // compact the records that stay staged into a fresh arena
+        std::vector<Entry> rest(staged_.begin() + n, staged_.end());
+        arena_.clear();
+        for (auto &e : rest) {
+            size_t offset = arena_.size();
+            arena_.insert(arena_.end(), ready_arena.begin() + e.offset, ready_arena.begin() + e.offset + e.len);
+            e.offset = offset;
+        }
+        staged_.swap(rest);
+    }
+
+private:
+    std::chrono::milliseconds interval_; // time between two merge rounds
+    std::atomic<uint64_t> seq_{0};     // next sequence number, see Sequence()
+    bool stop_ = false;                // guarded by mtx_
+    std::mutex mtx_;
+    std::condition_variable cond_;
+    std::vector<Entry> staged_;        // records not emitted yet, guarded by mtx_
+    std::vector<char> arena_;          // bytes of the staged records, guarded by mtx_
+    std::vector<AsynWorker *> shards_; // shards numbering from seq_, guarded by mtx_
+    std::vector<std::function<void()>> barriers_; // callbacks waiting for the next emission, guarded by mtx_
+    functor callback_;                 // receives the merged batches
+    idle_functor idle_;                // releases what callback_ holds back, may be empty
+    ThreadOptions thread_opts_;        // affinity, scheduling and name of the merge thread
+    std::thread thread_;               // merge thread, started last
+};
+} // namespace asynlog
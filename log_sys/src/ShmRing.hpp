@@ -0,0 +1,300 @@
+/**
+ * @file ShmRing.hpp
+ * @brief ShmRing class: a single producer, single consumer byte ring in POSIX shared memory,
+ * the transport between a logger and the log agent.
+ * @author bhhxx
+ * @date 2025-06-17
+*/
+#pragma once
+#include <string> // for string
+#include <memory> // for shared_ptr
+#include <atomic> // for atomic
+#include <cstring> // for memcpy, memrchr, strncpy
+#include <cerrno> // for errno
+#include <iostream> // for cout
+#include <fcntl.h> // for O_CREAT
+#include <unistd.h> // for ftruncate, close
+#include <signal.h> // for kill
+#include <sys/mman.h> // for shm_open, mmap
+#include <sys/stat.h> // for fstat
+#include <sys/file.h> // for flock
+
+namespace asynlog
+{
+/**
+ * @brief ShmRing class
+ * @note
+ * 1. The segment is a header followed by `capacity` bytes of data, capacity a power of two. Producer and
+ * consumer only share two positions that grow forever, each on its own cache line; the atomics are
+ * lock-free and so work across processes.
+ *
+ * 2. The ring carries a byte stream, not framed records: a logger writes whole batches of lines, and
+ * when a batch does not fit the rest follows once the agent made room, in order.
+ *
+ * 3. The segment outlives its producer. After a crash the records written so far stay in /dev/shm until
+ * an agent drains the ring and unlinks it, see LogAgent.
+*/
+class ShmRing {
+public:
+    using ptr = std::shared_ptr<ShmRing>;
+    static constexpr uint32_t kMagic = 0x52534c41;  // "ALSR"
+    static constexpr uint32_t kVersion = 1;
+    static constexpr const char *kPrefix = "asynlog.";  // name prefix of the segments in /dev/shm
+
+    struct Header {
+        std::atomic<uint32_t> magic;        // kMagic once the header is initialized
+        uint32_t version;
+        uint64_t capacity;                  // bytes of data, a power of two
+        int32_t pid;                        // producer process
+        std::atomic<uint32_t> closed;       // 1 once the producer closed the ring
+        char name[64];                      // name of the stream, e.g. the logger
+        alignas(64) std::atomic<uint64_t> write_pos;    // bytes written, by the producer
+        alignas(64) std::atomic<uint64_t> read_pos;     // bytes consumed, by the consumer
+        alignas(64) std::atomic<uint64_t> dropped;      // bytes the producer gave up on
+    };
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared memory atomics must be lock-free");
+
+    /**
+     * @brief Create the ring of a producer
+     * @param base_name the segment name, e.g. "/asynlog.app.1234"
+     * @param name the stream name recorded in the header
+     * @param capacity the data size, rounded up to a power of two
+     * @return the ring, or nullptr if the segment cannot be created
+     * @note A stale segment of the same name, drained and closed or left by a dead process with a reused
+     * pid, is replaced. One still in use or holding records for the agent is kept, the ring is then
+     * created as `<base_name>.<n>`; the agent finds rings by prefix and names streams by the header.
+    */
+    static ptr Create(const std::string &base_name, const std::string &name, size_t capacity) {
+        size_t cap = 4096;
+        while (cap < capacity) cap <<= 1;
+        std::string shm_name;
+        int fd = -1;
+        for (int n = 0; n < 64 && fd < 0; n++) {
+            shm_name = n == 0 ? base_name : base_name + "." + std::to_string(n);
+            fd = shm_open(shm_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+            if (fd < 0 && errno == EEXIST && Stale(shm_name)) {
+                shm_unlink(shm_name.c_str());
+                fd = shm_open(shm_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+            }
+            if (fd < 0 && errno != EEXIST) break;
+        }
+        if (fd < 0) {
+            std::cout << __FILE__ << __LINE__ << "shm_open " << shm_name << " failed: " << strerror(errno) << std::endl;
+            return nullptr;
+        }
+        size_t size = sizeof(Header) + cap;
+        if (ftruncate(fd, size) != 0) {
+            std::cout << __FILE__ << __LINE__ << "ftruncate shm failed: " << strerror(errno) << std::endl;
+            close(fd);
+            shm_unlink(shm_name.c_str());
+            return nullptr;
+        }
+        auto ring = Map(fd, size, shm_name);
+        if (!ring) {
+            shm_unlink(shm_name.c_str());
+            return nullptr;
+        }
+        Header *h = new (ring->base_) Header();
+        h->version = kVersion;
+        h->capacity = cap;
+        h->pid = getpid();
+        strncpy(h->name, name.c_str(), sizeof(h->name) - 1);
+        h->magic.store(kMagic, std::memory_order_release); // the agent only opens initialized rings
+        return ring;
+    }
+
+    /**
+     * @brief Open an existing ring as its only consumer
+     * @param shm_name the segment name
+     * @return the ring, or nullptr if it is not an initialized ring or another consumer holds it
+    */
+    static ptr Open(const std::string &shm_name) {
+        int fd = shm_open(shm_name.c_str(), O_RDWR, 0600);
+        if (fd < 0) return nullptr;
+        struct stat st;
+        if (flock(fd, LOCK_EX | LOCK_NB) != 0 || fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(Header)) {
+            close(fd);
+            return nullptr;
+        }
+        auto ring = Map(fd, st.st_size, shm_name);
+        if (!ring) return nullptr;
+        Header *h = ring->header();
+        if (h->magic.load(std::memory_order_acquire) != kMagic || h->version != kVersion ||
+            sizeof(Header) + h->capacity != static_cast<size_t>(st.st_size)) {
+            return nullptr;
+        }
+        return ring;
+    }
+
+    ~ShmRing() {
+        if (base_ != MAP_FAILED) munmap(base_, size_);
+        if (fd_ >= 0) close(fd_);
+    }
+
+    /**
+     * @brief Append bytes, as many as fit, producer only
+     * @param data the bytes
+     * @param len the number of bytes
+     * @return the number of bytes written, less than len if the ring is full
+    */
+    size_t Write(const char *data, size_t len) {
+        Header *h = header();
+        uint64_t w = h->write_pos.load(std::memory_order_relaxed);
+        uint64_t r = h->read_pos.load(std::memory_order_acquire);
+        size_t n = std::min<size_t>(len, h->capacity - (w - r));
+        if (n == 0) return 0;
+        size_t at = w & (h->capacity - 1);
+        size_t first = std::min<size_t>(n, h->capacity - at);
+        memcpy(data_ + at, data, first);
+        memcpy(data_, data + first, n - first);
+        h->write_pos.store(w + n, std::memory_order_release);
+        return n;
+    }
+
+    /**
+     * @brief Hand the written bytes to a function, up to the last newline, consumer only
+     * @param write called with one or two contiguous spans, `write(const char *data, size_t len)`
+     * @return the number of bytes consumed
+     * @note A partial line is left for the next call, unless it fills the ring or the producer is gone.
+    */
+    template <class Write>
+    size_t Drain(Write write) {
+        Header *h = header();
+        uint64_t r = h->read_pos.load(std::memory_order_relaxed);
+        uint64_t w = h->write_pos.load(std::memory_order_acquire);
+        size_t avail = w - r;
+        if (avail == 0) return 0;
+        size_t at = r & (h->capacity - 1);
+        size_t first = std::min<size_t>(avail, h->capacity - at);
+        size_t second = avail - first;
+        if (avail < h->capacity && ProducerAlive()) { // cut after the last complete line
+            const void *nl = second ? memrchr(data_, '\n', second) : nullptr;
+            if (nl) {
+                second = static_cast<const char *>(nl) - data_ + 1;
+            } else {
+                second = 0;
+                nl = memrchr(data_ + at, '\n', first);
+                if (!nl) return 0;
+                first = static_cast<const char *>(nl) - (data_ + at) + 1;
+            }
+        }
+        write(data_ + at, first);
+        if (second) write(data_, second);
+        h->read_pos.store(r + first + second, std::memory_order_release);
+        return first + second;
+    }
+
+    /**
+     * @brief Count bytes the producer dropped because the ring stayed full
+    */
+    void AddDropped(uint64_t n) { header()->dropped.fetch_add(n, std::memory_order_relaxed); }
+    uint64_t Dropped() { return header()->dropped.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Mark the ring closed, the producer writes no more
+    */
+    void Close() { header()->closed.store(1, std::memory_order_release); }
+
+    /**
+     * @brief Check if the producer process still runs and has not closed the ring
+    */
+    bool ProducerAlive() {
+        Header *h = header();
+        if (h->closed.load(std::memory_order_acquire)) return false;
+        return kill(h->pid, 0) == 0 || errno == EPERM;
+    }
+
+    /**
+     * @brief Get the free bytes, producer only
+    */
+    size_t Free() {
+        Header *h = header();
+        return h->capacity - (h->write_pos.load(std::memory_order_relaxed) - h->read_pos.load(std::memory_order_acquire));
+    }
+
+    /**
+     * @brief Get the size of the ring, the longest line that fits
+    */
+    size_t Capacity() { return header()->capacity; }
+
+    /**
+     * @brief Check if every written byte has been consumed
+    */
+    bool Empty() {
+        Header *h = header();
+        return h->read_pos.load(std::memory_order_acquire) == h->write_pos.load(std::memory_order_acquire);
+    }
+
+    Header *header() { return reinterpret_cast<Header *>(base_); }
+    const std::string &ShmName() const { return shm_name_; }
+    std::string Name() { return std::string(header()->name, strnlen(header()->name, sizeof(header()->name))); }
+
+    /**
+     * @brief Remove the segment name, the memory goes away with the last mapping
+    */
+    void Unlink() { shm_unlink(shm_name_.c_str()); }
+
+    /**
+     * @brief Make a segment name for a stream of this process
+     * @param name the stream name, '/' is replaced
+    */
+    static std::string MakeShmName(const std::string &name) {
+        std::string clean = name;
+        for (char &c : clean) {
+            if (c == '/') c = '_';
+        }
+        return "/" + std::string(kPrefix) + clean + "." + std::to_string(getpid());
+    }
+
+private:
+    ShmRing() = default;
+
+    /**
+     * @brief Check if a segment can be replaced: not an initialized ring, or a drained one whose producer
+     * closed it or died
+    */
+    static bool Stale(const std::string &shm_name) {
+        int fd = shm_open(shm_name.c_str(), O_RDONLY, 0);
+        if (fd < 0) return errno == ENOENT;
+        bool stale = true;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(Header)) {
+            void *base = mmap(nullptr, sizeof(Header), PROT_READ, MAP_SHARED, fd, 0);
+            if (base != MAP_FAILED) {
+                const Header *h = static_cast<const Header *>(base);
+                if (h->magic.load(std::memory_order_acquire) == kMagic) {
+                    bool gone = h->closed.load(std::memory_order_acquire) || (kill(h->pid, 0) != 0 && errno != EPERM);
+                    bool drained = h->read_pos.load(std::memory_order_acquire) == h->write_pos.load(std::memory_order_acquire);
+                    stale = gone && drained;
+                }
+                munmap(base, sizeof(Header));
+            }
+        }
+        close(fd);
+        return stale;
+    }
+
+    static ptr Map(int fd, size_t size, const std::string &shm_name) {
+        void *base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (base == MAP_FAILED) {
+            std::cout << __FILE__ << __LINE__ << "mmap shm failed: " << strerror(errno) << std::endl;
+            close(fd);
+            return nullptr;
+        }
+        ptr ring(new ShmRing());
+        ring->fd_ = fd;
+        ring->base_ = base;
+        ring->size_ = size;
+        ring->data_ = static_cast<char *>(base) + sizeof(Header);
+        ring->shm_name_ = shm_name;
+        return ring;
+    }
+
+private:
+    int fd_ = -1;               // segment descriptor, holds the consumer lock
+    void *base_ = MAP_FAILED;   // mapping of the header and the data
+    size_t size_ = 0;           // size of the mapping
+    char *data_ = nullptr;      // the data after the header
+    std::string shm_name_;      // segment name
+};
+} // namespace asynlog
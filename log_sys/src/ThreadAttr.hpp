@@ -0,0 +1,107 @@
+/**
+ * @file ThreadAttr.hpp
+ * @brief ThreadOptions: CPU affinity, scheduling policy, nice value and name of a library thread.
+ * @author bhhxx
+ * @date 2025-06-03
+*/
+#pragma once
+#include <vector> // for vector
+#include <string> // for string
+#include <cstring> // for strerror
+#include <iostream> // for cout
+#include <pthread.h> // for pthread_setaffinity_np, pthread_setschedparam, pthread_setname_np
+#include <sched.h> // for cpu_set_t, SCHED_OTHER
+#include <sys/resource.h> // for setpriority
+#include <sys/syscall.h> // for SYS_gettid
+#include <unistd.h> // for syscall
+
+namespace asynlog
+{
+/**
+ * @brief ThreadOptions struct
+ * @note
+ * 1. The default options leave the thread as the scheduler created it.
+ *
+ * 2. The options are applied by the thread itself when it starts, see Apply(). That also marks it as a
+ * library thread, see LibraryThread().
+*/
+struct ThreadOptions {
+    std::vector<int> cpus;        // cores the thread may run on, empty for no pinning
+    int policy = SCHED_OTHER;     // SCHED_OTHER, SCHED_BATCH, SCHED_IDLE, SCHED_FIFO or SCHED_RR
+    int priority = 0;             // static priority, only used by SCHED_FIFO and SCHED_RR
+    int nice = 0;                 // nice value, only used by SCHED_OTHER and SCHED_BATCH
+    std::string name;             // thread name, at most 15 characters are kept
+
+    /**
+     * @brief Get the options of one thread of a group
+     * @param index index of the thread in the group
+     * @param count number of threads in the group
+     * @return the same options, pinned to one of the cores and named `<name><index>` if count > 1
+    */
+    ThreadOptions ForThread(size_t index, size_t count) const {
+        ThreadOptions ret = *this;
+        if (count > 1) {
+            if (!cpus.empty()) {
+                ret.cpus = { cpus[index % cpus.size()] };
+            }
+            if (!name.empty()) {
+                ret.name += std::to_string(index);
+            }
+        }
+        return ret;
+    }
+
+    /**
+     * @brief Check if the options pin the thread to some cores
+    */
+    bool Pinned() const { return !cpus.empty(); }
+
+    /**
+     * @brief Check if the calling thread is a consumer, merge or thread pool thread of the library
+     * @note Such a thread must not wait for a barrier, the wait may need the thread itself.
+    */
+    static bool LibraryThread() { return LibraryThreadFlag(); }
+
+    /**
+     * @brief Apply the options to the calling thread
+     * @note Failures, e.g. missing CAP_SYS_NICE for SCHED_FIFO, are reported and the thread keeps running.
+    */
+    void Apply() const {
+        LibraryThreadFlag() = true;
+        pthread_t self = pthread_self();
+        if (!cpus.empty()) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            for (int cpu : cpus) {
+                CPU_SET(cpu, &set);
+            }
+            int r = pthread_setaffinity_np(self, sizeof(set), &set);
+            if (r != 0) {
+                std::cout << __FILE__ << __LINE__ << "set affinity failed: " << strerror(r) << std::endl;
+            }
+        }
+        if (policy != SCHED_OTHER || priority != 0) {
+            struct sched_param param;
+            param.sched_priority = priority;
+            int r = pthread_setschedparam(self, policy, &param);
+            if (r != 0) {
+                std::cout << __FILE__ << __LINE__ << "set sched policy failed: " << strerror(r) << std::endl;
+            }
+        }
+        if (nice != 0) { // on Linux the nice value is per thread
+            if (setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), nice) != 0) {
+                std::cout << __FILE__ << __LINE__ << "set nice failed: " << strerror(errno) << std::endl;
+            }
+        }
+        if (!name.empty()) {
+            pthread_setname_np(self, name.substr(0, 15).c_str());
+        }
+    }
+
+private:
+    static bool &LibraryThreadFlag() {
+        thread_local bool flag = false; // set by Apply()
+        return flag;
+    }
+};
+} // namespace asynlog
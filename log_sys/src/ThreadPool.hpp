@@ -8,46 +8,241 @@
 #pragma once
 #include <vector> // for vector
 #include <thread> // for thread
-#include <queue> // for queue
-#include <functional> // for function
+#include <deque> // for deque
 #include <mutex> // for mutex
 #include <condition_variable> // for condition_variable
 #include <future> // for future
-#include <stdexcept> // for runtime_error 
-#include <memory> // for make_shared
+#include <stdexcept> // for runtime_error
+#include <memory> // for unique_ptr
+#include <atomic> // for atomic
+#include <tuple> // for tuple, apply
+#include <type_traits> // for decay_t
+#include <cstddef> // for max_align_t
+#include <new> // for placement new
+#include <cstdint> // for uint64_t
+#include <string> // for string
+#include <iostream> // for cout
+#include "ThreadAttr.hpp" // for ThreadOptions
 
-/** 
+/**
+ * @brief Task class: a move-only `void()` callable with small buffer optimization
+ * @note Callables up to kInlineSize bytes are stored inline, so queuing them does not allocate.
+*/
+class Task {
+public:
+    static const size_t kInlineSize = 56;
+
+    Task() = default;
+
+    template <class F, class Fn = std::decay_t<F>, class = std::enable_if_t<!std::is_same<Fn, Task>::value>>
+    explicit Task(F &&f) {
+        if constexpr (sizeof(Fn) <= kInlineSize && alignof(Fn) <= alignof(std::max_align_t) &&
+                      std::is_nothrow_move_constructible<Fn>::value) {
+            new (storage_) Fn(std::forward<F>(f));
+            ops_ = &InlineOps<Fn>;
+        } else {
+            *reinterpret_cast<Fn **>(storage_) = new Fn(std::forward<F>(f));
+            ops_ = &HeapOps<Fn>;
+        }
+    }
+
+    Task(Task &&other) noexcept { MoveFrom(other); }
+
+    Task &operator=(Task &&other) noexcept {
+        if (this != &other) {
+            Reset();
+            MoveFrom(other);
+        }
+        return *this;
+    }
+
+    Task(const Task &) = delete;
+    Task &operator=(const Task &) = delete;
+
+    ~Task() { Reset(); }
+
+    /**
+     * @brief Run the callable
+    */
+    void operator()() { ops_->invoke(storage_); }
+
+    explicit operator bool() const { return ops_ != nullptr; }
+
+private:
+    struct Ops {
+        void (*invoke)(void *);
+        void (*move)(void *dst, void *src);   // move src into dst and destroy src
+        void (*destroy)(void *);
+    };
+
+    template <class Fn>
+    static constexpr Ops InlineOps = {
+        [](void *p) { (*static_cast<Fn *>(p))(); },
+        [](void *dst, void *src) {
+            new (dst) Fn(std::move(*static_cast<Fn *>(src)));
+            static_cast<Fn *>(src)->~Fn();
+        },
+        [](void *p) { static_cast<Fn *>(p)->~Fn(); },
+    };
+
+    template <class Fn>
+    static constexpr Ops HeapOps = {
+        [](void *p) { (**static_cast<Fn **>(p))(); },
+        [](void *dst, void *src) { *static_cast<Fn **>(dst) = *static_cast<Fn **>(src); },
+        [](void *p) { delete *static_cast<Fn **>(p); },
+    };
+
+    void MoveFrom(Task &other) {
+        ops_ = other.ops_;
+        if (ops_) {
+            ops_->move(storage_, other.storage_);
+            other.ops_ = nullptr;
+        }
+    }
+
+    void Reset() {
+        if (ops_) {
+            ops_->destroy(storage_);
+            ops_ = nullptr;
+        }
+    }
+
+    const Ops *ops_ = nullptr;
+    alignas(std::max_align_t) unsigned char storage_[kInlineSize];
+};
+
+/**
+ * @param LOW: first to be dropped under DROP_LOWEST
+ * @param NORMAL: default priority
+ * @param HIGH: taken before any queued NORMAL or LOW task
+*/
+enum class TaskPriority { LOW, NORMAL, HIGH };
+
+/**
+ * @param BLOCK: the submitter waits until there is room; a worker of the pool runs the task itself instead,
+ * since waiting could deadlock when every worker waits for room only workers can make
+ * @param REJECT: the submitter gets a ThreadPoolFull exception
+ * @param DROP_LOWEST: the oldest queued task of the lowest priority not above the new one is dropped,
+ * its future gets a broken_promise error; if every queued task has a higher priority the new one is rejected
+*/
+enum class OverflowPolicy { BLOCK, REJECT, DROP_LOWEST };
+
+/**
+ * @brief Tasks queue limits of a ThreadPool
+*/
+struct QueueOptions {
+    size_t capacity = 0;                          // max queued tasks, 0 for unbounded
+    OverflowPolicy policy = OverflowPolicy::BLOCK;
+
+    /**
+     * @brief parse an overflow policy name, as written in config files
+     * @param name "block", "reject" or "drop_lowest"
+     * @param policy set to the parsed policy
+     * @return false if the name is unknown
+    */
+    static bool PolicyFromString(const std::string &name, OverflowPolicy *policy) {
+        if (name == "block") *policy = OverflowPolicy::BLOCK;
+        else if (name == "reject") *policy = OverflowPolicy::REJECT;
+        else if (name == "drop_lowest") *policy = OverflowPolicy::DROP_LOWEST;
+        else return false;
+        return true;
+    }
+
+    /**
+     * @brief Build the queue limits from the thread_queue_capacity and thread_queue_policy config keys
+     * @note An unknown policy name is reported and BLOCK is used.
+    */
+    static QueueOptions FromConfig(size_t capacity, const std::string &policy) {
+        QueueOptions opts;
+        opts.capacity = capacity;
+        if (!PolicyFromString(policy, &opts.policy)) {
+            std::cout << __FILE__ << __LINE__ << "unknown thread_queue_policy " << policy << ", using block" << std::endl;
+        }
+        return opts;
+    }
+};
+
+/**
+ * @brief Snapshot of the tasks queue metrics of a ThreadPool
+*/
+struct ThreadPoolStats {
+    size_t depth;          // tasks queued and not taken yet
+    size_t capacity;       // max queued tasks, 0 for unbounded
+    size_t high_water;     // max depth seen
+    uint64_t submitted;    // tasks accepted
+    uint64_t rejected;     // tasks refused because the queue was full
+    uint64_t dropped;      // queued tasks dropped to make room under DROP_LOWEST
+};
+
+/**
+ * @brief Exception thrown when a task does not fit in a bounded ThreadPool
+*/
+class ThreadPoolFull : public std::runtime_error {
+public:
+    ThreadPoolFull() : std::runtime_error("enqueue on full ThreadPool") {}
+};
+
+/**
  * @brief ThreadPool class
- * @note This class provides a thread pool implementation for asynchronous task execution.
+ * @note
+ * 1. This class provides a thread pool implementation for asynchronous task execution.
+ *
+ * 2. Every worker owns a deque. Tasks submitted from outside the pool are spread round robin
+ * over the deques, tasks submitted from a worker go to its own deque.
+ *
+ * 3. A worker pops its own deque from the back and steals from the front of the others when it
+ * runs dry, so idle workers do not all contend on one mutex.
+ *
+ * 4. Every deque is split by TaskPriority, higher priorities are always taken first.
+ *
+ * 5. With a capacity the queue is bounded and the OverflowPolicy decides what a full queue does.
 */
 class ThreadPool
 {
 private:
+    static const size_t kPriorities = 3;
+    static const size_t kStopping = ~(~size_t(0) >> 1); // top bit of pending, set by the destructor
+    struct alignas(64) WorkQueue {                // one cache line apart to avoid false sharing
+        std::mutex mtx;
+        std::deque<Task> tasks[kPriorities];      // indexed by TaskPriority
+    };
     std::vector<std::thread> workers;             // threads
-    std::queue<std::function<void()>> tasks;      // tasks queue
-    std::mutex queue_mutex;                       // queue mutex
+    std::vector<std::unique_ptr<WorkQueue>> queues; // one tasks deque per thread
+    QueueOptions queue_opts;                      // capacity and overflow policy
+    std::atomic<size_t> pending{0};               // tasks reserved or queued and not taken yet, and kStopping
+    std::atomic<size_t> queued{0};                // tasks pushed to a deque and not taken yet
+    std::atomic<size_t> pending_by_priority[kPriorities] = {}; // queued tasks of each priority
+    std::atomic<size_t> high_water{0};            // max pending seen
+    std::atomic<uint64_t> submitted{0};
+    std::atomic<uint64_t> rejected{0};
+    std::atomic<uint64_t> dropped{0};
+    std::mutex space_mutex;                       // mutex for submitters blocked on a full queue
+    std::condition_variable space_condition;
+    std::atomic<size_t> space_waiters{0};
+    std::atomic<size_t> next_queue{0};            // round robin for submitters outside the pool
+    std::mutex sleep_mutex;                       // mutex for idle workers
     std::condition_variable condition;            // condition_variable for syn
-    bool stop;
+    std::atomic<size_t> sleepers{0};              // workers waiting on condition
 public:
     /**
      * @brief Construct a new Thread Poll object
      * @param thread_size number of threads
+     * @param opts cores, scheduling policy, nice value and name of the threads,
+     * every thread is pinned to one of the cores, see ThreadOptions::ForThread()
+     * @param queue capacity and overflow policy of the tasks queue, unbounded by default
      */
-    ThreadPool(size_t thread_size) : stop(false) {
+    ThreadPool(size_t thread_size, const asynlog::ThreadOptions &opts = asynlog::ThreadOptions(),
+               const QueueOptions &queue = QueueOptions()) : queue_opts(queue) {
+        if (thread_size == 0) thread_size = 1;
+        for (size_t i = 0; i < thread_size; i++) {
+            queues.emplace_back(new WorkQueue);
+        }
         for (size_t i = 0; i < thread_size; i++) {
             workers.emplace_back( // use lambda function to create thread
-                [this] {
-                    while (true) {
-                        std::function<void()> task; // create task object
-                        {
-                            std::unique_lock<std::mutex> lock(this->queue_mutex);
-                            this->condition.wait(lock, [this]{return this->stop || !this->tasks.empty();}); // wait until there is a task or stop
-                            if (this->stop && this->tasks.empty()) return;
-                            task = std::move(this->tasks.front());
-                            this->tasks.pop();
-                        }
-                        task();
-                    }
+                [this, i, thread_opts = opts.ForThread(i, thread_size)] {
+                    thread_opts.Apply();
+                    Current() = {this, i};
+                    WorkerLoop(i);
                 }
             );
         }
@@ -61,36 +256,292 @@ public:
      */
     template <class F, class... Args> // template function
     auto enqueue(F &&f, Args &&...args)->std::future<std::invoke_result_t<F, Args...>> {
+        return enqueue(TaskPriority::NORMAL, std::forward<F>(f), std::forward<Args>(args)...);
+    }
+
+    /**
+     * @brief Enqueue a task with a priority
+     * @param priority priority of the task
+     * @param f function to be executed
+     * @param args arguments to be passed to the function
+     * @return future object
+     * @throw ThreadPoolFull if the queue is full and the policy is REJECT or nothing could be dropped
+     */
+    template <class F, class... Args>
+    auto enqueue(TaskPriority priority, F &&f, Args &&...args)->std::future<std::invoke_result_t<F, Args...>> {
         using return_type = std::invoke_result_t<F, Args...>;
-        auto task = std::make_shared<
-            std::packaged_task<return_type()>
-        >(
-            std::bind(std::forward<F>(f), std::forward<Args>(args)...)
+        std::packaged_task<return_type()> task( // the only allocation is the shared state
+            [f = std::forward<F>(f), tup = std::make_tuple(std::forward<Args>(args)...)]() mutable {
+                return std::apply(std::move(f), std::move(tup));
+            }
         );
+        std::future<return_type> res = task.get_future();
+        Submit(priority, Task(std::move(task)));
+        return res;
+    }
 
-        std::future<return_type> res = task->get_future();
-        {
-            std::unique_lock<std::mutex> lock(queue_mutex);
-            if (stop) {
-                throw std::runtime_error("enqueue on stopped ThreadPool");
-            }
-            tasks.emplace([task]{(*task)();});
+    /**
+     * @brief Post a fire-and-forget task
+     * @param f function to be executed
+     * @param args arguments to be passed to the function
+     * @note No future is created, so small closures do not allocate at all.
+     * An exception escaping the task terminates the program, like in a plain std::thread.
+     */
+    template <class F, class... Args>
+    void post(F &&f, Args &&...args) {
+        post(TaskPriority::NORMAL, std::forward<F>(f), std::forward<Args>(args)...);
+    }
+
+    /**
+     * @brief Post a fire-and-forget task with a priority
+     * @param priority priority of the task
+     * @param f function to be executed
+     * @param args arguments to be passed to the function
+     * @throw ThreadPoolFull if the queue is full and the policy is REJECT or nothing could be dropped
+     */
+    template <class F, class... Args>
+    void post(TaskPriority priority, F &&f, Args &&...args) {
+        if constexpr (sizeof...(Args) == 0) {
+            Submit(priority, Task(std::forward<F>(f)));
+        } else {
+            Submit(priority, Task([f = std::forward<F>(f), tup = std::make_tuple(std::forward<Args>(args)...)]() mutable {
+                std::apply(std::move(f), std::move(tup));
+            }));
         }
-        condition.notify_one();
-        return res;
+    }
+
+    /**
+     * @brief Get the number of queued tasks not taken by a worker yet
+     */
+    size_t depth() const { return pending.load(std::memory_order_relaxed) & ~kStopping; }
+
+    /**
+     * @brief Get the tasks queue metrics
+     */
+    ThreadPoolStats stats() const {
+        return {depth(), queue_opts.capacity,
+                high_water.load(std::memory_order_relaxed), submitted.load(std::memory_order_relaxed),
+                rejected.load(std::memory_order_relaxed), dropped.load(std::memory_order_relaxed)};
     }
 
     /**
      * @brief Stop the thread pool
+     * @note Workers finish every queued task before they exit. Setting kStopping in pending is the same
+     * atomic step a submitter reserves its task with, so a task is either refused or run before the workers exit.
      */
     ~ThreadPool() {
         {
-            std::unique_lock<std::mutex> lock(queue_mutex);
-            stop = true;
+            std::unique_lock<std::mutex> lock(sleep_mutex);
+            pending.fetch_or(kStopping);
         }
         condition.notify_all();
+        {
+            std::lock_guard<std::mutex> lock(space_mutex);
+        }
+        space_condition.notify_all();
         for (std::thread &worker : workers) {
             worker.join();
         }
     }
-};
\ No newline at end of file
+
+private:
+    /**
+     * @brief The pool and index of the calling worker thread, {nullptr, 0} outside any pool
+     */
+    static std::pair<ThreadPool *, size_t> &Current() {
+        thread_local std::pair<ThreadPool *, size_t> current{nullptr, 0};
+        return current;
+    }
+
+    /**
+     * @brief Check if the destructor has started, no task is accepted then
+     */
+    bool Stopping() const { return pending.load() & kStopping; }
+
+    /**
+     * @brief Reserve room for one task
+     * @return true if pending was incremented without going above the capacity, false if it is full or stopping
+     */
+    bool TryReserve() {
+        size_t cur = pending.load();
+        while (!(cur & kStopping) && (queue_opts.capacity == 0 || cur < queue_opts.capacity)) {
+            if (pending.compare_exchange_weak(cur, cur + 1)) {
+                size_t hw = high_water.load(std::memory_order_relaxed);
+                while (cur + 1 > hw && !high_water.compare_exchange_weak(hw, cur + 1, std::memory_order_relaxed)) {}
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * @brief Reserve room for one task, applying the overflow policy when the queue is full
+     * @param priority priority of the new task
+     * @return false if the caller is a worker of the pool that has to run the task itself, see BLOCK
+     * @throw ThreadPoolFull if the task cannot be queued
+     */
+    bool Reserve(TaskPriority priority) {
+        while (!TryReserve()) {
+            if (Stopping()) {
+                throw std::runtime_error("enqueue on stopped ThreadPool");
+            }
+            switch (queue_opts.policy) {
+                case OverflowPolicy::BLOCK: {
+                    if (Current().first == this) return false;
+                    std::unique_lock<std::mutex> lock(space_mutex);
+                    space_waiters.fetch_add(1);
+                    space_condition.wait(lock, [this]{ return Stopping() || depth() < queue_opts.capacity; });
+                    space_waiters.fetch_sub(1);
+                    break;
+                }
+                case OverflowPolicy::DROP_LOWEST:
+                    if (DropOne(priority)) break;
+                    [[fallthrough]]; // every queued task has a higher priority
+                case OverflowPolicy::REJECT:
+                    rejected.fetch_add(1, std::memory_order_relaxed);
+                    throw ThreadPoolFull();
+            }
+        }
+        return true;
+    }
+
+    /**
+     * @brief Give back the room of a queued task that was taken or dropped
+     */
+    void Release() {
+        queued.fetch_sub(1);
+        if (pending.fetch_sub(1) == (kStopping | 1)) { // the last task of a stopping pool, wake the workers to exit
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+            condition.notify_all();
+        }
+    }
+
+    /**
+     * @brief Drop the oldest queued task of the lowest priority not above max_priority
+     * @param max_priority priority of the task that needs the room
+     * @return true if a task was dropped
+     */
+    bool DropOne(TaskPriority max_priority) {
+        for (size_t p = 0; p <= static_cast<size_t>(max_priority); p++) {
+            if (pending_by_priority[p].load() == 0) continue;
+            for (auto &q : queues) {
+                Task victim; // destroyed outside the lock, which breaks its promise
+                {
+                    std::lock_guard<std::mutex> lock(q->mtx);
+                    if (q->tasks[p].empty()) continue;
+                    victim = std::move(q->tasks[p].front());
+                    q->tasks[p].pop_front();
+                }
+                pending_by_priority[p].fetch_sub(1);
+                Release();
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * @brief Queue a task and wake a sleeping worker if there is one
+     * @details A worker of the pool submitting to a full BLOCK queue runs the task itself.
+     * @param priority priority of the task
+     * @param task the task
+     */
+    void Submit(TaskPriority priority, Task &&task) {
+        if (!Reserve(priority)) {
+            task();
+            return;
+        }
+        submitted.fetch_add(1, std::memory_order_relaxed);
+        auto &current = Current();
+        size_t index = current.first == this ? current.second
+                                             : next_queue.fetch_add(1, std::memory_order_relaxed) % queues.size();
+        size_t p = static_cast<size_t>(priority);
+        {
+            std::lock_guard<std::mutex> lock(queues[index]->mtx);
+            queues[index]->tasks[p].push_back(std::move(task));
+        }
+        pending_by_priority[p].fetch_add(1);
+        queued.fetch_add(1);
+        if (sleepers.load() > 0) { // pairs with the sleepers increment in WorkerLoop
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+            condition.notify_one();
+        }
+    }
+
+    /**
+     * @brief Take a task, highest priority first, own deque first, then steal from the others
+     * @param index index of the calling worker
+     * @param task set to the task taken
+     * @return true if a task was taken
+     */
+    bool TryTake(size_t index, Task &task) {
+        for (size_t p = kPriorities; p-- > 0;) {
+            if (pending_by_priority[p].load() == 0) continue;
+            if (TryTake(index, p, task)) {
+                pending_by_priority[p].fetch_sub(1);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * @brief Take a task of one priority, own deque first, then steal from the others
+     * @param index index of the calling worker
+     * @param p priority
+     * @param task set to the task taken
+     * @return true if a task was taken
+     */
+    bool TryTake(size_t index, size_t p, Task &task) {
+        {
+            WorkQueue &own = *queues[index];
+            std::lock_guard<std::mutex> lock(own.mtx);
+            if (!own.tasks[p].empty()) {
+                task = std::move(own.tasks[p].back());
+                own.tasks[p].pop_back();
+                return true;
+            }
+        }
+        for (size_t k = 1; k < queues.size(); k++) {
+            WorkQueue &victim = *queues[(index + k) % queues.size()];
+            std::unique_lock<std::mutex> lock(victim.mtx, std::try_to_lock);
+            if (lock.owns_lock() && !victim.tasks[p].empty()) {
+                task = std::move(victim.tasks[p].front());
+                victim.tasks[p].pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * @brief Worker thread: run tasks until the pool is stopped and drained
+     * @param index index of the worker
+     */
+    void WorkerLoop(size_t index) {
+        Task task;
+        while (true) {
+            if (TryTake(index, task)) {
+                Release();
+                if (space_waiters.load() > 0) { // pairs with the space_waiters increment in Reserve
+                    std::lock_guard<std::mutex> lock(space_mutex);
+                    space_condition.notify_one();
+                }
+                task();
+                task = Task();
+                continue;
+            }
+            if (queued.load() > 0) { // a task is queued but a victim was busy, try again
+                std::this_thread::yield();
+                continue;
+            }
+            auto done = [this]{ return pending.load() == kStopping; }; // stopping and every reserved task taken
+            std::unique_lock<std::mutex> lock(sleep_mutex);
+            sleepers.fetch_add(1);
+            condition.wait(lock, [&]{ return queued.load() > 0 || done(); }); // a reserved task is pushed before it wakes anyone
+            sleepers.fetch_sub(1);
+            if (done()) return;
+        }
+    }
+};
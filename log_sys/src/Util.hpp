@@ -3,7 +3,7 @@
  * @brief Provides utility functions for the asynlog logging library.
  * @author bhhxx
  * @date 2025-05-10
- * @note config path now is `../src/config.json` you need to change it to your own path.
+ * @note config path is JsonData::SetConfigPath(), or `$ASYNLOG_CONFIG`, or `../src/config.json` by default.
  * * This file is part of the asynlog logging library.
  */
 #pragma once
@@ -12,6 +12,8 @@
 #include <fstream> // for istream
 #include <string>
 #include <iostream>
+#include <atomic> // for atomic
+#include <cstdlib> // for getenv
 #include <jsoncpp/json/json.h> // for json
 namespace asynlog {
 namespace Util {
@@ -29,6 +31,24 @@ public:
     static time_t Now() { return time(nullptr); }
 };
 
+/**
+ * @class Thread
+ * @brief Provides Index() function to get a small per-thread index.
+ */
+class Thread {
+public:
+    /**
+     * @brief Gets the index of the calling thread.
+     * @return size_t Indexes are handed out 0, 1, 2... in the order threads first ask,
+     * so `Index() % n` spreads threads evenly over n shards.
+     */
+    static size_t Index() {
+        static std::atomic<size_t> next(0);
+        thread_local size_t index = next.fetch_add(1, std::memory_order_relaxed);
+        return index;
+    }
+};
+
 /**
  * @class File
  * @brief Provides utility functions for file operations.
@@ -188,6 +208,28 @@ public:
 class JsonData {
 public:
 
+    /**
+     * @brief Sets the path of the configuration file.
+     * @param path The path, takes precedence over `$ASYNLOG_CONFIG`.
+     * @note Must be called before the first GetJsonData().
+     */
+    static void SetConfigPath(const std::string &path) { ConfigPathOverride() = path; }
+
+    /**
+     * @brief Gets the path of the configuration file.
+     * @return SetConfigPath() if set, else `$ASYNLOG_CONFIG` if set, else `../src/config.json`.
+     */
+    static std::string ConfigPath() {
+        if (!ConfigPathOverride().empty()) {
+            return ConfigPathOverride();
+        }
+        const char *env = getenv("ASYNLOG_CONFIG");
+        if (env != nullptr && env[0] != '\0') {
+            return env;
+        }
+        return "../src/config.json";
+    }
+
     /**
      * @brief Gets the JsonData object.
      * @return The JsonData object.
@@ -207,12 +249,14 @@ private:
     JsonData() {
         std::string content;
         asynlog::Util::File file;
-        if (file.GetContent(&content, "../src/config.json") == false) {
-            std::cout << __FILE__ << __LINE__ << "-" << "read config.json error" << std::endl;
+        if (file.GetContent(&content, ConfigPath()) == false) {
+            std::cout << __FILE__ << __LINE__ << "-" << "read " << ConfigPath() << " error, using defaults" << std::endl;
             return;
         }
         Json::Value root;
-        asynlog::Util::JsonUtil::UnSerialize(content, &root);
+        if (!asynlog::Util::JsonUtil::UnSerialize(content, &root)) {
+            return;
+        }
         buffer_size = root["buffer_size"].asInt64();
         threshold = root["threshold"].asInt64();
         linear_growth = root["linear_growth"].asInt64();
@@ -220,15 +264,34 @@ private:
         backup_addr = root["backup_addr"].asString();
         backup_port = root["backup_port"].asInt();
         thread_count = root["thread_count"].asInt();
+        if (root.isMember("wakeup_threshold")) wakeup_threshold = root["wakeup_threshold"].asUInt64();
+        if (root.isMember("max_flush_delay_ms")) max_flush_delay_ms = root["max_flush_delay_ms"].asUInt64();
+        if (root.isMember("backup_spool_dir")) backup_spool_dir = root["backup_spool_dir"].asString();
+        if (root.isMember("backup_spool_max_bytes")) backup_spool_max_bytes = root["backup_spool_max_bytes"].asUInt64();
+        if (root.isMember("backup_protocol")) backup_protocol = root["backup_protocol"].asString();
+        if (root.isMember("thread_queue_capacity")) thread_queue_capacity = root["thread_queue_capacity"].asUInt64();
+        if (root.isMember("thread_queue_policy")) thread_queue_policy = root["thread_queue_policy"].asString();
+    }
+
+    static std::string &ConfigPathOverride() {
+        static std::string path;
+        return path;
     }
 public:
-    int64_t buffer_size;    // buffer size in bytes
-    size_t threshold;       // threshold for buffer size in bytes
-    size_t linear_growth;   // linear growth for buffer size in bytes
-    size_t flush_log;       // 
-    std::string backup_addr;// backup address
-    uint16_t backup_port;   // backup port
-    size_t thread_count;    // thread pool size
+    int64_t buffer_size = 10000000;      // buffer size in bytes
+    size_t threshold = 10000000000;      // threshold for buffer size in bytes
+    size_t linear_growth = 10000000;     // linear growth for buffer size in bytes
+    size_t flush_log = 1;                // 0: stdio buffered, 1: fflush every batch, 2: fflush and fsync every batch
+    std::string backup_addr = "0.0.0.0"; // backup address
+    uint16_t backup_port = 8080;         // backup port
+    size_t thread_count = 3;             // thread pool size
+    size_t thread_queue_capacity = 0;    // max tasks queued in the thread pool, 0 for unbounded
+    std::string thread_queue_policy = "block"; // full thread pool queue: "block", "reject" or "drop_lowest"
+    size_t wakeup_threshold = 64 * 1024; // bytes in producer buffer that wake the consumer early
+    size_t max_flush_delay_ms = 5;       // worst-case delay before buffered logs are flushed
+    std::string backup_spool_dir = "./logfile/backup_spool"; // spools of backups the server has not acked
+    size_t backup_spool_max_bytes = 64 * 1024 * 1024;        // most bytes spooled per process
+    std::string backup_protocol = "framed"; // "legacy" for a backup server that predates the shipping protocol
 };
 } // namespace Util   
 } // namespace aynlog
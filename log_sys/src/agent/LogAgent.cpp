@@ -0,0 +1,29 @@
+#include <csignal>
+#include <iostream>
+#include "LogAgent.hpp"
+asynlog::Util::JsonData *conf_data = asynlog::Util::JsonData::GetJsonData();
+ThreadPool *tp = new ThreadPool(conf_data->thread_count, asynlog::ThreadOptions(),
+                                QueueOptions::FromConfig(conf_data->thread_queue_capacity, conf_data->thread_queue_policy));
+
+static std::atomic<bool> stop{false};
+
+static void on_signal(int) { stop.store(true); }
+
+// usage: log_agent [agent config]
+// Drains the shared memory rings of the loggers with a "shm" sink until SIGINT or SIGTERM.
+int main(int argc, char *argv[])
+{
+    Json::Value conf;
+    if (argc > 1) {
+        std::string content;
+        if (!asynlog::Util::File().GetContent(&content, argv[1]) || !asynlog::Util::JsonUtil::UnSerialize(content, &conf)) {
+            std::cout << "usage: " << argv[0] << " [agent config]" << std::endl;
+            return 1;
+        }
+    }
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    asynlog::LogAgent agent(conf);
+    agent.Run(stop);
+    return 0;
+}
@@ -0,0 +1,245 @@
+/**
+ * @file LogAgent.hpp
+ * @brief LogAgent class: drains the shared memory rings of the loggers of many processes into its own sinks.
+ * @author bhhxx
+ * @date 2025-06-17
+*/
+#pragma once
+#include <map> // for map
+#include <string> // for string
+#include <vector> // for vector
+#include <atomic> // for atomic
+#include <thread> // for this_thread
+#include <dirent.h> // for opendir
+#ifdef ASYNLOG_HAVE_ZLIB
+#include <zlib.h> // for gzopen
+#endif
+#include "../ShmRing.hpp" // for ShmRing
+#include "../LogFlush.hpp" // for LogFlushFactory
+#include "../ThreadPool.hpp" // for ThreadPool
+#include "../Metrics.hpp" // for Metrics
+#include "../backup/ClientBackup.hpp" // for start_log_backup
+
+extern ThreadPool *tp;
+
+namespace asynlog
+{
+#ifdef ASYNLOG_HAVE_ZLIB
+/**
+ * @brief GzipFileFlush class: appends to a gzip file, one gzip member per agent run
+*/
+class GzipFileFlush : public LogFlush {
+public:
+    explicit GzipFileFlush(const std::string &filename) {
+        Util::File::CreateDirectory(Util::File::Path(filename));
+        gz_ = gzopen(filename.c_str(), "ab6");
+        if (gz_ == NULL) {
+            std::cout << __FILE__ << __LINE__ << "open gzip file failed: " << filename << std::endl;
+        }
+    }
+
+    ~GzipFileFlush() override {
+        if (gz_ != NULL) gzclose(gz_);
+    }
+
+    void Flush(const char *data, size_t len) override {
+        if (gz_ != NULL && len > 0 && gzwrite(gz_, data, len) == 0) {
+            std::cout << __FILE__ << __LINE__ << "write gzip file failed" << std::endl;
+        }
+    }
+
+    /**
+     * @brief Ends the current deflate block, so a crash of the agent loses nothing written before
+    */
+    void Sync() override {
+        if (gz_ != NULL) gzflush(gz_, Z_SYNC_FLUSH);
+    }
+
+    const char *Type() override { return "gzip_file"; }
+
+private:
+    gzFile gz_ = NULL;  // the compressed file
+};
+#endif
+
+/**
+ * @brief LogAgent class
+ * @note
+ * 1. Poll() finds the rings in /dev/shm, locks each for itself, and writes what the producers wrote to the
+ * sinks of the stream, e.g. `./logfile/agent/{name}.log` with {name} the stream name. A ring whose producer
+ * closed it or died is drained to the end and then unlinked, so records of a crashed process are recovered,
+ * also by an agent started after the crash.
+ *
+ * 2. Lines containing one of the `forward` strings, by default "[ERROR]" and "[FATAL]", are sent to the
+ * backup server on the thread pool. This replaces the backups of the loggers: a logger with a shm sink
+ * does not post its own, so every record reaches the server once.
+ *
+ * 3. Configuration, every key optional:
+ * `{"shm_dir": "/dev/shm", "poll_ms": 5, "forward": ["[ERROR]", "[FATAL]"],
+ *   "sinks": [{"type": "file", "path": "./logfile/agent/{name}.log"}]}`, the sink types of
+ * LogFlushFactory::CreateFromConfig() and "gzip_file" if built with zlib.
+*/
+class LogAgent {
+public:
+    explicit LogAgent(const Json::Value &conf) :
+        shm_dir_(conf.get("shm_dir", "/dev/shm").asString()),
+        poll_ms_(conf.get("poll_ms", 5).asUInt()),
+        sinks_(conf["sinks"]),
+        bytes_(Metrics::Get().GetCounter("asynlog_agent_bytes_total", "Bytes drained from the shared memory rings")),
+        recovered_(Metrics::Get().GetCounter("asynlog_agent_rings_reaped_total", "Rings drained after their producer closed or died")) {
+        if (!sinks_.isArray() || sinks_.empty()) {
+            Json::Value file;
+            file["type"] = "file";
+            file["path"] = "./logfile/agent/{name}.log";
+            sinks_ = Json::Value(Json::arrayValue);
+            sinks_.append(file);
+        }
+        if (conf.isMember("forward")) {
+            for (auto &f : conf["forward"]) forward_.push_back(f.asString());
+        } else {
+            forward_ = {"[ERROR]", "[FATAL]"};
+        }
+    }
+
+    ~LogAgent() {
+        for (auto &e : streams_) {
+            for (auto &s : e.second.sinks) s->Sync();
+        }
+    }
+
+    /**
+     * @brief One pass: open new rings, drain every ring, remove the finished ones
+     * @return the number of bytes drained
+    */
+    size_t Poll() {
+        Discover();
+        size_t total = 0;
+        for (auto it = streams_.begin(); it != streams_.end();) {
+            Stream &s = it->second;
+            bool alive = s.ring->ProducerAlive(); // read first, so nothing written before the producer ended is missed
+            size_t n;
+            while ((n = s.ring->Drain([&](const char *data, size_t len) { Write(s, data, len); })) > 0) total += n;
+            if (!alive && s.ring->Empty()) {
+                for (auto &sink : s.sinks) sink->Sync();
+                s.ring->Unlink();
+                recovered_->Add();
+                it = streams_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        bytes_->Add(total);
+        return total;
+    }
+
+    /**
+     * @brief Poll until stop is set, then drain once more
+    */
+    void Run(const std::atomic<bool> &stop) {
+        while (!stop.load()) {
+            if (Poll() == 0) std::this_thread::sleep_for(std::chrono::milliseconds(poll_ms_));
+        }
+        Poll();
+    }
+
+    /**
+     * @brief Get the number of rings being drained
+    */
+    size_t Streams() { return streams_.size(); }
+
+private:
+    struct Stream {
+        ShmRing::ptr ring;
+        std::vector<LogFlush::ptr> sinks;
+        std::string partial;    // start of a line cut by the end of the ring, for forwarding
+    };
+
+    void Discover() {
+        DIR *dir = opendir(shm_dir_.c_str());
+        if (dir == NULL) return;
+        size_t prefix = strlen(ShmRing::kPrefix);
+        while (struct dirent *e = readdir(dir)) {
+            if (strncmp(e->d_name, ShmRing::kPrefix, prefix) != 0) continue;
+            std::string shm_name = std::string("/") + e->d_name;
+            if (streams_.count(shm_name)) continue;
+            auto ring = ShmRing::Open(shm_name);
+            if (!ring) continue; // not initialized yet or drained by another agent
+            Stream s;
+            s.ring = ring;
+            std::string name = ring->Name();
+            for (auto conf : sinks_) {
+                std::string path = conf["path"].asString();
+                size_t at = path.find("{name}");
+                if (at != std::string::npos) conf["path"] = path.replace(at, 6, name);
+                auto sink = CreateSink(conf);
+                if (sink) s.sinks.push_back(sink);
+            }
+            streams_.emplace(shm_name, std::move(s));
+        }
+        closedir(dir);
+    }
+
+    static LogFlush::ptr CreateSink(const Json::Value &conf) {
+#ifdef ASYNLOG_HAVE_ZLIB
+        if (conf["type"].asString() == "gzip_file") {
+            return std::make_shared<GzipFileFlush>(conf["path"].asString());
+        }
+#endif
+        return LogFlushFactory::CreateFromConfig(conf);
+    }
+
+    void Write(Stream &s, const char *data, size_t len) {
+        for (auto &sink : s.sinks) sink->Flush(data, len);
+        if (forward_.empty()) return;
+        const char *p = data, *end = data + len;
+        while (p < end) {
+            const char *nl = static_cast<const char *>(memchr(p, '\n', end - p));
+            if (!nl) {
+                s.partial.append(p, end - p);
+                return;
+            }
+            if (!s.partial.empty()) {
+                s.partial.append(p, nl + 1 - p);
+                Forward(s.partial.data(), s.partial.size());
+                s.partial.clear();
+            } else {
+                Forward(p, nl + 1 - p);
+            }
+            p = nl + 1;
+        }
+    }
+
+    /**
+     * @brief Check if a line goes to the backup server: its header, the text before the first tab, contains
+     * one of the forward strings
+     * @note Only the default text layout has a header, with the [LEVEL]; a message that mentions "[ERROR]"
+     * does not count. JSON lines have no raw tab and are not forwarded, their loggers back them up themselves.
+    */
+    bool Forwards(const char *line, size_t len) const {
+        const char *tab = static_cast<const char *>(memchr(line, '\t', len));
+        if (tab == nullptr) return false;
+        for (auto &f : forward_) {
+            if (memmem(line, tab - line, f.data(), f.size()) != nullptr) return true;
+        }
+        return false;
+    }
+
+    void Forward(const char *line, size_t len) {
+        if (!Forwards(line, len)) return;
+        try {
+            tp->post(TaskPriority::NORMAL, start_log_backup, std::string(line, len));
+        } catch (const std::exception &e) {
+            std::cout << __FILE__ << __LINE__ << "backup rejected: " << e.what() << std::endl;
+        }
+    }
+
+private:
+    std::string shm_dir_;                       // where the segments are listed
+    unsigned poll_ms_;                          // sleep when a pass found nothing
+    Json::Value sinks_;                         // sink configurations, {name} is the stream name
+    std::vector<std::string> forward_;          // lines whose header contains one of these go to the backup server
+    std::map<std::string, Stream> streams_;     // rings being drained, by segment name
+    Counter *bytes_;                            // bytes drained
+    Counter *recovered_;                        // rings finished and removed
+};
+} // namespace asynlog
@@ -2,43 +2,294 @@
 #include <cstring>
 #include <string>
 #include <iostream>
+#include <vector> // for vector
+#include <memory> // for unique_ptr
+#include <algorithm> // for max
+#include <thread> // for thread
+#include <mutex> // for mutex
+#include <condition_variable> // for condition_variable
+#include <chrono> // for milliseconds
 #include <sys/socket.h> // for socket
 #include <netinet/in.h> // for sockaddr
 #include <arpa/inet.h>
+#include <errno.h> // for program_invocation_short_name
 #include "../Util.hpp"
+#include "../Metrics.hpp" // for Metrics
+#include "Protocol.hpp" // for backup::Connect
+#include "Spool.hpp" // for backup::Spool
 
 extern asynlog::Util::JsonData *conf_data;
 
-void start_log_backup(const std::string &msg) {
-    // init socket
-    int sock = socket(AF_INET, SOCK_STREAM, 0);
-    if (sock < 0) {
-        std::cout << __FILE__ << __LINE__ << "socket error: " << strerror(errno) << std::endl;
-        perror(NULL);
-    }
-    
-    struct sockaddr_in server;
-    memset(&server, 0, sizeof(server));
-    server.sin_family = AF_INET;
-    server.sin_port = htons(conf_data->backup_port);
-    inet_aton(conf_data->backup_addr.c_str(), &(server.sin_addr));
-
-    // connect
-    int retry = 5;
-    while (connect(sock, (struct sockaddr *)&server, sizeof(server)) == -1) { // here assign ip and port for client, which will be known by server
-        std::cout << "Connect Retry! Times remain: " << retry-- << std::endl;
-        if (retry <= 0) {
-            std::cout << __FILE__ << __LINE__ << "connect error : " << strerror(errno) << std::endl;
-            close(sock);
-            perror(NULL);
-            return;
-        }
-    }
-
-    // send msg
-    if (write(sock, msg.c_str(), msg.size()) == -1) {
-        std::cout << __FILE__ << __LINE__ << "send to server error : " << strerror(errno) << std::endl;
-        perror(NULL);
-    }
-    close(sock);
-}
\ No newline at end of file
+namespace asynlog
+{
+namespace backup
+{
+/**
+ * @brief BackupSender class: delivers the records of start_log_backup() to the backup server
+ * @note
+ * 1. start_log_backup() appends the record to a write-ahead Spool under the lock and wakes the sender
+ * thread, so the record survives a crash of the process right after, e.g. on FATAL. The sender fsyncs
+ * the spool without the lock, so posting never waits for the disk. It ships the records as frames of
+ * the shipping protocol, one per record with the record id as sequence number. A record is committed
+ * once the server acked it.
+ *
+ * 2. While the server is unreachable the records stay in the spool, up to backup_spool_max_bytes of the
+ * config; the sender tries to connect once a second and then sends them in order. Records that were
+ * sent but not acked are sent again, at least once; the server stores an id once.
+ *
+ * 3. The spool is <backup_spool_dir>/<program>, or <program>.<pid> while another process of the same
+ * program holds that one. The stream name on the server is <host>.<spool directory name>, so ids
+ * grow per stream, also over restarts, see Spool::NextId(). The server dedups
+ * ids per writer, i.e. per spool, so processes of the same program with other spool directories keep
+ * their records.
+ *
+ * 4. A server that predates the shipping protocol cannot read the frames, and it stored records in its
+ * ./logfile.log where the current one stores ./backup/<stream>.log. With backup_protocol "legacy" in the
+ * config the records go to such a server as before, one connection and one write per record, which
+ * it stores in ./logfile.log. Still spooled, a record is committed once it is written, there is no ack.
+*/
+class BackupSender {
+public:
+    /**
+     * @brief Get the sender of the process, started on first use
+     * @note Never destroyed, so backups posted while the process exits do not use a dead object.
+    */
+    static BackupSender &Get() {
+        static BackupSender *sender = new BackupSender();
+        return *sender;
+    }
+
+    /**
+     * @brief Append a record to the spool for delivery
+     * @param msg the record
+     * @return false if the spool is full or cannot be written and the record is dropped
+    */
+    bool Post(const std::string &msg) {
+        std::lock_guard<std::mutex> lock(mtx_);
+        if (!spool_->Append(spool_->NextId(), msg.data(), msg.size())) {
+            failures_->Add();
+            return false;
+        }
+        cond_.notify_one();
+        return true;
+    }
+
+    /**
+     * @brief Wait until every record posted so far is delivered
+     * @param timeout the longest wait
+     * @return true if the spool is empty
+    */
+    bool WaitDelivered(std::chrono::milliseconds timeout) {
+        std::unique_lock<std::mutex> lock(mtx_);
+        return delivered_cond_.wait_for(lock, timeout, [this]() { return spool_->Empty(); });
+    }
+
+    const std::string &Name() const { return name_; }
+    size_t SpoolBytes() {
+        std::lock_guard<std::mutex> lock(mtx_);
+        return spool_->Bytes();
+    }
+
+private:
+    struct Record {
+        uint64_t id;
+        std::string data;
+        Spool::Position next;
+    };
+
+    BackupSender() :
+        failures_(Metrics::Get().GetCounter("asynlog_backup_failures_total",
+                                            "Backups dropped because the backup spool was full")),
+        delivered_(Metrics::Get().GetCounter("asynlog_backup_delivered_total", "Backups acked by the backup server")),
+        corrupt_(Metrics::Get().GetCounter("asynlog_backup_corrupt_total", "Spooled backups skipped because they failed their checksum")) {
+        std::string dir = conf_data->backup_spool_dir + "/" + program_invocation_short_name;
+        spool_.reset(new Spool(dir, conf_data->backup_spool_max_bytes));
+        if (!spool_->Ok()) {
+            dir += "." + std::to_string(getpid());
+            spool_.reset(new Spool(dir, conf_data->backup_spool_max_bytes));
+        }
+        char host[256] = "localhost";
+        gethostname(host, sizeof(host) - 1);
+        name_ = std::string(host) + "." + dir.substr(dir.find_last_of('/') + 1);
+        writer_ = WriterId(dir);
+        std::thread(&BackupSender::Run, this).detach();
+    }
+
+    void Run() {
+        Spool::Position sent;   // after the last record sent on this connection
+        while (true) {
+            int fd;
+            {
+                std::unique_lock<std::mutex> lock(mtx_);
+                if (spool_->Empty()) {
+                    cond_.wait_for(lock, std::chrono::seconds(1));
+                    continue;
+                }
+                fd = spool_->SyncFd();
+            }
+            if (fd >= 0) { // a record is on disk before it leaves
+                fsync(fd);
+                close(fd);
+            }
+            size_t acked = 0;
+            std::chrono::milliseconds wait = conf_data->backup_protocol == "legacy" ? DeliverLegacy(&acked) : Deliver(&sent, &acked);
+            std::unique_lock<std::mutex> lock(mtx_);
+            if (acked > 0) {
+                delivered_->Add(acked);
+                delivered_cond_.notify_all();
+            }
+            if (wait.count() > 0) cond_.wait_for(lock, wait);
+        }
+    }
+
+    /**
+     * @brief Ship the spooled records as frames, connecting first if needed
+     * @param sent after the last record sent on the connection
+     * @param acked set to the number of records the server acked
+     * @return how long to wait before the next try, zero to go on
+    */
+    std::chrono::milliseconds Deliver(Spool::Position *sent, size_t *acked) {
+        if (fd_ < 0) {
+            time_t now = Util::Date::Now();
+            if (now == last_connect_) return std::chrono::milliseconds(100); // connects are tried once a second
+            last_connect_ = now;
+            fd_ = Connect(conf_data->backup_addr + ":" + std::to_string(conf_data->backup_port), MakeHello(name_, 0, writer_));
+            if (fd_ < 0) return std::chrono::seconds(1);
+            std::lock_guard<std::mutex> lock(mtx_);
+            *sent = spool_->Checkpoint();
+        }
+        std::vector<Record> batch;
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            Spool::Position from = *sent;
+            *sent = ReadBatch(from, &batch);
+            if (batch.empty() && *sent != from) { // only corrupt records, nothing to wait for
+                spool_->Commit(*sent);
+                return std::chrono::milliseconds(0);
+            }
+        }
+        if (batch.empty()) { // an unreadable segment, tried again on the next connection
+            close(fd_);
+            fd_ = -1;
+            return std::chrono::milliseconds(0);
+        }
+        *acked = Ship(batch);
+        if (*acked > 0) {
+            std::lock_guard<std::mutex> lock(mtx_);
+            spool_->Commit(batch[*acked - 1].next);
+        }
+        if (*acked < batch.size()) {
+            close(fd_);
+            fd_ = -1;
+            return std::chrono::seconds(1);
+        }
+        return std::chrono::milliseconds(0);
+    }
+
+    /**
+     * @brief Send the spooled records to a server of the legacy protocol, see note 4
+     * @param written set to the number of records written
+     * @return how long to wait before the next try, zero to go on
+    */
+    std::chrono::milliseconds DeliverLegacy(size_t *written) {
+        if (fd_ >= 0) {
+            close(fd_);
+            fd_ = -1;
+        }
+        std::vector<Record> batch;
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            Spool::Position end = ReadBatch(spool_->Checkpoint(), &batch);
+            if (batch.empty() && end != spool_->Checkpoint()) { // only corrupt records, nothing to wait for
+                spool_->Commit(end);
+                return std::chrono::milliseconds(0);
+            }
+        }
+        *written = ShipLegacy(batch);
+        if (*written > 0) {
+            std::lock_guard<std::mutex> lock(mtx_);
+            spool_->Commit(batch[*written - 1].next);
+        }
+        return *written < batch.size() ? std::chrono::seconds(1) : std::chrono::milliseconds(0);
+    }
+
+    /**
+     * @brief Read about 256KB of spooled records, skipping and counting the corrupt ones
+     * @param from where to start
+     * @param batch the records read
+     * @return the position after the last record read or skipped
+     * @note Must be called with mtx_ held.
+    */
+    Spool::Position ReadBatch(const Spool::Position &from, std::vector<Record> *batch) {
+        size_t skipped = 0;
+        Spool::Position end = spool_->Read(from, 256 * 1024, [&](uint64_t id, const char *data, size_t len, const Spool::Position &next) {
+            batch->push_back(Record{id, std::string(data, len), next});
+            return true;
+        }, &skipped);
+        if (skipped > 0) corrupt_->Add(skipped);
+        return end;
+    }
+
+    /**
+     * @brief Send a batch of records, at most kWindow not acked at a time
+     * @return the number of records acked, in order
+    */
+    size_t Ship(const std::vector<Record> &batch) {
+        static const size_t kWindow = 32;
+        std::string frame;
+        size_t sent = 0, acked = 0;
+        while (acked < batch.size()) {
+            if (sent < batch.size() && sent - acked < kWindow) {
+                MakeFrame(batch[sent].id, batch[sent].data.data(), batch[sent].data.size(), false, &frame);
+                if (!WriteFull(fd_, frame.data(), frame.size())) break;
+                sent++;
+                continue;
+            }
+            uint64_t ack;
+            if (!ReadFull(fd_, reinterpret_cast<char *>(&ack), sizeof(ack))) break;
+            ack = be64toh(ack);
+            while (acked < sent && batch[acked].id <= ack) acked++;
+        }
+        return acked;
+    }
+
+    /**
+     * @brief Send records to a server of the legacy protocol, one connection per record
+     * @return the number of records written, in order
+    */
+    size_t ShipLegacy(const std::vector<Record> &batch) {
+        std::string address = conf_data->backup_addr + ":" + std::to_string(conf_data->backup_port);
+        size_t written = 0;
+        for (; written < batch.size(); written++) {
+            int fd = Connect(address, std::string());
+            if (fd < 0) break;
+            bool ok = WriteFull(fd, batch[written].data.data(), batch[written].data.size());
+            close(fd);
+            if (!ok) break;
+        }
+        return written;
+    }
+
+private:
+    std::mutex mtx_;                        // guards spool_
+    std::condition_variable cond_;          // a record was posted
+    std::condition_variable delivered_cond_; // records were acked
+    std::unique_ptr<Spool> spool_;          // records not yet acked, guarded by mtx_
+    std::string name_;                      // stream name on the server
+    uint64_t writer_ = 0;                   // writer id of the spool, see WriterId()
+    int fd_ = -1;                           // connection to the server, only used by the sender thread
+    time_t last_connect_ = 0;               // second of the last connect attempt
+    Counter *failures_;                     // records dropped
+    Counter *delivered_;                    // records acked
+    Counter *corrupt_;                      // records skipped as corrupt
+};
+} // namespace backup
+} // namespace asynlog
+
+/**
+ * @brief Send a record to the backup server, through the spool of backup::BackupSender
+ * @param msg the record
+*/
+inline void start_log_backup(const std::string &msg) {
+    asynlog::backup::BackupSender::Get().Post(msg);
+}
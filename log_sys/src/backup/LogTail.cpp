@@ -0,0 +1,84 @@
+#include <getopt.h>
+#include <cstdio>
+#include <iostream>
+#include "Protocol.hpp"
+#include "Tail.hpp"
+
+static void usage(const char *prog) {
+    std::cout << "usage: " << prog << " [options] <host:port>\n"
+              << "  -l, --level LEVELS    comma separated levels, e.g. ERROR,FATAL\n"
+              << "  -m, --min-level LEVEL this level and above\n"
+              << "  -n, --logger NAME     records of this logger\n"
+              << "  -s, --stream NAME     records of this stream, e.g. host.app\n"
+              << "  -e, --contains TEXT   records containing TEXT\n";
+}
+
+static bool parse_levels(const std::string &list, std::vector<asynlog::LogLevel::value> *levels) {
+    size_t pos = 0;
+    while (pos <= list.size()) {
+        size_t comma = list.find(',', pos);
+        if (comma == std::string::npos) comma = list.size();
+        asynlog::LogLevel::value lv;
+        if (!asynlog::LogLevel::FromString(list.substr(pos, comma - pos), &lv)) return false;
+        levels->push_back(lv);
+        pos = comma + 1;
+    }
+    return true;
+}
+
+// usage: log_tail [options] <host:port>
+// Prints the matching records the backup server receives from now on, as "<stream>\t<record>", until
+// interrupted. Lines starting with "# " come from the server, e.g. when it dropped this subscriber.
+int main(int argc, char *argv[])
+{
+    static const struct option options[] = {
+        {"level", required_argument, nullptr, 'l'}, {"min-level", required_argument, nullptr, 'm'},
+        {"logger", required_argument, nullptr, 'n'}, {"stream", required_argument, nullptr, 's'},
+        {"contains", required_argument, nullptr, 'e'}, {nullptr, 0, nullptr, 0}};
+    asynlog::backup::TailRequest req;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "l:m:n:s:e:", options, nullptr)) != -1) {
+        switch (opt) {
+            case 'l':
+                if (!parse_levels(optarg, &req.filter.levels)) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'm': {
+                asynlog::LogLevel::value lv;
+                if (!asynlog::LogLevel::FromString(optarg, &lv)) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                for (int i = static_cast<int>(lv); i <= static_cast<int>(asynlog::LogLevel::value::FATAL); i++) {
+                    req.filter.levels.push_back(static_cast<asynlog::LogLevel::value>(i));
+                }
+                break;
+            }
+            case 'n': req.filter.logger = optarg; break;
+            case 's': req.stream = optarg; break;
+            case 'e': req.filter.contains = optarg; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (optind + 1 != argc) {
+        usage(argv[0]);
+        return 1;
+    }
+    int fd = asynlog::backup::Connect(argv[optind], asynlog::backup::MakeSubscribe(req));
+    if (fd < 0) {
+        std::cout << "connect to " << argv[optind] << " failed" << std::endl;
+        return 1;
+    }
+    struct timeval forever = {0, 0}; // records may be minutes apart
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &forever, sizeof(forever));
+    char buf[64 * 1024];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0) {
+        fwrite(buf, 1, n, stdout);
+        fflush(stdout);
+    }
+    close(fd);
+    return 0;
+}
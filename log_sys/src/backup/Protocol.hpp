@@ -0,0 +1,214 @@
+/**
+ * @file Protocol.hpp
+ * @brief Framing of the log shipping connection between BackupFlush and the backup server.
+ * @author bhhxx
+ * @date 2025-06-18
+*/
+#pragma once
+#include <string> // for string
+#include <cstdint> // for uint64_t
+#include <cstring> // for memcpy
+#include <cerrno> // for errno
+#include <cstdlib> // for realpath
+#include <endian.h> // for htobe64
+#include <unistd.h> // for read
+#include <sys/socket.h> // for send
+#include <sys/time.h> // for timeval
+#include <netinet/in.h> // for sockaddr_in
+#include <arpa/inet.h> // for inet_pton
+#ifdef ASYNLOG_HAVE_ZLIB
+#include <zlib.h> // for compress2
+#endif
+
+namespace asynlog
+{
+namespace backup
+{
+/**
+ * @note
+ * A shipping connection starts with a hello: the magic "ASLB", a version byte, a flags byte, the length
+ * of the stream name as 16 bit big endian, the name and, since version 2, the 64 bit big endian id of the
+ * writer, see WriterId(). Then the client sends frames, a FrameHeader and
+ * wire_len bytes of payload, a batch of log lines, zlib compressed if the flags say so. The server acks
+ * every frame it has written with its 8 byte big endian sequence number.
+ *
+ * Sequence numbers grow per stream across connections and restarts of the client, which starts them
+ * at its wall clock in microseconds or above the ids its spool reserved, see Spool::NextId(). The server skips frames a writer of the stream has already written,
+ * so a frame sent again after a lost ack is stored once, while writers that share a stream name do not
+ * drop each other's frames. A version 1 hello has writer 0.
+ *
+ * A legacy backup connection sends a single log line, which never starts with the magic.
+*/
+constexpr char kMagic[4] = {'A', 'S', 'L', 'B'};
+constexpr uint8_t kVersion = 2;
+constexpr uint32_t kFlagZlib = 1;           // the payload is zlib compressed
+constexpr size_t kHeaderSize = 24;          // encoded FrameHeader
+constexpr size_t kMaxFrame = 64 << 20;      // larger frames are a protocol error
+
+struct FrameHeader {
+    uint64_t seq = 0;       // sequence number of the batch in its stream
+    uint32_t wire_len = 0;  // payload bytes that follow
+    uint32_t raw_len = 0;   // payload bytes after decompression
+    uint32_t flags = 0;     // kFlagZlib
+};
+
+inline void EncodeHeader(const FrameHeader &h, char *out) {
+    uint64_t seq = htobe64(h.seq);
+    uint32_t v[4] = {htobe32(h.wire_len), htobe32(h.raw_len), htobe32(h.flags), 0};
+    memcpy(out, &seq, 8);
+    memcpy(out + 8, v, 16);
+}
+
+inline FrameHeader DecodeHeader(const char *in) {
+    FrameHeader h;
+    uint64_t seq;
+    uint32_t v[4];
+    memcpy(&seq, in, 8);
+    memcpy(v, in + 8, 16);
+    h.seq = be64toh(seq);
+    h.wire_len = be32toh(v[0]);
+    h.raw_len = be32toh(v[1]);
+    h.flags = be32toh(v[2]);
+    return h;
+}
+
+/**
+ * @brief Build a frame: header and payload, compressed if asked and smaller
+ * @param seq the sequence number
+ * @param data the batch
+ * @param len the length of the batch
+ * @param compress whether to try zlib
+ * @param out the frame, replaced
+*/
+inline void MakeFrame(uint64_t seq, const char *data, size_t len, bool compress, std::string *out) {
+    FrameHeader h;
+    h.seq = seq;
+    h.raw_len = len;
+    out->resize(kHeaderSize);
+#ifdef ASYNLOG_HAVE_ZLIB
+    if (compress) {
+        uLongf zlen = compressBound(len);
+        out->resize(kHeaderSize + zlen);
+        if (compress2(reinterpret_cast<Bytef *>(&(*out)[kHeaderSize]), &zlen,
+                      reinterpret_cast<const Bytef *>(data), len, 1) == Z_OK && zlen < len) {
+            out->resize(kHeaderSize + zlen);
+            h.wire_len = zlen;
+            h.flags = kFlagZlib;
+            EncodeHeader(h, &(*out)[0]);
+            return;
+        }
+        out->resize(kHeaderSize);
+    }
+#endif
+    out->append(data, len);
+    h.wire_len = len;
+    EncodeHeader(h, &(*out)[0]);
+}
+
+/**
+ * @brief Get the batch of a frame payload
+ * @return false if the payload cannot be decompressed
+*/
+inline bool Unpack(const FrameHeader &h, const char *payload, std::string *out) {
+    if (!(h.flags & kFlagZlib)) {
+        out->assign(payload, h.wire_len);
+        return true;
+    }
+#ifdef ASYNLOG_HAVE_ZLIB
+    out->resize(h.raw_len);
+    uLongf len = h.raw_len;
+    return uncompress(reinterpret_cast<Bytef *>(&(*out)[0]), &len, reinterpret_cast<const Bytef *>(payload), h.wire_len) == Z_OK &&
+           len == h.raw_len;
+#else
+    return false;
+#endif
+}
+
+/**
+ * @brief Build the hello of a connection
+ * @param name the stream name
+ * @param flags kFlagZlib if the frames may be compressed
+ * @param writer the writer id, see WriterId()
+*/
+inline std::string MakeHello(const std::string &name, uint8_t flags, uint64_t writer = 0) {
+    std::string hello(kMagic, 4);
+    hello += static_cast<char>(kVersion);
+    hello += static_cast<char>(flags);
+    hello += static_cast<char>(name.size() >> 8);
+    hello += static_cast<char>(name.size() & 0xff);
+    hello += name;
+    writer = htobe64(writer);
+    return hello.append(reinterpret_cast<const char *>(&writer), sizeof(writer));
+}
+
+/**
+ * @brief Get the writer id of a spool: a hash of the host and the absolute spool path
+ * @note The spool outlives a restart of its process and one process holds it at a time, so the id stays
+ * the same for the frames a writer replays and differs between writers of the same stream name.
+*/
+inline uint64_t WriterId(const std::string &spool) {
+    char host[256] = "localhost";
+    gethostname(host, sizeof(host) - 1);
+    char *path = realpath(spool.c_str(), NULL);
+    std::string key = std::string(host) + ":" + (path ? path : spool.c_str());
+    free(path);
+    uint64_t h = 14695981039346656037ULL; // FNV-1a
+    for (unsigned char c : key) h = (h ^ c) * 1099511628211ULL;
+    return h ? h : 1; // 0 is a version 1 writer
+}
+
+/**
+ * @brief Read exactly n bytes, false on EOF, error or timeout
+*/
+inline bool ReadFull(int fd, char *buf, size_t n) {
+    while (n > 0) {
+        ssize_t r = read(fd, buf, n);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return false;
+        buf += r;
+        n -= r;
+    }
+    return true;
+}
+
+/**
+ * @brief Write exactly n bytes, false on error or timeout
+*/
+inline bool WriteFull(int fd, const char *buf, size_t n) {
+    while (n > 0) {
+        ssize_t r = send(fd, buf, n, MSG_NOSIGNAL);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return false;
+        buf += r;
+        n -= r;
+    }
+    return true;
+}
+/**
+ * @brief Open a shipping connection: connect and send the hello
+ * @param address "host:port" of the server with an IPv4 host
+ * @param hello the hello, see MakeHello()
+ * @return the socket, with 1s send and receive timeouts, or -1
+*/
+inline int Connect(const std::string &address, const std::string &hello) {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    size_t colon = address.rfind(':');
+    if (colon == std::string::npos || inet_pton(AF_INET, address.substr(0, colon).c_str(), &addr.sin_addr) != 1) {
+        return -1;
+    }
+    addr.sin_port = htons(atoi(address.c_str() + colon + 1));
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    struct timeval timeout = {1, 0};
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || !WriteFull(fd, hello.data(), hello.size())) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+} // namespace backup
+} // namespace asynlog
@@ -3,7 +3,9 @@
 #include <sys/stat.h>
 #include <cassert>
 #include "ServerBackup.hpp"
+#include "../query/Index.hpp"
 #include <memory>
+#include <map>
 const std::string filename = "./logfile.log";
 
 void usage(std::string procgress) {
@@ -21,7 +23,7 @@ void backup_log(const std::string &message) {
         perror("fopen error: ");
         assert(false);
     }
-    int write_byte = fwrite(message.c_str(), 1, message.size(), fp);
+    size_t write_byte = fwrite(message.c_str(), 1, message.size(), fp);
     if (write_byte != message.size()) {
         perror("fwrite error: ");
         assert(false);
@@ -30,6 +32,30 @@ void backup_log(const std::string &message) {
     fclose(fp);
 }
 
+// a shipped batch of a stream goes to ./backup/<name>.log, indexed in ./backup/<name>.log.idx for log_query;
+// the server calls it for one batch at a time
+void backup_batch(const std::string &name, const std::string &batch) {
+    static std::map<std::string, std::unique_ptr<asynlog::query::IndexWriter>> indexes;
+    mkdir("./backup", 0755);
+    std::string path = "./backup/" + name + ".log";
+    FILE *fp = fopen(path.c_str(), "ab");
+    if (fp == NULL) {
+        perror("fopen error: ");
+        return;
+    }
+    std::unique_ptr<asynlog::query::IndexWriter> &index = indexes[name];
+    if (!index) {
+        struct stat st;
+        index.reset(new asynlog::query::IndexWriter(path, 64 * 1024, fstat(fileno(fp), &st) == 0 ? st.st_size : 0));
+    }
+    if (fwrite(batch.data(), 1, batch.size(), fp) != batch.size()) {
+        perror("fwrite error: ");
+    }
+    fclose(fp);
+    index->Add(batch.data(), batch.size());
+    index->Flush();
+}
+
 int main(int args, char *argv[])
 {
     if (args != 2) {
@@ -39,7 +65,7 @@ int main(int args, char *argv[])
     }
 
     uint16_t port = atoi(argv[1]);
-    std::unique_ptr<TCP_Server> tcp(new TCP_Server(port, backup_log));
+    std::unique_ptr<TCP_Server> tcp(new TCP_Server(port, backup_log, backup_batch));
 
     tcp->init_service();
     tcp->start_service();
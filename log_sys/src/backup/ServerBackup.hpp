@@ -7,8 +7,14 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <functional>
+#include <map>
+#include <mutex>
+#include <poll.h>
+#include "Protocol.hpp"
+#include "Tail.hpp"
 
 using func_t = std::function<void(const std::string &)>;
+using batch_func_t = std::function<void(const std::string &name, const std::string &batch)>; // one shipped batch of a stream
 const int backlog_times = 32;
 class TCP_Server;
 
@@ -29,8 +35,15 @@ private:
     int listen_sock_;
     uint16_t port_;
     func_t func_;
+    batch_func_t batch_func_;                   // shipping connections of BackupFlush, see Protocol.hpp
+    std::mutex seq_mtx_;                        // serializes the batches, guards last_seq_
+    std::map<std::pair<std::string, uint64_t>, uint64_t> last_seq_;  // last sequence number stored per stream and writer
+    asynlog::backup::TailHub tail_;             // live subscribers, see Tail.hpp
 public:
-    TCP_Server(uint16_t port, func_t func) : port_(port), func_(func) {}
+    TCP_Server(uint16_t port, func_t func, batch_func_t batch_func = nullptr) : port_(port), func_(func), batch_func_(batch_func) {}
+
+    uint16_t port() const { return port_; }
+    asynlog::backup::TailHub &tail() { return tail_; }
 
     void init_service() {
         // init socket
@@ -39,6 +52,8 @@ public:
             std::cout << __FILE__ << __LINE__ << "socket error: " << strerror(errno) << std::endl;
             perror(NULL);
         }
+        int opt = 1; // rebind right after a restart, while old connections are in TIME_WAIT
+        setsockopt(listen_sock_, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
         struct sockaddr_in local;
         local.sin_family = AF_INET;
         local.sin_port = htons(port_);
@@ -48,6 +63,8 @@ public:
         if (bind(listen_sock_, (struct sockaddr *)&local, sizeof(local)) < 0) {
             std::cout << __FILE__ << __LINE__ << "bind socket error"<< strerror(errno) << std::endl;
         }
+        socklen_t len = sizeof(local); // port 0 picks a free port
+        if (getsockname(listen_sock_, (struct sockaddr *)&local, &len) == 0) port_ = ntohs(local.sin_port);
 
         // listen
         if (listen(listen_sock_, backlog_times) < 0) {
@@ -59,7 +76,20 @@ public:
     {
         char buf[1024];
 
-        int r_ret = read(sock, buf, sizeof(buf));
+        // a shipping connection starts with the magic, a subscriber with SUBSCRIBE, a legacy one with a log line;
+        // a hello is longer than SUBSCRIBE, a shorter legacy record is all there is once its client closes
+        const size_t subscribe_len = sizeof(asynlog::backup::kSubscribe) - 1;
+        int r_ret = recv(sock, buf, subscribe_len, MSG_PEEK | MSG_WAITALL);
+        if (r_ret >= static_cast<int>(sizeof(asynlog::backup::kMagic)) && batch_func_ &&
+            memcmp(buf, asynlog::backup::kMagic, sizeof(asynlog::backup::kMagic)) == 0) {
+            shipping_service(sock);
+            return;
+        }
+        if (r_ret == static_cast<int>(subscribe_len) && memcmp(buf, asynlog::backup::kSubscribe, subscribe_len) == 0) {
+            subscribe_service(sock);
+            return;
+        }
+        r_ret = read(sock, buf, sizeof(buf) - 1);
         if (r_ret ==-1) {
             std::cout << __FILE__ << __LINE__ << "read error" << strerror(errno) << std::endl;
             perror("NULL");
@@ -67,8 +97,99 @@ public:
             buf[r_ret] = 0;
             std::string tmp = buf;
             func_(client_info + tmp);
+            tail_.Publish(client_info, tmp);
+        }
+    }
+
+    /**
+     * @brief Receive the frames of a shipping connection, store each new one and ack it
+     * @note A frame with a sequence number the writer already stored for its stream is acked and not stored again.
+    */
+    void shipping_service(int sock)
+    {
+        using namespace asynlog::backup;
+        char hello[8];
+        if (!ReadFull(sock, hello, sizeof(hello))) return;
+        uint8_t version = static_cast<uint8_t>(hello[4]);
+        if (version < 1 || version > kVersion) return;
+        std::string name(static_cast<uint8_t>(hello[6]) << 8 | static_cast<uint8_t>(hello[7]), '\0');
+        if (name.empty() || !ReadFull(sock, &name[0], name.size())) return;
+        uint64_t writer = 0;
+        if (version >= 2) {
+            if (!ReadFull(sock, reinterpret_cast<char *>(&writer), sizeof(writer))) return;
+            writer = be64toh(writer);
+        }
+        for (char &c : name) { // the name becomes a file name
+            if (c == '/') c = '_';
+        }
+        if (name[0] == '.') name[0] = '_';
+
+        char head[kHeaderSize];
+        std::string payload, batch;
+        while (ReadFull(sock, head, kHeaderSize)) {
+            FrameHeader h = DecodeHeader(head);
+            if (h.wire_len > kMaxFrame || h.raw_len > kMaxFrame) {
+                std::cout << __FILE__ << __LINE__ << "frame too large from " << name << std::endl;
+                return;
+            }
+            payload.resize(h.wire_len);
+            if (!ReadFull(sock, &payload[0], h.wire_len)) return;
+            if (!Unpack(h, payload.data(), &batch)) {
+                std::cout << __FILE__ << __LINE__ << "bad frame from " << name << std::endl;
+                return;
+            }
+            {
+                std::lock_guard<std::mutex> lock(seq_mtx_);
+                uint64_t &last = last_seq_[{name, writer}];
+                if (h.seq > last) {
+                    batch_func_(name, batch);
+                    tail_.Publish(name, batch);
+                    last = h.seq;
+                }
+            }
+            uint64_t ack = htobe64(h.seq);
+            if (!WriteFull(sock, reinterpret_cast<const char *>(&ack), sizeof(ack))) return;
+        }
+    }
+
+    /**
+     * @brief Stream the matching records to a subscriber until it closes or falls behind
+     * @note This thread does the sends, so a slow subscriber only fills its own buffer in tail_.
+    */
+    void subscribe_service(int sock)
+    {
+        using namespace asynlog::backup;
+        std::string line;
+        char c;
+        while (line.size() < 4096 && read(sock, &c, 1) == 1 && c != '\n') line += c;
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        TailRequest req;
+        if (!ParseSubscribe(line, &req)) {
+            const std::string err = "# error: bad request, " + std::string(kSubscribe) +
+                                    " [level=ERROR,FATAL] [logger=NAME] [stream=NAME] [contains=TEXT]\n";
+            WriteFull(sock, err.data(), err.size());
+            return;
         }
+        struct timeval timeout = {5, 0}; // a subscriber that stops reading is dropped, not waited for
+        setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        std::shared_ptr<TailSubscriber> sub = tail_.Subscribe(req);
+        const std::string ok = "# subscribed\n";
+        std::string out;
+        bool open = WriteFull(sock, ok.data(), ok.size());
+        while (open) {
+            bool alive = sub->Take(&out, std::chrono::milliseconds(500));
+            if (!out.empty() && !WriteFull(sock, out.data(), out.size())) break;
+            if (!alive) {
+                const std::string dropped = "# dropped: more than the buffer behind\n";
+                WriteFull(sock, dropped.data(), dropped.size());
+                break;
+            }
+            struct pollfd pfd = {sock, POLLIN, 0}; // the client sends nothing more, readable means closed
+            open = poll(&pfd, 1, 0) == 0;
+        }
+        tail_.Unsubscribe(sub);
     }
+
     void start_service() {
         while (true) {
             struct sockaddr_in client;
@@ -0,0 +1,391 @@
+/**
+ * @file Spool.hpp
+ * @brief Spool class: a write-ahead spool of records for the backup server, segmented append-only files with a checkpoint.
+ * @author bhhxx
+ * @date 2025-06-18
+*/
+#pragma once
+#include <string> // for string
+#include <map> // for map
+#include <iostream> // for cout
+#include <algorithm> // for min, max
+#include <cstdio> // for fopen
+#include <cstring> // for memcpy
+#include <ctime> // for time
+#include <chrono> // for system_clock
+#include <cinttypes> // for PRIu64
+#include <unistd.h> // for fsync, truncate
+#include <fcntl.h> // for open
+#include <dirent.h> // for opendir
+#include <sys/file.h> // for flock
+#include "../Util.hpp" // for Util::File
+
+namespace asynlog
+{
+namespace backup
+{
+/**
+ * @brief Spool class
+ * @note
+ * 1. A directory of segments `<n>.wal`, numbered from 1, and a `checkpoint` file. A record is a 16 byte header,
+ * length, checksum and the id of the record, followed by its bytes. Records are appended to the newest
+ * segment; a segment holds segment_bytes or a little more, then the next one is started.
+ *
+ * 2. The checkpoint is the position of the first record not yet delivered. Commit() moves it when the server
+ * acked records, deletes the segments before it and writes it to disk, at most once a second and on Sync().
+ * After a crash delivery restarts at the last checkpoint written, so records can be delivered twice; the
+ * server recognizes them by their ids. A torn record at the end of a segment is cut off on open.
+ *
+ * 3. Disk usage is bounded: appends beyond max_bytes of undelivered records are refused.
+ *
+ * 4. An appended record is handed to the kernel at once, so it survives a crash of the process; SyncFd()
+ * makes it survive one of the machine. A record that fails its checksum later is skipped by Read().
+ *
+ * 5. NextId() numbers the records of the writer. Ids start at the wall clock in microseconds, or above every
+ * id handed out before if that is larger: the checkpoint file also keeps a reservation kIdBlock ahead of the
+ * last id, so a clock stepped back across a restart cannot reuse ids the server already stored.
+ *
+ * 6. One process owns a spool directory, it holds a lock on it, see Ok(). Not thread safe.
+*/
+class Spool {
+public:
+    static constexpr size_t kRecordHeader = 16;
+    static constexpr uint64_t kIdBlock = 1 << 20;  // ids reserved by one checkpoint write
+
+    /**
+     * @brief A position in the spool, the segment and the byte offset in it
+    */
+    struct Position {
+        uint64_t segment = 1;
+        uint64_t offset = 0;
+        bool operator==(const Position &o) const { return segment == o.segment && offset == o.offset; }
+        bool operator!=(const Position &o) const { return !(*this == o); }
+    };
+
+    /**
+     * @brief Open a spool, creating the directory, and recover what an earlier run left
+     * @param dir the spool directory
+     * @param max_bytes the most bytes of undelivered records
+     * @param segment_bytes the size of a segment
+    */
+    Spool(const std::string &dir, size_t max_bytes, size_t segment_bytes = 4 * 1024 * 1024) :
+        dir_(dir), max_bytes_(max_bytes), segment_bytes_(segment_bytes) {
+        Util::File::CreateDirectory(dir_);
+        lock_fd_ = open((dir_ + "/lock").c_str(), O_CREAT | O_RDWR | O_CLOEXEC, 0644);
+        if (lock_fd_ < 0 || flock(lock_fd_, LOCK_EX | LOCK_NB) != 0) {
+            std::cout << __FILE__ << __LINE__ << "spool " << dir_ << " is used by another process" << std::endl;
+        } else {
+            Recover();
+        }
+        uint64_t now = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        next_id_ = std::max({last_id_, reserved_id_, now}) + 1;
+    }
+
+    ~Spool() {
+        if (lock_fd_ < 0) return;
+        if (ok_) Sync();
+        if (writer_ != NULL) fclose(writer_);
+        close(lock_fd_);
+    }
+
+    /**
+     * @brief Check if this process owns the spool, a spool of another process refuses every append
+    */
+    bool Ok() const { return ok_; }
+
+    /**
+     * @brief Append a record
+     * @param id the id of the record, ids grow
+     * @param data the record
+     * @param len the length of the record
+     * @return false if the spool is full or cannot be written
+    */
+    bool Append(uint64_t id, const char *data, size_t len) {
+        size_t size = kRecordHeader + len;
+        if (!ok_ || bytes_ + size > max_bytes_) return false;
+        if (end_.offset >= segment_bytes_) { // start the next segment, the full one is synced first
+            if (writer_ != NULL) {
+                fsync(fileno(writer_));
+                fclose(writer_);
+            }
+            writer_ = NULL;
+            end_ = Position{end_.segment + 1, 0};
+        }
+        if (writer_ == NULL && (writer_ = fopen(SegmentPath(end_.segment).c_str(), "ab")) == NULL) return false;
+        char head[kRecordHeader];
+        EncodeRecord(head, len, Check(data, len), id);
+        if (fwrite(head, 1, kRecordHeader, writer_) != kRecordHeader || fwrite(data, 1, len, writer_) != len ||
+            fflush(writer_) != 0) {
+            fclose(writer_);
+            writer_ = NULL;
+            truncate(SegmentPath(end_.segment).c_str(), end_.offset); // cut off whatever part was written
+            return false;
+        }
+        end_.offset += size;
+        sizes_[end_.segment] = end_.offset;
+        bytes_ += size;
+        last_id_ = id;
+        return true;
+    }
+
+    /**
+     * @brief Read records in order
+     * @param from the position to start at, e.g. Checkpoint()
+     * @param max_bytes stop after about this many bytes
+     * @param f called as `bool f(uint64_t id, const char *data, size_t len, const Position &next)` with next the
+     * position after the record, false stops the read before the record is counted
+     * @param skipped if set, incremented for every record skipped because it is corrupt
+     * @return the position after the last record counted or skipped
+     * @note A corrupt record is skipped as Recover() cuts off a torn one, so a bad record cannot hold back
+     * the ones after it. If its length cannot be trusted, the rest of its segment is skipped.
+    */
+    template <class F>
+    Position Read(Position from, size_t max_bytes, F f, size_t *skipped = nullptr) {
+        if (writer_ != NULL) fflush(writer_);
+        Position p = from;
+        size_t read = 0;
+        FILE *fp = NULL;
+        uint64_t open_segment = 0;
+        std::string record;
+        while (p != end_ && read < max_bytes) {
+            if (p.offset >= SegmentSize(p.segment)) { // the end of a full segment
+                if (p.segment >= end_.segment) break;
+                p = Position{p.segment + 1, 0};
+                continue;
+            }
+            if (fp == NULL || open_segment != p.segment) {
+                if (fp != NULL) fclose(fp);
+                if ((fp = fopen(SegmentPath(p.segment).c_str(), "rb")) == NULL) break;
+                open_segment = p.segment;
+            }
+            char head[kRecordHeader];
+            uint32_t len = 0, check = 0;
+            uint64_t id = 0;
+            bool good = fseek(fp, p.offset, SEEK_SET) == 0 && fread(head, 1, kRecordHeader, fp) == kRecordHeader;
+            if (good) DecodeRecord(head, &len, &check, &id);
+            Position next{p.segment, p.offset + kRecordHeader + len};
+            if (!good || next.offset > SegmentSize(p.segment)) {
+                next.offset = SegmentSize(p.segment);
+                good = false;
+            } else {
+                record.resize(len);
+                good = fread(&record[0], 1, len, fp) == len && Check(record.data(), len) == check;
+            }
+            if (!good) {
+                if (skipped != nullptr) ++*skipped;
+                read += next.offset - p.offset;
+                p = next;
+                continue;
+            }
+            if (!f(id, record.data(), record.size(), next)) break;
+            p = next;
+            read += kRecordHeader + len;
+        }
+        if (fp != NULL) fclose(fp);
+        return p;
+    }
+
+    /**
+     * @brief Mark everything before a position delivered
+     * @param p a position returned by Read()
+    */
+    void Commit(const Position &p) {
+        if (!ok_) return;
+        bytes_ -= Distance(checkpoint_, p);
+        checkpoint_ = p;
+        bool removed = false;
+        while (!sizes_.empty() && sizes_.begin()->first < p.segment) {
+            remove(SegmentPath(sizes_.begin()->first).c_str());
+            sizes_.erase(sizes_.begin());
+            removed = true;
+        }
+        if (checkpoint_ == end_ && end_.offset > 0) { // all delivered, the next record starts a new segment
+            if (writer_ != NULL) fclose(writer_);
+            writer_ = NULL;
+            remove(SegmentPath(end_.segment).c_str());
+            sizes_.erase(end_.segment);
+            end_ = checkpoint_ = Position{end_.segment + 1, 0};
+            bytes_ = 0;
+            removed = true;
+        }
+        time_t now = time(nullptr);
+        if (removed || now != saved_at_) SaveCheckpoint();
+    }
+
+    /**
+     * @brief Make the appended records and the checkpoint durable
+    */
+    void Sync() {
+        if (writer_ != NULL && fflush(writer_) == 0) fsync(fileno(writer_));
+        if (ok_ && saved_ != checkpoint_) SaveCheckpoint();
+    }
+
+    /**
+     * @brief Make the checkpoint durable and get what to fsync to make the appended records durable
+     * @return a duplicate descriptor of the newest segment, to fsync() and close() without the lock that
+     * guards the spool, or -1 if no segment is open; older segments were synced when they were closed
+    */
+    int SyncFd() {
+        if (ok_ && saved_ != checkpoint_) SaveCheckpoint();
+        return writer_ != NULL ? dup(fileno(writer_)) : -1;
+    }
+
+    /**
+     * @brief Get the id of the next record, see note 5
+     * @note Writes the checkpoint file once every kIdBlock ids.
+    */
+    uint64_t NextId() {
+        uint64_t id = next_id_++;
+        if (ok_ && id >= reserved_id_) {
+            reserved_id_ = id + kIdBlock;
+            SaveCheckpoint();
+        }
+        return id;
+    }
+
+    Position Checkpoint() const { return checkpoint_; }
+    Position End() const { return end_; }
+    bool Empty() const { return checkpoint_ == end_; }
+    size_t Bytes() const { return bytes_; }
+    uint64_t LastId() const { return last_id_; }
+
+private:
+    std::string SegmentPath(uint64_t segment) const {
+        char name[32];
+        snprintf(name, sizeof(name), "/%016" PRIu64 ".wal", segment);
+        return dir_ + name;
+    }
+
+    uint64_t SegmentSize(uint64_t segment) const {
+        auto it = sizes_.find(segment);
+        return it == sizes_.end() ? 0 : it->second;
+    }
+
+    /**
+     * @brief Bytes from a to b, a <= b
+    */
+    uint64_t Distance(const Position &a, const Position &b) const {
+        if (a.segment == b.segment) return b.offset - a.offset;
+        uint64_t d = SegmentSize(a.segment) - std::min(a.offset, SegmentSize(a.segment));
+        for (auto it = sizes_.upper_bound(a.segment); it != sizes_.end() && it->first < b.segment; ++it) d += it->second;
+        return d + b.offset;
+    }
+
+    static void EncodeRecord(char *out, uint32_t len, uint32_t check, uint64_t id) {
+        memcpy(out, &len, 4);
+        memcpy(out + 4, &check, 4);
+        memcpy(out + 8, &id, 8);
+    }
+
+    static void DecodeRecord(const char *in, uint32_t *len, uint32_t *check, uint64_t *id) {
+        memcpy(len, in, 4);
+        memcpy(check, in + 4, 4);
+        memcpy(id, in + 8, 8);
+    }
+
+    /**
+     * @brief FNV-1a of the record, finds torn and corrupt records
+    */
+    static uint32_t Check(const char *data, size_t len) {
+        uint32_t h = 2166136261u;
+        for (size_t i = 0; i < len; i++) h = (h ^ static_cast<uint8_t>(data[i])) * 16777619u;
+        return h;
+    }
+
+    void SaveCheckpoint() {
+        std::string tmp = dir_ + "/checkpoint.tmp";
+        FILE *fp = fopen(tmp.c_str(), "w");
+        if (fp == NULL) return;
+        fprintf(fp, "%" PRIu64 " %" PRIu64 " %" PRIu64 "\n", checkpoint_.segment, checkpoint_.offset, reserved_id_);
+        fflush(fp);
+        fsync(fileno(fp));
+        fclose(fp);
+        rename(tmp.c_str(), (dir_ + "/checkpoint").c_str());
+        saved_ = checkpoint_;
+        saved_at_ = time(nullptr);
+    }
+
+    /**
+     * @brief Find the segments and the checkpoint of an earlier run, cut torn records off
+    */
+    void Recover() {
+        DIR *d = opendir(dir_.c_str());
+        if (d == NULL) return;
+        while (struct dirent *e = readdir(d)) {
+            uint64_t segment;
+            char tail[8];
+            if (sscanf(e->d_name, "%16" SCNu64 ".%3s", &segment, tail) == 2 && strcmp(tail, "wal") == 0 && segment > 0) {
+                sizes_[segment] = 0;
+            }
+        }
+        closedir(d);
+        FILE *fp = fopen((dir_ + "/checkpoint").c_str(), "r");
+        if (fp != NULL) {
+            // the reservation is missing in the checkpoint of an older version
+            if (fscanf(fp, "%" SCNu64 " %" SCNu64 " %" SCNu64, &checkpoint_.segment, &checkpoint_.offset, &reserved_id_) < 2) {
+                checkpoint_ = Position();
+            }
+            fclose(fp);
+        }
+        while (!sizes_.empty() && sizes_.begin()->first < checkpoint_.segment) { // delivered before the crash
+            remove(SegmentPath(sizes_.begin()->first).c_str());
+            sizes_.erase(sizes_.begin());
+        }
+        if (!sizes_.empty() && sizes_.begin()->first > checkpoint_.segment) checkpoint_ = Position{sizes_.begin()->first, 0};
+        for (auto &s : sizes_) {
+            s.second = ScanSegment(s.first);
+            truncate(SegmentPath(s.first).c_str(), s.second);
+        }
+        if (sizes_.empty()) {
+            end_ = checkpoint_ = Position{checkpoint_.segment + (checkpoint_.offset > 0), 0};
+        } else {
+            end_ = Position{sizes_.rbegin()->first, sizes_.rbegin()->second};
+            if (checkpoint_.segment == end_.segment && checkpoint_.offset > end_.offset) checkpoint_ = end_;
+        }
+        bytes_ = Distance(checkpoint_, end_);
+        ok_ = true;
+        saved_ = checkpoint_;
+    }
+
+    /**
+     * @brief Get the size of the valid records of a segment and the last id in it
+    */
+    uint64_t ScanSegment(uint64_t segment) {
+        FILE *fp = fopen(SegmentPath(segment).c_str(), "rb");
+        if (fp == NULL) return 0;
+        uint64_t size = 0;
+        char head[kRecordHeader];
+        std::string record;
+        while (fread(head, 1, kRecordHeader, fp) == kRecordHeader) {
+            uint32_t len, check;
+            uint64_t id;
+            DecodeRecord(head, &len, &check, &id);
+            record.resize(len);
+            if (fread(&record[0], 1, len, fp) != len || Check(record.data(), len) != check) break;
+            size += kRecordHeader + len;
+            last_id_ = std::max(last_id_, id);
+        }
+        fclose(fp);
+        return size;
+    }
+
+private:
+    std::string dir_;                       // spool directory
+    size_t max_bytes_;                      // most bytes of undelivered records
+    size_t segment_bytes_;                  // size of a segment
+    int lock_fd_ = -1;                      // holds the lock on the directory
+    bool ok_ = false;                       // this process owns the spool
+    std::map<uint64_t, uint64_t> sizes_;    // segment -> bytes, of the segments on disk
+    Position checkpoint_;                   // first record not delivered
+    Position saved_;                        // checkpoint on disk
+    time_t saved_at_ = 0;                   // second the checkpoint was written
+    Position end_;                          // where the next record goes
+    size_t bytes_ = 0;                      // bytes from the checkpoint to the end
+    uint64_t last_id_ = 0;                  // id of the newest record
+    uint64_t next_id_ = 0;                  // id NextId() returns next
+    uint64_t reserved_id_ = 0;              // ids below it may have been handed out, kept in the checkpoint file
+    FILE *writer_ = NULL;                   // newest segment, open for appending
+};
+} // namespace backup
+} // namespace asynlog
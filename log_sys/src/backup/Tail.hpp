@@ -0,0 +1,199 @@
+/**
+ * @file Tail.hpp
+ * @brief TailHub class: live subscriptions to the records the backup server receives.
+ * @author bhhxx
+ * @date 2025-06-21
+*/
+#pragma once
+#include <string> // for string
+#include <string_view> // for string_view
+#include <vector> // for vector
+#include <memory> // for shared_ptr
+#include <mutex> // for mutex
+#include <condition_variable> // for condition_variable
+#include <algorithm> // for remove
+#include <chrono> // for milliseconds
+#include "../query/Query.hpp" // for query::Matcher
+
+namespace asynlog
+{
+namespace backup
+{
+/**
+ * @note
+ * A subscribe connection starts with one request line instead of a hello:
+ * `SUBSCRIBE [level=ERROR,FATAL] [logger=NAME] [stream=NAME] [contains=TEXT]\n`, contains last, its
+ * value runs to the end of the line. The server answers `# subscribed\n` or `# error: ...\n`, then
+ * sends every matching record as `<stream>\t<record>\n` until the client closes. A subscriber that
+ * falls more than its buffer behind gets `# dropped: ...\n` and is disconnected.
+*/
+constexpr char kSubscribe[] = "SUBSCRIBE";
+
+/**
+ * @brief What a subscriber wants to see
+*/
+struct TailRequest {
+    query::Filter filter;   // levels, logger and contains are used
+    std::string stream;     // stream name, any if empty
+};
+
+/**
+ * @brief Make the request line of a subscription
+*/
+inline std::string MakeSubscribe(const TailRequest &req) {
+    std::string line = kSubscribe;
+    for (size_t i = 0; i < req.filter.levels.size(); i++) {
+        std::string name = LogLevel::ToString(req.filter.levels[i]);
+        line += (i == 0 ? " level=" : ",") + name.substr(0, name.find_last_not_of(' ') + 1);
+    }
+    if (!req.filter.logger.empty()) line += " logger=" + req.filter.logger;
+    if (!req.stream.empty()) line += " stream=" + req.stream;
+    if (!req.filter.contains.empty()) line += " contains=" + req.filter.contains;
+    return line + "\n";
+}
+
+/**
+ * @brief Parse the request line of a subscription, without its newline
+ * @return false if it is not a valid request
+*/
+inline bool ParseSubscribe(std::string_view line, TailRequest *req) {
+    if (line.substr(0, sizeof(kSubscribe) - 1) != kSubscribe) return false;
+    size_t pos = sizeof(kSubscribe) - 1;
+    while (pos < line.size()) {
+        if (line[pos] == ' ') {
+            pos++;
+            continue;
+        }
+        size_t eq = line.find('=', pos);
+        if (eq == std::string_view::npos) return false;
+        std::string_view key = line.substr(pos, eq - pos);
+        size_t end = key == "contains" ? line.size() : std::min(line.find(' ', eq), line.size());
+        std::string value(line.substr(eq + 1, end - eq - 1));
+        if (key == "level") {
+            for (size_t from = 0; from <= value.size();) {
+                size_t comma = std::min(value.find(',', from), value.size());
+                LogLevel::value lv;
+                if (!LogLevel::FromString(value.substr(from, comma - from), &lv)) return false;
+                req->filter.levels.push_back(lv);
+                from = comma + 1;
+            }
+        } else if (key == "logger") {
+            req->filter.logger = value;
+        } else if (key == "stream") {
+            req->stream = value;
+        } else if (key == "contains") {
+            req->filter.contains = value;
+        } else {
+            return false;
+        }
+        pos = end;
+    }
+    return true;
+}
+
+/**
+ * @brief TailSubscriber class: the records waiting for one subscriber
+*/
+class TailSubscriber {
+public:
+    TailSubscriber(const TailRequest &req, size_t max_bytes) : matcher_(req.filter), stream_(req.stream), max_bytes_(max_bytes) {}
+
+    bool Wants(const std::string &stream, std::string_view line) const {
+        return (stream_.empty() || stream_ == stream) && matcher_.Match(line);
+    }
+
+    /**
+     * @brief Queue a record, or drop the subscriber if it would go over its buffer
+    */
+    void Push(const std::string &stream, std::string_view line) {
+        std::lock_guard<std::mutex> lock(mtx_);
+        if (dropped_) return;
+        if (buf_.size() + stream.size() + line.size() + 2 > max_bytes_) {
+            dropped_ = true;
+        } else {
+            buf_ += stream;
+            buf_ += '\t';
+            buf_ += line;
+            buf_ += '\n';
+        }
+        cond_.notify_one();
+    }
+
+    /**
+     * @brief Take the queued records
+     * @param out set to the records, empty if none came within timeout
+     * @param timeout the longest wait for a record
+     * @return false if the subscriber was dropped, out then holds what was queued before
+    */
+    bool Take(std::string *out, std::chrono::milliseconds timeout) {
+        std::unique_lock<std::mutex> lock(mtx_);
+        cond_.wait_for(lock, timeout, [this]() { return !buf_.empty() || dropped_; });
+        out->swap(buf_);
+        buf_.clear();
+        return !dropped_;
+    }
+
+private:
+    query::Matcher matcher_;        // level, logger and substring filter
+    std::string stream_;            // stream filter
+    size_t max_bytes_;              // bound of buf_
+    std::mutex mtx_;                // guards buf_ and dropped_
+    std::condition_variable cond_;  // a record was queued
+    std::string buf_;               // records not yet taken
+    bool dropped_ = false;          // buf_ overflowed
+};
+
+/**
+ * @brief TailHub class: hands the records the server receives to the matching subscribers
+ * @note Publish() runs on the receiving path and never waits for a subscriber: it only appends to their
+ * bounded buffers, each subscriber's own connection thread sends them. Without subscribers it returns
+ * right away.
+*/
+class TailHub {
+public:
+    /**
+     * @param max_bytes the buffer of a subscriber
+    */
+    explicit TailHub(size_t max_bytes = 1024 * 1024) : max_bytes_(max_bytes) {}
+
+    std::shared_ptr<TailSubscriber> Subscribe(const TailRequest &req) {
+        auto sub = std::make_shared<TailSubscriber>(req, max_bytes_);
+        std::lock_guard<std::mutex> lock(mtx_);
+        subs_.push_back(sub);
+        return sub;
+    }
+
+    void Unsubscribe(const std::shared_ptr<TailSubscriber> &sub) {
+        std::lock_guard<std::mutex> lock(mtx_);
+        subs_.erase(std::remove(subs_.begin(), subs_.end(), sub), subs_.end());
+    }
+
+    /**
+     * @brief Offer the lines of a batch of a stream to the subscribers
+    */
+    void Publish(const std::string &stream, std::string_view batch) {
+        std::lock_guard<std::mutex> lock(mtx_);
+        if (subs_.empty()) return;
+        size_t pos = 0;
+        while (pos < batch.size()) {
+            size_t nl = std::min(batch.find('\n', pos), batch.size());
+            std::string_view line = batch.substr(pos, nl - pos);
+            for (const auto &sub : subs_) {
+                if (sub->Wants(stream, line)) sub->Push(stream, line);
+            }
+            pos = nl + 1;
+        }
+    }
+
+    size_t Subscribers() {
+        std::lock_guard<std::mutex> lock(mtx_);
+        return subs_.size();
+    }
+
+private:
+    size_t max_bytes_;                                  // buffer of a subscriber
+    std::mutex mtx_;                                    // guards subs_
+    std::vector<std::shared_ptr<TailSubscriber>> subs_; // current subscribers
+};
+} // namespace backup
+} // namespace asynlog
@@ -0,0 +1,226 @@
+/**
+ * @file Index.hpp
+ * @brief IndexWriter and IndexReader classes: the sparse index sidecar `<log file>.idx` of a log file.
+ * @author bhhxx
+ * @date 2025-06-20
+*/
+#pragma once
+#include <string> // for string
+#include <string_view> // for string_view
+#include <vector> // for vector
+#include <cstdio> // for fopen
+#include <cstring> // for memcpy, memchr
+#include <cstdint> // for uint64_t
+#include "Record.hpp" // for ParseRecord
+
+namespace asynlog
+{
+namespace query
+{
+/**
+ * @brief One block of whole lines of a log file, about `interval` bytes
+*/
+struct IndexEntry {
+    uint64_t offset;        // first byte of the block in the log file
+    uint64_t bytes;         // length of the block
+    uint32_t lines;         // lines in the block
+    uint32_t levels[5];     // records per level, DEBUG to FATAL
+    uint64_t loggers;       // bloom filter of the logger names, see LoggerBits()
+    char min_time[24];      // earliest record time as written, empty if unknown
+    char max_time[24];      // latest record time
+};
+static_assert(sizeof(IndexEntry) == 96, "index entries are written as they are");
+
+/**
+ * @brief Get the two bloom filter bits of a logger name
+*/
+inline uint64_t LoggerBits(std::string_view name) {
+    uint64_t h = 14695981039346656037ull;
+    for (char c : name) h = (h ^ static_cast<uint8_t>(c)) * 1099511628211ull;
+    return (1ull << (h & 63)) | (1ull << ((h >> 6) & 63));
+}
+
+/**
+ * @note
+ * The sidecar is a 16 byte header, "ALIX", version and interval, followed by one IndexEntry per block of the
+ * log file, appended when the block is complete. The lines written since the last entry are not indexed yet,
+ * a query scans them. Times are the text the layout wrote, so they compare like the query filters do.
+*/
+constexpr char kIndexMagic[4] = {'A', 'L', 'I', 'X'};
+constexpr uint32_t kIndexVersion = 1;
+constexpr size_t kIndexHeader = 16;
+
+/**
+ * @brief IndexWriter class: builds the sidecar while the log file is written
+ * @note Add() looks at each line once: a memchr for its end and the bracket tokens of its header, and
+ * writes 96 bytes per interval; only a line cut between two batches is copied. Not thread safe, it
+ * belongs to the sink of the file.
+*/
+class IndexWriter {
+public:
+    static std::string PathFor(const std::string &log_path) { return log_path + ".idx"; }
+
+    /**
+     * @param log_path the log file
+     * @param interval bytes of log per entry
+     * @param offset the size of the log file now, the position of the next byte written to it
+    */
+    IndexWriter(const std::string &log_path, size_t interval, uint64_t offset) :
+        path_(PathFor(log_path)), interval_(interval ? interval : 1), offset_(offset) {
+        fp_ = fopen(path_.c_str(), "ab");
+        if (fp_ == NULL) return;
+        fseek(fp_, 0, SEEK_END);
+        long size = ftell(fp_);
+        if (size > 0 && !ValidFor(size)) { // the index of an older file of the same name
+            fclose(fp_);
+            fp_ = fopen(path_.c_str(), "wb");
+            if (fp_ == NULL) return;
+            size = 0;
+        }
+        if (size == 0) {
+            char head[kIndexHeader];
+            uint64_t interval64 = interval_;
+            memcpy(head, kIndexMagic, 4);
+            memcpy(head + 4, &kIndexVersion, 4);
+            memcpy(head + 8, &interval64, 8);
+            fwrite(head, 1, kIndexHeader, fp_);
+        }
+        Reset();
+    }
+
+    ~IndexWriter() {
+        if (fp_ != NULL) fclose(fp_);
+    }
+
+    /**
+     * @brief Account for bytes just appended to the log file
+     * @note A line cut at the end of data is kept until its newline arrives.
+    */
+    void Add(const char *data, size_t len) {
+        if (fp_ == NULL) return;
+        const char *p = data, *end = data + len;
+        while (p < end) {
+            const char *nl = static_cast<const char *>(memchr(p, '\n', end - p));
+            if (nl == nullptr) { // the rest of the line comes with the next batch
+                pending_.append(p, end - p);
+                offset_ += end - p;
+                return;
+            }
+            if (pending_.empty()) {
+                AddLine(std::string_view(p, nl - p));
+            } else {
+                pending_.append(p, nl - p);
+                AddLine(pending_);
+                pending_.clear();
+            }
+            cur_.lines++;
+            offset_ += nl + 1 - p;
+            p = nl + 1;
+            if (offset_ - cur_.offset >= interval_) Close();
+        }
+    }
+
+    /**
+     * @brief Write the completed entries out of the stdio buffer
+    */
+    void Flush() {
+        if (fp_ != NULL) fflush(fp_);
+    }
+
+private:
+    void AddLine(std::string_view line) {
+        Record r;
+        if (!ParseRecord(line, &r)) return;
+        int lv = LevelIndex(r.level);
+        if (lv >= 0) cur_.levels[lv]++;
+        cur_.loggers |= LoggerBits(r.logger);
+        if (r.time.empty() || r.time.size() >= sizeof(cur_.min_time)) {
+            time_unknown_ = true;
+        } else if (!time_unknown_) {
+            if (cur_.min_time[0] == '\0' || CompareTime(r.time, cur_.min_time) < 0) Copy(cur_.min_time, r.time);
+            if (cur_.max_time[0] == '\0' || CompareTime(r.time, cur_.max_time) > 0) Copy(cur_.max_time, r.time);
+        }
+    }
+
+    static void Copy(char *dst, std::string_view s) {
+        memcpy(dst, s.data(), s.size());
+        dst[s.size()] = '\0';
+    }
+
+    /**
+     * @brief Write the entry of the current block and start the next one
+    */
+    void Close() {
+        cur_.bytes = offset_ - cur_.offset;
+        if (time_unknown_) cur_.min_time[0] = cur_.max_time[0] = '\0';
+        fwrite(&cur_, sizeof(cur_), 1, fp_);
+        Reset();
+    }
+
+    void Reset() {
+        memset(&cur_, 0, sizeof(cur_));
+        cur_.offset = offset_;
+        time_unknown_ = false;
+    }
+
+    /**
+     * @brief Check that the entries of an existing sidecar end inside the log file
+    */
+    bool ValidFor(long size) {
+        if (size < static_cast<long>(kIndexHeader) || (size - kIndexHeader) % sizeof(IndexEntry) != 0) return false;
+        if (size == static_cast<long>(kIndexHeader)) return true;
+        FILE *fp = fopen(path_.c_str(), "rb");
+        if (fp == NULL) return false;
+        IndexEntry last;
+        bool ok = fseek(fp, size - sizeof(IndexEntry), SEEK_SET) == 0 && fread(&last, sizeof(last), 1, fp) == 1 &&
+                  last.offset + last.bytes <= offset_;
+        fclose(fp);
+        return ok;
+    }
+
+private:
+    std::string path_;          // the sidecar
+    size_t interval_;           // bytes of log per entry
+    uint64_t offset_;           // size of the log file
+    FILE *fp_ = NULL;           // the sidecar, open for appending
+    IndexEntry cur_;            // the block being written
+    bool time_unknown_ = false; // a record time of the block did not fit an entry
+    std::string pending_;       // the start of a line whose newline is not written yet
+};
+
+/**
+ * @brief IndexReader class: loads the sidecar of a log file
+*/
+class IndexReader {
+public:
+    /**
+     * @brief Load the entries that describe the log file as it is now
+     * @param log_path the log file
+     * @param file_size the size of the log file
+     * @param entries set to the entries in file order
+     * @return false if there is no usable sidecar
+    */
+    static bool Load(const std::string &log_path, uint64_t file_size, std::vector<IndexEntry> *entries) {
+        entries->clear();
+        FILE *fp = fopen(IndexWriter::PathFor(log_path).c_str(), "rb");
+        if (fp == NULL) return false;
+        char head[kIndexHeader];
+        uint32_t version = 0;
+        if (fread(head, 1, kIndexHeader, fp) != kIndexHeader || memcmp(head, kIndexMagic, 4) != 0 ||
+            (memcpy(&version, head + 4, 4), version != kIndexVersion)) {
+            fclose(fp);
+            return false;
+        }
+        IndexEntry e;
+        uint64_t end = 0;
+        while (fread(&e, sizeof(e), 1, fp) == 1) {
+            if (e.offset < end || e.offset + e.bytes > file_size) break; // written for another file
+            entries->push_back(e);
+            end = e.offset + e.bytes;
+        }
+        fclose(fp);
+        return true;
+    }
+};
+} // namespace query
+} // namespace asynlog
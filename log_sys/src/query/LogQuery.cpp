@@ -0,0 +1,111 @@
+#include <getopt.h>
+#include <cstdio>
+#include <iostream>
+#include <cctype> // for isdigit
+#include <algorithm> // for max
+#include "Query.hpp"
+ThreadPool *tp = nullptr;
+
+static void usage(const char *prog) {
+    std::cout << "usage: " << prog << " [options] <file or directory>...\n"
+              << "  -f, --from TIME       records at or after TIME, e.g. 12:00:00, or a JSON ts\n"
+              << "  -t, --to TIME         records at or before TIME\n"
+              << "  -l, --level LEVELS    comma separated levels, e.g. ERROR,FATAL\n"
+              << "  -m, --min-level LEVEL this level and above\n"
+              << "  -n, --logger NAME     records of this logger\n"
+              << "  -s, --source FILE[:LINE] records logged from this source file or line\n"
+              << "  -e, --contains TEXT   records whose message contains TEXT\n"
+              << "  -r, --regex RE        records whose message matches RE\n"
+              << "  -c, --count           print the number of matching records only\n"
+              << "  -j, --threads N       search with N threads, default: the number of cores\n"
+              << "  -x, --no-index        read every block, ignore the .idx sidecars\n";
+}
+
+static bool parse_levels(const std::string &list, std::vector<asynlog::LogLevel::value> *levels) {
+    size_t pos = 0;
+    while (pos <= list.size()) {
+        size_t comma = list.find(',', pos);
+        if (comma == std::string::npos) comma = list.size();
+        asynlog::LogLevel::value lv;
+        if (!asynlog::LogLevel::FromString(list.substr(pos, comma - pos), &lv)) return false;
+        levels->push_back(lv);
+        pos = comma + 1;
+    }
+    return true;
+}
+
+// usage: log_query [options] <file or directory>...
+// Prints the matching records of the files in order, directories are searched file by file in name order.
+int main(int argc, char *argv[])
+{
+    static const struct option options[] = {
+        {"from", required_argument, nullptr, 'f'}, {"to", required_argument, nullptr, 't'},
+        {"level", required_argument, nullptr, 'l'}, {"min-level", required_argument, nullptr, 'm'},
+        {"logger", required_argument, nullptr, 'n'}, {"source", required_argument, nullptr, 's'},
+        {"contains", required_argument, nullptr, 'e'}, {"regex", required_argument, nullptr, 'r'},
+        {"count", no_argument, nullptr, 'c'}, {"threads", required_argument, nullptr, 'j'},
+        {"no-index", no_argument, nullptr, 'x'}, {nullptr, 0, nullptr, 0}};
+    asynlog::query::Filter filter;
+    bool count = false;
+    bool use_index = true;
+    size_t threads = std::max(1u, std::thread::hardware_concurrency()); // 0 if unknown
+    int opt;
+    while ((opt = getopt_long(argc, argv, "f:t:l:m:n:s:e:r:cj:x", options, nullptr)) != -1) {
+        switch (opt) {
+            case 'f': filter.from = optarg; break;
+            case 't': filter.to = optarg; break;
+            case 'l':
+                if (!parse_levels(optarg, &filter.levels)) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'm': {
+                asynlog::LogLevel::value lv;
+                if (!asynlog::LogLevel::FromString(optarg, &lv)) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                for (int i = static_cast<int>(lv); i <= static_cast<int>(asynlog::LogLevel::value::FATAL); i++) {
+                    filter.levels.push_back(static_cast<asynlog::LogLevel::value>(i));
+                }
+                break;
+            }
+            case 'n': filter.logger = optarg; break;
+            case 's': filter.file = optarg; break;
+            case 'e': filter.contains = optarg; break;
+            case 'r': filter.regex = optarg; break;
+            case 'c': count = true; break;
+            case 'j': {
+                char *end;
+                unsigned long n = isdigit(static_cast<unsigned char>(optarg[0])) ? strtoul(optarg, &end, 10) : 0;
+                if (n == 0 || *end != '\0') { // "-j 0", "-j -2" and "-j four" are mistakes, not a default
+                    usage(argv[0]);
+                    return 1;
+                }
+                threads = n;
+                break;
+            }
+            case 'x': use_index = false; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    std::vector<std::string> files = asynlog::query::Query::ExpandPaths(std::vector<std::string>(argv + optind, argv + argc));
+    if (files.empty()) {
+        usage(argv[0]);
+        return 1;
+    }
+    try {
+        tp = new ThreadPool(threads);
+        asynlog::query::Query query(filter, tp, 16 * 1024 * 1024, use_index);
+        size_t n = query.Run(files, count ? asynlog::query::Query::Output() : [](const asynlog::query::Query::Hit &hit) {
+            fwrite(hit.line.data(), 1, hit.line.size(), stdout);
+            fputc('\n', stdout);
+        });
+        if (count) std::cout << n << std::endl;
+    } catch (const std::regex_error &e) {
+        std::cout << "bad regex: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,368 @@
+/**
+ * @file Query.hpp
+ * @brief Query class: search stored log files, memory mapped, in segments on the ThreadPool.
+ * @author bhhxx
+ * @date 2025-06-19
+*/
+#pragma once
+#include <string> // for string
+#include <string_view> // for string_view
+#include <vector> // for vector
+#include <memory> // for unique_ptr
+#include <regex> // for regex
+#include <future> // for future
+#include <algorithm> // for sort
+#include <functional> // for function
+#include <fcntl.h> // for open
+#include <unistd.h> // for close
+#include <dirent.h> // for opendir
+#include <sys/mman.h> // for mmap
+#include <sys/stat.h> // for fstat
+#include "../Level.hpp" // for LogLevel
+#include "../ThreadPool.hpp" // for ThreadPool
+#include "Scan.hpp" // for Scan::Find
+#include "Record.hpp" // for ParseRecord
+#include "Index.hpp" // for IndexReader
+
+namespace asynlog
+{
+namespace query
+{
+/**
+ * @brief What a record must match, every filter that is set
+*/
+struct Filter {
+    std::string from;                       // earliest time, as written in the records: "12:00:00" or a JSON ts
+    std::string to;                         // latest time, inclusive, "12:05" takes all of that minute
+    std::vector<LogLevel::value> levels;    // one of these levels, any if empty
+    std::string logger;                     // logger name
+    std::string file;                       // source file basename, or "file:line"
+    std::string contains;                   // substring of the message
+    std::string regex;                      // ECMAScript regex searched in the message
+};
+
+/**
+ * @brief Matcher class: decides if a line matches a Filter
+*/
+class Matcher {
+public:
+    explicit Matcher(const Filter &f) : f_(f) {
+        if (!f_.regex.empty()) re_.reset(new std::regex(f_.regex, std::regex::ECMAScript | std::regex::optimize));
+        if (f_.levels.size() == 1) {
+            level_name_ = LogLevel::ToString(f_.levels[0]);
+            level_name_.erase(level_name_.find_last_not_of(' ') + 1);
+        }
+        size_t colon = f_.file.rfind(':');
+        if (colon != std::string::npos) {
+            file_ = f_.file.substr(0, colon);
+            line_ = f_.file.substr(colon + 1);
+        } else {
+            file_ = f_.file;
+        }
+        // the longest literal every matching line contains, the scan only parses lines that contain it
+        for (const std::string *s : {&f_.contains, &f_.logger, &file_, &level_name_}) {
+            if (s->size() > needle_.size()) needle_ = *s;
+        }
+        fields_ = !f_.from.empty() || !f_.to.empty() || !f_.levels.empty() || !f_.logger.empty() || !f_.file.empty();
+    }
+
+    /**
+     * @brief Get the literal every matching line contains, empty if there is none
+    */
+    const std::string &Needle() const { return needle_; }
+
+    /**
+     * @brief Check a line, without its newline
+    */
+    bool Match(std::string_view line) const {
+        Record r;
+        bool parsed = ParseRecord(line, &r);
+        if (fields_) {
+            if (!parsed) return false;
+            if (!f_.from.empty() && CompareTime(r.time, f_.from) < 0) return false;
+            if (!f_.to.empty() && CompareTime(r.time.substr(0, IsNumber(f_.to) ? r.time.size() : f_.to.size()), f_.to) > 0) return false;
+            if (!f_.levels.empty() && !LevelIn(r.level)) return false;
+            if (!f_.logger.empty() && r.logger != f_.logger) return false;
+            if (!file_.empty() && r.file != file_ && !EndsWithPath(r.file, file_)) return false;
+            if (!line_.empty() && r.line != line_) return false;
+        }
+        std::string_view msg = parsed ? r.msg : line;
+        if (!f_.contains.empty() && !Scan::Find(msg.data(), msg.size(), f_.contains.data(), f_.contains.size())) return false;
+        if (re_ && !std::regex_search(msg.begin(), msg.end(), *re_)) return false;
+        return true;
+    }
+
+    /**
+     * @brief Check if a block of a log file may contain a match, from its index entry
+     * @return false if no line of the block can match
+    */
+    bool MayMatch(const IndexEntry &e) const {
+        if (!f_.levels.empty()) {
+            uint32_t n = 0;
+            for (LogLevel::value lv : f_.levels) n += e.levels[static_cast<int>(lv)];
+            if (n == 0) return false;
+        }
+        if (!f_.logger.empty()) {
+            uint64_t bits = LoggerBits(f_.logger);
+            if ((e.loggers & bits) != bits) return false;
+        }
+        if (e.min_time[0] != '\0') { // the same comparisons Match() makes for the first and the last record
+            std::string_view min(e.min_time), max(e.max_time);
+            if (!f_.from.empty() && CompareTime(max, f_.from) < 0) return false;
+            if (!f_.to.empty() && CompareTime(min.substr(0, IsNumber(f_.to) ? min.size() : f_.to.size()), f_.to) > 0) return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Check if MayMatch() can ever be false
+    */
+    bool Prunes() const {
+        return !f_.levels.empty() || !f_.logger.empty() || !f_.from.empty() || !f_.to.empty();
+    }
+
+private:
+    static bool EndsWithPath(std::string_view path, std::string_view base) {
+        return path.size() > base.size() && path.substr(path.size() - base.size()) == base &&
+               path[path.size() - base.size() - 1] == '/';
+    }
+
+    bool LevelIn(std::string_view name) const {
+        for (LogLevel::value lv : f_.levels) {
+            std::string_view s = LogLevel::ToString(lv);
+            if (s.substr(0, s.find_last_not_of(' ') + 1) == name) return true;
+        }
+        return false;
+    }
+
+private:
+    Filter f_;
+    std::unique_ptr<std::regex> re_;    // compiled regex, nullptr if none
+    std::string level_name_;            // the level if exactly one is asked for
+    std::string file_, line_;           // file filter split at the colon
+    std::string needle_;                // literal in every matching line
+    bool fields_;                       // a filter needs the parsed fields
+};
+
+/**
+ * @brief MappedFile class: a whole file mapped read only
+*/
+class MappedFile {
+public:
+    explicit MappedFile(const std::string &path) {
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                data_ = static_cast<const char *>(p);
+                size_ = st.st_size;
+                madvise(p, size_, MADV_SEQUENTIAL);
+            }
+        }
+        close(fd);
+    }
+    ~MappedFile() {
+        if (data_) munmap(const_cast<char *>(data_), size_);
+    }
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const char *data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    const char *data_ = nullptr;
+    size_t size_ = 0;
+};
+
+/**
+ * @brief Query class
+ * @note
+ * 1. Every file is mapped and cut into segments of about segment_bytes at line ends; each segment is a
+ * task on the ThreadPool, the results are handed out in file and line order.
+ *
+ * 2. A segment is searched with Scan::Find for the Matcher's needle, so only lines containing it are
+ * parsed; without a needle every line is. The default text layout and the JSON layout are understood;
+ * lines in other layouts only match filters on the message, which is then the whole line.
+ *
+ * 3. If a file has an index sidecar (see IndexWriter) and the filter has a time range, levels or a logger,
+ * the blocks whose entry rules out a match are not read at all; the bytes after the last entry are.
+*/
+class Query {
+public:
+    /**
+     * @brief A matching line in a file
+    */
+    struct Hit {
+        size_t file;        // index into the files given to Run()
+        size_t offset;      // byte offset of the line
+        std::string_view line; // the line without its newline, valid during Run()
+    };
+    using Output = std::function<void(const Hit &)>;
+
+    /**
+     * @param filter what to search for
+     * @param pool the pool the segments run on, nullptr to run them on the calling thread
+     * @param segment_bytes the size of a segment
+     * @param use_index skip blocks by the index sidecars of the files
+    */
+    Query(const Filter &filter, ThreadPool *pool, size_t segment_bytes = 16 * 1024 * 1024, bool use_index = true) :
+        matcher_(filter), pool_(pool), segment_bytes_(segment_bytes ? segment_bytes : 1), use_index_(use_index) {}
+
+    /**
+     * @brief Search files
+     * @param files the files, in the order their lines are handed out
+     * @param out called for every matching line in order, nullptr to only count
+     * @return the number of matching lines
+    */
+    size_t Run(const std::vector<std::string> &files, const Output &out) {
+        struct Segment {
+            size_t file;
+            const char *begin, *end;
+        };
+        std::vector<std::unique_ptr<MappedFile>> maps;
+        std::vector<Segment> segments;
+        skipped_ = 0;
+        for (size_t i = 0; i < files.size(); i++) {
+            maps.emplace_back(new MappedFile(files[i]));
+            const char *data = maps.back()->data();
+            for (const auto &range : Ranges(files[i], maps.back()->size())) {
+                const char *p = data + range.first, *end = data + range.second;
+                while (p < end) {
+                    const char *cut = p + std::min<size_t>(segment_bytes_, end - p);
+                    if (cut < end) {
+                        const char *nl = Scan::FindByte(cut, end - cut, '\n');
+                        cut = nl ? nl + 1 : end;
+                    }
+                    segments.push_back(Segment{i, p, cut});
+                    p = cut;
+                }
+            }
+        }
+        bool keep = static_cast<bool>(out);
+        auto search = [this, keep](const char *begin, const char *end) {
+            std::vector<std::string_view> lines;
+            size_t count = 0;
+            ScanSegment(begin, end, [&](std::string_view line) {
+                count++;
+                if (keep) lines.push_back(line);
+            });
+            return std::make_pair(count, std::move(lines));
+        };
+        std::vector<std::future<std::pair<size_t, std::vector<std::string_view>>>> results;
+        for (const Segment &s : segments) {
+            if (pool_) {
+                results.push_back(pool_->enqueue(search, s.begin, s.end));
+            } else {
+                std::promise<std::pair<size_t, std::vector<std::string_view>>> done;
+                done.set_value(search(s.begin, s.end));
+                results.push_back(done.get_future());
+            }
+        }
+        size_t total = 0;
+        for (size_t i = 0; i < segments.size(); i++) {
+            auto r = results[i].get();
+            total += r.first;
+            const char *base = maps[segments[i].file]->data();
+            for (std::string_view line : r.second) out(Hit{segments[i].file, static_cast<size_t>(line.data() - base), line});
+        }
+        return total;
+    }
+
+    /**
+     * @brief Get the bytes the last Run() skipped by the index
+    */
+    uint64_t SkippedBytes() const { return skipped_; }
+
+    /**
+     * @brief Replace directories by the files in them, sorted by name, e.g. the files of a RollFileFlush
+    */
+    static std::vector<std::string> ExpandPaths(const std::vector<std::string> &paths) {
+        std::vector<std::string> files;
+        for (const std::string &path : paths) {
+            struct stat st;
+            if (stat(path.c_str(), &st) != 0) continue;
+            if (!S_ISDIR(st.st_mode)) {
+                files.push_back(path);
+                continue;
+            }
+            std::vector<std::string> in_dir;
+            DIR *d = opendir(path.c_str());
+            if (d == nullptr) continue;
+            while (struct dirent *e = readdir(d)) {
+                std::string f = path + "/" + e->d_name;
+                bool sidecar = f.size() > 4 && f.compare(f.size() - 4, 4, ".idx") == 0;
+                if (e->d_name[0] != '.' && !sidecar && stat(f.c_str(), &st) == 0 && S_ISREG(st.st_mode)) in_dir.push_back(f);
+            }
+            closedir(d);
+            std::sort(in_dir.begin(), in_dir.end());
+            files.insert(files.end(), in_dir.begin(), in_dir.end());
+        }
+        return files;
+    }
+
+private:
+    /**
+     * @brief Get the byte ranges of a file that have to be searched, in order
+    */
+    std::vector<std::pair<uint64_t, uint64_t>> Ranges(const std::string &file, uint64_t size) {
+        std::vector<std::pair<uint64_t, uint64_t>> ranges;
+        auto add = [&](uint64_t begin, uint64_t end) {
+            if (begin == end) return;
+            if (!ranges.empty() && ranges.back().second == begin) {
+                ranges.back().second = end;
+            } else {
+                ranges.emplace_back(begin, end);
+            }
+        };
+        std::vector<IndexEntry> entries;
+        uint64_t pos = 0;
+        if (use_index_ && matcher_.Prunes() && IndexReader::Load(file, size, &entries)) {
+            for (const IndexEntry &e : entries) {
+                add(pos, e.offset); // written before the index was
+                if (matcher_.MayMatch(e)) {
+                    add(e.offset, e.offset + e.bytes);
+                } else {
+                    skipped_ += e.bytes;
+                }
+                pos = e.offset + e.bytes;
+            }
+        }
+        add(pos, size);
+        return ranges;
+    }
+
+    /**
+     * @brief Hand the matching lines of [begin, end) to f
+    */
+    template <class F>
+    void ScanSegment(const char *begin, const char *end, F f) const {
+        const std::string &needle = matcher_.Needle();
+        const char *p = begin;
+        while (p < end) {
+            const char *line = p;
+            if (!needle.empty()) { // skip to the line of the next needle
+                const char *hit = Scan::Find(p, end - p, needle.data(), needle.size());
+                if (hit == nullptr) return;
+                const void *nl = memrchr(p, '\n', hit - p);
+                line = nl ? static_cast<const char *>(nl) + 1 : p;
+            }
+            const char *nl = Scan::FindByte(line, end - line, '\n');
+            const char *line_end = nl ? nl : end;
+            std::string_view s(line, line_end - line);
+            if (matcher_.Match(s)) f(s);
+            p = line_end + 1;
+        }
+    }
+
+private:
+    Matcher matcher_;       // the filter
+    ThreadPool *pool_;      // runs the segments, may be nullptr
+    size_t segment_bytes_;  // size of a segment
+    bool use_index_;        // skip blocks by the index sidecars
+    uint64_t skipped_ = 0;  // bytes the last Run() skipped
+};
+} // namespace query
+} // namespace asynlog
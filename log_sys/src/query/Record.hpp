@@ -0,0 +1,111 @@
+/**
+ * @file Record.hpp
+ * @brief Parsing of stored record lines, shared by the query and the index sidecar.
+ * @author bhhxx
+ * @date 2025-06-19
+*/
+#pragma once
+#include <string_view> // for string_view
+#include <algorithm> // for all_of, min
+#include "../Level.hpp" // for LogLevel
+
+namespace asynlog
+{
+namespace query
+{
+/**
+ * @brief The parts of a record line, pointing into the line
+*/
+struct Record {
+    std::string_view time;      // "HH:MM:SS" of the text layout, the ts digits of the JSON layout
+    std::string_view level;     // level name without padding
+    std::string_view logger;
+    std::string_view file;
+    std::string_view line;      // source line digits
+    std::string_view msg;       // message and fields, JSON escaped in the JSON layout
+};
+
+/**
+ * @brief Split a line of the default text layout, `[time][tid][LEVEL][logger][file:line]\tmessage`
+ * @return false if the line is not in that layout
+*/
+inline bool ParseText(std::string_view s, Record *r) {
+    std::string_view tokens[5];
+    size_t pos = 0;
+    for (auto &t : tokens) {
+        if (pos >= s.size() || s[pos] != '[') return false;
+        size_t close = s.find(']', pos + 1);
+        if (close == std::string_view::npos) return false;
+        t = s.substr(pos + 1, close - pos - 1);
+        pos = close + 1;
+    }
+    r->time = tokens[0];
+    r->level = tokens[2].substr(0, tokens[2].find_last_not_of(' ') + 1);
+    r->logger = tokens[3];
+    size_t colon = tokens[4].rfind(':');
+    r->file = tokens[4].substr(0, colon);
+    r->line = colon == std::string_view::npos ? std::string_view() : tokens[4].substr(colon + 1);
+    if (pos < s.size() && s[pos] == '\t') pos++;
+    r->msg = s.substr(pos);
+    return true;
+}
+
+/**
+ * @brief Split a line of the JSON layout of Message::FormatJson
+ * @return false if the line is not a JSON record
+*/
+inline bool ParseJson(std::string_view s, Record *r) {
+    if (s.empty() || s[0] != '{') return false;
+    auto value = [&](std::string_view key, bool quoted) -> std::string_view {
+        size_t at = s.find(key);
+        if (at == std::string_view::npos) return std::string_view();
+        size_t begin = at + key.size(), end = begin;
+        if (quoted) {
+            while (end < s.size() && s[end] != '"') end += s[end] == '\\' ? 2 : 1;
+        } else {
+            while (end < s.size() && s[end] >= '0' && s[end] <= '9') end++;
+        }
+        return s.substr(begin, std::min(end, s.size()) - begin);
+    };
+    r->time = value("\"ts\":", false);
+    r->level = value("\"level\":\"", true);
+    r->logger = value("\"logger\":\"", true);
+    r->file = value("\"file\":\"", true);
+    r->line = value("\"line\":", false);
+    r->msg = value("\"msg\":\"", true);
+    return !r->time.empty() && !r->level.empty();
+}
+
+inline bool ParseRecord(std::string_view s, Record *r) {
+    return ParseText(s, r) || ParseJson(s, r);
+}
+
+/**
+ * @brief Get the level of a parsed level name
+ * @return the index of the level in LogLevel::value, -1 if unknown
+*/
+inline int LevelIndex(std::string_view name) {
+    switch (name.empty() ? ' ' : name[0]) {
+        case 'D': return name == "DEBUG" ? 0 : -1;
+        case 'I': return name == "INFO" ? 1 : -1;
+        case 'W': return name == "WARN" ? 2 : -1;
+        case 'E': return name == "ERROR" ? 3 : -1;
+        case 'F': return name == "FATAL" ? 4 : -1;
+        default: return -1;
+    }
+}
+
+inline bool IsNumber(std::string_view s) {
+    return !s.empty() && std::all_of(s.begin(), s.end(), [](char c) { return c >= '0' && c <= '9'; });
+}
+
+/**
+ * @brief Compare two record times, as numbers if both are, else as text
+ * @return <0, 0 or >0
+*/
+inline int CompareTime(std::string_view a, std::string_view b) {
+    if (IsNumber(a) && IsNumber(b) && a.size() != b.size()) return a.size() < b.size() ? -1 : 1;
+    return a.compare(b);
+}
+} // namespace query
+} // namespace asynlog
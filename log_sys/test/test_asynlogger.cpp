@@ -4,7 +4,23 @@
 #include <iostream>
 #include <vector>
 #include <memory>
+#include <algorithm>
 asynlog::Util::JsonData* conf_data = asynlog::Util::JsonData::GetJsonData();
+ThreadPool *tp = new ThreadPool(1);
+
+class FatalFlush : public asynlog::LogFlush {
+public:
+    void Flush(const char *data, size_t len) override {
+        lines += std::count(data, data + len, '\n');
+        if (logger && !logged) {
+            logged = true;
+            logger->Fatal(__FILE__, __LINE__, "logged from the consumer");
+        }
+    }
+    asynlog::AsynLogger *logger = nullptr;
+    bool logged = false;
+    size_t lines = 0;
+};
 
 int main() {
     // // class AsynLogger
@@ -17,7 +33,7 @@ int main() {
     // logger.Error(__FILE__, __LINE__, "Hello %s, number = %d", "World", 42);
     // logger.Fatal(__FILE__, __LINE__, "Hello %s, number = %d", "World", 42);
     // logger.Warn(__FILE__, __LINE__, "Hello %s, number = %d", "World", 42);
-    // sleep(10); // wait the child thread flush all, otherwise the logger destroy
+    // logger.Flush().wait(); // wait the child thread flush all, otherwise the logger destroy
 
     // // class LoggerBuilder
     // asynlog::LoggerBuilder builder;
@@ -30,6 +46,48 @@ int main() {
     // logger->Error(__FILE__, __LINE__, "Hello %s, number = %d", "World", 42);
     // logger->Fatal(__FILE__, __LINE__, "Hello %s, number = %d", "World", 42);
     // logger->Warn(__FILE__, __LINE__, "Hello %s, number = %d", "World", 42);
-    // sleep(10); // wait the child thread flush all, otherwise the logger destroy
+    // logger->Flush().wait(); // wait the child thread flush all, otherwise the logger destroy
+
+    // Flush and Sync
+    asynlog::LoggerBuilder builder;
+    builder.BuildLoggerName("test");
+    builder.BuildLoggerType(asynlog::AsynType::ASYNC_SAFE);
+    builder.BuildLoggerFlush<asynlog::StdOutFlush>();
+    builder.BuildLoggerFlush<asynlog::FileFlush>("./logfile/test_asynlogger.log");
+    asynlog::AsynLogger::ptr logger = builder.Build();
+    logger->Info(__FILE__, __LINE__, "Hello %s, number = %d", "World", 42);
+    logger->Warn(__FILE__, __LINE__, "Hello %s, number = %d", "World", 42);
+    logger->Flush().wait(); // both lines are printed before the next one
+    std::cout << "flushed" << std::endl;
+    logger->Debug(__FILE__, __LINE__, "Hello %s, number = %d", "World", 42);
+    logger->Sync().wait(); // the line is on disk now
+    std::cout << "synced" << std::endl;
+
+    // with flush_log 0 the file flush leaves a batch in the stdio buffer, Flush() writes it out
+    conf_data->flush_log = 0;
+    const std::string buffered_file = "./logfile/test_asynlogger_buffered.log";
+    remove(buffered_file.c_str());
+    asynlog::LoggerBuilder buffered_builder;
+    buffered_builder.BuildLoggerName("test_buffered");
+    buffered_builder.BuildLoggerFlush<asynlog::FileFlush>(buffered_file);
+    asynlog::AsynLogger::ptr buffered = buffered_builder.Build();
+    buffered->Info(__FILE__, __LINE__, "visible after Flush");
+    buffered->Flush().wait();
+    std::string buffered_content;
+    asynlog::Util::File::GetContent(&buffered_content, buffered_file);
+    std::cout << "buffered line visible after Flush: " << (buffered_content.find("visible after Flush") != std::string::npos) << std::endl;
+    conf_data->flush_log = 1;
+
+    // a FATAL logged on the consumer thread, from a flush, does not wait for the consumer itself
+    auto fatal_flush = std::make_shared<FatalFlush>();
+    asynlog::LoggerBuilder fatal_builder;
+    fatal_builder.BuildLoggerName("test_fatal");
+    fatal_builder.BuildLoggerFlush(fatal_flush);
+    asynlog::AsynLogger::ptr fatal_logger = fatal_builder.Build();
+    fatal_flush->logger = fatal_logger.get();
+    fatal_logger->Info(__FILE__, __LINE__, "the flush logs a FATAL on this one");
+    fatal_logger->Flush().wait();
+    fatal_logger->Flush().wait();
+    std::cout << "FATAL on the consumer returned, lines: " << fatal_flush->lines << std::endl;
     return 0;
 }
\ No newline at end of file
@@ -2,7 +2,9 @@
 #include <iostream>
 asynlog::Util::JsonData* conf_data = asynlog::Util::JsonData::GetJsonData();
 int main() {
-    asynlog::functor cb = [](asynlog::Buffer& buf) {
+    std::atomic<size_t> calls(0);
+    asynlog::functor cb = [&calls](asynlog::Buffer& buf) {
+        ++calls;
         std::cout << "Callback called with buffer size: " << buf.ReadableSize() << std::endl;
     };
     asynlog::AsynWorker worker(cb, asynlog::AsynType::ASYNC_SAFE);
@@ -10,5 +12,13 @@ int main() {
     size_t len = strlen(data);
     worker.Push(data, len);
     std::this_thread::sleep_for(std::chrono::seconds(1)); // wait for the callback to be called
+
+    // a burst of small pushes is batched, so there are far fewer callbacks than pushes
+    calls = 0;
+    for (int i = 0; i < 10000; i++) {
+        worker.Push(data, len);
+    }
+    std::this_thread::sleep_for(std::chrono::seconds(1)); // wait for the max flush delay
+    std::cout << "10000 pushes, callbacks: " << calls << std::endl;
     return 0;
-}
\ No newline at end of file
+}
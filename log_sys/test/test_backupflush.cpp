@@ -0,0 +1,180 @@
+#include "../src/AsynLogger.hpp"
+#include "../src/backup/ServerBackup.hpp"
+#include <iostream>
+#include <thread>
+asynlog::Util::JsonData* conf_data = asynlog::Util::JsonData::GetJsonData();
+ThreadPool *tp = new ThreadPool(1);
+
+static std::mutex mtx;
+static std::map<std::string, std::string> stored; // stream name -> batches stored by the server
+static std::map<std::string, int> batches;         // stream name -> number of batches
+static std::string legacy;                         // lines of legacy connections
+
+static std::string Batch(int n) {
+    std::string out;
+    for (int i = 0; i < 200; i++) out += "[INFO][test_backupflush.cpp:1]\tbatch " + std::to_string(n) + " record " + std::to_string(i) + "\n";
+    return out;
+}
+
+static uint16_t FreePort() {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    socklen_t len = sizeof(addr);
+    getsockname(fd, (struct sockaddr *)&addr, &len);
+    close(fd);
+    return ntohs(addr.sin_port);
+}
+
+static int Connect(uint16_t port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    connect(fd, (struct sockaddr *)&addr, sizeof(addr));
+    return fd;
+}
+
+int main() {
+    uint16_t port = FreePort();
+    std::string address = "127.0.0.1:" + std::to_string(port);
+    std::string spool = "./logfile/backup/test_backupflush.spool";
+    remove(spool.c_str());
+    std::string sent;
+
+    // the server is down: batches go to the spool, compressed
+    asynlog::BackupFlush flush(address, "test_backupflush", true, spool);
+    for (int i = 0; i < 3; i++) {
+        std::string b = Batch(i);
+        flush.Flush(b.data(), b.size());
+        sent += b;
+    }
+    std::cout << "server down, connected: " << flush.Connected() << ", spooled " << flush.SpoolBytes()
+              << " bytes of " << sent.size() << std::endl;
+#ifdef ASYNLOG_HAVE_ZLIB
+    std::cout << "compressed: " << (flush.SpoolBytes() < sent.size() / 4) << std::endl;
+#endif
+
+    // the server comes up: the next batch connects, replays the spool first, then all is acked
+    TCP_Server *server = new TCP_Server(port, [](const std::string &msg) {
+        std::lock_guard<std::mutex> lock(mtx);
+        legacy += msg;
+    }, [](const std::string &name, const std::string &batch) {
+        std::lock_guard<std::mutex> lock(mtx);
+        stored[name] += batch;
+        batches[name]++;
+    });
+    server->init_service();
+    std::thread([server]() { server->start_service(); }).detach();
+    std::this_thread::sleep_for(std::chrono::milliseconds(1100)); // connects are tried once a second
+    for (int i = 3; i < 50; i++) {
+        std::string b = Batch(i);
+        flush.Flush(b.data(), b.size());
+        sent += b;
+    }
+    flush.Sync();
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        std::cout << "server up, connected: " << flush.Connected() << ", in flight " << flush.InFlight()
+                  << ", spool " << flush.SpoolBytes() << ", 50 batches stored: " << batches["test_backupflush"]
+                  << ", all in order: " << (stored["test_backupflush"] == sent) << std::endl;
+    }
+
+    // a long outage is replayed a slice per Flush(), before the new batches
+    {
+        uint16_t port2 = FreePort();
+        std::string spool2 = "./logfile/backup/test_backupreplay.spool", sent2;
+        asynlog::BackupFlush replay("127.0.0.1:" + std::to_string(port2), "test_backupreplay", false, spool2);
+        for (int i = 0; i < 600; i++) {
+            std::string b = Batch(i);
+            if (i == 500) {
+                TCP_Server *server2 = new TCP_Server(port2, [](const std::string &) {}, [](const std::string &name, const std::string &batch) {
+                    std::lock_guard<std::mutex> lock(mtx);
+                    stored[name] += batch;
+                });
+                server2->init_service();
+                std::thread([server2]() { server2->start_service(); }).detach();
+                std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+            }
+            replay.Flush(b.data(), b.size());
+            sent2 += b;
+            if (i == 500) std::cout << "first flush replayed part of " << (sent2.size() >> 20) << "MB: " << (replay.SpoolBytes() > 0) << std::endl;
+        }
+        replay.Sync();
+        std::lock_guard<std::mutex> lock(mtx);
+        std::cout << "spool " << replay.SpoolBytes() << ", all in order: " << (stored["test_backupreplay"] == sent2) << std::endl;
+    }
+
+    // a frame sent again is acked and stored once
+    {
+        int fd = Connect(port);
+        std::string hello = asynlog::backup::MakeHello("test_dedup", 0), frame;
+        asynlog::backup::WriteFull(fd, hello.data(), hello.size());
+        uint64_t seqs[] = {5, 5, 6, 4};
+        for (uint64_t seq : seqs) {
+            std::string b = "seq " + std::to_string(seq) + "\n";
+            asynlog::backup::MakeFrame(seq, b.data(), b.size(), false, &frame);
+            asynlog::backup::WriteFull(fd, frame.data(), frame.size());
+        }
+        int acks = 0;
+        uint64_t ack;
+        while (acks < 4 && asynlog::backup::ReadFull(fd, reinterpret_cast<char *>(&ack), sizeof(ack))) acks++;
+        close(fd);
+        std::lock_guard<std::mutex> lock(mtx);
+        std::cout << "dedup: 4 acks: " << acks << ", stored once: " << (stored["test_dedup"] == "seq 5\nseq 6\n") << std::endl;
+    }
+
+    // two writers of the same stream name keep their own sequence numbers
+    {
+        int fds[2];
+        for (uint64_t writer = 1; writer <= 2; writer++) {
+            int fd = fds[writer - 1] = Connect(port);
+            std::string hello = asynlog::backup::MakeHello("test_writers", 0, writer), frame;
+            std::string b = "writer " + std::to_string(writer) + "\n";
+            asynlog::backup::MakeFrame(7, b.data(), b.size(), false, &frame);
+            hello += frame;
+            asynlog::backup::WriteFull(fd, hello.data(), hello.size());
+            uint64_t ack;
+            asynlog::backup::ReadFull(fd, reinterpret_cast<char *>(&ack), sizeof(ack));
+        }
+        close(fds[0]);
+        close(fds[1]);
+        std::lock_guard<std::mutex> lock(mtx);
+        std::cout << "same name, other writer stored: " << (stored["test_writers"] == "writer 1\nwriter 2\n") << std::endl;
+    }
+
+    // a legacy connection still sends a single line
+    {
+        int fd = Connect(port);
+        std::string line = "[ERROR] legacy backup\n";
+        write(fd, line.data(), line.size());
+        close(fd);
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        std::lock_guard<std::mutex> lock(mtx);
+        std::cout << "legacy line stored: " << (legacy.find(line) != std::string::npos) << std::endl;
+    }
+
+    // a logger with the sink from its configuration
+    {
+        asynlog::LoggerBuilder builder;
+        builder.BuildLoggerName("backup_logger");
+        Json::Value conf;
+        conf["type"] = "backup";
+        conf["address"] = address;
+        conf["name"] = "test_backup_logger";
+        conf["spool"] = "./logfile/backup/test_backup_logger.spool";
+        builder.BuildLoggerFlush(asynlog::LogFlushFactory::CreateFromConfig(conf));
+        auto logger = builder.Build();
+        for (int i = 0; i < 100; i++) logger->Info(__FILE__, __LINE__, "shipped %d", i);
+        logger->Sync().wait();
+        std::lock_guard<std::mutex> lock(mtx);
+        const std::string &s = stored["test_backup_logger"];
+        std::cout << "logger: 100 lines stored: " << std::count(s.begin(), s.end(), '\n') << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,198 @@
+#include "../src/AsynLogger.hpp"
+#include "../src/backup/ServerBackup.hpp"
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <set>
+asynlog::Util::JsonData* conf_data = asynlog::Util::JsonData::GetJsonData();
+ThreadPool *tp = new ThreadPool(1);
+
+using asynlog::backup::Spool;
+
+static std::mutex mtx;
+static std::map<std::string, std::string> stored; // stream name -> records stored by the server
+
+static size_t Segments(const std::string &dir) {
+    size_t n = 0;
+    DIR *d = opendir(dir.c_str());
+    while (struct dirent *e = readdir(d)) n += strstr(e->d_name, ".wal") != nullptr;
+    closedir(d);
+    return n;
+}
+
+static std::vector<uint64_t> ReadAll(Spool &spool) {
+    std::vector<uint64_t> ids;
+    spool.Read(spool.Checkpoint(), SIZE_MAX, [&](uint64_t id, const char *, size_t, const Spool::Position &) {
+        ids.push_back(id);
+        return true;
+    });
+    return ids;
+}
+
+static uint16_t FreePort() {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    socklen_t len = sizeof(addr);
+    getsockname(fd, (struct sockaddr *)&addr, &len);
+    close(fd);
+    return ntohs(addr.sin_port);
+}
+
+int main() {
+    std::string dir = "./logfile/test_backupspool." + std::to_string(getpid());
+    std::string record(100, 'r');
+    size_t size = Spool::kRecordHeader + record.size();
+
+    // records roll over 4096 byte segments, a commit deletes the delivered segments
+    {
+        Spool spool(dir, 1024 * 1024, 4096);
+        Spool other(dir, 1024 * 1024, 4096);
+        std::cout << "second owner refused: " << !other.Ok() << std::endl;
+        for (uint64_t id = 1; id <= 100; id++) spool.Append(id, record.data(), record.size());
+        std::vector<uint64_t> ids = ReadAll(spool);
+        std::cout << "100 records in order: " << (ids.size() == 100 && std::is_sorted(ids.begin(), ids.end()))
+                  << ", segments: " << Segments(dir) << std::endl;
+        int n = 0;
+        Spool::Position half = spool.Read(spool.Checkpoint(), SIZE_MAX, [&](uint64_t, const char *, size_t, const Spool::Position &) {
+            return ++n <= 50;
+        });
+        spool.Commit(half);
+        std::cout << "50 committed, bytes left: " << (spool.Bytes() == 50 * size) << ", segments: " << Segments(dir) << std::endl;
+        for (uint64_t id = 101; id <= 110; id++) spool.Append(id, record.data(), record.size());
+    }
+
+    // reopened after a torn write: the checkpoint holds, the partial record is cut off
+    {
+        std::string last;
+        DIR *d = opendir(dir.c_str());
+        while (struct dirent *e = readdir(d)) {
+            if (strstr(e->d_name, ".wal") && e->d_name > last) last = e->d_name;
+        }
+        closedir(d);
+        FILE *fp = fopen((dir + "/" + last).c_str(), "ab");
+        fwrite("\x40\x00\x00\x00torn", 1, 8, fp);
+        fclose(fp);
+        Spool spool(dir, 1024 * 1024, 4096);
+        std::vector<uint64_t> ids = ReadAll(spool);
+        std::cout << "recovered 51..110: " << (ids.size() == 60 && ids.front() == 51 && ids.back() == 110)
+                  << ", last id " << spool.LastId() << ", bytes: " << (spool.Bytes() == 60 * size) << std::endl;
+        spool.Commit(spool.End());
+        std::cout << "all committed, empty: " << spool.Empty() << ", segments: " << Segments(dir) << std::endl;
+    }
+
+    // a record corrupted after it was written is skipped and counted, the ones after it are still read
+    {
+        Spool spool(dir, 1024 * 1024, 4096);
+        Spool::Position start = spool.End();
+        for (uint64_t id = 1; id <= 3; id++) spool.Append(id, record.data(), record.size());
+        char segment[32];
+        snprintf(segment, sizeof(segment), "/%016" PRIu64 ".wal", start.segment);
+        FILE *fp = fopen((dir + segment).c_str(), "r+b");
+        fseek(fp, start.offset + size + Spool::kRecordHeader + 5, SEEK_SET); // a byte in the data of record 2
+        fputc('x', fp);
+        fclose(fp);
+        std::vector<uint64_t> ids;
+        size_t skipped = 0;
+        Spool::Position end = spool.Read(spool.Checkpoint(), SIZE_MAX, [&](uint64_t id, const char *, size_t, const Spool::Position &) {
+            ids.push_back(id);
+            return true;
+        }, &skipped);
+        std::cout << "corrupt record skipped, read 1 and 3: " << (ids == std::vector<uint64_t>{1, 3})
+                  << ", skipped " << skipped << ", at the end: " << (end == spool.End()) << std::endl;
+        spool.Commit(end);
+    }
+
+    // ids stay above the reservation in the checkpoint, also when the clock is behind it after a restart
+    {
+        uint64_t ahead = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count() + 3600ull * 1000000; // as if the clock went back 1h
+        {
+            Spool spool(dir, 1024 * 1024, 4096);
+            spool.Commit(spool.End());
+            FILE *fp = fopen((dir + "/checkpoint").c_str(), "w");
+            fprintf(fp, "%" PRIu64 " %" PRIu64 " %" PRIu64 "\n", spool.Checkpoint().segment, spool.Checkpoint().offset, ahead);
+            fclose(fp);
+        }
+        Spool spool(dir, 1024 * 1024, 4096);
+        uint64_t first = spool.NextId();
+        std::cout << "ids above the persisted reservation: " << (first > ahead && spool.NextId() == first + 1) << std::endl;
+    }
+
+    // bounded: appends beyond max_bytes are refused
+    {
+        Spool spool(dir, 1000, 4096);
+        int accepted = 0;
+        for (uint64_t id = 1; id <= 20; id++) accepted += spool.Append(id, record.data(), record.size());
+        std::cout << "bounded, accepted " << accepted << " of 20, bytes " << spool.Bytes() << " <= 1000" << std::endl;
+        spool.Commit(spool.End());
+    }
+    remove((dir + "/checkpoint").c_str());
+    remove((dir + "/lock").c_str());
+    rmdir(dir.c_str());
+
+    // start_log_backup while the server is down: records wait in the spool, then arrive in order
+    uint16_t port = FreePort();
+    conf_data->backup_addr = "127.0.0.1";
+    conf_data->backup_port = port;
+    conf_data->backup_spool_dir = "./logfile/test_backupspool_sender";
+    std::string sent;
+    for (int i = 0; i < 20; i++) {
+        std::string line = "[ERROR] backup " + std::to_string(i) + " of pid " + std::to_string(getpid()) + "\n";
+        start_log_backup(line);
+        sent += line;
+    }
+    auto &sender = asynlog::backup::BackupSender::Get();
+    { // Post() appended every record to the spool, so none is lost if the process dies right after
+        std::string spool_dir = conf_data->backup_spool_dir + "/" + sender.Name().substr(sender.Name().rfind("test_backupspool"));
+        std::string spooled, content;
+        DIR *d = opendir(spool_dir.c_str());
+        while (struct dirent *e = readdir(d)) {
+            if (strstr(e->d_name, ".wal") && asynlog::Util::File::GetContent(&content, spool_dir + "/" + e->d_name)) spooled += content;
+        }
+        closedir(d);
+        std::cout << "posted records are in the spool file at once: "
+                  << (spooled.find("[ERROR] backup 19 of pid " + std::to_string(getpid())) != std::string::npos) << std::endl;
+    }
+    std::cout << "server down, delivered: " << sender.WaitDelivered(std::chrono::milliseconds(300))
+              << ", spooled: " << (sender.SpoolBytes() > 0) << std::endl;
+
+    TCP_Server *server = new TCP_Server(port, [](const std::string &) {}, [](const std::string &name, const std::string &batch) {
+        std::lock_guard<std::mutex> lock(mtx);
+        stored[name] += batch;
+    });
+    server->init_service();
+    std::thread([server]() { server->start_service(); }).detach();
+    bool delivered = sender.WaitDelivered(std::chrono::seconds(5));
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        const std::string &s = stored[sender.Name()];
+        std::cout << "server up, delivered: " << delivered << ", spool " << sender.SpoolBytes()
+                  << ", all 20 in order: " << (s.find(sent) != std::string::npos) << std::endl;
+    }
+
+    // backup_protocol "legacy": one raw record per connection, as a server before the shipping protocol reads them
+    static std::vector<std::string> legacy;
+    uint16_t legacy_port = FreePort();
+    TCP_Server *legacy_server = new TCP_Server(legacy_port, [](const std::string &record) {
+        std::lock_guard<std::mutex> lock(mtx);
+        legacy.push_back(record);
+    });
+    legacy_server->init_service();
+    std::thread([legacy_server]() { legacy_server->start_service(); }).detach();
+    conf_data->backup_port = legacy_port;
+    conf_data->backup_protocol = "legacy";
+    for (int i = 0; i < 3; i++) {
+        start_log_backup("[ERROR] legacy backup " + std::to_string(i) + "\n");
+    }
+    delivered = sender.WaitDelivered(std::chrono::seconds(5));
+    std::lock_guard<std::mutex> lock(mtx);
+    std::set<std::string> records; // each connection has its own server thread, they may store out of order
+    for (auto &e : legacy) records.insert(e.substr(e.find('[')));
+    std::cout << "legacy server, delivered: " << delivered << ", one record per connection: "
+              << (legacy.size() == 3 && records.size() == 3 && records.count("[ERROR] legacy backup 2\n")) << std::endl;
+    return 0;
+}
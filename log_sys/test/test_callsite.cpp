@@ -0,0 +1,42 @@
+#include "../src/AsynLog.hpp"
+#include <iostream>
+#include <fstream>
+asynlog::Util::JsonData* conf_data = asynlog::Util::JsonData::GetJsonData();
+ThreadPool *tp = new ThreadPool(1);
+
+static const asynlog::CallSite *SiteOfLoop() {
+    return ASYNLOG_SITE(INFO, "in a loop %d");
+}
+
+int main() {
+    // the basename is computed by the compiler
+    static_assert(asynlog::Basename("/a/b/c.cpp")[0] == 'c', "constexpr basename");
+    static_assert(asynlog::Basename("plain.cpp")[0] == 'p', "constexpr basename without directories");
+    const asynlog::CallSite *site = SiteOfLoop();
+    std::cout << "site: " << site->basename << ":" << site->line << " " << site->function << " "
+              << asynlog::LogLevel::ToString(site->level) << " \"" << site->format << "\"" << std::endl;
+    std::cout << "same record every call: " << (site == SiteOfLoop()) << std::endl;
+
+    // macros log the basename and the function, runtime formats go through the member in parentheses
+    remove("./logfile/test_callsite.log");
+    {
+        asynlog::LoggerBuilder builder;
+        builder.BuildLoggerName("site_logger");
+        builder.BuildLoggerPattern("%l %s:%# %! %v");
+        builder.BuildLoggerFlush<asynlog::FileFlush>("./logfile/test_callsite.log");
+        auto logger = builder.Build();
+        for (int i = 0; i < 2; i++) {
+            logger->Info("in a loop %d", i);
+        }
+        logger->Warn("a long message %s", std::string(300, 'x').c_str());
+        std::string format = "runtime format %d";
+        (logger->Debug)(__FILE__, __LINE__, format, 5);
+        logger->Info("structured", asynlog::kv("id", 1));
+        logger->Flush().wait();
+    }
+    std::ifstream ifs("./logfile/test_callsite.log");
+    std::string line;
+    std::cout << "expect basename and main, the runtime format without a function:" << std::endl;
+    while (std::getline(ifs, line)) std::cout << line.substr(0, 80) << std::endl;
+    return 0;
+}
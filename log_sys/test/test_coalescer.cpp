@@ -0,0 +1,159 @@
+#include "../src/AsynLogger.hpp"
+#include "../src/backup/ServerBackup.hpp"
+#include <iostream>
+#include <fstream>
+#include <thread>
+#include <sstream>
+asynlog::Util::JsonData* conf_data = asynlog::Util::JsonData::GetJsonData();
+ThreadPool *tp = new ThreadPool(1);
+
+// keeps what the logger wrote, readable without a barrier
+class CaptureFlush : public asynlog::LogFlush {
+public:
+    void Flush(const char *data, size_t len) override {
+        std::lock_guard<std::mutex> lock(mtx_);
+        out_.append(data, len);
+    }
+    std::string Out() {
+        std::lock_guard<std::mutex> lock(mtx_);
+        return out_;
+    }
+private:
+    std::mutex mtx_;
+    std::string out_;
+};
+
+int main() {
+    // Coalescer: a run of identical payloads becomes the first line and a count, the order is kept
+    {
+        asynlog::Coalescer coalescer(std::chrono::milliseconds(1000));
+        auto print = [](asynlog::Buffer &out) { std::cout << std::string(out.Begin(), out.ReadableSize()); };
+        asynlog::Buffer batch(1024);
+        std::string lines = "[10:00:00][1][ERROR][c][a.cpp:1]\tdisk full\n"
+                            "[10:00:01][1][ERROR][c][a.cpp:1]\tdisk full\n"
+                            "[10:00:02][2][ERROR][c][a.cpp:1]\tdisk full\n";
+        batch.Push(lines.data(), lines.size());
+        std::cout << "expect disk full once, the count comes with the next batch:" << std::endl;
+        coalescer.Filter(batch, print);
+        batch.Reset();
+        lines = "[10:00:03][1][ERROR][c][a.cpp:1]\tdisk full\n"
+                "[10:00:04][1][INFO ][c][a.cpp:9]\tdisk cleaned\n";
+        batch.Push(lines.data(), lines.size());
+        std::cout << "expect repeated 3 times at 10:00:03, then disk cleaned:" << std::endl;
+        coalescer.Filter(batch, print);
+        batch.Reset();
+        batch.Push(lines.data() + lines.find("[10:00:04"), lines.size() - lines.find("[10:00:04"));
+        coalescer.Filter(batch, print);
+        std::cout << "expect repeated 1 times at 10:00:04 after a drain:" << std::endl;
+        coalescer.Drain(print);
+    }
+
+    // the same text at another level or call site is not a repeat
+    {
+        asynlog::Coalescer coalescer(std::chrono::milliseconds(1000));
+        auto print = [](asynlog::Buffer &out) { std::cout << std::string(out.Begin(), out.ReadableSize()); };
+        asynlog::Buffer batch(1024);
+        std::string lines = "[10:00:00][1][INFO ][c][a.cpp:1]\tretry\n"
+                            "[10:00:01][1][ERROR][c][a.cpp:1]\tretry\n"
+                            "[10:00:02][2][ERROR][c][b.cpp:1]\tretry\n"
+                            "[10:00:03][3][ERROR][c][b.cpp:1]\tretry\n"
+                            "[10:00:04][3][ERROR][c][b.cpp:12]\tretry\n";
+        batch.Push(lines.data(), lines.size());
+        std::cout << "expect INFO, ERROR a.cpp, ERROR b.cpp:1, repeated 1 times, ERROR b.cpp:12:" << std::endl;
+        coalescer.Filter(batch, print);
+        coalescer.Drain(print);
+    }
+
+    // logger: 1000 identical errors in a loop, written as one line and a count
+    remove("./logfile/test_coalescer.log");
+    {
+        asynlog::LoggerBuilder builder;
+        builder.BuildLoggerName("coalesce_logger");
+        builder.BuildLoggerCoalesce(std::chrono::milliseconds(1000));
+        builder.BuildLoggerFlush<asynlog::FileFlush>("./logfile/test_coalescer.log");
+        auto logger = builder.Build();
+        for (int i = 0; i < 1000; i++) {
+            logger->Warn(__FILE__, __LINE__, "connection refused");
+        }
+        logger->Warn(__FILE__, __LINE__, "connection restored");
+        logger->Flush().wait();
+    }
+    std::ifstream ifs("./logfile/test_coalescer.log");
+    std::string line;
+    std::cout << "expect refused, repeated 999 times, restored:" << std::endl;
+    while (std::getline(ifs, line)) std::cout << line.substr(line.find('\t') + 1) << std::endl;
+
+    // JSON records collapse although ts differs, the count is a JSON record too
+    {
+        asynlog::LoggerBuilder builder;
+        builder.BuildLoggerName("coalesce_json");
+        builder.BuildLoggerFormat(asynlog::LogFormat::JSON);
+        builder.BuildLoggerCoalesce(std::chrono::milliseconds(5000));
+        auto capture = std::make_shared<CaptureFlush>();
+        builder.BuildLoggerFlush(capture);
+        auto logger = builder.Build();
+        for (int i = 0; i < 3; i++) {
+            logger->Warn("disk almost full", asynlog::kv("pct", 91));
+            std::this_thread::sleep_for(std::chrono::milliseconds(600)); // another second in ts
+        }
+        logger->Info("disk cleaned", asynlog::kv("pct", 40));
+        logger->Flush().wait();
+        std::istringstream lines(capture->Out());
+        std::string line;
+        std::cout << "json: expect warn, repeated 2, info:" << std::endl;
+        while (std::getline(lines, line)) {
+            Json::Value root;
+            bool ok = asynlog::Util::JsonUtil::UnSerialize(line, &root);
+            std::cout << "parsed " << ok << ": level=" << root["level"].asString() << " msg=" << root["msg"].asString()
+                      << " repeated=" << root["repeated"].asUInt() << std::endl;
+        }
+    }
+
+    // an idle logger writes the count once the window is over, without a barrier or more records
+    {
+        asynlog::LoggerBuilder builder;
+        builder.BuildLoggerName("coalesce_idle");
+        builder.BuildLoggerCoalesce(std::chrono::milliseconds(100));
+        auto capture = std::make_shared<CaptureFlush>();
+        builder.BuildLoggerFlush(capture);
+        auto logger = builder.Build();
+        for (int i = 0; i < 10; i++) logger->Warn(__FILE__, __LINE__, "retrying");
+        std::this_thread::sleep_for(std::chrono::milliseconds(conf_data->max_flush_delay_ms + 400));
+        std::string out = capture->Out();
+        std::cout << "idle: count written: " << (out.find("\tlast message repeated 9 times\n") != std::string::npos) << std::endl;
+    }
+
+    // backups are coalesced too: a run of errors reaches the backup server as one record and a count
+    {
+        static std::mutex mtx;
+        static std::string stored;
+        TCP_Server *server = new TCP_Server(0, [](const std::string &) {}, [](const std::string &, const std::string &batch) {
+            std::lock_guard<std::mutex> lock(mtx);
+            stored += batch;
+        });
+        server->init_service();
+        std::thread([server]() { server->start_service(); }).detach();
+        conf_data->backup_addr = "127.0.0.1";
+        conf_data->backup_port = server->port();
+        conf_data->backup_spool_dir = "./logfile/test_coalescer_spool";
+        asynlog::LoggerBuilder builder;
+        builder.BuildLoggerName("coalesce_backup");
+        builder.BuildLoggerCoalesce(std::chrono::milliseconds(1000));
+        builder.BuildLoggerFlush(std::make_shared<CaptureFlush>());
+        auto logger = builder.Build();
+        for (int i = 0; i < 100; i++) logger->Error(__FILE__, __LINE__, "disk full");
+        logger->Flush().wait();
+        std::string expect = "last message repeated 99 times\n";
+        for (int i = 0; i < 50; i++) {
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                if (stored.find(expect) != std::string::npos) break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        std::lock_guard<std::mutex> lock(mtx);
+        size_t records = std::count(stored.begin(), stored.end(), '\n');
+        std::cout << "backups: 2 lines on the server: " << records << ", count: " << (stored.find(expect) != std::string::npos) << std::endl;
+    }
+    return 0;
+}
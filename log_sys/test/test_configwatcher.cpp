@@ -0,0 +1,66 @@
+#include "../src/Manager.hpp"
+#include <iostream>
+#include <fstream>
+asynlog::Util::JsonData* conf_data = asynlog::Util::JsonData::GetJsonData();
+ThreadPool *tp = new ThreadPool(1);
+
+static void WriteConfig(const std::string &path, const std::string &level, const std::string &file) {
+    std::string tmp = path + ".tmp"; // write and rename, like most deploy tools
+    std::ofstream ofs(tmp);
+    ofs << "{\"loggers\": [{\"name\": \"config_logger\", \"level\": \"" << level << "\", \"sinks\": ["
+        << "{\"type\": \"stdout\"}, {\"type\": \"file\", \"path\": \"" << file << "\"}]}]}";
+    ofs.close();
+    rename(tmp.c_str(), path.c_str());
+}
+
+int main() {
+    // ConfigWatcher: the callback runs once the file is rewritten
+    const std::string path = "./logfile/test_configwatcher.json";
+    asynlog::Util::File::CreateDirectory("./logfile/");
+    WriteConfig(path, "INFO", "./logfile/config_a.log");
+    auto &manager = asynlog::LoggerManager::GetInstance();
+    std::cout << "watch: " << manager.WatchConfig(path) << std::endl;
+    asynlog::AsynLogger *logger = manager.FindLogger("config_logger");
+    std::cout << "logger built from config: " << (logger != nullptr) << std::endl;
+    logger->Debug(__FILE__, __LINE__, "this debug line is filtered");
+    logger->Info(__FILE__, __LINE__, "this info line goes to config_a.log");
+    logger->Flush().wait();
+
+    // reload: the level drops to DEBUG and the file sink moves to config_b.log
+    WriteConfig(path, "DEBUG", "./logfile/config_b.log");
+    for (int i = 0; i < 100 && logger->Level() != asynlog::LogLevel::value::DEBUG; i++) {
+        usleep(10000);
+    }
+    std::cout << "level reloaded: " << (logger->Level() == asynlog::LogLevel::value::DEBUG) << std::endl;
+    logger->Debug(__FILE__, __LINE__, "this debug line goes to config_b.log");
+    logger->Flush().wait();
+    manager.StopWatching();
+
+    // a malformed rewrite is ignored
+    std::cout << "bad config rejected: " << !manager.ApplyConfig(Json::Value("not an object")) << std::endl;
+
+    // a bad entry rejects the whole reload, the entries before it are not applied either
+    Json::Value partial;
+    asynlog::Util::JsonUtil::UnSerialize("{\"loggers\": [{\"name\": \"config_logger\", \"level\": \"ERROR\"},"
+                                         " {\"name\": \"config_other\", \"sinks\": [{\"type\": \"no_such_sink\"}]}]}", &partial);
+    bool applied = manager.ApplyConfig(partial);
+    std::cout << "bad entry rejected: " << !applied << ", earlier entry kept its level: "
+              << (logger->Level() == asynlog::LogLevel::value::DEBUG) << ", no logger added: "
+              << !manager.LoggerExists("config_other") << std::endl;
+
+    // an unknown format is rejected, not taken as text
+    Json::Value format;
+    asynlog::Util::JsonUtil::UnSerialize("{\"loggers\": [{\"name\": \"config_format\", \"format\": \"jsn\"}]}", &format);
+    std::cout << "unknown format rejected: " << !manager.ApplyConfig(format) << ", no logger added: "
+              << !manager.LoggerExists("config_format") << std::endl;
+
+    // a reload with the same sinks keeps them open, a fixed field cannot change on a running logger
+    Json::Value same;
+    asynlog::Util::JsonUtil::UnSerialize("{\"loggers\": [{\"name\": \"config_logger\", \"level\": \"WARN\", \"format\": \"json\", \"sinks\": ["
+                                         "{\"type\": \"stdout\"}, {\"type\": \"file\", \"path\": \"./logfile/config_b.log\"}]}]}", &same);
+    remove("./logfile/config_b.log"); // a reopened file sink would create it again
+    applied = manager.ApplyConfig(same);
+    std::cout << "same sinks applied: " << applied << ", level: " << (logger->Level() == asynlog::LogLevel::value::WARN)
+              << ", file sink not reopened: " << !asynlog::Util::File::Exists("./logfile/config_b.log") << std::endl;
+    return 0;
+}
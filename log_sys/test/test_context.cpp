@@ -0,0 +1,76 @@
+#include "../src/AsynLog.hpp"
+#include <iostream>
+#include <fstream>
+#include <thread>
+asynlog::Util::JsonData* conf_data = asynlog::Util::JsonData::GetJsonData();
+ThreadPool *tp = new ThreadPool(1);
+
+using asynlog::kv;
+using asynlog::LogContext;
+using asynlog::ScopedContext;
+
+// the message and what follows it, the time and thread id differ per run
+static void PrintMessages(const std::string &path) {
+    std::ifstream ifs(path);
+    std::string line;
+    while (std::getline(ifs, line)) std::cout << line.substr(line.find('\t') + 1) << std::endl;
+}
+
+int main() {
+    // the cached renderings follow pushes and pops, a later key hides an earlier one
+    {
+        LogContext &ctx = LogContext::Current();
+        std::string tenant = "acme corp";
+        {
+            ScopedContext request(kv("request_id", 7), kv("tenant", tenant));
+            tenant = "changed"; // the context keeps its copy
+            std::cout << "text: [" << ctx.Text() << "] json: [" << ctx.Json() << "]" << std::endl;
+            {
+                ScopedContext retry(kv("request_id", 8), kv("retry", true));
+                std::cout << "text: [" << ctx.Text() << "] json: [" << ctx.Json() << "]" << std::endl;
+            }
+            std::cout << "text: [" << ctx.Text() << "]" << std::endl;
+        }
+        std::cout << "empty after the scopes: " << ctx.Empty() << ", text: [" << ctx.Text() << "]" << std::endl;
+    }
+
+    // records of the default text layout, of a pattern with %X and of the JSON layout
+    remove("./logfile/test_context.log");
+    remove("./logfile/test_context_x.log");
+    remove("./logfile/test_context.json");
+    {
+        asynlog::LoggerBuilder text, pattern, json;
+        text.BuildLoggerName("ctx_text");
+        text.BuildLoggerFlush<asynlog::FileFlush>("./logfile/test_context.log");
+        pattern.BuildLoggerName("ctx_x");
+        pattern.BuildLoggerPattern("%l\t%v {%X}");
+        pattern.BuildLoggerFlush<asynlog::FileFlush>("./logfile/test_context_x.log");
+        json.BuildLoggerName("ctx_json");
+        json.BuildLoggerFormat(asynlog::LogFormat::JSON);
+        json.BuildLoggerFlush<asynlog::FileFlush>("./logfile/test_context.json");
+        auto t = text.Build(), p = pattern.Build(), j = json.Build();
+        t->Info("before");
+        {
+            ScopedContext ctx(kv("request_id", "r-1"), kv("tenant", 42));
+            t->Info("printf %d", 1);
+            t->Info("structured", kv("rows", 3));
+            p->Warn("with pattern");
+            j->Error("json", kv("rows", 3));
+            std::thread([&]() { t->Info("other thread"); }).join(); // contexts are per thread
+        }
+        t->Info("after");
+        for (auto &l : {t, p, j}) l->Flush().wait();
+    }
+    std::cout << "expect before, printf 1 request_id=r-1 tenant=42, structured rows=3 request_id=r-1 tenant=42, other thread, after:" << std::endl;
+    PrintMessages("./logfile/test_context.log");
+    std::cout << "expect with pattern {request_id=r-1 tenant=42}:" << std::endl;
+    PrintMessages("./logfile/test_context_x.log");
+    std::ifstream ifs("./logfile/test_context.json");
+    std::string line;
+    std::getline(ifs, line);
+    Json::Value root;
+    bool ok = asynlog::Util::JsonUtil::UnSerialize(line, &root);
+    std::cout << "json parsed " << ok << ": msg=" << root["msg"].asString() << " rows=" << root["rows"].asInt()
+              << " request_id=" << root["request_id"].asString() << " tenant=" << root["tenant"].asInt() << std::endl;
+    return 0;
+}
@@ -0,0 +1,79 @@
+#include "../src/AsynLogger.hpp"
+#include <iostream>
+#include <string>
+#include <sys/wait.h>
+#include <fcntl.h>
+asynlog::Util::JsonData* conf_data = asynlog::Util::JsonData::GetJsonData();
+ThreadPool *tp = new ThreadPool(1);
+
+int main() {
+    const std::string filename = "./logfile/test_crashhandler.log";
+    remove(filename.c_str());
+    pid_t pid = fork();
+    if (pid == 0) { // child: log, then crash before the consumer had a chance to flush
+        asynlog::CrashHandler::Install();
+        asynlog::LoggerBuilder builder;
+        builder.BuildLoggerName("crash");
+        builder.BuildLoggerFlush<asynlog::FileFlush>(filename);
+        auto logger = builder.Build();
+        logger->Info(__FILE__, __LINE__, "flushed before the crash");
+        logger->Flush().wait();
+        logger->Info(__FILE__, __LINE__, "still pending when the crash happens");
+        raise(SIGSEGV);
+        _exit(0);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    std::cout << "child killed by signal " << (WIFSIGNALED(status) ? WTERMSIG(status) : 0) << std::endl;
+    std::string content;
+    asynlog::Util::File::GetContent(&content, filename);
+    std::cout << "the log file has both lines and a backtrace:" << std::endl << content << std::endl;
+
+    // a repeat count the coalescer holds back is written by the crash handler
+    const std::string coalesced = "./logfile/test_crashhandler_coalesce.log";
+    remove(coalesced.c_str());
+    pid = fork();
+    if (pid == 0) {
+        asynlog::CrashHandler::Install();
+        asynlog::LoggerBuilder builder;
+        builder.BuildLoggerName("crash_coalesce");
+        builder.BuildLoggerCoalesce(std::chrono::milliseconds(60 * 1000));
+        builder.BuildLoggerFlush<asynlog::FileFlush>(coalesced);
+        auto logger = builder.Build();
+        for (int i = 0; i < 5; i++) logger->Warn(__FILE__, __LINE__, "retrying");
+        usleep((conf_data->max_flush_delay_ms + 200) * 1000); // filtered by the consumer, the count is held
+        raise(SIGSEGV);
+        _exit(0);
+    }
+    waitpid(pid, &status, 0);
+    content.clear();
+    asynlog::Util::File::GetContent(&content, coalesced);
+    std::cout << "the held count is in the log: " << (content.find("\tlast message repeated 4 times\n") != std::string::npos) << std::endl;
+
+    // per shard files share the stdout sink, the backtrace goes to it once
+    const std::string shared = "./logfile/test_crashhandler_stdout.log";
+    pid = fork();
+    if (pid == 0) {
+        int fd = open(shared.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        dup2(fd, STDOUT_FILENO);
+        asynlog::CrashHandler::Install();
+        asynlog::LoggerBuilder builder;
+        builder.BuildLoggerName("crash_shards");
+        builder.BuildLoggerShards(2, asynlog::ShardMode::PER_SHARD_FILE);
+        builder.BuildLoggerFlush<asynlog::StdOutFlush>();
+        builder.BuildLoggerFlush<asynlog::FileFlush>("./logfile/test_crashhandler_shard.log");
+        auto logger = builder.Build();
+        logger->Info(__FILE__, __LINE__, "pending in a shard");
+        raise(SIGSEGV);
+        _exit(0);
+    }
+    waitpid(pid, &status, 0);
+    content.clear();
+    asynlog::Util::File::GetContent(&content, shared);
+    size_t backtraces = 0;
+    for (size_t pos = content.find("*** fatal signal"); pos != std::string::npos; pos = content.find("*** fatal signal", pos + 1)) {
+        backtraces++;
+    }
+    std::cout << "one backtrace on the shared stdout: " << backtraces << std::endl;
+    return 0;
+}
@@ -0,0 +1,130 @@
+#include "../src/AsynLogger.hpp"
+#include "../src/query/Query.hpp"
+#include <iostream>
+asynlog::Util::JsonData* conf_data = asynlog::Util::JsonData::GetJsonData();
+ThreadPool *tp = new ThreadPool(2);
+
+using namespace asynlog::query;
+
+static const char *kLevels[] = {"DEBUG", "INFO ", "WARN ", "ERROR", "FATAL"};
+
+// one record a second from 10:00:00, ERROR only in the last hundred, logger "late" only after 10:50:00
+static std::string Line(int i) {
+    char buf[256];
+    snprintf(buf, sizeof(buf), "[%02d:%02d:%02d][140000000000][%s][%s][a.cpp:%d]\trequest id=%d\n",
+             10 + i / 3600, i / 60 % 60, i % 60, kLevels[i >= 3900 ? 3 : i % 3], i >= 3000 ? "late" : "svc", i % 50, i);
+    return buf;
+}
+
+static size_t Count(const Filter &f, const std::vector<std::string> &files, bool use_index, uint64_t *skipped = nullptr) {
+    Query q(f, tp, 16 * 1024, use_index);
+    size_t n = q.Run(files, nullptr);
+    if (skipped) *skipped = q.SkippedBytes();
+    return n;
+}
+
+int main() {
+    std::string dir = "./logfile/test_index";
+    std::string path = dir + "/a.log";
+    asynlog::Util::File::CreateDirectory(dir);
+    remove(path.c_str());
+    remove(IndexWriter::PathFor(path).c_str());
+
+    // written through a FileFlush in batches that cut lines in two
+    std::string all;
+    for (int i = 0; i < 4000; i++) all += Line(i);
+    {
+        asynlog::FileFlush flush(path, 8 * 1024);
+        for (size_t pos = 0; pos < all.size(); pos += 3001) flush.Flush(all.data() + pos, std::min<size_t>(3001, all.size() - pos));
+        flush.Sync();
+    }
+    std::vector<IndexEntry> entries;
+    bool loaded = IndexReader::Load(path, all.size(), &entries);
+    uint64_t end = 0;
+    uint32_t errors = 0;
+    bool contiguous = true;
+    for (const IndexEntry &e : entries) {
+        contiguous = contiguous && e.offset == end && all[e.offset + e.bytes - 1] == '\n';
+        end = e.offset + e.bytes;
+        errors += e.levels[3];
+    }
+    std::cout << "loaded: " << loaded << ", entries: " << entries.size() << ", whole lines back to back: " << contiguous
+              << ", first block " << entries.front().min_time << " to " << entries.front().max_time << std::endl;
+    uint32_t tail_errors = 0;
+    for (size_t p = end; p < all.size(); p = all.find('\n', p) + 1) tail_errors += all.compare(p + 25, 5, "ERROR") == 0;
+    std::cout << "ERROR counts of the entries and the tail: " << errors + tail_errors << " (100)" << std::endl;
+
+    // the same answers with and without the index, the index skips most of the file
+    std::vector<std::string> files{path};
+    {
+        Filter f;
+        f.from = "10:20:00";
+        f.to = "10:29";
+        uint64_t skipped;
+        size_t with = Count(f, files, true, &skipped), without = Count(f, files, false);
+        std::cout << "10:20:00 to 10:29: " << with << " (600), same without index: " << (with == without)
+                  << ", skipped " << (skipped * 100 / all.size()) << "% of the file" << std::endl;
+    }
+    {
+        Filter f;
+        f.levels = {asynlog::LogLevel::value::ERROR};
+        uint64_t skipped;
+        size_t with = Count(f, files, true, &skipped);
+        std::cout << "level ERROR: " << with << " (100), same without index: " << (with == Count(f, files, false))
+                  << ", skipped more than 90%: " << (skipped * 10 > all.size() * 9) << std::endl;
+    }
+    {
+        Filter f;
+        f.logger = "late";
+        f.contains = "id=3";
+        uint64_t skipped;
+        size_t with = Count(f, files, true, &skipped);
+        std::cout << "logger late: " << with << " (1000), same without index: " << (with == Count(f, files, false))
+                  << ", skipped: " << (skipped > 0) << std::endl;
+    }
+
+    // a new file of the same name: the old sidecar is replaced, not trusted
+    {
+        FILE *fp = fopen(path.c_str(), "w");
+        fclose(fp);
+        std::vector<IndexEntry> stale;
+        IndexReader::Load(path, 0, &stale);
+        asynlog::FileFlush flush(path, 8 * 1024);
+        std::string some;
+        for (int i = 0; i < 500; i++) some += Line(i);
+        flush.Flush(some.data(), some.size());
+        flush.Sync();
+        std::vector<IndexEntry> fresh;
+        IndexReader::Load(path, some.size(), &fresh);
+        Filter f;
+        f.from = "10:05:00";
+        std::cout << "stale entries ignored: " << stale.empty() << ", rewritten from 0: " << (!fresh.empty() && fresh[0].offset == 0)
+                  << ", query: " << Count(f, files, true) << " (200)" << std::endl;
+    }
+
+    // a RollFileFlush indexes every file it rolls to, the sidecars are not searched as logs
+    {
+        std::string roll = dir + "/roll";
+        asynlog::Util::File::CreateDirectory(roll);
+        {
+            asynlog::RollFileFlush flush(roll + "/r-", 64 * 1024, 4 * 1024);
+            for (int i = 0; i < 4000; i += 40) { // batches of whole records, as the logger hands them over
+                std::string batch;
+                for (int j = i; j < i + 40; j++) batch += Line(j);
+                flush.Flush(batch.data(), batch.size());
+            }
+        }
+        std::vector<std::string> logs = Query::ExpandPaths({roll});
+        size_t sidecars = 0;
+        for (const std::string &log : logs) sidecars += access(IndexWriter::PathFor(log).c_str(), F_OK) == 0;
+        Filter f;
+        f.levels = {asynlog::LogLevel::value::ERROR};
+        std::cout << "rolled files: " << logs.size() << ", each with a sidecar: " << (sidecars == logs.size())
+                  << ", level ERROR: " << Count(f, logs, true) << " (100)" << std::endl;
+        for (const std::string &log : logs) {
+            remove(log.c_str());
+            remove(IndexWriter::PathFor(log).c_str());
+        }
+    }
+    return 0;
+}
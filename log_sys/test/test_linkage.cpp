@@ -0,0 +1,18 @@
+#include "../src/AsynLog.hpp"
+#include <iostream>
+asynlog::Util::JsonData* conf_data = asynlog::Util::JsonData::GetJsonData();
+ThreadPool *tp = new ThreadPool(1);
+
+void LogFromOtherUnit();
+
+int main() {
+    // two translation units include the whole library, see test_linkage_other.cpp
+    asynlog::LoggerBuilder builder;
+    builder.BuildLoggerName("linkage");
+    builder.BuildLoggerFlush<asynlog::StdOutFlush>();
+    asynlog::LoggerManager::GetInstance().AddLogger(builder.Build());
+    asynlog::GetLogger("linkage")->Info("logged from the first translation unit");
+    LogFromOtherUnit();
+    asynlog::GetLogger("linkage")->Flush().wait();
+    return 0;
+}
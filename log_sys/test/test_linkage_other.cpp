@@ -0,0 +1,8 @@
+#include "../src/AsynLog.hpp"
+// second translation unit of test_linkage: every header is included again here, so a free function
+// that is not inline makes the link fail
+void LogFromOtherUnit() {
+    asynlog::GetLogger("linkage")->Info("logged from the second translation unit");
+    void (*backup)(const std::string &) = start_log_backup; // odr-use it from this unit as well
+    std::cout << "start_log_backup has one address: " << (backup != nullptr) << std::endl;
+}
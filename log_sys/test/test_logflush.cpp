@@ -1,7 +1,7 @@
 #include <iostream>
 #include <string>
 #include "../src/LogFlush.hpp"
-asynlog::Util::JsonData* g_conf_data = asynlog::Util::JsonData::GetJsonData();
+asynlog::Util::JsonData* conf_data = asynlog::Util::JsonData::GetJsonData();
 int main() {
     auto flush = asynlog::LogFlushFactory::CreateLog<asynlog::StdOutFlush>();
     flush->Flush("test", 4);
@@ -12,4 +12,17 @@ int main() {
     auto flush3 = asynlog::LogFlushFactory::CreateLog<asynlog::RollFileFlush>("jzq/", 1000);
     std::string str(10000, 'a');
     flush3->Flush(str.c_str(), str.size());
+
+    // a file that cannot be opened: the config is refused, a flush built directly drops the data
+    Json::Value file_conf, roll_conf;
+    file_conf["type"] = "file";
+    file_conf["path"] = "/proc/asynlog/app.log";
+    roll_conf["type"] = "roll_file";
+    roll_conf["path"] = "/proc/asynlog/app-";
+    roll_conf["max_size"] = 1000;
+    bool refused = !asynlog::LogFlushFactory::CreateFromConfig(file_conf) && !asynlog::LogFlushFactory::CreateFromConfig(roll_conf);
+    std::cout << "unopenable sinks refused: " << refused << std::endl;
+    asynlog::FileFlush unopened("/proc/asynlog/app.log");
+    unopened.Flush("test", 4);
+    std::cout << "flush to an unopened file survived" << std::endl;
 }
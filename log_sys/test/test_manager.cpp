@@ -20,6 +20,39 @@ int main() {
     sleep(1); // Sleep for 1 second to allow async logging to complete
     asynlog::LoggerManager::GetInstance().GetLogger("test_logger")->Error(__FILE__, __LINE__, "This is a test log message: %s", "Hello, World!");
     sleep(1); // Sleep for 1 second to allow async logging to complete
+    // a second logger with the same name is ignored
+    builder->BuildLoggerName("test_logger");
+    asynlog::LoggerManager::GetInstance().AddLogger(builder->Build());
+    std::cout << "1 logger named test_logger: "
+              << (asynlog::LoggerManager::GetInstance().FindLogger("test_logger") ==
+                  asynlog::LoggerManager::GetInstance().GetLogger("test_logger").get()) << std::endl;
+    // interned handle
+    static asynlog::LoggerHandle handle("test_logger");
+    handle->Info(__FILE__, __LINE__, "This is a test log message through a handle");
+    handle->Flush().wait();
+    // lookups while loggers are added: the retired maps are freed under them
+    std::atomic<bool> done(false);
+    std::atomic<size_t> misses(0);
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 4; t++) {
+        readers.emplace_back([&]() {
+            while (!done.load()) {
+                if (!asynlog::LoggerManager::GetInstance().FindLogger("test_logger")) misses++;
+                if (!asynlog::LoggerManager::GetInstance().GetLogger("default_logger")) misses++;
+            }
+        });
+    }
+    for (int i = 0; i < 50; i++) {
+        auto added = std::make_shared<asynlog::LoggerBuilder>();
+        added->BuildLoggerName("added_" + std::to_string(i));
+        added->BuildLoggerBufferSize(4096);
+        added->BuildLoggerFlush<asynlog::StdOutFlush>();
+        asynlog::LoggerManager::GetInstance().AddLogger(added->Build());
+    }
+    done = true;
+    for (auto &t : readers) t.join();
+    std::cout << "lookups during adds: " << (misses == 0) << ", all added: "
+              << asynlog::LoggerManager::GetInstance().LoggerExists("added_49") << std::endl;
     // delete tp;
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,76 @@
+#include "../src/AsynLogger.hpp"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <vector>
+asynlog::Util::JsonData* conf_data = asynlog::Util::JsonData::GetJsonData();
+ThreadPool *tp = new ThreadPool(1);
+
+static void PrintMatching(const std::string &text, const std::string &prefix) {
+    std::istringstream in(text);
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.compare(0, prefix.size(), prefix) == 0) std::cout << line << std::endl;
+    }
+}
+
+int main() {
+    auto &metrics = asynlog::Metrics::Get();
+    // Counter: 4 threads add to their own stripes, the value is the sum
+    asynlog::Counter *counter = metrics.GetCounter("test_events_total", "Events", asynlog::Metrics::Labels({{"name", "a\"b"}}));
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([counter]() { for (int i = 0; i < 1000; i++) counter->Add(); });
+    }
+    for (auto &t : threads) t.join();
+    std::cout << "counter is 4000: " << (counter->Value() == 4000) << std::endl;
+    std::cout << "same series: " << (counter == metrics.GetCounter("test_events_total", "Events",
+                                                                   asynlog::Metrics::Labels({{"name", "a\"b"}}))) << std::endl;
+
+    // Histogram: 500ns and 1us land in the first bucket, 1.5us in the second
+    asynlog::Histogram *hist = metrics.GetHistogram("test_wait_seconds", "Waits");
+    hist->Observe(500);
+    hist->Observe(1024);
+    hist->Observe(1500);
+    std::vector<uint64_t> counts;
+    uint64_t sum_ns;
+    hist->Snapshot(&counts, &sum_ns);
+    std::cout << "buckets 2 1, sum 3024: " << counts[0] << " " << counts[1] << " " << sum_ns << std::endl;
+
+    // logger metrics
+    asynlog::LoggerBuilder builder;
+    builder.BuildLoggerName("metrics_logger");
+    builder.BuildLoggerFlush<asynlog::FileFlush>("./logfile/test_metrics.log");
+    auto logger = builder.Build();
+    for (int i = 0; i < 100; i++) {
+        logger->Info(__FILE__, __LINE__, "record %d", i);
+    }
+    logger->Flush().wait();
+    std::string text = metrics.Render();
+    PrintMatching(text, "asynlog_records_");
+    PrintMatching(text, "asynlog_flush_seconds_count");
+    PrintMatching(text, "asynlog_threadpool_queue_depth");
+    PrintMatching(text, "test_events_total");
+
+    // export to a file and to a unix socket
+    std::cout << "file written: " << metrics.WriteFile("./logfile/test_metrics.prom") << std::endl;
+    {
+        asynlog::MetricsExporter exporter("./logfile/test_metrics.sock");
+        std::cout << "exporter running: " << exporter.Running() << std::endl;
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, "./logfile/test_metrics.sock");
+        std::string got;
+        if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+            char buf[4096];
+            ssize_t n;
+            while ((n = read(fd, buf, sizeof(buf))) > 0) got.append(buf, n);
+        }
+        close(fd);
+        std::cout << "socket snapshot has the logger: " << (got.find("logger=\"metrics_logger\"") != std::string::npos) << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,56 @@
+#include "../src/AsynLog.hpp"
+#include <iostream>
+#include <fstream>
+asynlog::Util::JsonData* conf_data = asynlog::Util::JsonData::GetJsonData();
+ThreadPool *tp = new ThreadPool(1);
+
+int main() {
+    // layouts against a fixed record: 2025-06-15 10:20:30.045678 local time
+    struct tm t = {};
+    t.tm_year = 125; t.tm_mon = 5; t.tm_mday = 15; t.tm_hour = 10; t.tm_min = 20; t.tm_sec = 30; t.tm_isdst = -1;
+    std::string name = "net";
+    constexpr asynlog::CallSite site = asynlog::CallSite::Make("/src/server/conn.cpp", 88, "Accept",
+                                                               asynlog::LogLevel::value::WARN, "slow peer");
+    static_assert(site.basename[0] == 'c', "basename computed at compile time");
+    asynlog::PatternLayout::Record r{&site, {mktime(&t), 45678000}, &name, "slow peer", 9};
+    auto print = [&](const std::string &pattern, const std::string &expect) {
+        asynlog::PatternLayout layout(pattern);
+        std::string out;
+        layout.Format(out, r);
+        out.pop_back();
+        std::cout << (out == expect ? "ok   " : "FAIL ") << pattern << " -> " << out << std::endl;
+    };
+    print("%d{%H:%M:%S.%e} %l %n %s:%# %v", "10:20:30.045 WARN  net conn.cpp:88 slow peer");
+    print("%d{%Y-%m-%d %H:%M:%S.%f}|%g|%!|100%%|%q", "2025-06-15 10:20:30.045678|/src/server/conn.cpp|Accept|100%|%q");
+    print("%d %v", "2025-06-15 10:20:30 slow peer");
+    asynlog::Field fields[] = {asynlog::kv("peer", "10.0.0.1"), asynlog::kv("ms", 250)};
+    r.fields = fields;
+    r.nfields = 2;
+    print("%l%v", "WARN slow peer peer=10.0.0.1 ms=250");
+
+    // the default layout is the one of LogMessage::format() with the file basename
+    asynlog::LogMessage msg(asynlog::LogLevel::value::INFO, "a.cpp", 7, "net", "hello");
+    constexpr asynlog::CallSite msg_site = asynlog::CallSite::Make("src/a.cpp", 7, "", asynlog::LogLevel::value::INFO, "hello");
+    asynlog::PatternLayout def;
+    std::string out;
+    def.Format(out, asynlog::PatternLayout::Record{&msg_site, {msg.ctime_, 0}, &msg.name_, "hello", 5});
+    std::cout << "default layout matches LogMessage::format(): " << (out == msg.format()) << std::endl;
+
+    // logger with a custom pattern
+    remove("./logfile/test_pattern.log");
+    {
+        asynlog::LoggerBuilder builder;
+        builder.BuildLoggerName("pattern_logger");
+        builder.BuildLoggerPattern("%l|%n|%s:%#|%!|%v");
+        builder.BuildLoggerFlush<asynlog::FileFlush>("./logfile/test_pattern.log");
+        auto logger = builder.Build();
+        logger->Info("started %d workers", 4);
+        logger->Error("lost", asynlog::kv("peer", 3));
+        logger->Flush().wait();
+    }
+    std::ifstream ifs("./logfile/test_pattern.log");
+    std::string line;
+    std::cout << "expect INFO |pattern_logger|test_pattern.cpp:N|main|started 4 workers, ERROR|...|lost peer=3:" << std::endl;
+    while (std::getline(ifs, line)) std::cout << line << std::endl;
+    return 0;
+}
@@ -0,0 +1,115 @@
+#include "../src/AsynLogger.hpp"
+#include "../src/query/Query.hpp"
+#include <iostream>
+#include <random>
+asynlog::Util::JsonData* conf_data = asynlog::Util::JsonData::GetJsonData();
+ThreadPool *tp = new ThreadPool(4);
+
+using namespace asynlog::query;
+
+static const char *kLevels[] = {"DEBUG", "INFO ", "WARN ", "ERROR", "FATAL"};
+
+static std::string Line(int i) {
+    char buf[256];
+    snprintf(buf, sizeof(buf), "[%02d:%02d:%02d][140000000000][%s][svc%d][a.cpp:%d]\trequest id=%d user=u%d\n",
+             10 + i / 3600, i / 60 % 60, i % 60, kLevels[i % 5], i % 3, i % 50, i, i % 7);
+    return buf;
+}
+
+static size_t Count(const Filter &f, const std::vector<std::string> &files, bool *ordered = nullptr) {
+    Query q(f, tp, 64 * 1024);
+    size_t last = 0, file = 0;
+    bool in_order = true;
+    size_t n = q.Run(files, [&](const Query::Hit &hit) {
+        in_order = in_order && (hit.file > file || hit.offset >= last);
+        file = hit.file;
+        last = hit.offset;
+    });
+    if (ordered) *ordered = in_order;
+    return n;
+}
+
+int main() {
+    // the SIMD search finds what std::string::find finds, also near the ends of the buffer
+    {
+        std::mt19937 rng(7);
+        bool same = true;
+        for (int round = 0; round < 2000; round++) {
+            std::string hay(rng() % 300, 'a'), needle(1 + rng() % 6, 'a');
+            for (char &c : hay) c = "ab\n"[rng() % 3];
+            for (char &c : needle) c = "ab"[rng() % 2];
+            const char *hit = Scan::Find(hay.data(), hay.size(), needle.data(), needle.size());
+            size_t want = hay.find(needle);
+            same = same && (hit ? static_cast<size_t>(hit - hay.data()) : std::string::npos) == want;
+            const char *nl = Scan::FindByte(hay.data(), hay.size(), '\n');
+            same = same && (nl ? static_cast<size_t>(nl - hay.data()) : std::string::npos) == hay.find('\n');
+        }
+        std::cout << "simd search agrees with std::string::find: " << same << std::endl;
+    }
+
+    // 10000 text records over many 64KB segments on 4 threads
+    asynlog::Util::File::CreateDirectory("./logfile/test_query");
+    std::string path = "./logfile/test_query/a.log";
+    FILE *fp = fopen(path.c_str(), "w");
+    for (int i = 0; i < 10000; i++) fputs(Line(i).c_str(), fp);
+    fclose(fp);
+    std::vector<std::string> files{path};
+    {
+        Filter f;
+        f.levels = {asynlog::LogLevel::value::ERROR};
+        bool ordered;
+        std::cout << "level ERROR: " << Count(f, files, &ordered) << " (2000), in order: " << ordered << std::endl;
+    }
+    {
+        Filter f;
+        f.logger = "svc1";
+        f.contains = "user=u3";
+        size_t want = 0;
+        for (int i = 0; i < 10000; i++) want += i % 3 == 1 && i % 7 == 3;
+        std::cout << "logger and substring: " << (Count(f, files) == want) << std::endl;
+    }
+    {
+        Filter f;
+        f.from = "10:10:00";
+        f.to = "10:19";
+        std::cout << "10:10:00 to 10:19: " << Count(f, files) << " (600)" << std::endl;
+    }
+    {
+        Filter f;
+        f.file = "a.cpp:7";
+        std::cout << "source a.cpp:7: " << Count(f, files) << " (200)" << std::endl;
+    }
+    {
+        Filter f;
+        f.regex = "id=12[0-9]{2} ";
+        f.levels = {asynlog::LogLevel::value::WARN, asynlog::LogLevel::value::FATAL};
+        std::cout << "regex and two levels: " << Count(f, files) << " (40)" << std::endl;
+    }
+
+    // JSON records of a logger, and a directory searched file by file
+    {
+        std::string json = "./logfile/test_query/b.log";
+        remove(json.c_str());
+        {
+            asynlog::LoggerBuilder builder;
+            builder.BuildLoggerName("query_json");
+            builder.BuildLoggerFormat(asynlog::LogFormat::JSON);
+            builder.BuildLoggerFlush<asynlog::FileFlush>(json);
+            auto logger = builder.Build();
+            for (int i = 0; i < 100; i++) {
+                if (i % 2) logger->Error(__FILE__, __LINE__, "json %d", i);
+                else logger->Info(__FILE__, __LINE__, "json %d", i);
+            }
+            logger->Sync().wait();
+        }
+        Filter f;
+        f.levels = {asynlog::LogLevel::value::ERROR};
+        f.logger = "query_json";
+        std::cout << "json level ERROR: " << Count(f, {json}) << " (50)" << std::endl;
+        Filter all;
+        all.contains = "user=u";
+        std::vector<std::string> dir = Query::ExpandPaths({"./logfile/test_query"});
+        std::cout << "directory: " << dir.size() << " files, substring in text records: " << Count(all, dir) << " (10000)" << std::endl;
+    }
+    return 0;
+}
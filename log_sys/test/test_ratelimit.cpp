@@ -0,0 +1,53 @@
+#include "../src/AsynLog.hpp"
+#include <iostream>
+#include <fstream>
+#include <string>
+asynlog::Util::JsonData* conf_data = asynlog::Util::JsonData::GetJsonData();
+ThreadPool *tp = new ThreadPool(1);
+
+static size_t CountLines(const std::string &path, const std::string &needle) {
+    std::ifstream ifs(path);
+    std::string line;
+    size_t n = 0;
+    while (std::getline(ifs, line)) n += line.find(needle) != std::string::npos;
+    return n;
+}
+
+int main() {
+    // RateLimiter: 10 per second, the rest is counted and reported by the next record let through
+    asynlog::RateLimiter limiter(10);
+    uint64_t suppressed = 0;
+    size_t allowed = 0;
+    for (int i = 0; i < 1000; i++) allowed += limiter.Allow(&suppressed);
+    std::cout << "allowed at most 20 of 1000 (a second may tick): " << (allowed >= 10 && allowed <= 20) << std::endl;
+    int64_t second = asynlog::RateLimiter::CoarseSeconds();
+    while (asynlog::RateLimiter::CoarseSeconds() == second) usleep(10000);
+    std::cout << "next second allowed: " << limiter.Allow(&suppressed) << ", suppressed reported: " << (suppressed > 0) << std::endl;
+
+    // Sampler: 0 and 1 are exact, 0.1 lets about a tenth through
+    asynlog::Sampler none(0.0), all(1.0), tenth(0.1);
+    size_t n0 = 0, n1 = 0, n10 = 0;
+    for (int i = 0; i < 100000; i++) {
+        n0 += none.Sample();
+        n1 += all.Sample();
+        n10 += tenth.Sample();
+    }
+    std::cout << "sampled 0 / 100000 / about 10000: " << n0 << " " << n1 << " " << (n10 > 9000 && n10 < 11000) << std::endl;
+
+    // macros: a hot loop on one call site
+    remove("./logfile/test_ratelimit.log");
+    asynlog::LoggerBuilder builder;
+    builder.BuildLoggerName("ratelimit_logger");
+    builder.BuildLoggerFlush<asynlog::FileFlush>("./logfile/test_ratelimit.log");
+    auto logger = builder.Build();
+    for (int i = 0; i < 100000; i++) {
+        WarnLimited(logger, 5, "hot loop warning %d", i);
+        DebugSampled(logger, 0.01, "sampled debug %d", i);
+    }
+    logger->Flush().wait();
+    size_t warns = CountLines("./logfile/test_ratelimit.log", "hot loop warning");
+    size_t debugs = CountLines("./logfile/test_ratelimit.log", "sampled debug");
+    std::cout << "limited warnings <= 10: " << (warns >= 5 && warns <= 10) << std::endl;
+    std::cout << "sampled debugs about 1000: " << (debugs > 700 && debugs < 1300) << std::endl;
+    return 0;
+}
@@ -0,0 +1,128 @@
+#include "../src/AsynLogger.hpp"
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <future>
+asynlog::Util::JsonData* conf_data = asynlog::Util::JsonData::GetJsonData();
+ThreadPool *tp = new ThreadPool(1);
+
+int main() {
+    // ShardMerger: two shards hand in their batches, the output is in sequence order
+    {
+        asynlog::ShardMerger merger([](asynlog::Buffer &buf) {
+            std::cout << std::string(buf.Begin(), buf.ReadableSize());
+        }, std::chrono::milliseconds(10));
+        auto push = [](asynlog::Buffer &buf, uint64_t seq, const std::string &s) {
+            asynlog::ShardRecordHeader head{seq, static_cast<uint32_t>(s.size())};
+            buf.Push(reinterpret_cast<const char *>(&head), sizeof(head));
+            buf.Push(s.c_str(), s.size());
+        };
+        asynlog::Buffer shard0, shard1;
+        push(shard0, 0, "seq 0\n");
+        push(shard0, 2, "seq 2\n");
+        push(shard1, 1, "seq 1\n");
+        push(shard1, 3, "seq 3\n");
+        std::cout << "the output is seq 0 1 2 3" << std::endl;
+        merger.Sequence().store(4); // as if the shards had numbered four records
+        merger.Collect(shard1);
+        merger.Collect(shard0);
+    }
+
+    // a slow shard holds the others back instead of letting its records come out of order
+    {
+        std::mutex out_mtx;
+        std::string out;
+        asynlog::ShardMerger merger([&](asynlog::Buffer &buf) {
+            std::lock_guard<std::mutex> lock(out_mtx);
+            out.append(buf.Begin(), buf.ReadableSize());
+        }, std::chrono::milliseconds(1));
+        asynlog::AsynWorker slow([&merger](asynlog::Buffer &buf) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(200)); // far longer than any flush delay
+            merger.Collect(buf);
+        });
+        asynlog::AsynWorker fast([&merger](asynlog::Buffer &buf) { merger.Collect(buf); });
+        merger.AddShard(&slow);
+        merger.AddShard(&fast);
+        auto push = [&merger](asynlog::AsynWorker &w, const std::string &s) {
+            asynlog::ShardRecordHeader head{0, static_cast<uint32_t>(s.size())};
+            w.Push(merger.Sequence(), reinterpret_cast<const char *>(&head), sizeof(head), s.c_str(), s.size());
+        };
+        push(slow, "a\n");
+        push(fast, "b\n");
+        push(fast, "c\n");
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        bool held;
+        {
+            std::lock_guard<std::mutex> lock(out_mtx);
+            held = out.empty();
+        }
+        std::promise<void> done;
+        slow.Barrier([&]() { // as AsynLogger::Barrier(): the shards first, then the merge stage
+            fast.Barrier([&]() { merger.Barrier([&done]() { done.set_value(); }); });
+        });
+        done.get_future().wait();
+        slow.Stop();
+        fast.Stop();
+        merger.Stop();
+        std::cout << "records of the fast shard held back while the slow one lags: " << held << std::endl;
+        std::cout << "merged in push order with a slow shard: " << (out == "a\nb\nc\n") << std::endl;
+    }
+
+    // sharded logger: 4 threads on 4 shards, merged into one file
+    {
+        asynlog::LoggerBuilder builder;
+        builder.BuildLoggerName("sharded");
+        builder.BuildLoggerShards(4, asynlog::ShardMode::ORDERED_MERGE);
+        builder.BuildLoggerFlush<asynlog::FileFlush>("./logfile/sharded.log");
+        auto logger = builder.Build();
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; t++) {
+            threads.emplace_back([&logger, t]() {
+                for (int i = 0; i < 1000; i++) {
+                    logger->Info(__FILE__, __LINE__, "thread %d record %d", t, i);
+                }
+            });
+        }
+        for (auto &th : threads) th.join();
+        logger->Flush().wait(); // every record went through the merge stage
+        std::string content;
+        asynlog::Util::File::GetContent(&content, "./logfile/sharded.log");
+        std::cout << "records in ./logfile/sharded.log after Flush: " << std::count(content.begin(), content.end(), '\n') << std::endl;
+    }
+
+    // per shard files: every shard writes to its own copy of the file
+    {
+        asynlog::LoggerBuilder builder;
+        builder.BuildLoggerName("per_shard");
+        builder.BuildLoggerShards(2, asynlog::ShardMode::PER_SHARD_FILE);
+        builder.BuildLoggerFlush<asynlog::FileFlush>("./logfile/per_shard.log");
+        auto logger = builder.Build();
+        std::thread a([&logger]() { logger->Info(__FILE__, __LINE__, "from thread a"); });
+        a.join();
+        std::thread b([&logger]() { logger->Info(__FILE__, __LINE__, "from thread b"); });
+        b.join();
+    }
+    std::cout << "per shard files: ./logfile/per_shard.shard0.log ./logfile/per_shard.shard1.log" << std::endl;
+
+    // Sync() while the shards roll their files: each consumer syncs its own files
+    {
+        asynlog::LoggerBuilder builder;
+        builder.BuildLoggerName("per_shard_roll");
+        builder.BuildLoggerShards(2, asynlog::ShardMode::PER_SHARD_FILE);
+        builder.BuildLoggerFlush<asynlog::RollFileFlush>("./logfile/per_shard_roll/roll-", 4096);
+        auto logger = builder.Build();
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 2; t++) {
+            threads.emplace_back([&logger, t]() {
+                for (int i = 0; i < 2000; i++) {
+                    logger->Info(__FILE__, __LINE__, "thread %d record %d", t, i);
+                    if (i % 100 == 0) logger->Sync().wait();
+                }
+            });
+        }
+        for (auto &t : threads) t.join();
+        logger->Sync().wait();
+        std::cout << "per shard roll files synced while rolling" << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,183 @@
+#include "../src/AsynLogger.hpp"
+#include "../src/agent/LogAgent.hpp"
+#include "../src/backup/ServerBackup.hpp"
+#include <iostream>
+#include <set>
+#include <fstream>
+#include <sys/wait.h>
+asynlog::Util::JsonData* conf_data = asynlog::Util::JsonData::GetJsonData();
+ThreadPool *tp = new ThreadPool(1);
+
+static std::string ReadFile(const std::string &path) {
+    std::ifstream ifs(path);
+    return std::string(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+}
+
+int main() {
+    // ring: writes wrap around the end, a drain stops after the last complete line
+    {
+        std::string shm_name = asynlog::ShmRing::MakeShmName("test_ring");
+        auto producer = asynlog::ShmRing::Create(shm_name, "test_ring", 4096);
+        auto consumer = asynlog::ShmRing::Open(shm_name);
+        std::cout << "second consumer refused: " << (asynlog::ShmRing::Open(shm_name) == nullptr) << std::endl;
+        std::string line(99, 'a');
+        line += '\n';
+        std::string got;
+        auto collect = [&](const char *data, size_t len) { got.append(data, len); };
+        size_t written = 0;
+        for (int i = 0; i < 100; i++) { // 10000 bytes through 4096
+            written += producer->Write(line.data(), line.size());
+            consumer->Drain(collect);
+        }
+        std::cout << "all bytes through, in order: " << (written == 10000 && got == [&]() {
+            std::string all; for (int i = 0; i < 100; i++) all += line; return all; }()) << std::endl;
+        producer->Write("partial", 7);
+        std::cout << "partial line held back: " << (consumer->Drain(collect) == 0) << std::endl;
+        std::string fill(8192, 'b');
+        std::cout << "full ring takes 4089 of 8192: " << producer->Write(fill.data(), fill.size()) << std::endl;
+        auto second = asynlog::ShmRing::Create(shm_name, "test_ring", 4096);
+        std::cout << "a live ring is kept, the second gets its own segment: "
+                  << (second && second->ShmName() != shm_name && !consumer->Empty()) << std::endl;
+        second->Close();
+        second->Unlink();
+        producer->Close();
+        std::cout << "closed ring drained to the end: " << consumer->Drain(collect) << std::endl;
+        consumer->Unlink();
+    }
+
+    // shm sink on a full ring: whole lines are written or dropped, never a part of one
+    {
+        asynlog::ShmFlush flush("test_ring_full", 4096, std::chrono::milliseconds(1));
+        auto consumer = asynlog::ShmRing::Open(flush.Ring()->ShmName());
+        std::string batch;
+        for (int i = 0; i < 100; i++) batch += "line " + std::to_string(i) + " of a batch larger than the ring\n";
+        flush.Flush(batch.data(), batch.size());
+        std::string got;
+        consumer->Drain([&](const char *data, size_t len) { got.append(data, len); });
+        std::cout << "only whole lines in the ring: " << (!got.empty() && got.back() == '\n' && batch.compare(0, got.size(), got) == 0)
+                  << ", rest dropped: " << (consumer->Dropped() == batch.size() - got.size()) << std::endl;
+        consumer->Unlink();
+    }
+
+    // a line longer than the ring is dropped at once, the lines after it still go in
+    {
+        asynlog::ShmFlush flush("test_ring_long", 4096, std::chrono::milliseconds(1000));
+        auto consumer = asynlog::ShmRing::Open(flush.Ring()->ShmName());
+        std::string huge(5000, 'h');
+        std::string batch = "before\n" + huge + "\nafter\n";
+        auto start = std::chrono::steady_clock::now();
+        flush.Flush(batch.data(), batch.size());
+        auto waited = std::chrono::steady_clock::now() - start;
+        std::string got;
+        consumer->Drain([&](const char *data, size_t len) { got.append(data, len); });
+        std::cout << "long line skipped without waiting: " << (waited < std::chrono::milliseconds(500))
+                  << ", the others kept: " << (got == "before\nafter\n")
+                  << ", dropped: " << (consumer->Dropped() == huge.size() + 1) << std::endl;
+        consumer->Unlink();
+    }
+
+    // logger -> shm sink -> agent -> file
+    Json::Value conf;
+    conf["sinks"][0]["type"] = "file";
+    conf["sinks"][0]["path"] = "./logfile/test_shmring/{name}.log";
+    conf["forward"] = Json::Value(Json::arrayValue);
+    remove("./logfile/test_shmring/shm_app.log");
+    remove("./logfile/test_shmring/shm_crash.log");
+    asynlog::LogAgent agent(conf);
+    {
+        asynlog::LoggerBuilder builder;
+        builder.BuildLoggerName("shm_logger");
+        builder.BuildLoggerFlush<asynlog::ShmFlush>("shm_app");
+        auto logger = builder.Build();
+        for (int i = 0; i < 1000; i++) {
+            logger->Info(__FILE__, __LINE__, "record %d", i);
+        }
+        logger->Flush().wait();
+        agent.Poll();
+        std::cout << "agent drains a live ring: " << agent.Streams() << std::endl;
+    }
+    agent.Poll();
+    std::string text = ReadFile("./logfile/test_shmring/shm_app.log");
+    std::cout << "1000 records in the agent file: " << std::count(text.begin(), text.end(), '\n') << std::endl;
+    std::cout << "closed ring removed: " << agent.Streams() << std::endl;
+
+    // a process that dies without closing its ring, its records are recovered
+    pid_t pid = fork();
+    if (pid == 0) {
+        asynlog::ShmFlush *flush = new asynlog::ShmFlush("shm_crash"); // never destroyed, as in a crash
+        std::string records = "written before the crash 1\nwritten before the crash 2\n";
+        flush->Flush(records.data(), records.size());
+        _exit(1);
+    }
+    waitpid(pid, nullptr, 0);
+    agent.Poll();
+    std::cout << "recovered after the crash:" << std::endl << ReadFile("./logfile/test_shmring/shm_crash.log");
+    std::cout << "crashed ring removed: " << agent.Streams() << std::endl;
+
+    // forwarding on: the agent backs up the ERROR records and the logger does not, each arrives once
+    {
+        static std::mutex mtx;
+        static std::string stored;
+        TCP_Server *server = new TCP_Server(0, [](const std::string &) {}, [](const std::string &, const std::string &batch) {
+            std::lock_guard<std::mutex> lock(mtx);
+            stored += batch;
+        });
+        server->init_service();
+        std::thread([server]() { server->start_service(); }).detach();
+        conf_data->backup_addr = "127.0.0.1";
+        conf_data->backup_port = server->port();
+        conf_data->backup_spool_dir = "./logfile/test_shmring_spool";
+        Json::Value fwd_conf;
+        fwd_conf["sinks"][0]["type"] = "file";
+        fwd_conf["sinks"][0]["path"] = "./logfile/test_shmring/{name}.log";
+        asynlog::LogAgent forwarder(fwd_conf);
+        {
+            asynlog::LoggerBuilder builder;
+            builder.BuildLoggerName("shm_forward");
+            builder.BuildLoggerFlush<asynlog::ShmFlush>("shm_fwd");
+            auto logger = builder.Build();
+            for (int i = 0; i < 50; i++) {
+                logger->Error(__FILE__, __LINE__, "forwarded %d pid %d", i, getpid());
+                logger->Info(__FILE__, __LINE__, "not forwarded %d", i);
+            }
+            logger->Info(__FILE__, __LINE__, "an INFO that mentions [ERROR] pid %d", getpid());
+            logger->Flush().wait();
+        }
+        { // the agent cannot tell the level of a JSON line, the logger backs it up itself
+            asynlog::LoggerBuilder builder;
+            builder.BuildLoggerName("shm_forward_json");
+            builder.BuildLoggerFormat(asynlog::LogFormat::JSON);
+            builder.BuildLoggerFlush<asynlog::ShmFlush>("shm_fwd_json");
+            auto logger = builder.Build();
+            for (int i = 0; i < 5; i++) {
+                logger->Error(__FILE__, __LINE__, "json backup %d pid %d", i, getpid());
+            }
+            logger->Flush().wait();
+        }
+        forwarder.Poll();
+        auto count = [&](std::set<std::string> *ids) {
+            std::lock_guard<std::mutex> lock(mtx);
+            size_t n = 0;
+            std::string tag = " pid " + std::to_string(getpid()) + "\n";
+            for (size_t at = stored.find("forwarded "); at != std::string::npos; at = stored.find("forwarded ", at + 1)) {
+                size_t end = stored.find(tag, at);
+                if (end == std::string::npos || stored.compare(at - 4, 4, "not ") == 0) continue;
+                n++;
+                if (ids) ids->insert(stored.substr(at, end - at));
+            }
+            return n;
+        };
+        for (int i = 0; i < 50 && count(nullptr) < 50; i++) std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        asynlog::backup::BackupSender::Get().WaitDelivered(std::chrono::seconds(5)); // the JSON backups
+        std::this_thread::sleep_for(std::chrono::milliseconds(300)); // a duplicate would come right behind
+        std::set<std::string> ids;
+        size_t n = count(&ids);
+        std::cout << "forwarded ERROR records on the server: " << n << " (50), distinct: " << ids.size() << " (50)" << std::endl;
+        std::lock_guard<std::mutex> lock(mtx);
+        size_t json = 0;
+        for (size_t at = stored.find("json backup "); at != std::string::npos; at = stored.find("json backup ", at + 1)) json++;
+        std::cout << "JSON ERROR records backed up by the logger: " << json << " (5), INFO mentioning [ERROR] not forwarded: "
+                  << (stored.find("an INFO that mentions") == std::string::npos) << std::endl;
+    }
+    return 0;
+}
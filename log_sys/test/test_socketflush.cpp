@@ -0,0 +1,114 @@
+#include "../src/AsynLogger.hpp"
+#include <iostream>
+#include <thread>
+asynlog::Util::JsonData* conf_data = asynlog::Util::JsonData::GetJsonData();
+ThreadPool *tp = new ThreadPool(1);
+
+static std::string Records(int n, size_t width) {
+    std::string out;
+    for (int i = 0; i < n; i++) {
+        std::string r = "record " + std::to_string(i) + " ";
+        r.resize(width - 1, 'x');
+        out += r + '\n';
+    }
+    return out;
+}
+
+// receive every pending datagram, check each ends at a record boundary
+static void Receive(int fd, size_t max, size_t *datagrams, size_t *records, bool *whole) {
+    char buf[70000];
+    ssize_t n;
+    while ((n = recv(fd, buf, sizeof(buf), MSG_DONTWAIT)) > 0) {
+        (*datagrams)++;
+        *records += std::count(buf, buf + n, '\n');
+        *whole = *whole && buf[n - 1] == '\n' && static_cast<size_t>(n) <= max;
+    }
+}
+
+int main() {
+    std::string batch = Records(1000, 100); // 100000 bytes
+
+    // UDP to a local receiver: 1472 byte datagrams hold 14 records each
+    {
+        int rx = socket(AF_INET, SOCK_DGRAM, 0);
+        int size = 4 * 1024 * 1024;
+        setsockopt(rx, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        bind(rx, (struct sockaddr *)&addr, sizeof(addr));
+        socklen_t len = sizeof(addr);
+        getsockname(rx, (struct sockaddr *)&addr, &len);
+        asynlog::DatagramFlush udp(asynlog::DatagramFlush::Kind::UDP, "127.0.0.1:" + std::to_string(ntohs(addr.sin_port)));
+        udp.Flush(batch.data(), batch.size());
+        size_t datagrams = 0, records = 0;
+        bool whole = true;
+        Receive(rx, 1472, &datagrams, &records, &whole);
+        std::cout << "udp: " << records << " records in " << datagrams << " datagrams (72), whole records: " << whole
+                  << ", sent " << udp.Sent() << " dropped " << udp.Dropped() << std::endl;
+        close(rx);
+    }
+
+    // Unix datagrams: a receiver that does not read fills up, the rest is dropped without blocking
+    {
+        std::string path = "./logfile/test_socketflush.dgram";
+        asynlog::Util::File::CreateDirectory("./logfile");
+        unlink(path.c_str());
+        int rx = socket(AF_UNIX, SOCK_DGRAM, 0);
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+        bind(rx, (struct sockaddr *)&addr, sizeof(addr));
+        asynlog::DatagramFlush dgram(asynlog::DatagramFlush::Kind::UNIX, path, 1000);
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < 50; i++) dgram.Flush(batch.data(), batch.size());
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+        size_t datagrams = 0, records = 0;
+        bool whole = true;
+        Receive(rx, 1000, &datagrams, &records, &whole);
+        std::cout << "unix dgram: received " << datagrams << " + dropped " << dgram.Dropped() << " = 5000: "
+                  << (datagrams + dgram.Dropped() == 5000) << ", some dropped: " << (dgram.Dropped() > 0)
+                  << ", whole records: " << whole << ", did not block: " << (ms < 1000) << std::endl;
+        close(rx);
+        unlink(path.c_str());
+    }
+
+    // Unix stream through a logger, records arrive newline delimited
+    {
+        std::string path = "./logfile/test_socketflush.stream";
+        unlink(path.c_str());
+        int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+        bind(listener, (struct sockaddr *)&addr, sizeof(addr));
+        listen(listener, 1);
+        size_t lines = 0;
+        std::thread reader([&]() {
+            int fd = accept(listener, nullptr, nullptr);
+            char buf[4096];
+            ssize_t n;
+            while ((n = read(fd, buf, sizeof(buf))) > 0) lines += std::count(buf, buf + n, '\n');
+            close(fd);
+        });
+        {
+            asynlog::LoggerBuilder builder;
+            builder.BuildLoggerName("stream_logger");
+            Json::Value conf;
+            conf["type"] = "unix_stream";
+            conf["path"] = path;
+            builder.BuildLoggerFlush(asynlog::LogFlushFactory::CreateFromConfig(conf));
+            auto logger = builder.Build();
+            for (int i = 0; i < 100; i++) logger->Info(__FILE__, __LINE__, "streamed %d", i);
+            logger->Flush().wait();
+        }
+        reader.join();
+        std::cout << "unix stream: 100 lines received: " << lines << std::endl;
+        close(listener);
+        unlink(path.c_str());
+    }
+    return 0;
+}
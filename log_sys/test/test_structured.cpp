@@ -0,0 +1,91 @@
+#include "../src/AsynLog.hpp"
+#include <iostream>
+#include <fstream>
+asynlog::Util::JsonData* conf_data = asynlog::Util::JsonData::GetJsonData();
+ThreadPool *tp = new ThreadPool(1);
+
+using asynlog::kv;
+
+static void PrintFile(const std::string &path) {
+    std::ifstream ifs(path);
+    std::string line;
+    while (std::getline(ifs, line)) std::cout << line << std::endl;
+}
+
+int main() {
+    // encoder: escapes, numbers, non finite doubles
+    {
+        std::string out;
+        asynlog::JsonEncoder enc(out);
+        enc.Begin();
+        enc.Member(kv("s", std::string("a \"quoted\"\tline\n\x01")));
+        enc.Member(kv("i", -42));
+        enc.Member(kv("u", 18446744073709551615ull));
+        enc.Member(kv("d", 0.25));
+        enc.Member(kv("nan", 0.0 / 0.0));
+        enc.Member(kv("b", true));
+        enc.End();
+        std::cout << "expect {\"s\":\"a \\\"quoted\\\"\\tline\\n\\u0001\",\"i\":-42,\"u\":18446744073709551615,\"d\":0.25,\"nan\":null,\"b\":true}" << std::endl;
+        std::cout << "       " << out << std::endl;
+        Json::Value root;
+        std::cout << "jsoncpp parses it: " << asynlog::Util::JsonUtil::UnSerialize(out, &root)
+                  << " s=" << root["s"].asString().size() << " chars" << std::endl;
+    }
+
+    // text layout: fields after the message in logfmt style
+    remove("./logfile/test_structured.log");
+    {
+        asynlog::LoggerBuilder builder;
+        builder.BuildLoggerName("kv_text");
+        builder.BuildLoggerFlush<asynlog::FileFlush>("./logfile/test_structured.log");
+        auto logger = builder.Build();
+        logger->Info("login", kv("user", 42), kv("name", "bob smith"), kv("ok", true));
+        logger->Info("request", kv("latency_us", 1250u), kv("ratio", 0.5));
+        logger->Info("printf style %d still works", 7);
+        logger->Info("escaped", kv("q", "say \"hi\""), kv("eq", "a=b"), kv("nl", "two\nlines"), kv("bs", "c:\\tmp"), kv("empty", ""));
+        logger->Flush().wait();
+    }
+    std::cout << "expect login user=42 name=\"bob smith\" ok=true, request latency_us=1250 ratio=0.5, printf style,"
+              << " escaped q=\"say \\\"hi\\\"\" eq=\"a=b\" nl=\"two\\nlines\" bs=c:\\tmp empty=\"\":" << std::endl;
+    PrintFile("./logfile/test_structured.log");
+
+    // JSON layout: structured and printf style records, each line parsed back with jsoncpp
+    remove("./logfile/test_structured.json");
+    {
+        asynlog::LoggerBuilder builder;
+        builder.BuildLoggerName("kv_json");
+        builder.BuildLoggerFormat(asynlog::LogFormat::JSON);
+        builder.BuildLoggerFlush<asynlog::FileFlush>("./logfile/test_structured.json");
+        auto logger = builder.Build();
+        logger->Warn("slow \"query\"", kv("table", "users"), kv("rows", int64_t(-1)));
+        logger->Debug("plain %s", "text");
+        asynlog::ScopedContext ctx(kv("ts", "context ts"));
+        logger->Error("reserved keys", kv("msg", "field msg"), kv("level", 3), kv("a\"b", 1));
+        asynlog::ScopedContext user(kv("user", "context user"), kv("tenant", "acme"));
+        logger->Info("duplicate keys", kv("rows", 1), kv("user", "field user"), kv("rows", 2));
+        logger->Flush().wait();
+    }
+    std::ifstream ifs("./logfile/test_structured.json");
+    std::string line;
+    while (std::getline(ifs, line)) {
+        Json::Value root;
+        bool ok = asynlog::Util::JsonUtil::UnSerialize(line, &root);
+        std::cout << "parsed " << ok << ": level=" << root["level"].asString() << " logger=" << root["logger"].asString()
+                  << " msg=" << root["msg"].asString() << " table=" << root["table"].asString()
+                  << " rows=" << root["rows"].asInt64() << " line>0=" << (root["line"].asUInt() > 0) << std::endl;
+        if (root["msg"].asString() == "reserved keys") {
+            std::cout << "prefixed: fields.msg=" << root["fields.msg"].asString() << " fields.level=" << root["fields.level"].asInt()
+                      << " fields.ts=" << root["fields.ts"].asString() << " ts is the time: " << root["ts"].isInt64()
+                      << " a\"b=" << root["a\"b"].asInt() << std::endl;
+        }
+        if (root["msg"].asString() == "duplicate keys") {
+            size_t rows = 0, users = 0;
+            for (size_t at = line.find("\"rows\":"); at != std::string::npos; at = line.find("\"rows\":", at + 1)) rows++;
+            for (size_t at = line.find("\"user\":"); at != std::string::npos; at = line.find("\"user\":", at + 1)) users++;
+            std::cout << "each key once: " << (rows == 1 && users == 1) << ", last field wins: " << (root["rows"].asInt() == 2)
+                      << ", field hides context: " << (root["user"].asString() == "field user")
+                      << ", tenant=" << root["tenant"].asString() << std::endl;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,138 @@
+#include "../src/AsynLogger.hpp"
+#include "../src/backup/ServerBackup.hpp"
+#include <iostream>
+#include <thread>
+asynlog::Util::JsonData* conf_data = asynlog::Util::JsonData::GetJsonData();
+ThreadPool *tp = new ThreadPool(1);
+
+using namespace asynlog::backup;
+
+static const char *kLevels[] = {"DEBUG", "INFO ", "WARN ", "ERROR", "FATAL"};
+
+static std::string Batch(int from, int n) {
+    std::string batch;
+    char buf[256];
+    for (int i = from; i < from + n; i++) {
+        snprintf(buf, sizeof(buf), "[10:00:00][140000000000][%s][svc%d][a.cpp:1]\trequest id=%d user=u%d\n",
+                 kLevels[i % 5], i % 2, i, i % 10);
+        batch += buf;
+    }
+    return batch;
+}
+
+// read until n lines arrived or nothing came for a second
+static std::string ReadLines(int fd, size_t n) {
+    std::string got;
+    char buf[4096];
+    while (static_cast<size_t>(std::count(got.begin(), got.end(), '\n')) < n) {
+        ssize_t r = read(fd, buf, sizeof(buf));
+        if (r <= 0) break;
+        got.append(buf, r);
+    }
+    return got;
+}
+
+static int Subscribe(uint16_t port, const TailRequest &req) {
+    int fd = Connect("127.0.0.1:" + std::to_string(port), MakeSubscribe(req));
+    ReadLines(fd, 1); // "# subscribed"
+    return fd;
+}
+
+static bool Ship(int fd, uint64_t seq, const std::string &batch) {
+    std::string frame;
+    MakeFrame(seq, batch.data(), batch.size(), false, &frame);
+    uint64_t ack;
+    return WriteFull(fd, frame.data(), frame.size()) && ReadFull(fd, reinterpret_cast<char *>(&ack), sizeof(ack));
+}
+
+int main() {
+    // the request line round trips, contains keeps its spaces
+    {
+        TailRequest req, back;
+        req.filter.levels = {asynlog::LogLevel::value::ERROR, asynlog::LogLevel::value::FATAL};
+        req.filter.logger = "svc1";
+        req.stream = "host.app";
+        req.filter.contains = "user id=7";
+        std::string line = MakeSubscribe(req);
+        bool ok = ParseSubscribe(std::string_view(line).substr(0, line.size() - 1), &back);
+        std::cout << line << "parsed: " << ok << ", same: "
+                  << (back.filter.levels == req.filter.levels && back.filter.logger == req.filter.logger &&
+                      back.stream == req.stream && back.filter.contains == req.filter.contains)
+                  << ", bad key refused: " << !ParseSubscribe("SUBSCRIBE colour=red", &back) << std::endl;
+    }
+
+    // a subscriber that never takes is dropped once its buffer is full, the others go on
+    {
+        TailHub hub(4096);
+        TailRequest all;
+        auto slow = hub.Subscribe(all), fast = hub.Subscribe(all);
+        std::string out;
+        size_t taken = 0;
+        for (int i = 0; i < 100; i++) {
+            hub.Publish("s", Batch(i, 1));
+            fast->Take(&out, std::chrono::milliseconds(0));
+            taken += std::count(out.begin(), out.end(), '\n');
+        }
+        std::cout << "slow dropped: " << !slow->Take(&out, std::chrono::milliseconds(0))
+                  << ", kept under 4096: " << (out.size() <= 4096) << ", fast got " << taken << " (100)" << std::endl;
+    }
+
+    // live records of shipped batches, filtered per subscriber
+    static std::mutex legacy_mtx;
+    static std::string legacy;
+    TCP_Server *server = new TCP_Server(0, [](const std::string &record) {
+        std::lock_guard<std::mutex> lock(legacy_mtx);
+        legacy += record;
+    }, [](const std::string &, const std::string &) {});
+    server->init_service();
+    uint16_t port = server->port();
+    std::thread([server]() { server->start_service(); }).detach();
+
+    TailRequest errors, user7;
+    errors.filter.levels = {asynlog::LogLevel::value::ERROR};
+    user7.filter.logger = "svc1";
+    user7.filter.contains = "user=u7";
+    user7.stream = "host.a";
+    int err_fd = Subscribe(port, errors), user_fd = Subscribe(port, user7);
+    std::cout << "subscribers: " << server->tail().Subscribers() << std::endl;
+
+    int a = Connect("127.0.0.1:" + std::to_string(port), MakeHello("host.a", 0));
+    int b = Connect("127.0.0.1:" + std::to_string(port), MakeHello("host.b", 0));
+    Ship(a, 1, Batch(0, 100));
+    Ship(b, 1, Batch(100, 100));
+    std::string got = ReadLines(err_fd, 40);
+    std::cout << "ERROR records of both streams: " << std::count(got.begin(), got.end(), '\n')
+              << " (40), first: " << got.substr(0, got.find('\n')) << std::endl;
+    got = ReadLines(user_fd, 10);
+    std::cout << "svc1 user=u7 of host.a: " << std::count(got.begin(), got.end(), '\n') << " (10)" << std::endl;
+
+    // a subscriber that stops reading does not hold back the shipping connection
+    int stalled = Subscribe(port, TailRequest());
+    std::string big = Batch(0, 2000);
+    int64_t start = asynlog::Util::Date::Now();
+    bool acked = true;
+    for (uint64_t seq = 2; seq < 2 + 16 * 1024 * 1024 / big.size(); seq++) acked = acked && Ship(a, seq, big);
+    std::cout << "16MB shipped and acked while stalled: " << acked << ", within a second or two: "
+              << (asynlog::Util::Date::Now() - start <= 2) << std::endl;
+    std::string rest;
+    char buf[64 * 1024];
+    ssize_t r;
+    while ((r = read(stalled, buf, sizeof(buf))) > 0) rest.append(buf, r);
+    std::cout << "stalled subscriber told it was dropped: " << (rest.find("# dropped") != std::string::npos) << std::endl;
+
+    // a legacy record that starts like SUBSCRIBE is still a record
+    int old_client = Connect("127.0.0.1:" + std::to_string(port), "SUBSTITUTE failed\n");
+    shutdown(old_client, SHUT_WR);
+    read(old_client, buf, sizeof(buf)); // the server closes once it stored the record
+    close(old_client);
+    {
+        std::lock_guard<std::mutex> lock(legacy_mtx);
+        std::cout << "legacy SUBS... record stored: " << (legacy.find("SUBSTITUTE failed\n") != std::string::npos) << std::endl;
+    }
+    close(err_fd);
+    close(user_fd);
+    close(stalled);
+    close(a);
+    close(b);
+    return 0;
+}
@@ -0,0 +1,35 @@
+#include "../src/AsynLogger.hpp"
+#include <iostream>
+asynlog::Util::JsonData* conf_data = asynlog::Util::JsonData::GetJsonData();
+ThreadPool *tp = new ThreadPool(1);
+
+int main() {
+    // ThreadPool threads pinned to core 0 and named pool0, pool1
+    asynlog::ThreadOptions opts;
+    opts.cpus = {0};
+    opts.nice = 5;
+    opts.name = "pool";
+    {
+        ThreadPool pool(2, opts);
+        for (int i = 0; i < 2; i++) {
+            auto ret = pool.enqueue([]() {
+                char name[16];
+                pthread_getname_np(pthread_self(), name, sizeof(name));
+                std::cout << "thread " << name << " runs on cpu " << sched_getcpu() << std::endl;
+            });
+            ret.get();
+        }
+    }
+
+    // consumer thread of a logger pinned to core 0 and named asynlog-test
+    asynlog::LoggerBuilder builder;
+    builder.BuildLoggerName("test");
+    asynlog::ThreadOptions consumer;
+    consumer.cpus = {0};
+    consumer.name = "asynlog-test";
+    builder.BuildLoggerThread(consumer);
+    builder.BuildLoggerFlush<asynlog::StdOutFlush>();
+    auto logger = builder.Build();
+    logger->Info(__FILE__, __LINE__, "logged from a logger with a pinned consumer");
+    return 0;
+}
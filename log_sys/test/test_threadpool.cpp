@@ -13,5 +13,96 @@ int main() {
     cout << "Result of addition: " << result1.get() << endl; // Should print 3
     cout << "Result of multiplication: " << result2.get() << endl; // Should print 12
 
+    // Post fire-and-forget tasks, tasks posted from a worker run on the pool too
+    std::atomic<int> done(0);
+    for (int i = 0; i < 100; i++) {
+        pool.post([&pool, &done]() {
+            pool.post([&done]() { done++; });
+            done++;
+        });
+    }
+    while (done.load() < 200) std::this_thread::yield();
+    cout << "Posted tasks done: " << done.load() << endl; // Should print 200
+
+    // Bounded queue: one busy thread, capacity 2
+    std::promise<void> gate;
+    std::shared_future<void> opened = gate.get_future().share();
+    {
+        ThreadPool rejecting(1, asynlog::ThreadOptions(), QueueOptions{2, OverflowPolicy::REJECT});
+        rejecting.post([opened]() { opened.wait(); }); // keeps the only thread busy
+        while (rejecting.depth() > 0) std::this_thread::yield();
+        rejecting.post([]() {});
+        rejecting.post([]() {});
+        try {
+            rejecting.post([]() {});
+        } catch (const ThreadPoolFull &e) {
+            cout << "REJECT: " << e.what() << endl;
+        }
+        gate.set_value();
+        ThreadPoolStats st = rejecting.stats();
+        cout << "rejected " << st.rejected << " high water " << st.high_water << endl; // Should print 1 and 2
+    }
+
+    // DROP_LOWEST: a HIGH task pushes out the oldest NORMAL one and runs first
+    std::promise<void> gate2;
+    std::shared_future<void> opened2 = gate2.get_future().share();
+    {
+        ThreadPool dropping(1, asynlog::ThreadOptions(), QueueOptions{2, OverflowPolicy::DROP_LOWEST});
+        dropping.post([opened2]() { opened2.wait(); });
+        while (dropping.depth() > 0) std::this_thread::yield();
+        auto first = dropping.enqueue([]() { return 1; });
+        auto second = dropping.enqueue([]() { cout << "NORMAL runs second" << endl; return 2; });
+        auto urgent = dropping.enqueue(TaskPriority::HIGH, []() { cout << "HIGH runs first" << endl; return 3; });
+        gate2.set_value();
+        try {
+            first.get();
+        } catch (const std::future_error &e) {
+            cout << "dropped task: " << e.what() << endl;
+        }
+        cout << second.get() + urgent.get() << endl; // Should print 5
+        cout << "dropped " << dropping.stats().dropped << endl; // Should print 1
+    }
+
+    // BLOCK: a worker submitting to its own full pool runs the task itself instead of waiting forever
+    {
+        std::atomic<int> runs(0);
+        ThreadPool blocking(1, asynlog::ThreadOptions(), QueueOptions{1, OverflowPolicy::BLOCK});
+        auto outer = blocking.enqueue([&blocking, &runs]() {
+            for (int i = 0; i < 3; i++) {
+                blocking.post([&runs]() { runs++; }); // the first is queued, the queue is full then
+            }
+            return runs.load(); // the queued one waits for this task to return
+        });
+        cout << "tasks run inline by the worker: " << outer.get() << endl; // Should print 2
+    }
+
+    // destroyed while tasks submit more tasks: every task is either refused or run, none is lost
+    {
+        std::atomic<int> accepted(0), ran(0);
+        std::function<void()> chain; // outlives the pool, whose tasks refer to it
+        {
+            ThreadPool chaining(2);
+            chain = [&]() {
+                ran++;
+                try {
+                    chaining.post(chain);
+                    accepted++;
+                } catch (const std::runtime_error &) {} // the pool is stopping
+            };
+            for (int i = 0; i < 4; i++) {
+                chaining.post(chain);
+                accepted++;
+            }
+        }
+        cout << "accepted tasks all ran: " << (accepted.load() == ran.load()) << endl; // Should print 1
+    }
+
+    // queue limits from the config keys, an unknown policy falls back to BLOCK
+    QueueOptions from_config = QueueOptions::FromConfig(16, "drop_lowest");
+    cout << "config capacity " << from_config.capacity << " drop_lowest "
+         << (from_config.policy == OverflowPolicy::DROP_LOWEST) << endl; // Should print 16 and 1
+    QueueOptions unknown = QueueOptions::FromConfig(0, "wait");
+    cout << "unknown policy blocks " << (unknown.policy == OverflowPolicy::BLOCK) << endl; // Should print 1
+
     return 0;
 }
\ No newline at end of file